@@ -0,0 +1,101 @@
+AR = ['/usr/bin/ar']
+ARFLAGS = ['rcs']
+BINDIR = '/usr/local/bin'
+BOOST_VERSION = '1_74'
+CC = ['/usr/bin/gcc']
+CCLNK_SRC_F = []
+CCLNK_TGT_F = ['-o']
+CC_NAME = 'gcc'
+CC_SRC_F = []
+CC_TGT_F = ['-c', '-o']
+CC_VERSION = ('12', '2', '0')
+CFLAGS = ['-Wall', '-Wextra', '-std=c99', '-D_GNU_SOURCE', '-g', '-O3', '-mtune=native', '-march=native', '-DNDEBUG']
+CFLAGS_MACBUNDLE = ['-fPIC']
+CFLAGS_cshlib = ['-fPIC']
+COMPILER_CC = 'gcc'
+COMPILER_CXX = 'g++'
+CPPPATH_ST = '-I%s'
+CXX = ['/usr/bin/g++']
+CXXFLAGS = ['-Wall', '-Wextra', '-D__STDC_CONSTANT_MACROS', '-g', '-O3', '-fopenmp', '-mtune=native', '-march=native', '-DNDEBUG', '-D_GLIBCXX_PARALLEL', '-fopenmp']
+CXXFLAGS_MACBUNDLE = ['-fPIC']
+CXXFLAGS_cxx14 = ['-std=c++14']
+CXXFLAGS_cxxshlib = ['-fPIC']
+CXXLNK_SRC_F = []
+CXXLNK_TGT_F = ['-o']
+CXX_NAME = 'gcc'
+CXX_SRC_F = []
+CXX_TGT_F = ['-c', '-o']
+DATADIR = '/usr/local/share'
+DATAROOTDIR = '/usr/local/share'
+DEFINES = []
+DEFINES_ST = '-D%s'
+DEFINE_COMMENTS = {'HAVE_ATTRIBUTE_UNUSED': '', 'HAVE_ATTRIBUTE_ALIGNED': '', 'HAVE_IO_URING': '', 'HAVE_ZLIB': '', 'FAST_ALLOC': ''}
+DEST_BINFMT = 'elf'
+DEST_CPU = 'x86_64'
+DEST_OS = 'linux'
+DOCDIR = '/usr/local/share/doc/tinyhtm'
+DVIDIR = '/usr/local/share/doc/tinyhtm'
+EXEC_PREFIX = '/usr/local'
+HAVE_ATTRIBUTE_ALIGNED = 1
+HAVE_ATTRIBUTE_UNUSED = 1
+HAVE_LINUX_IO_URING_H = 1
+HAVE_Z = 1
+HTMLDIR = '/usr/local/share/doc/tinyhtm'
+INCLUDEDIR = '/usr/local/include'
+INCLUDES_BOOST = '/usr/include'
+INCLUDES_hdf5 = ['/usr/include/hdf5/serial']
+INCLUDES_hdf5_cxx = ['/usr/include/hdf5/serial']
+INFODIR = '/usr/local/share/info'
+LIBDIR = '/usr/local/lib64'
+LIBEXECDIR = '/usr/local/libexec'
+LIBPATH_BOOST = ['/usr/lib/x86_64-linux-gnu']
+LIBPATH_ST = '-L%s'
+LIBPATH_hdf5 = ['/usr/lib/x86_64-linux-gnu/hdf5/serial']
+LIBPATH_hdf5_cxx = ['/usr/lib/x86_64-linux-gnu/hdf5/serial']
+LIB_BOOST = ['boost_filesystem', 'boost_system', 'boost_iostreams']
+LIB_M = ['m']
+LIB_PTHREAD = ['pthread']
+LIB_ST = '-l%s'
+LIB_Z = ['z']
+LIB_hdf5 = ['hdf5']
+LIB_hdf5_cxx = ['hdf5', 'hdf5_cpp']
+LINKFLAGS = ['-fopenmp']
+LINKFLAGS_MACBUNDLE = ['-bundle', '-undefined', 'dynamic_lookup']
+LINKFLAGS_cshlib = ['-shared']
+LINKFLAGS_cstlib = ['-Wl,-Bstatic']
+LINKFLAGS_cxx14 = ['-std=c++14']
+LINKFLAGS_cxxshlib = ['-shared']
+LINKFLAGS_cxxstlib = ['-Wl,-Bstatic']
+LINK_CC = ['/usr/bin/gcc']
+LINK_CXX = ['/usr/bin/g++']
+LOCALEDIR = '/usr/local/share/locale'
+LOCALSTATEDIR = '/usr/local/var'
+MANDIR = '/usr/local/share/man'
+OLDINCLUDEDIR = '/usr/include'
+PACKAGE = 'tinyhtm'
+PDFDIR = '/usr/local/share/doc/tinyhtm'
+PREFIX = '/usr/local'
+PSDIR = '/usr/local/share/doc/tinyhtm'
+RPATH_ST = '-Wl,-rpath,%s'
+RPATH_hdf5 = ['/usr/lib/x86_64-linux-gnu/hdf5/serial']
+RPATH_hdf5_cxx = ['/usr/lib/x86_64-linux-gnu/hdf5/serial']
+SBINDIR = '/usr/local/sbin'
+SHAREDSTATEDIR = '/usr/local/com'
+SHLIB_MARKER = '-Wl,-Bdynamic'
+SONAME_ST = '-Wl,-h,%s'
+STLIBPATH_BOOST = ['/usr/lib/x86_64-linux-gnu']
+STLIBPATH_ST = '-L%s'
+STLIB_BOOST = []
+STLIB_MARKER = '-Wl,-Bstatic'
+STLIB_ST = '-l%s'
+SYSCONFDIR = '/usr/local/etc'
+TINYHTM_VERSION = '0.5'
+cfg_files = ['/root/repo/build/include/tinyhtm/config.h']
+cprogram_PATTERN = '%s'
+cshlib_PATTERN = 'lib%s.so'
+cstlib_PATTERN = 'lib%s.a'
+cxxprogram_PATTERN = '%s'
+cxxshlib_PATTERN = 'lib%s.so'
+cxxstlib_PATTERN = 'lib%s.a'
+define_key = []
+macbundle_PATTERN = '%s.bundle'
@@ -0,0 +1,12 @@
+/* WARNING! All changes made to this file will be lost! */
+
+#ifndef W_INCLUDE_TINYHTM_CONFIG_H_WAF
+#define W_INCLUDE_TINYHTM_CONFIG_H_WAF
+
+#define HAVE_ATTRIBUTE_UNUSED 1
+#define HAVE_ATTRIBUTE_ALIGNED 1
+#define HAVE_IO_URING 1
+#define HAVE_ZLIB 1
+#define FAST_ALLOC 1
+
+#endif /* W_INCLUDE_TINYHTM_CONFIG_H_WAF */
@@ -18,11 +18,13 @@ public:
   {
   }
 
-  int64_t search (const Tree &tree, htm_callback callback) const override
+  int64_t search (const Tree &tree, htm_callback callback,
+                  struct htm_query_stats *stats = nullptr) const override
   {
     struct htm_s2cpoly *poly = make_poly ();
     enum htm_errcode ec;
-    int64_t count = htm_tree_s2cpoly (&(tree.tree), poly, &ec, callback);
+    int64_t count
+        = htm_tree_s2cpoly (&(tree.tree), poly, &ec, callback, stats);
     free (poly);
     if (ec != HTM_OK)
       {
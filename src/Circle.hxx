@@ -16,12 +16,13 @@ public:
 
   Circle (const Spherical &Center, const double &R) : center (Center), r (R) {}
 
-  int64_t search (const Tree &tree, htm_callback callback) const override
+  int64_t search (const Tree &tree, htm_callback callback,
+                  struct htm_query_stats *stats = nullptr) const override
   {
     Cartesian c (center);
     enum htm_errcode ec;
     int64_t count
-        = htm_tree_s2circle (&(tree.tree), &(c.v3), r, &ec, callback);
+        = htm_tree_s2circle (&(tree.tree), &(c.v3), r, &ec, callback, stats);
     if (ec != HTM_OK)
       throw Exception ("Corrupted index file");
     return count;
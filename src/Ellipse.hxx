@@ -22,6 +22,17 @@ public:
       }
   }
 
+  int64_t search (const Tree &tree, htm_callback callback,
+                  struct htm_query_stats *stats = nullptr) const override
+  {
+    enum htm_errcode ec;
+    int64_t count
+        = htm_tree_s2ellipse (&(tree.tree), &ellipse, &ec, callback, stats);
+    if (ec != HTM_OK)
+      throw Exception ("Corrupted index file");
+    return count;
+  }
+
   std::vector<htm_range>
   covering_ranges (const size_t &level,
                    const size_t &max_ranges) const override
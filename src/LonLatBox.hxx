@@ -0,0 +1,78 @@
+#pragma once
+
+#include <utility>
+
+#include "Spherical.hxx"
+#include "Shape.hxx"
+
+namespace tinyhtm
+{
+/// A box bounded by two meridians and two parallels of latitude.  Unlike
+/// Box, whose edges are all great circles, the latitude edges of a
+/// LonLatBox are small circles, so it matches a cut on lon/lat columns.
+class LonLatBox : public Shape
+{
+public:
+  struct htm_s2box box;
+
+  /// The box extends eastwards from lonmin to lonmax, so lonmax < lonmin
+  /// gives a box crossing the 0/360 meridian.
+  LonLatBox (const double &lonmin, const double &lonmax,
+             const double &latmin, const double &latmax)
+  {
+    enum htm_errcode ec
+        = htm_s2box_init (&box, lonmin, lonmax, latmin, latmax);
+    if (ec != HTM_OK)
+      {
+        throw Exception ("Invalid lon/lat box parameters: "
+                         + std::to_string (lonmin) + " "
+                         + std::to_string (lonmax) + " "
+                         + std::to_string (latmin) + " "
+                         + std::to_string (latmax) + ": "
+                         + htm_errmsg (ec));
+      }
+  }
+
+  int64_t search (const Tree &tree, htm_callback callback,
+                  struct htm_query_stats *stats = nullptr) const override
+  {
+    enum htm_errcode ec;
+    int64_t count
+        = htm_tree_s2box (&(tree.tree), &box, &ec, callback, stats);
+    if (ec != HTM_OK)
+      throw Exception ("Corrupted index file");
+    return count;
+  }
+
+  std::pair<Spherical, Spherical> bounding_box () const override
+  {
+    return std::make_pair (
+        Spherical (box.lonmin + 0.5 * box.width,
+                   0.5 * (box.latmin + box.latmax)),
+        Spherical (box.width, box.latmax - box.latmin));
+  }
+
+  std::vector<htm_range>
+  covering_ranges (const size_t &level,
+                   const size_t &max_ranges) const override
+  {
+    struct htm_ids *ids = nullptr;
+    enum htm_errcode ec;
+    ids = htm_s2box_ids (ids, &box, level, max_ranges, &ec);
+    if (ec != HTM_OK)
+      {
+        if (ids != nullptr)
+          free (ids);
+        throw Exception (
+            std::string ("Failed to find HTM triangles overlapping box: ")
+            + htm_errmsg (ec));
+      }
+    std::vector<htm_range> ranges;
+    ranges.reserve (ids->n);
+    for (size_t r = 0; r < ids->n; ++r)
+      ranges.push_back (ids->range[r]);
+    free (ids);
+    return ranges;
+  }
+};
+}
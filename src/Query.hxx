@@ -9,11 +9,15 @@
 #include "Cartesian.hxx"
 #include "Ellipse.hxx"
 #include "Box.hxx"
+#include "LonLatBox.hxx"
 #include "Polygon.hxx"
 #include "Tree.hxx"
 
 namespace tinyhtm
 {
+/// Queries take a Tree, which may be given as a data file name (the tree
+/// is then looked up in, or opened through, the shared tree registry) or
+/// as a handle returned by Tree::open().
 class Query
 {
 public:
@@ -21,39 +25,44 @@ public:
   std::unique_ptr<Shape> shape;
 
   /// Circle
-  Query (const std::string &data_file, const Spherical &spherical,
+  Query (const Tree &data_tree, const Spherical &spherical,
          const double &R)
-      : tree (data_file), shape (std::make_unique<Circle>(spherical, R))
+      : tree (data_tree), shape (std::make_unique<Circle>(spherical, R))
   {
   }
 
   /// Ellipse
-  Query (const std::string &data_file, const Ellipse &e)
-      : tree (data_file), shape (std::make_unique<Ellipse>(e))
+  Query (const Tree &data_tree, const Ellipse &e)
+      : tree (data_tree), shape (std::make_unique<Ellipse>(e))
   {
   }
 
   /// Box
-  Query (const std::string &data_file, const Spherical &ra_dec,
+  Query (const Tree &data_tree, const Spherical &ra_dec,
          const Spherical &width_height)
-      : tree (data_file), shape (std::make_unique<Box>(ra_dec, width_height))
+      : tree (data_tree), shape (std::make_unique<Box>(ra_dec, width_height))
   {
   }
 
   /// Polygon
-  Query (const std::string &data_file, const std::vector<Spherical> &vertices)
-      : tree (data_file), shape (std::make_unique<Polygon>(vertices))
+  Query (const Tree &data_tree, const std::vector<Spherical> &vertices)
+      : tree (data_tree), shape (std::make_unique<Polygon>(vertices))
   {
   }
 
   /// Generic string
-  Query (const std::string &data_file, const std::string &query_shape,
+  Query (const Tree &data_tree, const std::string &query_shape,
          const std::string &vertex_string);
 
-  int64_t count () const { return shape->count (tree); }
-  int64_t search (htm_callback callback) const
+  /// If stats is not null, query statistics are stored in *stats.
+  int64_t count (struct htm_query_stats *stats = nullptr) const
   {
-    return shape->search (tree, callback);
+    return shape->count (tree, stats);
+  }
+  int64_t search (htm_callback callback,
+                  struct htm_query_stats *stats = nullptr) const
+  {
+    return shape->search (tree, callback, stats);
   }
 };
 }
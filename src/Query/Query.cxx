@@ -1,10 +1,9 @@
 #include "../Query.hxx"
 
 /// Generic string
-tinyhtm::Query::Query (const std::string &data_file,
-                       const std::string &query_shape,
+tinyhtm::Query::Query (const Tree &data_tree, const std::string &query_shape,
                        const std::string &vertex_string)
-    : tree (data_file)
+    : tree (data_tree)
 {
   std::stringstream ss (vertex_string);
   std::vector<double> numbers;
@@ -70,6 +69,17 @@ tinyhtm::Query::Query (const std::string &data_file,
       shape = std::make_unique<Box>(Spherical (numbers[0], numbers[1]),
                                     Spherical (numbers[2], numbers[3]));
     }
+  else if (query_shape == "lonlatbox")
+    {
+      if (numbers.size () != 4)
+        {
+          throw Exception ("Wrong number of arguments for lonlatbox.  "
+                           "Need 4 but have "
+                           + std::to_string (numbers.size ()));
+        }
+      shape = std::make_unique<LonLatBox>(numbers[0], numbers[1], numbers[2],
+                                          numbers[3]);
+    }
   else
     {
       throw Exception (std::string ("Bad query shape: ") + query_shape);
@@ -11,11 +11,14 @@ namespace tinyhtm
 class Shape
 {
 public:
-  virtual int64_t count (const Tree &) const
+  /// If stats is not null, query statistics are stored in *stats.
+  virtual int64_t count (const Tree &tree,
+                         struct htm_query_stats *stats = nullptr) const
   {
-    throw Exception ("Shape not valid");
+    return search (tree, nullptr, stats);
   };
-  virtual int64_t search (const Tree &, htm_callback) const
+  virtual int64_t search (const Tree &, htm_callback,
+                          struct htm_query_stats * = nullptr) const
   {
     throw Exception ("Shape not valid");
   };
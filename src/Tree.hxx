@@ -1,16 +1,42 @@
 #pragma once
 
+#include <memory>
+#include <string>
+
+#include "tinyhtm/tree.h"
+#include "Exception.hxx"
+
 namespace tinyhtm
 {
+/// A handle to an opened HTM tree.  Opened trees are shared process-wide:
+/// every Tree for the same data file refers to the same htm_tree, which
+/// is opened (and memory-mapped) only once.
 class Tree
 {
 public:
-  struct htm_tree tree;
-  Tree (const std::string &data_file)
+  std::shared_ptr<const struct htm_tree> handle;
+  const struct htm_tree &tree;
+
+  Tree (const std::string &data_file) : Tree (open (data_file)) {}
+  Tree (const char *data_file) : Tree (open (data_file)) {}
+  Tree (const std::shared_ptr<const struct htm_tree> &Handle)
+      : handle (Handle), tree (*Handle)
   {
-    enum htm_errcode ec = htm_tree_init (&tree, data_file.c_str ());
-    if (ec != HTM_OK)
-      throw Exception ("Failed to init tree file or data file: " + data_file);
   }
+  Tree (const Tree &t) : handle (t.handle), tree (*handle) {}
+
+  /// Returns a shared handle to the tree for data_file, opening it only
+  /// if the registry holds no handle for the same file.  Handles are
+  /// keyed by canonical path, and are reopened if the device, inode,
+  /// size or modification time of the file changed.  Thread-safe.
+  static std::shared_ptr<const struct htm_tree>
+  open (const std::string &data_file);
+
+  /// Drops the registry reference to the tree for data_file.  The tree
+  /// is closed once no Tree or Query refers to it anymore.
+  static void evict (const std::string &data_file);
+
+  /// Drops all registry references.
+  static void evict_all ();
 };
 }
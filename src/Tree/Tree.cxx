@@ -0,0 +1,164 @@
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <map>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#include "../Tree.hxx"
+
+namespace
+{
+struct registry_entry
+{
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  /// Ready once the thread that inserted the entry has opened the tree
+  /// (or failed to).
+  std::shared_future<std::shared_ptr<const struct htm_tree> > tree;
+  /// Distinguishes the entry from later ones for the same path.
+  uint64_t serial;
+
+  void set_file (const struct stat &sb)
+  {
+    dev = sb.st_dev;
+    ino = sb.st_ino;
+    size = sb.st_size;
+    mtime = sb.st_mtim;
+  }
+
+  bool same_file (const struct stat &sb) const
+  {
+    return dev == sb.st_dev && ino == sb.st_ino && size == sb.st_size
+           && mtime.tv_sec == sb.st_mtim.tv_sec
+           && mtime.tv_nsec == sb.st_mtim.tv_nsec;
+  }
+};
+
+/// Function-local statics, so that trees may be opened during static
+/// initialization of other translation units.
+std::mutex &registry_mutex ()
+{
+  static std::mutex m;
+  return m;
+}
+
+std::map<std::string, registry_entry> &registry ()
+{
+  static std::map<std::string, registry_entry> r;
+  return r;
+}
+
+std::string canonical_path (const std::string &data_file)
+{
+  char *resolved = realpath (data_file.c_str (), nullptr);
+  if (resolved == nullptr)
+    throw tinyhtm::Exception ("Failed to init tree file or data file: "
+                              + data_file);
+  std::string path (resolved);
+  free (resolved);
+  return path;
+}
+
+void destroy_tree (const struct htm_tree *tree)
+{
+  htm_tree_destroy (const_cast<struct htm_tree *>(tree));
+  delete tree;
+}
+
+/// Opens the tree for the canonical path of data_file, and returns the
+/// status of the file that was actually opened in *sb.
+std::shared_ptr<const struct htm_tree>
+open_tree (const std::string &path, const std::string &data_file,
+           struct stat *sb)
+{
+  struct htm_tree *tree = new struct htm_tree;
+  enum htm_errcode ec = htm_tree_init (tree, path.c_str ());
+  if (ec != HTM_OK)
+    {
+      delete tree;
+      throw tinyhtm::Exception ("Failed to init tree file or data file: "
+                                + data_file);
+    }
+  std::shared_ptr<const struct htm_tree> handle (tree, destroy_tree);
+  if (fstat (tree->datafd, sb) != 0)
+    throw tinyhtm::Exception ("Failed to init tree file or data file: "
+                              + data_file);
+  return handle;
+}
+}
+
+std::shared_ptr<const struct htm_tree>
+tinyhtm::Tree::open (const std::string &data_file)
+{
+  static uint64_t next_serial = 0;
+  const std::string path (canonical_path (data_file));
+  std::promise<std::shared_ptr<const struct htm_tree> > promise;
+  std::shared_future<std::shared_ptr<const struct htm_tree> > pending;
+  std::shared_ptr<const struct htm_tree> handle;
+  uint64_t serial = 0;
+  struct stat sb;
+  if (stat (path.c_str (), &sb) != 0)
+    throw Exception ("Failed to init tree file or data file: " + data_file);
+
+  /// Look up the tree, or claim the job of opening it.  Concurrent
+  /// requests for the same file then wait for that open rather than map
+  /// the file twice, and requests for other files need not wait at all.
+  {
+    std::lock_guard<std::mutex> lock (registry_mutex ());
+    auto it = registry ().find (path);
+    if (it != registry ().end () && it->second.same_file (sb))
+      {
+        pending = it->second.tree;
+      }
+    else
+      {
+        registry_entry &entry = registry ()[path];
+        entry.set_file (sb);
+        entry.tree = promise.get_future ().share ();
+        entry.serial = serial = ++next_serial;
+      }
+  }
+  if (serial == 0)
+    return pending.get ();
+
+  try
+    {
+      handle = open_tree (path, data_file, &sb);
+    }
+  catch (...)
+    {
+      /// Waiting requests fail too; later ones try again.
+      promise.set_exception (std::current_exception ());
+      std::lock_guard<std::mutex> lock (registry_mutex ());
+      auto it = registry ().find (path);
+      if (it != registry ().end () && it->second.serial == serial)
+        registry ().erase (it);
+      throw;
+    }
+  promise.set_value (handle);
+
+  /// Key on the file that was actually opened, in case it was replaced
+  /// since the stat() above.
+  std::lock_guard<std::mutex> lock (registry_mutex ());
+  auto it = registry ().find (path);
+  if (it != registry ().end () && it->second.serial == serial)
+    it->second.set_file (sb);
+  return handle;
+}
+
+void tinyhtm::Tree::evict (const std::string &data_file)
+{
+  const std::string path (canonical_path (data_file));
+  std::lock_guard<std::mutex> lock (registry_mutex ());
+  registry ().erase (path);
+}
+
+void tinyhtm::Tree::evict_all ()
+{
+  std::lock_guard<std::mutex> lock (registry_mutex ());
+  registry ().clear ();
+}
@@ -360,7 +360,7 @@ enum htm_errcode htm_s2ellipse_init2 (struct htm_s2ellipse *ellipse,
            0           0           -1 ]
    */
   ellipse->cen = *cen;
-  ellipse->a = a;
+  ellipse->a = (a > b) ? a : b;
   a = tan (HTM_RAD_PER_DEG * a);
   b = tan (HTM_RAD_PER_DEG * b);
   a = 1.0 / (a * a);
@@ -1865,6 +1865,289 @@ cleanup:
   return poly;
 }
 
+/* ---- Longitude/Latitude Boxes ---- */
+
+enum htm_errcode htm_s2box_init (struct htm_s2box *box, double lonmin,
+                                 double lonmax, double latmin, double latmax)
+{
+  double lon, s, c;
+
+  if (box == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  else if (HTM_ISSPECIAL (lonmin) || HTM_ISSPECIAL (lonmax)
+           || HTM_ISSPECIAL (latmin) || HTM_ISSPECIAL (latmax))
+    {
+      return HTM_ENANINF;
+    }
+  else if (latmin < -90.0 || latmin > 90.0 || latmax < -90.0
+           || latmax > 90.0)
+    {
+      return HTM_ELAT;
+    }
+  else if (latmin > latmax)
+    {
+      return HTM_EANG;
+    }
+  box->lonmin = htm_angred (lonmin);
+  if (lonmax - lonmin >= 360.0)
+    {
+      box->width = 360.0;
+    }
+  else
+    {
+      box->width = htm_angred (lonmax - lonmin);
+    }
+  box->latmin = latmin;
+  box->latmax = latmax;
+  box->zmin = (latmin == -90.0) ? -1.0 : sin (latmin * HTM_RAD_PER_DEG);
+  box->zmax = (latmax == 90.0) ? 1.0 : sin (latmax * HTM_RAD_PER_DEG);
+  /* the western meridian plane normal points east, the eastern
+     meridian plane normal points west */
+  lon = box->lonmin * HTM_RAD_PER_DEG;
+  s = sin (lon);
+  c = cos (lon);
+  box->w.x = -s;
+  box->w.y = c;
+  box->w.z = 0.0;
+  lon = (box->lonmin + box->width) * HTM_RAD_PER_DEG;
+  s = sin (lon);
+  c = cos (lon);
+  box->e.x = s;
+  box->e.y = -c;
+  box->e.z = 0.0;
+  return HTM_OK;
+}
+
+/* ---- Composite Spherical Regions ---- */
+
+static struct htm_s2region *_htm_s2region_alloc (enum htm_s2region_type type,
+                                                 enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  r = (struct htm_s2region *)calloc (1, sizeof(struct htm_s2region));
+  if (r == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENOMEM;
+        }
+      return NULL;
+    }
+  r->type = type;
+  if (err != NULL)
+    {
+      *err = HTM_OK;
+    }
+  return r;
+}
+
+struct htm_s2region *htm_s2region_circle (const struct htm_v3 *cen,
+                                          double radius,
+                                          enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  if (cen == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return NULL;
+    }
+  if (HTM_ISNAN (radius))
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENANINF;
+        }
+      return NULL;
+    }
+  r = _htm_s2region_alloc (HTM_S2REGION_CIRCLE, err);
+  if (r == NULL)
+    {
+      return NULL;
+    }
+  r->cen = *cen;
+  if (radius < 0.0)
+    {
+      /* empty circle: no point is within a negative distance */
+      r->dist2 = -1.0;
+    }
+  else if (radius >= 180.0)
+    {
+      /* entire sky: every point is within a distance of 2 */
+      r->dist2 = 5.0;
+    }
+  else
+    {
+      r->dist2 = sin (radius * 0.5 * HTM_RAD_PER_DEG);
+      r->dist2 = 4.0 * r->dist2 * r->dist2;
+    }
+  return r;
+}
+
+struct htm_s2region *htm_s2region_ellipse (const struct htm_s2ellipse *ellipse,
+                                           enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  if (ellipse == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return NULL;
+    }
+  r = _htm_s2region_alloc (HTM_S2REGION_ELLIPSE, err);
+  if (r != NULL)
+    {
+      r->ellipse = *ellipse;
+    }
+  return r;
+}
+
+struct htm_s2region *htm_s2region_cpoly (const struct htm_s2cpoly *poly,
+                                         enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  if (poly == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return NULL;
+    }
+  r = _htm_s2region_alloc (HTM_S2REGION_CPOLY, err);
+  if (r == NULL)
+    {
+      return NULL;
+    }
+  r->poly = htm_s2cpoly_clone (poly);
+  if (r->poly == NULL)
+    {
+      free (r);
+      if (err != NULL)
+        {
+          *err = HTM_ENOMEM;
+        }
+      return NULL;
+    }
+  return r;
+}
+
+struct htm_s2region *htm_s2region_box (const struct htm_s2box *box,
+                                       enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  if (box == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return NULL;
+    }
+  r = _htm_s2region_alloc (HTM_S2REGION_BOX, err);
+  if (r != NULL)
+    {
+      r->box = *box;
+    }
+  return r;
+}
+
+static struct htm_s2region *_htm_s2region_op (enum htm_s2region_type type,
+                                              struct htm_s2region *r1,
+                                              struct htm_s2region *r2,
+                                              enum htm_errcode *err)
+{
+  struct htm_s2region *r;
+
+  if (r1 == NULL || r2 == NULL)
+    {
+      htm_s2region_destroy (r1);
+      htm_s2region_destroy (r2);
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return NULL;
+    }
+  r = _htm_s2region_alloc (type, err);
+  if (r == NULL)
+    {
+      htm_s2region_destroy (r1);
+      htm_s2region_destroy (r2);
+      return NULL;
+    }
+  r->op[0] = r1;
+  r->op[1] = r2;
+  return r;
+}
+
+struct htm_s2region *htm_s2region_union (struct htm_s2region *r1,
+                                         struct htm_s2region *r2,
+                                         enum htm_errcode *err)
+{
+  return _htm_s2region_op (HTM_S2REGION_UNION, r1, r2, err);
+}
+
+struct htm_s2region *htm_s2region_isect (struct htm_s2region *r1,
+                                         struct htm_s2region *r2,
+                                         enum htm_errcode *err)
+{
+  return _htm_s2region_op (HTM_S2REGION_ISECT, r1, r2, err);
+}
+
+struct htm_s2region *htm_s2region_diff (struct htm_s2region *r1,
+                                        struct htm_s2region *r2,
+                                        enum htm_errcode *err)
+{
+  return _htm_s2region_op (HTM_S2REGION_DIFF, r1, r2, err);
+}
+
+void htm_s2region_destroy (struct htm_s2region *region)
+{
+  if (region == NULL)
+    {
+      return;
+    }
+  htm_s2region_destroy (region->op[0]);
+  htm_s2region_destroy (region->op[1]);
+  free (region->poly);
+  free (region);
+}
+
+int htm_s2region_cv3 (const struct htm_s2region *r, const struct htm_v3 *v)
+{
+  switch (r->type)
+    {
+    case HTM_S2REGION_CIRCLE:
+      return htm_v3_dist2 (&r->cen, v) <= r->dist2;
+    case HTM_S2REGION_ELLIPSE:
+      return htm_s2ellipse_cv3 (&r->ellipse, v);
+    case HTM_S2REGION_CPOLY:
+      return htm_s2cpoly_cv3 (r->poly, v);
+    case HTM_S2REGION_BOX:
+      return htm_s2box_cv3 (&r->box, v);
+    case HTM_S2REGION_UNION:
+      return htm_s2region_cv3 (r->op[0], v) || htm_s2region_cv3 (r->op[1], v);
+    case HTM_S2REGION_ISECT:
+      return htm_s2region_cv3 (r->op[0], v) && htm_s2region_cv3 (r->op[1], v);
+    case HTM_S2REGION_DIFF:
+      return htm_s2region_cv3 (r->op[0], v)
+             && !htm_s2region_cv3 (r->op[1], v);
+    }
+  return FALSE;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -453,22 +453,48 @@ int n_dec_digs (int64_t num) { return (strlen (str128 (num))); }
 
 int64_t htm_tree_s2circle_count (const struct htm_tree *tree,
                                  const struct htm_v3 *center, double radius,
-                                 enum htm_errcode *err)
+                                 enum htm_errcode *err,
+                                 struct htm_query_stats *stats)
 {
-  return htm_tree_s2circle (tree, center, radius, err, NULL);
+  return htm_tree_s2circle (tree, center, radius, err, NULL, stats);
 }
 
 int64_t htm_tree_s2ellipse_count (const struct htm_tree *tree,
                                   const struct htm_s2ellipse *ellipse,
-                                  enum htm_errcode *err)
+                                  enum htm_errcode *err,
+                                  struct htm_query_stats *stats)
 {
-  return htm_tree_s2ellipse (tree, ellipse, err, NULL);
+  return htm_tree_s2ellipse (tree, ellipse, err, NULL, stats);
 }
 
 int64_t htm_tree_s2cpoly_count (const struct htm_tree *tree,
                                 const struct htm_s2cpoly *poly,
-                                enum htm_errcode *err)
+                                enum htm_errcode *err,
+                                struct htm_query_stats *stats)
 {
-  return htm_tree_s2cpoly (tree, poly, err, NULL);
+  return htm_tree_s2cpoly (tree, poly, err, NULL, stats);
+}
+
+int64_t htm_tree_s2box_count (const struct htm_tree *tree,
+                              const struct htm_s2box *box,
+                              enum htm_errcode *err,
+                              struct htm_query_stats *stats)
+{
+  return htm_tree_s2box (tree, box, err, NULL, stats);
+}
+
+int64_t htm_tree_s2region_count (const struct htm_tree *tree,
+                                 const struct htm_s2region *region,
+                                 enum htm_errcode *err,
+                                 struct htm_query_stats *stats)
+{
+  return htm_tree_s2region (tree, region, err, NULL, stats);
+}
+
+int64_t htm_tree_ids_count (const struct htm_tree *tree,
+                            const struct htm_ids *ids, enum htm_errcode *err,
+                            struct htm_query_stats *stats)
+{
+  return htm_tree_ids (tree, ids, err, NULL, stats);
 }
 }
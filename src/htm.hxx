@@ -67,6 +67,15 @@ enum _htm_cov
   HTM_INSIDE = 3     /**< HTM triangle completely inside region. */
 };
 
+/** A spherical cap bounding the points of an HTM tree node.
+  */
+struct _htm_cap
+{
+  struct htm_v3 cen; /**< Cap center (unit vector). */
+  double dist2;      /**< Cap radius (square secant distance). */
+  double radius;     /**< Cap radius angle (radians). */
+};
+
 /** A node (triangle/trixel) in an HTM tree.
   */
 struct _htm_node
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "htm.hxx"
+
+/*  Bounding caps are stored in tree nodes as 4 little-endian IEEE floats:
+    the components of the cap center, followed by the cap radius as a
+    secant distance. The center is re-normalized on decode, and the stored
+    radius accounts for the rounding of the center, so that a decoded cap
+    always contains the points it was computed from.
+ */
+#define _HTM_CAP_SIZE 16
+
+HTM_INLINE void _htm_cap_putf (unsigned char *s, float f)
+{
+  uint32_t u;
+  memcpy (&u, &f, sizeof(u));
+  s[0] = (unsigned char)u;
+  s[1] = (unsigned char)(u >> 8);
+  s[2] = (unsigned char)(u >> 16);
+  s[3] = (unsigned char)(u >> 24);
+}
+
+HTM_INLINE float _htm_cap_getf (const unsigned char *s)
+{
+  uint32_t u = (uint32_t)s[0] | ((uint32_t)s[1] << 8)
+               | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24);
+  float f;
+  memcpy (&f, &u, sizeof(f));
+  return f;
+}
+
+/*  Encodes the cap with unit vector center \p cen and angular radius
+    \p radius (radians) into the _HTM_CAP_SIZE bytes at \p s.
+ */
+HTM_INLINE void _htm_cap_encode (unsigned char *s, const struct htm_v3 *cen,
+                                 double radius)
+{
+  struct htm_v3 c, x;
+  float f[4];
+  double d;
+  int i;
+
+  f[0] = (float)cen->x;
+  f[1] = (float)cen->y;
+  f[2] = (float)cen->z;
+  c.x = f[0];
+  c.y = f[1];
+  c.z = f[2];
+  htm_v3_normalize (&c, &c);
+  /* grow the radius by the angle between the exact and decoded centers */
+  htm_v3_cross (&x, cen, &c);
+  radius += atan2 (htm_v3_norm (&x), htm_v3_dot (cen, &c));
+  if (radius >= M_PI)
+    {
+      d = 2.0;
+    }
+  else
+    {
+      d = 2.0 * sin (0.5 * radius);
+    }
+  f[3] = (float)d;
+  if ((double)f[3] < d)
+    {
+      f[3] = nextafterf (f[3], 3.0f);
+    }
+  for (i = 0; i < 4; ++i)
+    {
+      _htm_cap_putf (s + 4 * i, f[i]);
+    }
+}
+
+/*  Decodes the cap stored at \p s, returning a pointer to the first byte
+    following it.
+ */
+HTM_INLINE const unsigned char *_htm_cap_decode (struct _htm_cap *cap,
+                                                 const unsigned char *s)
+{
+  double d;
+
+  cap->cen.x = _htm_cap_getf (s);
+  cap->cen.y = _htm_cap_getf (s + 4);
+  cap->cen.z = _htm_cap_getf (s + 8);
+  htm_v3_normalize (&cap->cen, &cap->cen);
+  d = _htm_cap_getf (s + 12);
+  if (d > 2.0)
+    {
+      d = 2.0;
+    }
+  cap->dist2 = d * d;
+  cap->radius = 2.0 * asin (0.5 * d);
+  return s + _HTM_CAP_SIZE;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <endian.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "htm.hxx"
+
+/*  In fixed-width indexes (HTM_TREE_FIXED), the children of an internal
+    node are described by a single block following the node. The block
+    starts with a width code w (0, 1 or 2), followed by 4 child slots, each
+    holding 3 little-endian unsigned integers of 2 << w bytes: the child
+    point count, the child index relative to that of the node, and the
+    offset + 1 of the child relative to the end of the block (0 for an
+    empty child). The widths are chosen per block, as the narrowest that
+    fits all 12 values. Decoding a block involves no data-dependent
+    branches beyond the dispatch on its width, so that it vectorizes.
+ */
+#define _HTM_FIXED_NVAL 12
+
+/*  Returns the size (bytes) of the children block with width code \p w.
+ */
+HTM_INLINE size_t _htm_fixed_size (unsigned char w)
+{
+  return 1 + _HTM_FIXED_NVAL * ((size_t)2 << w);
+}
+
+/*  Decodes the children block at \p s into v. Returns 0 if the block
+    width code is invalid, and 1 otherwise.
+ */
+HTM_INLINE int _htm_fixed_decode (uint64_t v[_HTM_FIXED_NVAL],
+                                  const unsigned char *s)
+{
+  int i;
+  switch (s[0])
+    {
+    case 0:
+      {
+        uint16_t u[_HTM_FIXED_NVAL];
+        memcpy (u, s + 1, sizeof(u));
+        for (i = 0; i < _HTM_FIXED_NVAL; ++i)
+          {
+            v[i] = le16toh (u[i]);
+          }
+        return 1;
+      }
+    case 1:
+      {
+        uint32_t u[_HTM_FIXED_NVAL];
+        memcpy (u, s + 1, sizeof(u));
+        for (i = 0; i < _HTM_FIXED_NVAL; ++i)
+          {
+            v[i] = le32toh (u[i]);
+          }
+        return 1;
+      }
+    case 2:
+      {
+        uint64_t u[_HTM_FIXED_NVAL];
+        memcpy (u, s + 1, sizeof(u));
+        for (i = 0; i < _HTM_FIXED_NVAL; ++i)
+          {
+            v[i] = le64toh (u[i]);
+          }
+        return 1;
+      }
+    default:
+      break;
+    }
+  return 0;
+}
+
+/*  Encodes v as a children block at \p s, using the narrowest width that
+    fits every value, and returns the size of the block.
+ */
+HTM_INLINE size_t _htm_fixed_encode (unsigned char *s,
+                                     const uint64_t v[_HTM_FIXED_NVAL])
+{
+  uint64_t m = 0;
+  size_t nb;
+  int i, j;
+  unsigned char w;
+
+  for (i = 0; i < _HTM_FIXED_NVAL; ++i)
+    {
+      m |= v[i];
+    }
+  w = (m <= 0xffff) ? 0 : ((m <= 0xffffffff) ? 1 : 2);
+  nb = (size_t)2 << w;
+  s[0] = w;
+  for (i = 0; i < _HTM_FIXED_NVAL; ++i)
+    {
+      for (j = 0; j < (int)nb; ++j)
+        {
+          s[1 + i * nb + j] = (unsigned char)(v[i] >> (8 * j));
+        }
+    }
+  return _htm_fixed_size (w);
+}
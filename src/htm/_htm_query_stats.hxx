@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string.h>
+#include <time.h>
+
+#include <utility>
+
+#include "tinyhtm/tree.h"
+#include "htm.hxx"
+
+/*  Gathers the execution statistics of a tree query (see htm_query_stats).
+
+    Tree searches are instantiated either with this class, or with
+    _htm_nostats, whose members do nothing and are optimized away, so that
+    queries run without statistics pay nothing for them.
+ */
+class _htm_stats
+{
+public:
+  explicit _htm_stats (struct htm_query_stats *s) : stats (s), scanning (0.0)
+  {
+    memset (stats, 0, sizeof(struct htm_query_stats));
+    start = now ();
+  }
+
+  /* Records a visit to a node at the given level, and the # of index
+     bytes decoded to classify it. */
+  void node (int level, enum _htm_cov coverage, size_t nbytes)
+  {
+    const int l = (level < HTM_QUERY_MAX_LEVEL) ? level : HTM_QUERY_MAX_LEVEL;
+    ++stats->nodes[l];
+    ++stats->classified[l][coverage];
+    switch (coverage)
+      {
+      case HTM_DISJOINT:
+        ++stats->disjoint;
+        break;
+      case HTM_INTERSECT:
+        ++stats->intersect;
+        break;
+      case HTM_CONTAINS:
+        ++stats->contains;
+        break;
+      default:
+        ++stats->inside;
+        break;
+      }
+    stats->index_bytes += nbytes;
+  }
+
+  /* Records the # of index bytes decoded to locate the children of a
+     node. */
+  void index (size_t nbytes) { stats->index_bytes += nbytes; }
+
+  /* Records that the n points of a leaf, each entry_size bytes long, are
+     read. */
+  void leaf (uint64_t n, size_t entry_size)
+  {
+    ++stats->leaves;
+    stats->data_bytes += n * entry_size;
+  }
+
+  /* Records the outcome of testing a point against the query region. */
+  bool test (bool inside)
+  {
+    ++stats->tested;
+    stats->matched += inside;
+    return inside;
+  }
+
+  /* Brackets time spent reading and scanning leaves. */
+  void scan_begin () { t = now (); }
+  void scan_end () { scanning += now () - t; }
+
+  /* Splits the elapsed time between index traversal and leaf scans. */
+  void finish ()
+  {
+    const double total = now () - start;
+    stats->scan_time = scanning;
+    stats->traversal_time = (total > scanning) ? total - scanning : 0.0;
+  }
+
+private:
+  static double now ()
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1.0e-9 * ts.tv_nsec;
+  }
+
+  struct htm_query_stats *stats;
+  double start;
+  double t;
+  double scanning;
+};
+
+/*  Gathers nothing.
+ */
+struct _htm_nostats
+{
+  void node (int, enum _htm_cov, size_t) {}
+  void index (size_t) {}
+  void leaf (uint64_t, size_t) {}
+  bool test (bool inside) { return inside; }
+  void scan_begin () {}
+  void scan_end () {}
+  void finish () {}
+};
+
+/*  Invokes \p query with a _htm_stats gathering into \p stats, or with a
+    _htm_nostats if \p stats is NULL, and returns its result.
+ */
+template <typename Query>
+auto _htm_with_stats (struct htm_query_stats *stats, Query &&query)
+    -> decltype (query (std::declval<_htm_nostats &>()))
+{
+  if (stats == NULL)
+    {
+      _htm_nostats nostats;
+      return query (nostats);
+    }
+  _htm_stats s (stats);
+  auto result = query (s);
+  s.finish ();
+  return result;
+}
@@ -0,0 +1,171 @@
+#include "htm.hxx"
+#include "htm/_htm_s2box_htmcov.hxx"
+
+/*  Tolerances used when classifying HTM triangles. Triangles are only
+    reported as inside or disjoint from a box when they are so by a small
+    margin, so that the coverage code never contradicts htm_s2box_cv3()
+    for points on (or numerically very close to) the box boundary.
+ */
+#define _HTM_S2BOX_ZEPS 1.0e-12
+#define _HTM_S2BOX_LONEPS 1.0e-9
+
+/*  Widens [*zmin, *zmax] to include the z-extrema of the great circle arc
+    from v1 to v2, where e is parallel to the cross product of v1 and v2.
+ */
+static void _htm_arc_zrange (const struct htm_v3 *v1, const struct htm_v3 *v2,
+                             const struct htm_v3 *e, double *zmin,
+                             double *zmax)
+{
+  struct htm_v3 p, c;
+  double e2 = htm_v3_norm2 (e);
+  double pz, s1, s2;
+
+  /* The point of maximum z on the great circle is the projection of
+     the z axis onto the plane of the circle. */
+  p.x = -e->z * e->x / e2;
+  p.y = -e->z * e->y / e2;
+  p.z = 1.0 - e->z * e->z / e2;
+  if (p.z <= 0.0)
+    {
+      /* the great circle is the equator */
+      return;
+    }
+  pz = sqrt (p.z);
+  htm_v3_rcross (&c, v1, &p);
+  s1 = htm_v3_dot (&c, e);
+  htm_v3_rcross (&c, &p, v2);
+  s2 = htm_v3_dot (&c, e);
+  if (s1 >= 0.0 && s2 >= 0.0)
+    {
+      /* maximum is on the arc */
+      *zmax = pz > *zmax ? pz : *zmax;
+    }
+  else if (s1 <= 0.0 && s2 <= 0.0)
+    {
+      /* minimum (the antipode of the maximum) is on the arc */
+      *zmin = -pz < *zmin ? -pz : *zmin;
+    }
+}
+
+/*  Computes the longitude range [*lon, *lon + *width] (in degrees) of an
+    HTM triangle. A width of 360 is returned when the triangle contains a
+    pole in its interior.
+ */
+static void _htm_node_lonrange (const struct _htm_node *n, double *lon,
+                                double *width)
+{
+  double lons[3], tmp, gap, maxgap;
+  int npos = 0, nneg = 0, north = 0, south = 0;
+  int i, j, nlon = 0;
+
+  for (i = 0; i < 3; ++i)
+    {
+      const struct htm_v3 *v = n->vert[i];
+      const double ez = n->edge[i]->z;
+      npos += ez >= 0.0;
+      nneg += ez <= 0.0;
+      if (v->x == 0.0 && v->y == 0.0)
+        {
+          /* longitude is undefined at the poles */
+          north += v->z > 0.0;
+          south += v->z < 0.0;
+          continue;
+        }
+      lons[nlon++] = htm_angred (atan2 (v->y, v->x) * HTM_DEG_PER_RAD);
+    }
+  if ((npos == 3 && north == 0) || (nneg == 3 && south == 0) || nlon < 2)
+    {
+      /* the triangle contains a pole */
+      *lon = 0.0;
+      *width = 360.0;
+      return;
+    }
+  for (i = 1; i < nlon; ++i)
+    {
+      for (j = i; j > 0 && lons[j - 1] > lons[j]; --j)
+        {
+          tmp = lons[j];
+          lons[j] = lons[j - 1];
+          lons[j - 1] = tmp;
+        }
+    }
+  /* Since the triangle does not contain a pole, its longitude range is
+     the smallest interval containing the vertex longitudes, i.e. the
+     complement of the largest gap between consecutive vertex longitudes. */
+  maxgap = lons[0] + 360.0 - lons[nlon - 1];
+  *lon = lons[0];
+  for (i = 1; i < nlon; ++i)
+    {
+      gap = lons[i] - lons[i - 1];
+      if (gap > maxgap)
+        {
+          maxgap = gap;
+          *lon = lons[i];
+        }
+    }
+  *width = maxgap < 180.0 ? 360.0 : 360.0 - maxgap;
+}
+
+/*  Returns the coverage code describing the spatial relationship between the
+    given HTM triangle and longitude/latitude box. The latitude band and the
+    longitude wedge of the box are classified separately, using the exact
+    z and longitude ranges of the triangle. HTM_CONTAINS is never returned.
+ */
+enum _htm_cov _htm_s2box_htmcov (const struct _htm_node *n,
+                                 const struct htm_s2box *box)
+{
+  double zmin, zmax, lon, width, d;
+  int inband, inwedge, pole;
+
+  /* z range of the triangle */
+  zmin = zmax = n->vert[0]->z;
+  for (int i = 1; i < 3; ++i)
+    {
+      zmin = n->vert[i]->z < zmin ? n->vert[i]->z : zmin;
+      zmax = n->vert[i]->z > zmax ? n->vert[i]->z : zmax;
+    }
+  if (n->edge[0]->z >= 0.0 && n->edge[1]->z >= 0.0 && n->edge[2]->z >= 0.0)
+    {
+      /* north pole is inside the triangle */
+      zmax = 1.0;
+    }
+  else if (n->edge[0]->z <= 0.0 && n->edge[1]->z <= 0.0
+           && n->edge[2]->z <= 0.0)
+    {
+      /* south pole is inside the triangle */
+      zmin = -1.0;
+    }
+  _htm_arc_zrange (n->vert[0], n->vert[1], n->edge[0], &zmin, &zmax);
+  _htm_arc_zrange (n->vert[1], n->vert[2], n->edge[1], &zmin, &zmax);
+  _htm_arc_zrange (n->vert[2], n->vert[0], n->edge[2], &zmin, &zmax);
+
+  if (zmax < box->zmin - _HTM_S2BOX_ZEPS || zmin > box->zmax + _HTM_S2BOX_ZEPS)
+    {
+      return HTM_DISJOINT;
+    }
+  inband = (box->zmin <= -1.0 || zmin >= box->zmin + _HTM_S2BOX_ZEPS)
+           && (box->zmax >= 1.0 || zmax <= box->zmax - _HTM_S2BOX_ZEPS);
+  if (box->width >= 360.0)
+    {
+      return inband ? HTM_INSIDE : HTM_INTERSECT;
+    }
+
+  /* longitude range of the triangle */
+  _htm_node_lonrange (n, &lon, &width);
+  if (width >= 360.0)
+    {
+      return HTM_INTERSECT;
+    }
+  d = htm_angred (lon - box->lonmin);
+  inwedge = d + width <= box->width - _HTM_S2BOX_LONEPS;
+  if (!inwedge && d > box->width + _HTM_S2BOX_LONEPS
+      && htm_angred (box->lonmin - lon) > width + _HTM_S2BOX_LONEPS)
+    {
+      /* The longitude ranges are disjoint. A pole vertex of the triangle
+         belongs to every meridian though, and so can still be in the box. */
+      pole = (zmax >= 1.0 && box->zmax >= 1.0)
+             || (zmin <= -1.0 && box->zmin <= -1.0);
+      return pole ? HTM_INTERSECT : HTM_DISJOINT;
+    }
+  return (inband && inwedge) ? HTM_INSIDE : HTM_INTERSECT;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "htm.hxx"
+
+enum _htm_cov _htm_s2box_htmcov (const struct _htm_node *n,
+                                 const struct htm_s2box *box);
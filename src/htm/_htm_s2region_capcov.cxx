@@ -0,0 +1,220 @@
+#include "htm.hxx"
+#include "htm/_htm_s2region_capcov.hxx"
+
+/*  Angular tolerance (radians) for cap classification. Points on or very
+    near a region boundary must never be classified by their bounding cap.
+ */
+#define _HTM_CAPCOV_EPS 1.0e-12
+
+/*  Returns the angle (radians) between unit vector v and the plane with
+    normal n; the angle is positive on the side of the plane n points to.
+ */
+static double _htm_plane_angle (const struct htm_v3 *v, const struct htm_v3 *n)
+{
+  struct htm_v3 x;
+  htm_v3_cross (&x, v, n);
+  return atan2 (htm_v3_dot (v, n), htm_v3_norm (&x));
+}
+
+/*  Classifies a cap against the half-space of points v with v.n >= 0.
+    Returns 1 if the cap is inside, -1 if it is outside, and 0 otherwise.
+ */
+static int _htm_cap_halfspace (const struct _htm_cap *cap,
+                               const struct htm_v3 *n)
+{
+  double alpha = _htm_plane_angle (&cap->cen, n);
+  if (alpha > cap->radius + _HTM_CAPCOV_EPS)
+    {
+      return 1;
+    }
+  else if (alpha < -cap->radius - _HTM_CAPCOV_EPS)
+    {
+      return -1;
+    }
+  return 0;
+}
+
+static enum _htm_cov _htm_s2circle_capcov (const struct _htm_cap *cap,
+                                           const struct htm_s2region *r)
+{
+  struct htm_v3 x;
+  double delta, radius;
+
+  if (r->dist2 < 0.0)
+    {
+      return HTM_DISJOINT;
+    }
+  else if (r->dist2 >= 4.0)
+    {
+      return HTM_INSIDE;
+    }
+  radius = 2.0 * asin (0.5 * sqrt (r->dist2));
+  htm_v3_cross (&x, &cap->cen, &r->cen);
+  delta = atan2 (htm_v3_norm (&x), htm_v3_dot (&cap->cen, &r->cen));
+  if (delta > radius + cap->radius + _HTM_CAPCOV_EPS)
+    {
+      return HTM_DISJOINT;
+    }
+  else if (delta + cap->radius < radius - _HTM_CAPCOV_EPS)
+    {
+      return HTM_INSIDE;
+    }
+  return HTM_INTERSECT;
+}
+
+static enum _htm_cov _htm_s2ellipse_capcov (const struct _htm_cap *cap,
+                                            const struct htm_s2ellipse *e)
+{
+  struct htm_v3 x;
+  double delta;
+
+  /* an ellipse lies within a circle of radius a around its center */
+  htm_v3_cross (&x, &cap->cen, &e->cen);
+  delta = atan2 (htm_v3_norm (&x), htm_v3_dot (&cap->cen, &e->cen));
+  if (delta > e->a * HTM_RAD_PER_DEG + cap->radius + _HTM_CAPCOV_EPS)
+    {
+      return HTM_DISJOINT;
+    }
+  return HTM_INTERSECT;
+}
+
+static enum _htm_cov _htm_s2cpoly_capcov (const struct _htm_cap *cap,
+                                          const struct htm_s2cpoly *p)
+{
+  size_t i;
+  int inside = 1;
+
+  for (i = 0; i < p->n; ++i)
+    {
+      int h = _htm_cap_halfspace (cap, &p->ve[p->n + i]);
+      if (h < 0)
+        {
+          return HTM_DISJOINT;
+        }
+      inside = inside && h > 0;
+    }
+  return inside ? HTM_INSIDE : HTM_INTERSECT;
+}
+
+static enum _htm_cov _htm_s2box_capcov (const struct _htm_cap *cap,
+                                        const struct htm_s2box *box)
+{
+  const double latmin = box->latmin * HTM_RAD_PER_DEG;
+  const double latmax = box->latmax * HTM_RAD_PER_DEG;
+  double lat, lo, hi;
+  int band, lon, w, e;
+
+  /* latitude range of the cap */
+  lat = atan2 (cap->cen.z,
+               sqrt (cap->cen.x * cap->cen.x + cap->cen.y * cap->cen.y));
+  lo = lat - cap->radius;
+  hi = lat + cap->radius;
+  if (hi < latmin - _HTM_CAPCOV_EPS || lo > latmax + _HTM_CAPCOV_EPS)
+    {
+      return HTM_DISJOINT;
+    }
+  band = (box->latmin <= -90.0 || lo > latmin + _HTM_CAPCOV_EPS)
+         && (box->latmax >= 90.0 || hi < latmax - _HTM_CAPCOV_EPS);
+
+  /* longitude range of the box, as a combination of meridian half-spaces */
+  if (box->width >= 360.0)
+    {
+      lon = 1;
+    }
+  else
+    {
+      w = _htm_cap_halfspace (cap, &box->w);
+      e = _htm_cap_halfspace (cap, &box->e);
+      if (box->width <= 180.0)
+        {
+          if (w < 0 || e < 0)
+            {
+              return HTM_DISJOINT;
+            }
+          lon = w > 0 && e > 0;
+        }
+      else
+        {
+          if (w < 0 && e < 0)
+            {
+              return HTM_DISJOINT;
+            }
+          lon = w > 0 || e > 0;
+        }
+    }
+  return (band && lon) ? HTM_INSIDE : HTM_INTERSECT;
+}
+
+/*  Returns the coverage code describing the spatial relationship between
+    the points inside a bounding cap and a spherical region: HTM_DISJOINT
+    if no point inside the cap can belong to the region, HTM_INSIDE if
+    all of them do, and HTM_INTERSECT when this cannot be decided from the
+    cap alone. HTM_CONTAINS is never returned, since a cap says nothing
+    about the extent of its HTM triangle.
+ */
+enum _htm_cov _htm_s2region_capcov (const struct _htm_cap *cap,
+                                    const struct htm_s2region *r)
+{
+  enum _htm_cov c1, c2;
+
+  switch (r->type)
+    {
+    case HTM_S2REGION_CIRCLE:
+      return _htm_s2circle_capcov (cap, r);
+    case HTM_S2REGION_ELLIPSE:
+      return _htm_s2ellipse_capcov (cap, &r->ellipse);
+    case HTM_S2REGION_CPOLY:
+      return _htm_s2cpoly_capcov (cap, r->poly);
+    case HTM_S2REGION_BOX:
+      return _htm_s2box_capcov (cap, &r->box);
+    case HTM_S2REGION_UNION:
+      c1 = _htm_s2region_capcov (cap, r->op[0]);
+      if (c1 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      c2 = _htm_s2region_capcov (cap, r->op[1]);
+      if (c2 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      else if (c1 == HTM_DISJOINT && c2 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      return HTM_INTERSECT;
+    case HTM_S2REGION_ISECT:
+      c1 = _htm_s2region_capcov (cap, r->op[0]);
+      if (c1 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      c2 = _htm_s2region_capcov (cap, r->op[1]);
+      if (c2 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (c1 == HTM_INSIDE && c2 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      return HTM_INTERSECT;
+    case HTM_S2REGION_DIFF:
+      c1 = _htm_s2region_capcov (cap, r->op[0]);
+      if (c1 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      c2 = _htm_s2region_capcov (cap, r->op[1]);
+      if (c2 == HTM_INSIDE)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (c1 == HTM_INSIDE && c2 == HTM_DISJOINT)
+        {
+          return HTM_INSIDE;
+        }
+      return HTM_INTERSECT;
+    }
+  return HTM_INTERSECT;
+}
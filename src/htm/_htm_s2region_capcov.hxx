@@ -0,0 +1,6 @@
+#pragma once
+
+#include "htm.hxx"
+
+enum _htm_cov _htm_s2region_capcov (const struct _htm_cap *cap,
+                                    const struct htm_s2region *r);
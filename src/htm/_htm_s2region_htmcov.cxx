@@ -0,0 +1,129 @@
+#include "htm.hxx"
+#include "htm/_htm_s2box_htmcov.hxx"
+#include "htm/_htm_s2circle_htmcov.hxx"
+#include "htm/_htm_s2cpoly_htmcov.hxx"
+#include "htm/_htm_s2ellipse_htmcov.hxx"
+#include "htm/_htm_s2region_htmcov.hxx"
+
+/*  Returns the coverage code describing the spatial relationship between the
+    given HTM triangle and spherical region. The coverage of a composite
+    region is derived from the coverage of its operands, without ever
+    computing a boundary for the composite itself. When the relationship
+    cannot be decided from the operands, HTM_INTERSECT is returned - this
+    is always safe, since points in intersecting leaves are tested
+    individually.
+
+    \p ab must point to at least _htm_s2region_absz(r) doubles of scratch
+    space.
+ */
+enum _htm_cov _htm_s2region_htmcov (const struct _htm_node *n,
+                                    const struct htm_s2region *r, double *ab)
+{
+  enum _htm_cov c1, c2;
+
+  switch (r->type)
+    {
+    case HTM_S2REGION_CIRCLE:
+      if (r->dist2 < 0.0)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (r->dist2 >= 4.0)
+        {
+          return HTM_INSIDE;
+        }
+      return _htm_s2circle_htmcov (n, &r->cen, r->dist2);
+    case HTM_S2REGION_ELLIPSE:
+      return _htm_s2ellipse_htmcov (n, &r->ellipse);
+    case HTM_S2REGION_CPOLY:
+      return _htm_s2cpoly_htmcov (n, r->poly, ab);
+    case HTM_S2REGION_BOX:
+      return _htm_s2box_htmcov (n, &r->box);
+    case HTM_S2REGION_UNION:
+      c1 = _htm_s2region_htmcov (n, r->op[0], ab);
+      if (c1 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      c2 = _htm_s2region_htmcov (n, r->op[1], ab);
+      if (c2 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      else if (c1 == HTM_DISJOINT && c2 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (c1 == HTM_CONTAINS && c2 == HTM_CONTAINS)
+        {
+          /* both operands, and hence their union, are inside the triangle */
+          return HTM_CONTAINS;
+        }
+      return HTM_INTERSECT;
+    case HTM_S2REGION_ISECT:
+      c1 = _htm_s2region_htmcov (n, r->op[0], ab);
+      if (c1 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      c2 = _htm_s2region_htmcov (n, r->op[1], ab);
+      if (c2 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (c1 == HTM_INSIDE && c2 == HTM_INSIDE)
+        {
+          return HTM_INSIDE;
+        }
+      else if (c1 == HTM_CONTAINS || c2 == HTM_CONTAINS)
+        {
+          /* the intersection is a subset of an operand inside the triangle */
+          return HTM_CONTAINS;
+        }
+      return HTM_INTERSECT;
+    case HTM_S2REGION_DIFF:
+      c1 = _htm_s2region_htmcov (n, r->op[0], ab);
+      if (c1 == HTM_DISJOINT)
+        {
+          return HTM_DISJOINT;
+        }
+      c2 = _htm_s2region_htmcov (n, r->op[1], ab);
+      if (c2 == HTM_INSIDE)
+        {
+          return HTM_DISJOINT;
+        }
+      else if (c1 == HTM_INSIDE && c2 == HTM_DISJOINT)
+        {
+          return HTM_INSIDE;
+        }
+      else if (c1 == HTM_CONTAINS)
+        {
+          return HTM_CONTAINS;
+        }
+      return HTM_INTERSECT;
+    }
+  return HTM_INTERSECT;
+}
+
+/*  Returns the number of doubles of scratch space required by
+    _htm_s2region_htmcov() for the given region.
+ */
+size_t _htm_s2region_absz (const struct htm_s2region *r)
+{
+  size_t n1, n2;
+
+  switch (r->type)
+    {
+    case HTM_S2REGION_CPOLY:
+      return 2 * r->poly->n + 4;
+    case HTM_S2REGION_UNION:
+    case HTM_S2REGION_ISECT:
+    case HTM_S2REGION_DIFF:
+      n1 = _htm_s2region_absz (r->op[0]);
+      n2 = _htm_s2region_absz (r->op[1]);
+      return n1 > n2 ? n1 : n2;
+    default:
+      break;
+    }
+  return 0;
+}
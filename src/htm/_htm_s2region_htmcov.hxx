@@ -0,0 +1,8 @@
+#pragma once
+
+#include "htm.hxx"
+
+enum _htm_cov _htm_s2region_htmcov (const struct _htm_node *n,
+                                    const struct htm_s2region *r, double *ab);
+
+size_t _htm_s2region_absz (const struct htm_s2region *r);
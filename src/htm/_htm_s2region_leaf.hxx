@@ -0,0 +1,62 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include "tinyhtm/geometry.h"
+
+/*  Helpers that initialize a region consisting of a single primitive
+    shape, so that queries on primitive shapes can share the composite
+    region machinery. Such regions own no resources: polygons are
+    referenced rather than copied, and the regions must not be passed to
+    htm_s2region_destroy().
+ */
+
+inline void _htm_s2region_leaf_circle (struct htm_s2region *r,
+                                       const struct htm_v3 *cen,
+                                       double radius)
+{
+  memset (r, 0, sizeof(struct htm_s2region));
+  r->type = HTM_S2REGION_CIRCLE;
+  r->cen = *cen;
+  if (radius < 0.0)
+    {
+      /* empty circle */
+      r->dist2 = -1.0;
+    }
+  else if (radius >= 180.0)
+    {
+      /* entire sky */
+      r->dist2 = 5.0;
+    }
+  else
+    {
+      /* square of secant distance corresponding to radius */
+      r->dist2 = sin (radius * 0.5 * HTM_RAD_PER_DEG);
+      r->dist2 = 4.0 * r->dist2 * r->dist2;
+    }
+}
+
+inline void _htm_s2region_leaf_ellipse (struct htm_s2region *r,
+                                        const struct htm_s2ellipse *ellipse)
+{
+  memset (r, 0, sizeof(struct htm_s2region));
+  r->type = HTM_S2REGION_ELLIPSE;
+  r->ellipse = *ellipse;
+}
+
+inline void _htm_s2region_leaf_cpoly (struct htm_s2region *r,
+                                      const struct htm_s2cpoly *poly)
+{
+  memset (r, 0, sizeof(struct htm_s2region));
+  r->type = HTM_S2REGION_CPOLY;
+  r->poly = const_cast<struct htm_s2cpoly *>(poly);
+}
+
+inline void _htm_s2region_leaf_box (struct htm_s2region *r,
+                                    const struct htm_s2box *box)
+{
+  memset (r, 0, sizeof(struct htm_s2region));
+  r->type = HTM_S2REGION_BOX;
+  r->box = *box;
+}
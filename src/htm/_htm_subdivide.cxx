@@ -1,5 +1,6 @@
 #include "tinyhtm/varint.h"
 #include "htm.hxx"
+#include "_htm_fixed.hxx"
 
 /*  Constructs the next non-empty child of \p node.
  */
@@ -53,3 +54,65 @@ const unsigned char *_htm_subdivide (struct _htm_node *node,
   node->s = s;
   return s + (off - 1);
 }
+
+/*  Like _htm_subdivide(), but for the fixed-width children block at \p s
+    (see _htm_fixed.hxx). node->s is set to the block, and the count and
+    relative index of the constructed child are stored in \p count and
+    \p index. Returns NULL if no non-empty children remain, or if the
+    block is invalid.
+ */
+const unsigned char *_htm_subdivide_fixed (struct _htm_node *node,
+                                           const unsigned char *s,
+                                           uint64_t *count, uint64_t *index)
+{
+  uint64_t v[_HTM_FIXED_NVAL];
+  int c;
+  if (!_htm_fixed_decode (v, s))
+    {
+      return NULL;
+    }
+  switch (node->child)
+    {
+    case 0:
+      _htm_node_prep0 (node);
+      _htm_node_make0 (node);
+      if (v[2] != 0)
+        {
+          c = 0;
+          break;
+        }
+    /* fall-through */
+    case 1:
+      _htm_node_prep1 (node);
+      _htm_node_make1 (node);
+      if (v[5] != 0)
+        {
+          c = 1;
+          break;
+        }
+    /* fall-through */
+    case 2:
+      _htm_node_prep2 (node);
+      _htm_node_make2 (node);
+      if (v[8] != 0)
+        {
+          c = 2;
+          break;
+        }
+    /* fall-through */
+    case 3:
+      if (v[11] != 0)
+        {
+          _htm_node_make3 (node);
+          c = 3;
+          break;
+        }
+      return NULL;
+    default:
+      return NULL;
+    }
+  node->s = s;
+  *count = v[3 * c];
+  *index = v[3 * c + 1];
+  return s + _htm_fixed_size (s[0]) + (v[3 * c + 2] - 1);
+}
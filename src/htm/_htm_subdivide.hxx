@@ -4,3 +4,7 @@
 
 const unsigned char *_htm_subdivide (struct _htm_node *node,
                                      const unsigned char *s);
+
+const unsigned char *_htm_subdivide_fixed (struct _htm_node *node,
+                                           const unsigned char *s,
+                                           uint64_t *count, uint64_t *index);
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <endian.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tinyhtm/tree.h"
+#include "tinyhtm/varint.h"
+#include "htm.hxx"
+#include "_htm_cap.hxx"
+
+/*  Succinct indexes (HTM_TREE_SUCCINCT) store no child offsets. Nodes are
+    numbered in level order, starting with the 8 roots (S0 through N3, and
+    present even if empty), and the tree shape is stored as a bit-vector
+    holding a 4 bit child mask per node (bit c is set if child c is
+    non-empty). Since the children of nodes 0 through i - 1 precede those
+    of node i, the first child of node i is node 8 + rank(4i), where
+    rank(b) is the number of 1 bits in the first b bits of the vector.
+    Children partition the points of their parent in order, so node
+    indexes are not stored either: they are the sums of the counts of
+    preceding roots or siblings.
+
+    Following the header, the index consists of 2 varints, the number of
+    nodes N and the number of words W holding node counts, followed by
+    little-endian 64 bit words:
+
+        ceil(N/16)  mask words (node i in bits [4(i%16), 4(i%16) + 4) of
+                    word i/16)
+        ceil(N/128) rank words (the # of 1 bits in preceding mask words,
+                    sampled every 8 words)
+        ceil(N/64)  count directory words, one per group of 64 nodes: the
+                    bit offset of the group counts, shifted left by 7, and
+                    their bit width (0-64) in the low 7 bits
+        W + 1       words of bit-packed counts, the last one being padding
+
+    followed, with HTM_TREE_CAPS, by N bounding caps of _HTM_CAP_SIZE bytes.
+ */
+struct _htm_succinct
+{
+  uint64_t n;                  /* # of nodes */
+  const unsigned char *masks;  /* child mask words */
+  const unsigned char *rank;   /* rank samples */
+  const unsigned char *cdir;   /* count directory */
+  const unsigned char *counts; /* bit-packed counts */
+  const unsigned char *caps;   /* bounding caps, or NULL */
+  const unsigned char *end;    /* end of the index */
+};
+
+HTM_INLINE uint64_t _htm_succinct_word (const unsigned char *s, uint64_t i)
+{
+  uint64_t w;
+  memcpy (&w, s + 8 * i, sizeof(w));
+  return le64toh (w);
+}
+
+/*  Locates the sections of the succinct index starting at \p s, for a
+    tree with the given format flags. Returns a pointer to the end of the
+    index.
+ */
+HTM_INLINE const unsigned char *_htm_succinct_init (struct _htm_succinct *sx,
+                                                    const unsigned char *s,
+                                                    uint64_t flags)
+{
+  uint64_t nwords;
+  sx->n = htm_varint_decode (s);
+  s += 1 + htm_varint_nfollow (*s);
+  nwords = htm_varint_decode (s);
+  s += 1 + htm_varint_nfollow (*s);
+  sx->masks = s;
+  sx->rank = sx->masks + 8 * ((sx->n + 15) / 16);
+  sx->cdir = sx->rank + 8 * ((sx->n + 127) / 128);
+  sx->counts = sx->cdir + 8 * ((sx->n + 63) / 64);
+  sx->caps = NULL;
+  sx->end = sx->counts + 8 * (nwords + 1);
+  if ((flags & HTM_TREE_CAPS) != 0)
+    {
+      sx->caps = sx->end;
+      sx->end += _HTM_CAP_SIZE * sx->n;
+    }
+  return sx->end;
+}
+
+/*  Returns the child mask of node i.
+ */
+HTM_INLINE unsigned int _htm_succinct_mask (const struct _htm_succinct *sx,
+                                            uint64_t i)
+{
+  return (unsigned int)(_htm_succinct_word (sx->masks, i >> 4)
+                        >> (4 * (i & 15))) & 15;
+}
+
+/*  Returns the number of the first child of node i.
+ */
+HTM_INLINE uint64_t _htm_succinct_first (const struct _htm_succinct *sx,
+                                         uint64_t i)
+{
+  const uint64_t w = i >> 4;
+  uint64_t r = _htm_succinct_word (sx->rank, i >> 7);
+  uint64_t j;
+  for (j = w & ~(uint64_t)7; j < w; ++j)
+    {
+      r += htm_popcount (_htm_succinct_word (sx->masks, j));
+    }
+  r += htm_popcount (_htm_succinct_word (sx->masks, w)
+                     & ((UINT64_C (1) << (4 * (i & 15))) - 1));
+  return 8 + r;
+}
+
+/*  Returns the number of the child of node i with the given mask, whose
+    first child is node first.
+ */
+HTM_INLINE uint64_t _htm_succinct_child (uint64_t first, unsigned int mask,
+                                         int c)
+{
+  return first + htm_popcount (mask & ((1u << c) - 1));
+}
+
+/*  Returns the bit width of the count of node i.
+ */
+HTM_INLINE unsigned int _htm_succinct_width (const struct _htm_succinct *sx,
+                                             uint64_t i)
+{
+  return (unsigned int)(_htm_succinct_word (sx->cdir, i >> 6) & 127);
+}
+
+/*  Returns the point count of node i.
+ */
+HTM_INLINE uint64_t _htm_succinct_count (const struct _htm_succinct *sx,
+                                         uint64_t i)
+{
+  const uint64_t d = _htm_succinct_word (sx->cdir, i >> 6);
+  const unsigned int w = (unsigned int)(d & 127);
+  const uint64_t bit = (d >> 7) + (i & 63) * w;
+  const unsigned int sh = (unsigned int)(bit & 63);
+  uint64_t v;
+  if (w == 0)
+    {
+      return 0;
+    }
+  v = _htm_succinct_word (sx->counts, bit >> 6) >> sh;
+  if (sh + w > 64)
+    {
+      v |= _htm_succinct_word (sx->counts, (bit >> 6) + 1) << (64 - sh);
+    }
+  return (w == 64) ? v : v & ((UINT64_C (1) << w) - 1);
+}
+
+/*  Sets node[1] to the next non-empty child of \p node, given its child
+    mask, and returns the number (0-3) of that child, or -1 if no
+    non-empty children remain.
+ */
+HTM_INLINE int _htm_subdivide_mask (struct _htm_node *node, unsigned int mask)
+{
+  switch (node->child)
+    {
+    case 0:
+      _htm_node_prep0 (node);
+      _htm_node_make0 (node);
+      if ((mask & 1) != 0)
+        {
+          return 0;
+        }
+    /* fall-through */
+    case 1:
+      _htm_node_prep1 (node);
+      _htm_node_make1 (node);
+      if ((mask & 2) != 0)
+        {
+          return 1;
+        }
+    /* fall-through */
+    case 2:
+      _htm_node_prep2 (node);
+      _htm_node_make2 (node);
+      if ((mask & 4) != 0)
+        {
+          return 2;
+        }
+    /* fall-through */
+    case 3:
+      if ((mask & 8) != 0)
+        {
+          _htm_node_make3 (node);
+          return 3;
+        }
+    /* fall-through */
+    default:
+      break;
+    }
+  return -1;
+}
@@ -0,0 +1,192 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "htm/_htm_tree_layout.hxx"
+
+/*  A layout descriptor is stored next to its data file, as
+    <datafile>.layout. All fields are native-endian:
+
+        char[8]  magic ("HTMLAYT2")
+        uint64   data file device, inode, size
+        int64    data file modification time (seconds, nanoseconds)
+        uint64   data offset, data size, index offset, index size
+        uint64   entry size, number of entry members
+        uint64   prefix count table offset, prefix count table size
+        per member:
+            uint32   type code (index into _htm_layout_types + 1)
+            uint32   name length, followed by the name bytes
+
+    The index header is not cached: it is parsed straight from the data
+    file memory map.
+ */
+static const char _htm_layout_magic[8]
+    = { 'H', 'T', 'M', 'L', 'A', 'Y', 'T', '2' };
+
+/*  Member types that can be recorded in a layout descriptor.
+ */
+static const H5::PredType *const _htm_layout_types[]
+    = { &H5::PredType::NATIVE_INT8,   &H5::PredType::NATIVE_UINT8,
+        &H5::PredType::NATIVE_INT16,  &H5::PredType::NATIVE_UINT16,
+        &H5::PredType::NATIVE_INT32,  &H5::PredType::NATIVE_UINT32,
+        &H5::PredType::NATIVE_INT64,  &H5::PredType::NATIVE_UINT64,
+        &H5::PredType::NATIVE_FLOAT,  &H5::PredType::NATIVE_DOUBLE };
+
+#define HTM_LAYOUT_NTYPES \
+  (sizeof(_htm_layout_types) / sizeof(_htm_layout_types[0]))
+
+/*  Upper bound on member name lengths, to reject corrupt descriptors.
+ */
+#define HTM_LAYOUT_MAXNAME 4096
+
+static std::string _htm_layout_path (const char *datafile)
+{
+  return std::string (datafile) + ".layout";
+}
+
+static void _htm_layout_stat (uint64_t *w, const struct stat *sb)
+{
+  w[0] = (uint64_t)sb->st_dev;
+  w[1] = (uint64_t)sb->st_ino;
+  w[2] = (uint64_t)sb->st_size;
+  w[3] = (uint64_t)sb->st_mtim.tv_sec;
+  w[4] = (uint64_t)sb->st_mtim.tv_nsec;
+}
+
+int _htm_tree_layout_read (struct htm_tree *tree, const char *datafile,
+                           const struct stat *sb, size_t *index_offset,
+                           size_t *prefix_offset, size_t *prefixsz)
+{
+  const std::string path = _htm_layout_path (datafile);
+  char magic[8];
+  uint64_t st[5], expect[5], w[8];
+  uint32_t code, len;
+  FILE *f;
+  int ok = 0;
+
+  f = fopen (path.c_str (), "rb");
+  if (f == NULL)
+    {
+      return 0;
+    }
+  _htm_layout_stat (expect, sb);
+  if (fread (magic, sizeof(magic), 1, f) != 1
+      || memcmp (magic, _htm_layout_magic, sizeof(magic)) != 0
+      || fread (st, sizeof(st), 1, f) != 1
+      || memcmp (st, expect, sizeof(st)) != 0
+      || fread (w, sizeof(w), 1, f) != 1)
+    {
+      goto done;
+    }
+  try
+    {
+      std::vector<std::string> names;
+      std::vector<H5::DataType> types;
+      names.reserve (w[5]);
+      types.reserve (w[5]);
+      for (uint64_t i = 0; i < w[5]; ++i)
+        {
+          if (fread (&code, sizeof(code), 1, f) != 1
+              || fread (&len, sizeof(len), 1, f) != 1 || code == 0
+              || code > HTM_LAYOUT_NTYPES || len > HTM_LAYOUT_MAXNAME)
+            {
+              goto done;
+            }
+          std::string name (len, '\0');
+          if (len != 0 && fread (&name[0], len, 1, f) != 1)
+            {
+              goto done;
+            }
+          names.push_back (name);
+          types.push_back (*_htm_layout_types[code - 1]);
+        }
+      tree->offset = (off_t)w[0];
+      tree->datasz = (hsize_t)w[1];
+      *index_offset = (size_t)w[2];
+      tree->indexsz = (size_t)w[3];
+      tree->entry_size = (size_t)w[4];
+      tree->num_elements_per_entry = (size_t)w[5];
+      *prefix_offset = (size_t)w[6];
+      *prefixsz = (size_t)w[7];
+      tree->element_names.swap (names);
+      tree->element_types.swap (types);
+      ok = 1;
+    }
+  catch (std::exception &e)
+    {
+      ok = 0;
+    }
+done:
+  fclose (f);
+  return ok;
+}
+
+void _htm_tree_layout_write (const struct htm_tree *tree,
+                             const char *datafile, const struct stat *sb,
+                             size_t index_offset, size_t prefix_offset,
+                             size_t prefixsz)
+{
+  const std::string path = _htm_layout_path (datafile);
+  const std::string tmp = path + "." + std::to_string (getpid ());
+  std::vector<uint32_t> codes;
+  uint64_t st[5], w[8];
+  FILE *f;
+  int ok;
+
+  /* only native numeric members can be described */
+  try
+    {
+      for (size_t i = 0; i < tree->num_elements_per_entry; ++i)
+        {
+          uint32_t code = 0;
+          for (size_t t = 0; t < HTM_LAYOUT_NTYPES && code == 0; ++t)
+            {
+              if (tree->element_types.at (i) == *_htm_layout_types[t])
+                {
+                  code = (uint32_t)(t + 1);
+                }
+            }
+          if (code == 0)
+            {
+              return;
+            }
+          codes.push_back (code);
+        }
+    }
+  catch (std::exception &e)
+    {
+      return;
+    }
+  _htm_layout_stat (st, sb);
+  w[0] = (uint64_t)tree->offset;
+  w[1] = (uint64_t)tree->datasz;
+  w[2] = (uint64_t)index_offset;
+  w[3] = (uint64_t)tree->indexsz;
+  w[4] = (uint64_t)tree->entry_size;
+  w[5] = (uint64_t)tree->num_elements_per_entry;
+  w[6] = (uint64_t)prefix_offset;
+  w[7] = (uint64_t)prefixsz;
+
+  f = fopen (tmp.c_str (), "wb");
+  if (f == NULL)
+    {
+      return;
+    }
+  ok = fwrite (_htm_layout_magic, sizeof(_htm_layout_magic), 1, f) == 1
+       && fwrite (st, sizeof(st), 1, f) == 1
+       && fwrite (w, sizeof(w), 1, f) == 1;
+  for (size_t i = 0; ok && i < codes.size (); ++i)
+    {
+      const std::string &name = tree->element_names[i];
+      uint32_t len = (uint32_t)name.size ();
+      ok = fwrite (&codes[i], sizeof(uint32_t), 1, f) == 1
+           && fwrite (&len, sizeof(len), 1, f) == 1
+           && (len == 0 || fwrite (name.data (), len, 1, f) == 1);
+    }
+  if (fclose (f) != 0 || !ok || rename (tmp.c_str (), path.c_str ()) != 0)
+    {
+      unlink (tmp.c_str ());
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include "tinyhtm/tree.h"
+
+/*  Loads the layout of \p datafile (dataset offsets and sizes, entry member
+    names and types) from its layout descriptor, if there is one and it
+    is up to date with respect to \p sb. Returns 1 on success, and 0 if
+    the layout must be read with HDF5 instead.
+ */
+int _htm_tree_layout_read (struct htm_tree *tree, const char *datafile,
+                           const struct stat *sb, size_t *index_offset,
+                           size_t *prefix_offset, size_t *prefixsz);
+
+/*  Writes the layout descriptor of \p datafile, so that later opens can
+    skip HDF5. Failures are silently ignored: the descriptor is only a
+    cache.
+ */
+void _htm_tree_layout_write (const struct htm_tree *tree,
+                             const char *datafile, const struct stat *sb,
+                             size_t index_offset, size_t prefix_offset,
+                             size_t prefixsz);
@@ -0,0 +1,313 @@
+#pragma once
+
+#include "tinyhtm/tree.h"
+#include "tinyhtm/varint.h"
+#include "htm.hxx"
+#include "_htm_cap.hxx"
+#include "_htm_fixed.hxx"
+#include "_htm_succinct.hxx"
+#include "_htm_subdivide.hxx"
+#include "_htm_query_stats.hxx"
+
+/*  _htm_tree_search() for succinct indexes (HTM_TREE_SUCCINCT).
+ */
+template <typename Cov, typename CapCov, typename Visit, typename Stats>
+enum htm_errcode _htm_tree_search_succinct (const struct htm_tree *tree,
+                                            Cov &&cov, CapCov &&capcov,
+                                            Visit &&visit, const int maxlevel,
+                                            Stats &&stats)
+{
+  struct _htm_succinct sx;
+  struct _htm_path path;
+  struct _htm_cap cap;
+  /* per level: child mask and first child # of the node being subdivided,
+     and the data file index of its next child */
+  unsigned int mask[HTM_MAX_LEVEL + 1];
+  uint64_t first[HTM_MAX_LEVEL + 1];
+  uint64_t next[HTM_MAX_LEVEL + 1];
+  uint64_t rootindex = 0;
+  const bool adaptive = (tree->flags & HTM_TREE_ADAPTIVE) != 0;
+
+  _htm_succinct_init (&sx, tree->root[0], tree->flags);
+  for (int root = HTM_S0; root <= HTM_N3; ++root)
+    {
+      struct _htm_node *curnode = path.node;
+      uint64_t i = (uint64_t)root;
+      uint64_t curcount = _htm_succinct_count (&sx, i);
+      int level = 0;
+      int c;
+
+      if (curcount == 0)
+        {
+          /* root contains no points */
+          continue;
+        }
+      _htm_path_root (&path, static_cast<htm_root>(root));
+      curnode->index = rootindex;
+      rootindex += curcount;
+
+      while (1)
+        {
+          enum _htm_cov coverage = HTM_INTERSECT;
+          size_t nbytes = (_htm_succinct_width (&sx, i) + 7) / 8;
+          if (sx.caps != NULL)
+            {
+              _htm_cap_decode (&cap, sx.caps + _HTM_CAP_SIZE * i);
+              nbytes += _HTM_CAP_SIZE;
+              coverage = capcov (&cap);
+            }
+          if (coverage == HTM_INTERSECT)
+            {
+              coverage = cov (curnode);
+            }
+          stats.node (level, coverage, nbytes);
+          if (coverage == HTM_CONTAINS)
+            {
+              if (level == 0)
+                {
+                  /* no need to consider other roots */
+                  root = HTM_N3;
+                }
+              else
+                {
+                  /* no need to consider other children of parent */
+                  curnode[-1].child = 4;
+                }
+            }
+          if (coverage == HTM_CONTAINS || coverage == HTM_INTERSECT)
+            {
+              if (level < tree->depth && level < maxlevel
+                  && (adaptive || curcount >= tree->leafthresh))
+                {
+                  /* leaves of adaptive trees have empty child masks */
+                  mask[level] = _htm_succinct_mask (&sx, i);
+                  if (mask[level] == 0 && !adaptive)
+                    {
+                      /* tree is invalid */
+                      return HTM_EINV;
+                    }
+                  if (mask[level] != 0)
+                    {
+                      first[level] = _htm_succinct_first (&sx, i);
+                      next[level] = curnode->index;
+                      /* a mask word and a rank sample */
+                      stats.index (16);
+                      c = _htm_subdivide_mask (curnode, mask[level]);
+                      goto descend;
+                    }
+                }
+            }
+          if (coverage != HTM_DISJOINT)
+            {
+              visit (coverage, curnode, curcount);
+            }
+
+        /* ascend towards the root */
+        ascend:
+          --level;
+          --curnode;
+          while (level >= 0 && curnode->child == 4)
+            {
+              --curnode;
+              --level;
+            }
+          if (level < 0)
+            {
+              /* finished with this root */
+              break;
+            }
+          c = _htm_subdivide_mask (curnode, mask[level]);
+          if (c < 0)
+            {
+              /* no non-empty children remain */
+              goto ascend;
+            }
+
+        descend:
+          i = _htm_succinct_child (first[level], mask[level], c);
+          curcount = _htm_succinct_count (&sx, i);
+          curnode[1].index = next[level];
+          next[level] += curcount;
+          ++level;
+          ++curnode;
+        }
+    }
+  return HTM_OK;
+}
+
+/*  Performs a depth-first traversal of the index of \p tree, restricted to
+    the nodes overlapping a region.
+
+    \p cov(node) must return the coverage code of the given HTM triangle
+    with respect to the region. If the index stores node bounding caps
+    (HTM_TREE_CAPS), \p capcov(cap) is consulted first: it must return
+    HTM_DISJOINT or HTM_INSIDE if the points inside the cap are known to
+    be outside or inside the region, and HTM_INTERSECT otherwise, in which
+    case \p cov is used. \p visit(coverage, node, count) is invoked
+    for every overlapping node that is not subdivided further, i.e. for
+    nodes fully inside the region and for leaves that merely intersect it.
+    The points of such a node are stored at data file indexes
+    [node->index, node->index + count). Nodes at level \p maxlevel, or
+    at the depth of the tree, are never subdivided, and are visited like
+    leaves. Visited nodes and the
+    index bytes decoded are tallied in \p stats (see _htm_stats). Both
+    varint, fixed-width (HTM_TREE_FIXED) and succinct (HTM_TREE_SUCCINCT)
+    indexes are supported.
+
+    Returns HTM_OK on success, and HTM_EINV if the index is invalid.
+ */
+template <typename Cov, typename CapCov, typename Visit,
+          typename Stats = _htm_nostats>
+enum htm_errcode _htm_tree_search (const struct htm_tree *tree, Cov &&cov,
+                                   CapCov &&capcov, Visit &&visit,
+                                   const int maxlevel = HTM_MAX_LEVEL,
+                                   Stats &&stats = Stats ())
+{
+  const bool caps = (tree->flags & HTM_TREE_CAPS) != 0;
+  const bool fixed = (tree->flags & HTM_TREE_FIXED) != 0;
+  const bool adaptive = (tree->flags & HTM_TREE_ADAPTIVE) != 0;
+  if ((tree->flags & HTM_TREE_SUCCINCT) != 0)
+    {
+      return _htm_tree_search_succinct (tree, cov, capcov, visit, maxlevel,
+                                        stats);
+    }
+  struct _htm_path path;
+  struct _htm_cap cap;
+
+  for (int root = HTM_S0; root <= HTM_N3; ++root)
+    {
+      struct _htm_node *curnode = path.node;
+      const unsigned char *s = tree->root[root];
+      uint64_t index = 0;
+      uint64_t curcount = 0;
+      uint64_t delta = 0;
+      bool internal;
+      int level = 0;
+
+      if (s == NULL)
+        {
+          /* root contains no points */
+          continue;
+        }
+      _htm_path_root (&path, static_cast<htm_root>(root));
+
+      while (1)
+        {
+          const unsigned char *const beg = s;
+          if (!fixed || level == 0)
+            {
+              /* in fixed-width indexes, only roots store their count and
+                 index; those of other nodes come from their parent */
+              curcount = htm_varint_decode (s);
+              s += 1 + htm_varint_nfollow (*s);
+              delta = htm_varint_decode (s);
+              s += 1 + htm_varint_nfollow (*s);
+            }
+          if (adaptive)
+            {
+              /* the low bit of stored counts marks internal nodes */
+              internal = (curcount & 1) != 0;
+              curcount >>= 1;
+            }
+          else
+            {
+              internal = curcount >= tree->leafthresh;
+            }
+          index += delta;
+          curnode->index = index;
+
+          enum _htm_cov coverage = HTM_INTERSECT;
+          if (caps)
+            {
+              s = _htm_cap_decode (&cap, s);
+              coverage = capcov (&cap);
+            }
+          if (coverage == HTM_INTERSECT)
+            {
+              coverage = cov (curnode);
+            }
+          stats.node (level, coverage, (size_t)(s - beg));
+          if (coverage == HTM_CONTAINS)
+            {
+              if (level == 0)
+                {
+                  /* no need to consider other roots */
+                  root = HTM_N3;
+                }
+              else
+                {
+                  /* no need to consider other children of parent */
+                  curnode[-1].child = 4;
+                }
+            }
+          if (coverage == HTM_CONTAINS || coverage == HTM_INTERSECT)
+            {
+              if (level < tree->depth && level < maxlevel && internal)
+                {
+                  const unsigned char *const children = s;
+                  if (fixed)
+                    {
+                      s = _htm_subdivide_fixed (curnode, s, &curcount,
+                                                &delta);
+                    }
+                  else
+                    {
+                      s = _htm_subdivide (curnode, s);
+                    }
+                  if (s == NULL)
+                    {
+                      /* tree is invalid */
+                      return HTM_EINV;
+                    }
+                  stats.index (fixed ? _htm_fixed_size (*children)
+                                     : (size_t)(curnode->s - children));
+                  ++level;
+                  ++curnode;
+                  continue;
+                }
+            }
+          if (coverage != HTM_DISJOINT)
+            {
+              visit (coverage, curnode, curcount);
+            }
+
+        /* ascend towards the root */
+        ascend:
+          --level;
+          --curnode;
+          while (level >= 0 && curnode->child == 4)
+            {
+              --curnode;
+              --level;
+            }
+          if (level < 0)
+            {
+              /* finished with this root */
+              break;
+            }
+          index = curnode->index;
+          {
+            const unsigned char *const children = curnode->s;
+            if (fixed)
+              {
+                /* the children block was tallied on the way down */
+                s = _htm_subdivide_fixed (curnode, children, &curcount,
+                                          &delta);
+              }
+            else
+              {
+                s = _htm_subdivide (curnode, children);
+              }
+            if (s == NULL)
+              {
+                /* no non-empty children remain */
+                goto ascend;
+              }
+            stats.index ((size_t)(curnode->s - children));
+          }
+          ++level;
+          ++curnode;
+        }
+    }
+  return HTM_OK;
+}
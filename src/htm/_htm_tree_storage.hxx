@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tinyhtm/tree.h"
+#include "_htm_tree_search.hxx"
+
+/*  Location of a compressed data file chunk.
+ */
+struct _htm_chunk
+{
+  uint64_t addr;        /* file offset of the stored chunk */
+  uint64_t size;        /* size of the stored chunk (bytes) */
+  unsigned int mask;    /* bit i set: filter i was not applied */
+};
+
+/*  A filter in the pipeline of a chunked data set.
+ */
+struct _htm_filter
+{
+  int id;
+  std::vector<unsigned int> cd_values;
+};
+
+/*  The chunks of a chunked (and usually compressed) data set, in row
+    order, along with the filter pipeline applied to them.
+ */
+struct _htm_chunk_table
+{
+  uint64_t rows;        /* # of rows per chunk */
+  uint64_t nrows;       /* # of rows in the data set */
+  std::vector<struct _htm_chunk> chunks;
+  std::vector<struct _htm_filter> filters;
+};
+
+/*  Reads the chunk table of a chunked HDF5 data set. Returns HTM_ETREE if
+    a chunk is missing, or if the data set uses a filter that cannot be
+    decoded.
+ */
+enum htm_errcode _htm_chunk_table_read (const H5::DataSet &dataset,
+                                        struct _htm_chunk_table *table);
+
+/*  Installs a storage backend that decodes the chunks of \p table on
+    demand, into a block cache. Trees with chunked data files have no
+    memory mapped points (tree->datasz is 0), and must be read through it.
+ */
+enum htm_errcode _htm_storage_chunked (struct htm_tree *tree,
+                                       struct _htm_chunk_table *table);
+
+/*  Returns true if the points of \p tree must be read through its
+    storage backend.
+ */
+bool _htm_storage_required (const struct _htm_storage *storage);
+
+/*  Releases a storage backend created by htm_tree_storage().
+ */
+void _htm_storage_destroy (struct _htm_storage *storage);
+
+/*  Asks the kernel to start reading the memory mapped rows [beg, end) in
+    the background. *done is the end of the range prefetched so far, and
+    is advanced past [beg, end); rows below it are not prefetched again.
+ */
+void _htm_prefetch_rows (const char *beg, const char *end,
+                         const char **done);
+
+/*  Reads batches of data file row spans through the block cache of a
+    non-mmap storage backend (see htm_tree_storage()).
+
+    Spans are queued with add(), and read with fetch(), which issues one
+    read per run of adjacent uncached blocks (or per chunk, for chunked
+    data files). The rows of the i-th queued
+    span are then available from rows(i) until clear() is called; blocks
+    are pinned in the meantime, even if the cache evicts them.
+ */
+class _htm_rows
+{
+public:
+  explicit _htm_rows (const struct htm_tree *tree);
+
+  void add (uint64_t index, uint64_t count);
+  enum htm_errcode fetch ();
+  void clear ();
+
+  size_t size () const { return spans.size (); }
+  const char *rows (size_t i) const { return ptrs[i]; }
+
+  /* Returns true once enough rows are queued to warrant a fetch(). */
+  bool full () const { return pending >= limit; }
+
+  /* Returns the # of rows, starting at index, that make up a batch. */
+  uint64_t span_rows (uint64_t index) const;
+
+private:
+  typedef std::shared_ptr<const std::vector<char> > block_ptr;
+
+  struct _htm_storage *storage;
+  size_t entry_size;
+  size_t limit;
+  size_t pending;
+  std::vector<std::pair<uint64_t, uint64_t> > spans;
+  std::vector<const char *> ptrs;
+  std::unordered_map<uint64_t, block_ptr> pins;
+  std::deque<std::vector<char> > scratch;
+};
+
+/*  Like _htm_tree_search(), but hands the data file rows of visited nodes
+    to \p leaf(coverage, entries, count). \p need(coverage, node) is
+    invoked as each node is visited, and must return whether the rows of
+    the node are needed; if not, \p entries is NULL.
+
+    With the default mmap backend, rows are read from the data file memory
+    map as nodes are visited. If tree->lookahead is non-zero, the rows of
+    each node are prefetched as it is visited, and handed to \p leaf only
+    once tree->lookahead more nodes have been visited, so that disk reads
+    overlap with the processing of earlier nodes. Otherwise, visited nodes
+    are queued, and their rows are read in batches, so that leaves are
+    processed out of traversal order, but still in data file order.
+
+    Leaves whose rows are needed are tallied in \p stats, and the time
+    spent reading and handing them to \p leaf is accounted as scan time.
+ */
+template <typename Cov, typename CapCov, typename Need, typename Leaf,
+          typename Stats = _htm_nostats>
+enum htm_errcode _htm_tree_search_rows (const struct htm_tree *tree,
+                                        Cov &&cov, CapCov &&capcov,
+                                        Need &&need, Leaf &&leaf,
+                                        const int maxlevel = HTM_MAX_LEVEL,
+                                        Stats &&stats = Stats ())
+{
+  if (tree->storage == NULL && tree->lookahead != 0)
+    {
+      struct _htm_leaf
+      {
+        enum _htm_cov coverage;
+        const char *entries;
+        uint64_t count;
+      };
+      std::deque<struct _htm_leaf> window;
+      const char *done = NULL;
+      enum htm_errcode e = _htm_tree_search (
+          tree, cov, capcov,
+          [&](enum _htm_cov coverage, const struct _htm_node *node,
+              uint64_t n)
+          {
+            if (!need (coverage, node))
+              {
+                leaf (coverage, static_cast<const char *>(NULL), n);
+                return;
+              }
+            struct _htm_leaf l;
+            l.coverage = coverage;
+            l.entries = static_cast<const char *>(tree->entries)
+                        + node->index * tree->entry_size;
+            l.count = n;
+            _htm_prefetch_rows (l.entries, l.entries + n * tree->entry_size,
+                                &done);
+            stats.leaf (n, tree->entry_size);
+            window.push_back (l);
+            if (window.size () > tree->lookahead)
+              {
+                stats.scan_begin ();
+                leaf (window.front ().coverage, window.front ().entries,
+                      window.front ().count);
+                stats.scan_end ();
+                window.pop_front ();
+              }
+          },
+          maxlevel, stats);
+      stats.scan_begin ();
+      for (; !window.empty (); window.pop_front ())
+        {
+          leaf (window.front ().coverage, window.front ().entries,
+                window.front ().count);
+        }
+      stats.scan_end ();
+      return e;
+    }
+  if (tree->storage == NULL)
+    {
+      return _htm_tree_search (
+          tree, cov, capcov,
+          [&](enum _htm_cov coverage, const struct _htm_node *node,
+              uint64_t n)
+          {
+            if (!need (coverage, node))
+              {
+                leaf (coverage, static_cast<const char *>(NULL), n);
+                return;
+              }
+            stats.leaf (n, tree->entry_size);
+            stats.scan_begin ();
+            leaf (coverage,
+                  static_cast<const char *>(tree->entries)
+                      + node->index * tree->entry_size,
+                  n);
+            stats.scan_end ();
+          },
+          maxlevel, stats);
+    }
+
+  _htm_rows batch (tree);
+  std::vector<std::pair<enum _htm_cov, uint64_t> > queued;
+  enum htm_errcode err = HTM_OK;
+  auto flush = [&]()
+  {
+    stats.scan_begin ();
+    if (err == HTM_OK)
+      {
+        err = batch.fetch ();
+      }
+    if (err == HTM_OK)
+      {
+        for (size_t i = 0; i < queued.size (); ++i)
+          {
+            leaf (queued[i].first, batch.rows (i), queued[i].second);
+          }
+      }
+    batch.clear ();
+    queued.clear ();
+    stats.scan_end ();
+  };
+  enum htm_errcode e = _htm_tree_search (
+      tree, cov, capcov,
+      [&](enum _htm_cov coverage, const struct _htm_node *node, uint64_t n)
+      {
+        if (!need (coverage, node))
+          {
+            leaf (coverage, static_cast<const char *>(NULL), n);
+            return;
+          }
+        if (err != HTM_OK)
+          {
+            return;
+          }
+        stats.leaf (n, tree->entry_size);
+        batch.add (node->index, n);
+        queued.push_back (std::make_pair (coverage, n));
+        if (batch.full ())
+          {
+            flush ();
+          }
+      },
+      maxlevel, stats);
+  flush ();
+  return (e != HTM_OK) ? e : err;
+}
+
+/*  Hands the \p count data file rows of \p tree starting at \p index to
+    \p leaf(entries, count), in order, and in pieces if the rows are read
+    through a block cache. Each piece is tallied as a leaf in \p stats.
+ */
+template <typename Leaf, typename Stats = _htm_nostats>
+enum htm_errcode _htm_tree_scan_span (const struct htm_tree *tree,
+                                      uint64_t index, uint64_t count,
+                                      Leaf &&leaf, Stats &&stats = Stats ())
+{
+  const uint64_t end = index + count;
+  stats.scan_begin ();
+  if (tree->storage == NULL)
+    {
+      stats.leaf (count, tree->entry_size);
+      leaf (static_cast<const char *>(tree->entries)
+                + index * tree->entry_size,
+            count);
+      stats.scan_end ();
+      return HTM_OK;
+    }
+  _htm_rows batch (tree);
+  enum htm_errcode err = HTM_OK;
+  while (index < end && err == HTM_OK)
+    {
+      const uint64_t n = std::min (batch.span_rows (index), end - index);
+      batch.add (index, n);
+      err = batch.fetch ();
+      if (err == HTM_OK)
+        {
+          stats.leaf (n, tree->entry_size);
+          leaf (batch.rows (0), n);
+        }
+      batch.clear ();
+      index += n;
+    }
+  stats.scan_end ();
+  return err;
+}
+
+/*  Hands all data file rows of \p tree to \p leaf(entries, count), as
+    _htm_tree_scan_span() does.
+ */
+template <typename Leaf, typename Stats = _htm_nostats>
+enum htm_errcode _htm_tree_scan_rows (const struct htm_tree *tree,
+                                      Leaf &&leaf, Stats &&stats = Stats ())
+{
+  return _htm_tree_scan_span (tree, 0, tree->count, leaf, stats);
+}
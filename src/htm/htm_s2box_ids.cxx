@@ -0,0 +1,26 @@
+#include <cstdlib>
+
+#include "tinyhtm/htm.h"
+#include "_htm_s2region_leaf.hxx"
+
+extern "C" {
+
+struct htm_ids *htm_s2box_ids (struct htm_ids *ids,
+                               const struct htm_s2box *box, int level,
+                               size_t maxranges, enum htm_errcode *err)
+{
+  struct htm_s2region region;
+
+  if (box == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      free (ids);
+      return NULL;
+    }
+  _htm_s2region_leaf_box (&region, box);
+  return htm_s2region_ids (ids, &region, level, maxranges, err);
+}
+}
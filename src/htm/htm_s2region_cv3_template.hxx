@@ -0,0 +1,21 @@
+#pragma once
+
+#include "tinyhtm/geometry.h"
+
+template <typename T>
+inline int htm_s2region_cv3_template (const struct htm_s2region *r,
+                                      const T *v)
+{
+  htm_v3 temp;
+  temp.x = v[0];
+  temp.y = v[1];
+  temp.z = v[2];
+  return htm_s2region_cv3 (r, &temp);
+}
+
+template <>
+inline int htm_s2region_cv3_template (const struct htm_s2region *r,
+                                      const double *v)
+{
+  return htm_s2region_cv3 (r, reinterpret_cast<const struct htm_v3 *>(v));
+}
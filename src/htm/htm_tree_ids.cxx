@@ -0,0 +1,215 @@
+#include <endian.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "tinyhtm/tree.h"
+#include "htm.hxx"
+#include "_htm_tree_storage.hxx"
+
+/*  An HTM ID range at the tree depth, inside the k-th level L triangle
+    (L being the level of the prefix count table), which it does not
+    entirely cover.
+ */
+struct _htm_ids_part
+{
+  uint64_t k;
+  int64_t min;
+  int64_t max;
+};
+
+static bool _htm_ids_part_lt (const struct _htm_ids_part &a,
+                              const struct _htm_ids_part &b)
+{
+  return a.min < b.min;
+}
+
+/*  Returns entry k of the prefix count table of \p tree.
+ */
+static uint64_t _htm_prefix_count (const struct htm_tree *tree, uint64_t k)
+{
+  uint64_t c;
+  memcpy (&c, tree->prefix + 8 * k, sizeof(c));
+  return le64toh (c);
+}
+
+template <typename T, typename Stats>
+int64_t htm_tree_ids_template (const struct htm_tree *tree,
+                               const struct htm_ids *ids,
+                               enum htm_errcode *err, htm_callback callback,
+                               Stats &stats)
+{
+  const int depth = tree->depth;
+  const int shift = 2 * (depth - tree->prefixlevel);
+  const uint64_t base = UINT64_C (8) << (2 * tree->prefixlevel);
+  const uint64_t mask = (UINT64_C (1) << shift) - 1;
+  std::vector<struct _htm_ids_part> parts;
+  enum htm_errcode e = HTM_OK;
+  int64_t count = 0;
+  size_t i, j;
+
+  if (tree->prefixlevel > depth)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ETREE;
+        }
+      return -1;
+    }
+  /* count the points of entirely covered level L triangles straight from
+     the prefix count table, and set aside the others */
+  for (i = 0; i < ids->n && e == HTM_OK; ++i)
+    {
+      const int level = htm_level (ids->range[i].min);
+      uint64_t lo, hi, first, last;
+      if (level < 0 || htm_level (ids->range[i].max) != level
+          || ids->range[i].max < ids->range[i].min)
+        {
+          e = HTM_EID;
+          break;
+        }
+      if (level > depth)
+        {
+          e = HTM_ELEVEL;
+          break;
+        }
+      lo = (uint64_t)ids->range[i].min << 2 * (depth - level);
+      hi = (((uint64_t)ids->range[i].max + 1) << 2 * (depth - level)) - 1;
+      /* level L triangles [first, last) are inside [lo, hi] */
+      first = (lo + mask) >> shift;
+      last = (hi + 1) >> shift;
+      if (first < last)
+        {
+          const uint64_t beg = _htm_prefix_count (tree, first - base);
+          const uint64_t end = _htm_prefix_count (tree, last - base);
+          stats.index (16);
+          if (!callback)
+            {
+              count += (int64_t)(end - beg);
+            }
+          else if (end > beg)
+            {
+              e = _htm_tree_scan_span (
+                  tree, beg, end - beg,
+                  [&](const char *entry, uint64_t n)
+                  {
+                    for (; n > 0; --n, entry += tree->entry_size)
+                      {
+                        if (callback (entry))
+                          ++count;
+                      }
+                  },
+                  stats);
+            }
+        }
+      if ((lo & mask) != 0)
+        {
+          struct _htm_ids_part p;
+          p.k = (lo >> shift) - base;
+          p.min = (int64_t)lo;
+          p.max = (int64_t)std::min (hi, lo | mask);
+          parts.push_back (p);
+        }
+      if (((hi + 1) & mask) != 0
+          && ((lo & mask) == 0 || (hi >> shift) != (lo >> shift)))
+        {
+          struct _htm_ids_part p;
+          p.k = (hi >> shift) - base;
+          p.min = (int64_t)std::max (lo, hi & ~mask);
+          p.max = (int64_t)hi;
+          parts.push_back (p);
+        }
+    }
+
+  /* scan the points of partially covered level L triangles once each,
+     testing their IDs against all the ranges inside the triangle */
+  std::sort (parts.begin (), parts.end (), _htm_ids_part_lt);
+  for (i = 0; i < parts.size () && e == HTM_OK; i = j)
+    {
+      const uint64_t beg = _htm_prefix_count (tree, parts[i].k);
+      const uint64_t end = _htm_prefix_count (tree, parts[i].k + 1);
+      j = i + 1;
+      while (j < parts.size () && parts[j].k == parts[i].k)
+        {
+          ++j;
+        }
+      stats.index (16);
+      if (end == beg)
+        {
+          continue;
+        }
+      e = _htm_tree_scan_span (
+          tree, beg, end - beg,
+          [&](const char *entry, uint64_t n)
+          {
+            for (; n > 0; --n, entry += tree->entry_size)
+              {
+                const T *p = reinterpret_cast<const T *>(entry);
+                struct htm_v3 v;
+                struct _htm_ids_part key;
+                v.x = p[0];
+                v.y = p[1];
+                v.z = p[2];
+                key.min = htm_v3_id (&v, depth);
+                const struct _htm_ids_part *q = std::upper_bound (
+                    &parts[i], &parts[0] + j, key, _htm_ids_part_lt);
+                if (stats.test (q != &parts[i] && key.min <= q[-1].max))
+                  {
+                    if (!callback || callback (entry))
+                      ++count;
+                  }
+              }
+          },
+          stats);
+    }
+  if (err != NULL)
+    {
+      *err = e;
+    }
+  return e == HTM_OK ? count : -1;
+}
+
+extern "C" {
+
+int64_t htm_tree_ids (const struct htm_tree *tree, const struct htm_ids *ids,
+                      enum htm_errcode *err, htm_callback callback,
+                      struct htm_query_stats *stats)
+{
+  if (tree == NULL || ids == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return -1;
+    }
+  if (tree->prefix == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_EINV;
+        }
+      return -1;
+    }
+  if (tree->element_types.at (0) == H5::PredType::NATIVE_DOUBLE)
+    {
+      return _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_ids_template<double>(tree, ids, err, callback, s);
+      });
+    }
+  else if (tree->element_types.at (0) == H5::PredType::NATIVE_FLOAT)
+    {
+      return _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_ids_template<float>(tree, ids, err, callback, s);
+      });
+    }
+  if (err != NULL)
+    {
+      *err = HTM_ETREE;
+    }
+  return -1;
+}
+}
@@ -0,0 +1,27 @@
+#include "tinyhtm/tree.h"
+#include "_htm_s2region_leaf.hxx"
+
+extern "C" {
+
+struct htm_range htm_tree_s2box_range (const struct htm_tree *tree,
+                                       const struct htm_s2box *box,
+                                       enum htm_errcode *err,
+                                       struct htm_query_stats *stats)
+{
+  struct htm_s2region region;
+  struct htm_range range;
+
+  if (tree == NULL || box == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      range.min = 0;
+      range.max = -1;
+      return range;
+    }
+  _htm_s2region_leaf_box (&region, box);
+  return htm_tree_s2region_range (tree, &region, err, stats);
+}
+}
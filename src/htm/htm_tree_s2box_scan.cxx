@@ -0,0 +1,24 @@
+#include "tinyhtm/tree.h"
+#include "_htm_s2region_leaf.hxx"
+
+extern "C" {
+
+int64_t htm_tree_s2box_scan (const struct htm_tree *tree,
+                             const struct htm_s2box *box,
+                             enum htm_errcode *err, htm_callback callback,
+                             struct htm_query_stats *stats)
+{
+  struct htm_s2region region;
+
+  if (tree == NULL || box == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return -1;
+    }
+  _htm_s2region_leaf_box (&region, box);
+  return htm_tree_s2region_scan (tree, &region, err, callback, stats);
+}
+}
@@ -0,0 +1,126 @@
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+#include "tinyhtm/tree.h"
+#include "htm.hxx"
+#include "_htm_s2region_capcov.hxx"
+#include "_htm_s2region_htmcov.hxx"
+#include "_htm_tree_storage.hxx"
+#include "htm/htm_s2region_cv3_template.hxx"
+
+template <typename T, typename Stats>
+int64_t htm_tree_s2region_template (const struct htm_tree *tree,
+                                    const struct htm_s2region *region,
+                                    double *ab, enum htm_errcode *err,
+                                    htm_callback callback, Stats &stats)
+{
+  int64_t count = 0;
+  enum htm_errcode e = _htm_tree_search_rows (
+      tree,
+      [&](const struct _htm_node *node)
+      { return _htm_s2region_htmcov (node, region, ab); },
+      [&](const struct _htm_cap *cap)
+      { return _htm_s2region_capcov (cap, region); },
+      [&](enum _htm_cov coverage, const struct _htm_node *)
+      { return callback || coverage != HTM_INSIDE; },
+      [&](enum _htm_cov coverage, const char *entry, uint64_t n)
+      {
+        if (entry == NULL)
+          {
+            /* fully covered HTM triangle */
+            count += (int64_t)n;
+            return;
+          }
+        /* scan points in leaf */
+        for (uint64_t i = 0; i < n; ++i, entry += tree->entry_size)
+          {
+            if (coverage == HTM_INSIDE
+                || stats.test (htm_s2region_cv3_template<T>(
+                       region, reinterpret_cast<const T *>(entry))))
+              {
+                if (!callback || callback (entry))
+                  ++count;
+              }
+          }
+      },
+      HTM_MAX_LEVEL, stats);
+  if (err != NULL)
+    {
+      *err = e;
+    }
+  return e == HTM_OK ? count : -1;
+}
+
+extern "C" {
+
+int64_t htm_tree_s2region (const struct htm_tree *tree,
+                           const struct htm_s2region *region,
+                           enum htm_errcode *err, htm_callback callback,
+                           struct htm_query_stats *stats)
+{
+  double stackab[2 * 256 + 4];
+  double *ab;
+  size_t nb;
+  int64_t count;
+
+  if (tree == NULL || region == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return -1;
+    }
+  if (tree->index == MAP_FAILED)
+    {
+      return htm_tree_s2region_scan (tree, region, err, callback, stats);
+    }
+  nb = _htm_s2region_absz (region) * sizeof(double);
+  if (nb > sizeof(stackab))
+    {
+      ab = (double *)malloc (nb);
+      if (ab == NULL)
+        {
+          if (err != NULL)
+            {
+              *err = HTM_ENOMEM;
+            }
+          return -1;
+        }
+    }
+  else
+    {
+      ab = stackab;
+    }
+  if (tree->element_types.at (0) == H5::PredType::NATIVE_DOUBLE)
+    {
+      count = _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_s2region_template<double>(tree, region, ab, err,
+                                                  callback, s);
+      });
+    }
+  else if (tree->element_types.at (0) == H5::PredType::NATIVE_FLOAT)
+    {
+      count = _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_s2region_template<float>(tree, region, ab, err,
+                                                 callback, s);
+      });
+    }
+  else
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ETREE;
+        }
+      count = -1;
+    }
+  if (ab != stackab)
+    {
+      free (ab);
+    }
+  return count;
+}
+}
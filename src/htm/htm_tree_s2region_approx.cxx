@@ -0,0 +1,125 @@
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+#include "tinyhtm/tree.h"
+#include "htm.hxx"
+#include "_htm_s2region_capcov.hxx"
+#include "_htm_s2region_htmcov.hxx"
+#include "_htm_tree_storage.hxx"
+
+extern "C" {
+
+int64_t htm_tree_s2region_approx (const struct htm_tree *tree,
+                                  const struct htm_s2region *region,
+                                  int level, double *maxerr,
+                                  enum htm_errcode *err,
+                                  htm_callback callback,
+                                  struct htm_query_stats *stats)
+{
+  double stackab[2 * 256 + 4];
+  double *ab;
+  size_t nb;
+  int64_t count = 0;
+  double error = 0.0;
+  enum htm_errcode e;
+
+  if (maxerr != NULL)
+    {
+      *maxerr = 0.0;
+    }
+  if (tree == NULL || region == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return -1;
+    }
+  if (level < 0 || level > HTM_MAX_LEVEL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ELEVEL;
+        }
+      return -1;
+    }
+  if (tree->index == MAP_FAILED)
+    {
+      /* without an index, a scan gives exact results */
+      return htm_tree_s2region_scan (tree, region, err, callback, stats);
+    }
+  nb = _htm_s2region_absz (region) * sizeof(double);
+  if (nb > sizeof(stackab))
+    {
+      ab = (double *)malloc (nb);
+      if (ab == NULL)
+        {
+          if (err != NULL)
+            {
+              *err = HTM_ENOMEM;
+            }
+          return -1;
+        }
+    }
+  else
+    {
+      ab = stackab;
+    }
+  e = _htm_with_stats (stats, [&](auto &s)
+  {
+    return _htm_tree_search_rows (
+        tree,
+        [&](const struct _htm_node *node)
+        { return _htm_s2region_htmcov (node, region, ab); },
+        [&](const struct _htm_cap *cap)
+        { return _htm_s2region_capcov (cap, region); },
+        [&](enum _htm_cov coverage, const struct _htm_node *node)
+        {
+          if (coverage != HTM_INSIDE)
+            {
+              /* partially covered HTM triangle: every point in it is within
+                 one triangle diameter of the region */
+              struct htm_tri tri;
+              if (htm_tri_init (&tri, node->id) == HTM_OK
+                  && 2.0 * tri.radius > error)
+                {
+                  error = 2.0 * tri.radius;
+                }
+            }
+          return (bool)callback;
+        },
+        [&](enum _htm_cov, const char *entry, uint64_t n)
+        {
+          if (entry == NULL)
+            {
+              count += (int64_t)n;
+              return;
+            }
+          for (uint64_t i = 0; i < n; ++i, entry += tree->entry_size)
+            {
+              if (callback (entry))
+                ++count;
+            }
+        },
+        level, s);
+  });
+  if (ab != stackab)
+    {
+      free (ab);
+    }
+  if (err != NULL)
+    {
+      *err = e;
+    }
+  if (e != HTM_OK)
+    {
+      return -1;
+    }
+  if (maxerr != NULL)
+    {
+      *maxerr = error;
+    }
+  return count;
+}
+}
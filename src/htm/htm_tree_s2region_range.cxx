@@ -0,0 +1,96 @@
+#include <cstdlib>
+
+#include <sys/mman.h>
+
+#include "htm.hxx"
+#include "tinyhtm/tree.h"
+#include "_htm_s2region_capcov.hxx"
+#include "_htm_s2region_htmcov.hxx"
+#include "_htm_tree_search.hxx"
+
+extern "C" {
+
+struct htm_range htm_tree_s2region_range (const struct htm_tree *tree,
+                                          const struct htm_s2region *region,
+                                          enum htm_errcode *err,
+                                          struct htm_query_stats *stats)
+{
+  double stackab[2 * 256 + 4];
+  struct htm_range range;
+  enum htm_errcode e;
+  double *ab;
+  size_t nb;
+
+  range.min = 0;
+  range.max = 0;
+  if (tree == NULL || region == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      range.max = -1;
+      return range;
+    }
+  if (tree->index == MAP_FAILED)
+    {
+      range.max = htm_tree_s2region_scan (tree, region, err, NULL, stats);
+      if (range.max >= 0)
+        {
+          range.min = range.max;
+        }
+      return range;
+    }
+  nb = _htm_s2region_absz (region) * sizeof(double);
+  if (nb > sizeof(stackab))
+    {
+      ab = (double *)malloc (nb);
+      if (ab == NULL)
+        {
+          if (err != NULL)
+            {
+              *err = HTM_ENOMEM;
+            }
+          range.max = -1;
+          return range;
+        }
+    }
+  else
+    {
+      ab = stackab;
+    }
+  e = _htm_with_stats (stats, [&](auto &s)
+  {
+    return _htm_tree_search (
+        tree,
+        [&](const struct _htm_node *node)
+        { return _htm_s2region_htmcov (node, region, ab); },
+        [&](const struct _htm_cap *cap)
+        { return _htm_s2region_capcov (cap, region); },
+        [&](enum _htm_cov coverage, const struct _htm_node *, uint64_t n)
+        {
+          if (coverage == HTM_INSIDE)
+            {
+              /* fully covered HTM triangle */
+              range.min += (int64_t)n;
+            }
+          range.max += (int64_t)n;
+        },
+        HTM_MAX_LEVEL, s);
+  });
+  if (ab != stackab)
+    {
+      free (ab);
+    }
+  if (e != HTM_OK)
+    {
+      range.min = 0;
+      range.max = -1;
+    }
+  if (err != NULL)
+    {
+      *err = e;
+    }
+  return range;
+}
+}
@@ -0,0 +1,70 @@
+#include "tinyhtm/tree.h"
+#include "htm/_htm_tree_storage.hxx"
+#include "htm/htm_s2region_cv3_template.hxx"
+
+template <typename T, typename Stats>
+int64_t htm_tree_s2region_scan_template (const struct htm_tree *tree,
+                                         const struct htm_s2region *region,
+                                         enum htm_errcode *err,
+                                         htm_callback callback, Stats &stats)
+{
+  int64_t count = 0;
+  enum htm_errcode e = _htm_tree_scan_rows (
+      tree,
+      [&](const char *entry, uint64_t n)
+      {
+        for (uint64_t i = 0; i < n; ++i, entry += tree->entry_size)
+          {
+            if (stats.test (htm_s2region_cv3_template<T>(
+                    region, reinterpret_cast<const T *>(entry))))
+              {
+                if (!callback || callback (entry))
+                  ++count;
+              }
+          }
+      },
+      stats);
+  if (err != NULL)
+    {
+      *err = e;
+    }
+  return e == HTM_OK ? count : -1;
+}
+
+extern "C" {
+int64_t htm_tree_s2region_scan (const struct htm_tree *tree,
+                                const struct htm_s2region *region,
+                                enum htm_errcode *err, htm_callback callback,
+                                struct htm_query_stats *stats)
+{
+  if (tree == NULL || region == NULL)
+    {
+      if (err != NULL)
+        {
+          *err = HTM_ENULLPTR;
+        }
+      return -1;
+    }
+  if (tree->element_types.at (0) == H5::PredType::NATIVE_DOUBLE)
+    {
+      return _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_s2region_scan_template<double>(tree, region, err,
+                                                       callback, s);
+      });
+    }
+  else if (tree->element_types.at (0) == H5::PredType::NATIVE_FLOAT)
+    {
+      return _htm_with_stats (stats, [&](auto &s)
+      {
+        return htm_tree_s2region_scan_template<float>(tree, region, err,
+                                                      callback, s);
+      });
+    }
+  if (err != NULL)
+    {
+      *err = HTM_ETREE;
+    }
+  return -1;
+}
+}
@@ -10,12 +10,15 @@
 
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
-#include <cctype>
 #include <cstring>
-#include <cerrno>
 #include <stdexcept>
 #include <sstream>
 #include "../../sort_and_index/blk_writer.hxx"
@@ -23,14 +26,284 @@
 #include "../../tree_entry.hxx"
 #include "../../sort_and_index/now.hxx"
 
-char *eat_delim (char *s, char delim, const std::string &fname, size_t lineno);
-char *eat_ws (char *s, char delim, const std::string &fname, size_t lineno);
+void parse_record (char *line, const char delim, const std::string &fname,
+                   const size_t lineno, const int depth,
+                   struct tree_entry *entry);
+
+/* Maximum length of an input line, including its newline. */
+static const size_t MAX_LINE = 16384;
+
+/* Size of the input chunks parsed by each thread in parallel mode. */
+static const size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+static void line_too_long (const std::string &fname, size_t lineno)
+{
+  std::stringstream ss;
+  ss << "Line " << lineno << " of file " << fname << " is too long (> "
+     << MAX_LINE << " characters)";
+  throw std::runtime_error (ss.str ());
+}
+
+/*  A run of complete lines of an input file, and the entries parsed
+    from them.
+ */
+struct ascii_chunk
+{
+  const std::string *fname;
+  size_t lineno;           /* number of the first line */
+  std::vector<char> text;  /* lines, followed by at least 1 spare byte */
+  size_t len;              /* # of bytes of text holding lines */
+  std::vector<tree_entry> entries;
+  std::string error;       /* first parse error, if any */
+  bool last;               /* last chunk of the file? */
+  bool done;               /* parsed? */
+};
+
+/*  A pool of threads parsing chunks, in any order.
+ */
+struct ascii_pool
+{
+  char delim;
+  int depth;
+  std::mutex mtx;
+  std::condition_variable todo_cv; /* signalled when chunks are queued */
+  std::condition_variable done_cv; /* signalled when chunks are parsed */
+  std::deque<ascii_chunk *> todo;
+  bool stop;
+  std::vector<std::thread> threads;
+
+  ascii_pool (const char Delim, const int Depth, const int nthreads)
+      : delim (Delim), depth (Depth), stop (false)
+  {
+    for (int i = 0; i < nthreads; ++i)
+      {
+        threads.emplace_back (&ascii_pool::run, this);
+      }
+  }
+
+  ~ascii_pool ()
+  {
+    {
+      std::lock_guard<std::mutex> lock (mtx);
+      stop = true;
+    }
+    todo_cv.notify_all ();
+    for (auto &t : threads)
+      {
+        t.join ();
+      }
+  }
+
+  void submit (ascii_chunk *c)
+  {
+    {
+      std::lock_guard<std::mutex> lock (mtx);
+      c->done = false;
+      todo.push_back (c);
+    }
+    todo_cv.notify_one ();
+  }
+
+  void wait (ascii_chunk *c)
+  {
+    std::unique_lock<std::mutex> lock (mtx);
+    done_cv.wait (lock, [c] { return c->done; });
+  }
+
+  void run ()
+  {
+    while (1)
+      {
+        ascii_chunk *c;
+        {
+          std::unique_lock<std::mutex> lock (mtx);
+          todo_cv.wait (lock, [this] { return stop || !todo.empty (); });
+          if (todo.empty ())
+            {
+              return;
+            }
+          c = todo.front ();
+          todo.pop_front ();
+        }
+        parse (c);
+        {
+          std::lock_guard<std::mutex> lock (mtx);
+          c->done = true;
+        }
+        done_cv.notify_all ();
+      }
+  }
+
+  /*  Parses the lines of a chunk, stopping at the first error. */
+  void parse (ascii_chunk *c)
+  {
+    char *s = c->text.data ();
+    char *const end = s + c->len;
+    size_t lineno = c->lineno;
+    c->entries.clear ();
+    c->error.clear ();
+    try
+      {
+        for (; s < end; ++lineno)
+          {
+            struct tree_entry entry;
+            char *nl = static_cast<char *>(memchr (s, '\n', end - s));
+            if (nl == NULL)
+              {
+                nl = end; /* last line of a file without a newline */
+              }
+            if ((size_t)(nl - s) + 1 >= MAX_LINE)
+              {
+                line_too_long (*c->fname, lineno);
+              }
+            *nl = '\0';
+            parse_record (s, delim, *c->fname, lineno, depth, &entry);
+            c->entries.push_back (entry);
+            s = nl + 1;
+          }
+      }
+    catch (std::exception &ex)
+      {
+        c->error = ex.what ();
+      }
+  }
+};
+
+/*  Converts ASCII input files using nthreads threads. The files are
+    read sequentially and cut into chunks of complete lines, which are
+    parsed (and their HTM IDs computed) in parallel. Parsed chunks are
+    appended to the block writer in input order, so the output is the
+    same as that of a sequential conversion, and errors are reported for
+    the first bad line of the input.
+ */
+static size_t blk_sort_ascii_parallel (const std::vector<std::string> &infiles,
+                                       blk_writer<tree_entry> &out,
+                                       const char delim, const int depth,
+                                       const int nthreads)
+{
+  const size_t window = 2 * (size_t)nthreads;
+  std::vector<ascii_chunk> chunks (window);
+  std::deque<ascii_chunk *> inflight;
+  std::vector<ascii_chunk *> idle;
+  std::vector<char> carry;
+  size_t nentries = 0, nfile = 0;
+  double t = now ();
+  ascii_pool pool (delim, depth, nthreads);
+
+  for (auto &c : chunks)
+    {
+      idle.push_back (&c);
+    }
+
+  /* appends the entries of the oldest chunk in flight to the output */
+  auto consume = [&]()
+  {
+    ascii_chunk *c = inflight.front ();
+    pool.wait (c);
+    if (!c->error.empty ())
+      {
+        throw std::runtime_error (c->error);
+      }
+    /* one at a time, so that blocks hold exactly mem->sortsz bytes */
+    for (const tree_entry &e : c->entries)
+      {
+        out.append (&e);
+      }
+    nentries += c->entries.size ();
+    nfile += c->entries.size ();
+    if (c->last)
+      {
+        std::cout << "\t- processed " << *c->fname << ": " << nfile
+                  << " records in " << now () - t << " sec\n";
+        nfile = 0;
+        t = now ();
+      }
+    inflight.pop_front ();
+    return c;
+  };
+
+  for (size_t i = 0; i < infiles.size (); ++i)
+    {
+      const std::string &infile = infiles[i];
+      size_t lineno = 1;
+      bool eof = false;
+      FILE *f = fopen (infile.c_str (), "r");
+      if (f == NULL)
+        {
+          throw std::runtime_error ("Failed to open file " + infile
+                                    + " for reading");
+        }
+      carry.clear ();
+      while (!eof)
+        {
+          ascii_chunk *c;
+          size_t n;
+          if (!idle.empty ())
+            {
+              c = idle.back ();
+              idle.pop_back ();
+            }
+          else
+            {
+              c = consume ();
+            }
+          /* fill the chunk with the carried over partial line, and
+             as many bytes of the file as fit */
+          c->text.resize (CHUNK_SIZE + 1);
+          std::copy (carry.begin (), carry.end (), c->text.begin ());
+          n = carry.size ()
+              + fread (c->text.data () + carry.size (), 1,
+                       CHUNK_SIZE - carry.size (), f);
+          if (n < CHUNK_SIZE)
+            {
+              if (ferror (f) != 0)
+                {
+                  fclose (f);
+                  throw std::runtime_error ("failed to read file " + infile);
+                }
+              eof = true;
+            }
+          /* cut it after its last newline */
+          c->len = n;
+          if (!eof)
+            {
+              while (c->len > 0 && c->text[c->len - 1] != '\n')
+                {
+                  --c->len;
+                }
+              if (c->len == 0)
+                {
+                  fclose (f);
+                  line_too_long (infile, lineno);
+                }
+            }
+          carry.assign (c->text.begin () + c->len, c->text.begin () + n);
+          c->fname = &infile;
+          c->lineno = lineno;
+          c->last = eof;
+          lineno += std::count (c->text.begin (), c->text.begin () + c->len,
+                                '\n');
+          inflight.push_back (c);
+          pool.submit (c);
+        }
+      if (fclose (f) != 0)
+        {
+          throw std::runtime_error ("failed to close file " + infile);
+        }
+    }
+  while (!inflight.empty ())
+    {
+      idle.push_back (consume ());
+    }
+  return nentries;
+}
 
 size_t blk_sort_ascii (const std::vector<std::string> &infiles,
                        const std::string &outfile, const char delim,
-                       const mem_params *const mem)
+                       const mem_params *const mem, const int depth,
+                       const int nthreads)
 {
-  char line[16384];
+  char line[MAX_LINE];
   size_t nentries;
   double ttot;
 
@@ -43,7 +316,16 @@ size_t blk_sort_ascii (const std::vector<std::string> &infiles,
             << " from ASCII file(s)\n";
   ttot = now ();
   nentries = 0;
-  blk_writer<tree_entry> out (outfile, mem->sortsz);
+  blk_writer<tree_entry> out (outfile, mem->sortsz, mem->nthreads);
+
+  if (nthreads > 1)
+    {
+      nentries = blk_sort_ascii_parallel (infiles, out, delim, depth,
+                                          nthreads);
+      std::cout << "\t" << now () - ttot << " sec for " << nentries
+                << " records total (" << nthreads << " threads)\n\n";
+      return nentries;
+    }
 
   /* For each input file... */
   for (auto &infile : infiles)
@@ -51,7 +333,6 @@ size_t blk_sort_ascii (const std::vector<std::string> &infiles,
       FILE *f;
       size_t lineno;
       struct tree_entry entry;
-      struct htm_v3 v;
       double t;
 
       std::cout << "\t- processing " << infile << " ... ";
@@ -66,82 +347,17 @@ size_t blk_sort_ascii (const std::vector<std::string> &infiles,
         }
       for (lineno = 1; fgets (line, sizeof(line), f) != NULL; ++lineno)
         {
-          char *s, *endptr;
-          double lon, lat;
           size_t len = strlen (line);
 
           if (line[len - 1] != '\n')
             {
               if (feof (f) == 0)
                 {
-                  std::stringstream ss;
-                  ss << "Line " << lineno << " of file " << infile
-                     << " is too long (> " << sizeof(line) << "characters)";
-                  throw std::runtime_error (ss.str ());
+                  line_too_long (infile, lineno);
                 }
             }
-          s = eat_ws (line, delim, infile, lineno);
-          entry.rowid = (int64_t)strtoll (s, &endptr, 0);
-          if (endptr == s || endptr == NULL || errno != 0)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - failed to convert row_id to an integer";
-              throw std::runtime_error (ss.str ());
-            }
-          s = eat_delim (endptr, delim, infile, lineno);
-          s = eat_ws (s, delim, infile, lineno);
-          lon = strtod (s, &endptr);
-          if (endptr == s || endptr == NULL || errno != 0)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - failed to convert right ascension/longitude to a "
-                    "double";
-              throw std::runtime_error (ss.str ());
-            }
-          s = eat_delim (endptr, delim, infile, lineno);
-          s = eat_ws (s, delim, infile, lineno);
-          lat = strtod (s, &endptr);
-          if (endptr == s || endptr == NULL || errno != 0)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - failed to convert declination/latitude to a double";
-              throw std::runtime_error (ss.str ());
-            }
-          s = endptr;
-          if (*s != delim && *s != '\0' && !isspace (*s))
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno << "] - invalid record";
-              throw std::runtime_error (ss.str ());
-            }
           /* compute and store tree_entry for line */
-          if (htm_sc_init (&entry.sc, lon, lat) != HTM_OK)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - invalid spherical coordinates";
-              throw std::runtime_error (ss.str ());
-            }
-          if (htm_sc_tov3 (&v, &entry.sc) != HTM_OK)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - failed to convert spherical coordinates "
-                 << "to a unit vector";
-              throw std::runtime_error (ss.str ());
-            }
-          entry.htmid = htm_v3_id (&v, 20);
-          if (entry.htmid == 0)
-            {
-              std::stringstream ss;
-              ss << "[" << infile << ":" << lineno
-                 << "] - failed to compute HTM ID for spherical "
-                 << "coordinates";
-              throw std::runtime_error (ss.str ());
-            }
+          parse_record (line, delim, infile, lineno, depth, &entry);
           out.append (&entry);
         }
       if (ferror (f) != 0)
@@ -153,7 +369,7 @@ size_t blk_sort_ascii (const std::vector<std::string> &infiles,
           throw std::runtime_error ("failed to close file " + infile);
         }
       nentries += lineno - 1;
-      std::cout << lineno << " records in " << now () - t << " sec\n";
+      std::cout << lineno - 1 << " records in " << now () - t << " sec\n";
       /* advance to next input file */
     }
 
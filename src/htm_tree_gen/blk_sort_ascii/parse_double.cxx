@@ -0,0 +1,109 @@
+/** \file
+    \brief      HTM tree generation.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+
+#include <cstdint>
+#include <cstdlib>
+
+/* Exactly representable powers of 10. */
+static const double exact_pow10[23]
+    = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+/*  Converts the decimal number at s to a double, like strtod(). Numbers
+    with at most 19 significant digits, a mantissa below 2^53 and a
+    decimal exponent of magnitude 22 or less are converted with a single
+    (correctly rounded) multiplication or division of two exact doubles,
+    as described by Clinger in "How to Read Floating Point Numbers
+    Accurately". Everything else, including the rare inputs needing more
+    care, hexadecimal floats, infinities and NaNs, is handed to strtod().
+ */
+double parse_double (const char *s, char **endptr)
+{
+  const char *p = s;
+  uint64_t m = 0;
+  int ndigits = 0, e = 0, neg = 0;
+
+  if (*p == '-' || *p == '+')
+    {
+      neg = (*p == '-');
+      ++p;
+    }
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    {
+      return strtod (s, endptr);
+    }
+  /* mantissa digits, skipping leading zeros */
+  for (; *p == '0'; ++p)
+    {
+      ++ndigits;
+    }
+  for (; *p >= '0' && *p <= '9'; ++p, ++ndigits)
+    {
+      if (m >= UINT64_C (1000000000000000000))
+        {
+          return strtod (s, endptr);
+        }
+      m = m * 10 + (uint64_t)(*p - '0');
+    }
+  if (*p == '.')
+    {
+      ++p;
+      if (m == 0)
+        {
+          for (; *p == '0'; ++p, --e)
+            {
+              ++ndigits;
+            }
+        }
+      for (; *p >= '0' && *p <= '9'; ++p, ++ndigits, --e)
+        {
+          if (m >= UINT64_C (1000000000000000000))
+            {
+              return strtod (s, endptr);
+            }
+          m = m * 10 + (uint64_t)(*p - '0');
+        }
+    }
+  if (ndigits == 0)
+    {
+      /* not a decimal number - let strtod() decide */
+      return strtod (s, endptr);
+    }
+  if (*p == 'e' || *p == 'E')
+    {
+      const char *q = p + 1;
+      int x = 0, xneg = 0;
+      if (*q == '-' || *q == '+')
+        {
+          xneg = (*q == '-');
+          ++q;
+        }
+      if (*q >= '0' && *q <= '9')
+        {
+          for (; *q >= '0' && *q <= '9'; ++q)
+            {
+              if (x > 1000)
+                {
+                  return strtod (s, endptr);
+                }
+              x = x * 10 + (*q - '0');
+            }
+          e += xneg ? -x : x;
+          p = q;
+        }
+    }
+  if (m > (UINT64_C (1) << 53) || e < -22 || e > 22)
+    {
+      return strtod (s, endptr);
+    }
+  *endptr = const_cast<char *>(p);
+  {
+    double v = (double)m;
+    v = (e < 0) ? v / exact_pow10[-e] : v * exact_pow10[e];
+    return neg ? -v : v;
+  }
+}
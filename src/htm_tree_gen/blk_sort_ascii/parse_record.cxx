@@ -0,0 +1,95 @@
+/** \file
+    \brief      HTM tree generation.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include "../../tree_entry.hxx"
+
+char *eat_delim (char *s, char delim, const std::string &fname, size_t lineno);
+char *eat_ws (char *s, char delim, const std::string &fname, size_t lineno);
+double parse_double (const char *s, char **endptr);
+
+/*  Parses the row ID, longitude and latitude of the record in line
+    lineno of fname, and computes its HTM ID at the given level.
+ */
+void parse_record (char *line, const char delim, const std::string &fname,
+                   const size_t lineno, const int depth,
+                   struct tree_entry *entry)
+{
+  char *s, *endptr;
+  double lon, lat;
+  struct htm_v3 v;
+
+  s = eat_ws (line, delim, fname, lineno);
+  errno = 0;
+  entry->rowid = (int64_t)strtoll (s, &endptr, 0);
+  if (endptr == s || endptr == NULL || errno != 0)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - failed to convert row_id to an integer";
+      throw std::runtime_error (ss.str ());
+    }
+  s = eat_delim (endptr, delim, fname, lineno);
+  s = eat_ws (s, delim, fname, lineno);
+  errno = 0;
+  lon = parse_double (s, &endptr);
+  if (endptr == s || endptr == NULL || errno != 0)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - failed to convert right ascension/longitude to a double";
+      throw std::runtime_error (ss.str ());
+    }
+  s = eat_delim (endptr, delim, fname, lineno);
+  s = eat_ws (s, delim, fname, lineno);
+  errno = 0;
+  lat = parse_double (s, &endptr);
+  if (endptr == s || endptr == NULL || errno != 0)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - failed to convert declination/latitude to a double";
+      throw std::runtime_error (ss.str ());
+    }
+  s = endptr;
+  if (*s != delim && *s != '\0' && !isspace (*s))
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno << "] - invalid record";
+      throw std::runtime_error (ss.str ());
+    }
+  /* compute tree_entry for line */
+  if (htm_sc_init (&entry->sc, lon, lat) != HTM_OK)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - invalid spherical coordinates";
+      throw std::runtime_error (ss.str ());
+    }
+  if (htm_sc_tov3 (&v, &entry->sc) != HTM_OK)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - failed to convert spherical coordinates "
+         << "to a unit vector";
+      throw std::runtime_error (ss.str ());
+    }
+  entry->htmid = htm_v3_id (&v, depth);
+  if (entry->htmid == 0)
+    {
+      std::stringstream ss;
+      ss << "[" << fname << ":" << lineno
+         << "] - failed to compute HTM ID for spherical "
+         << "coordinates";
+      throw std::runtime_error (ss.str ());
+    }
+}
@@ -43,11 +43,100 @@
     children. For partially covered leaves, read points from the data
     file and check whether they are contained in the region.
 
+    With <tt>--caps</tt>, every node additionally stores a spherical cap
+    bounding its points (4 little-endian floats: the cap center, followed
+    by the cap radius as a secant distance). Caps are computed bottom-up,
+    from the points of the deepest nodes and the caps of their ancestors'
+    children, so they are not minimal, but they hug the actual contents
+    of a node far more closely than its HTM triangle does. Nodes whose
+    cap lies entirely inside or outside a region are classified without
+    further subdivision or point reads. Such indexes begin with a 0 byte
+    followed by a format flag word, and are not readable by older
+    versions of the library.
+
+    With <tt>--fixed</tt>, the children of an internal node are described
+    by a single block of fixed-width integers following it, rather than by
+    child offset varints. Each of the 4 child slots holds the child count,
+    relative index and offset, as 16, 32 or 64 bit little-endian integers
+    (the narrowest width fitting all 12 values of the block, recorded in a
+    leading byte), and only roots store their own count and index. Such
+    indexes are larger, but are decoded without the serial, branchy varint
+    decoding chain, which pays off for indexes that are memory resident.
+
+    With <tt>--succinct</tt>, the index stores no child offsets or node
+    indexes at all. Nodes are numbered in level order, and the tree shape
+    is stored as a bit-vector of 4 bit child masks, in which the first
+    child of a node is located by counting the 1 bits preceding its mask
+    (with the help of sampled counts). Node counts are bit-packed, with a
+    width per group of 64 nodes, and node indexes are derived from the
+    counts of preceding siblings. The result is 2-3 times smaller
+    than a varint index, which helps keep large indexes cache resident.
+
+    With <tt>--compress</tt>, the points are stored in a chunked,
+    shuffled and deflate compressed HDF5 data set instead of a contiguous
+    one. Chunks hold a multiple of the leaf threshold rows, so that
+    queries decompress few chunks per leaf; decompressed chunks are kept
+    in a bounded cache shared by all queries on a tree.
+
+    With <tt>--depth</tt>, points are sorted on HTM IDs at a level other
+    than 20 (up to HTM_MAX_LEVEL), which is also the level below which
+    nodes are never subdivided. Nodes are only subdivided while they hold
+    at least the leaf threshold number of points, so a deeper tree only
+    grows where the points are dense, e.g. in globular clusters, and its
+    leaves there hold fewer points for queries to test. The depth is
+    recorded in the index header.
+
+    With <tt>--adaptive</tt>, the leaf threshold becomes an upper bound on
+    the number of points in a leaf, and smaller nodes are split whenever a
+    cost model predicts that this makes queries cheaper. The cost of a
+    leaf is that of reading and testing its points; the cost of an
+    internal node is that of reading and classifying its children, plus
+    the cost of the children a query region boundary is likely to cross.
+    Clumped points thus end up in deeper, smaller leaves. Nodes at or
+    above the threshold are still always split, so adaptive splitting only
+    ever deepens dense regions: an adaptive tree is never shallower than
+    the plain tree built with the same threshold, and the threshold should
+    be chosen for the sparsest parts of a catalog. Every node then records
+    whether it is a leaf in the low bit of its stored count.
+
+    With <tt>--threads</tt>, ASCII inputs are parsed by a pool of threads.
+    Each input is read sequentially in chunks of complete lines, which the
+    threads convert to HTM IDs independently; converted chunks are then
+    handed to the block sorter in input order, so the output (and the line
+    reported for the first invalid record) is the same as with one thread.
+    External merge passes are also run on that many threads: the sorted
+    runs merged by a pass are cut into key ranges by sampling them, and
+    each thread merges one key range into its own region of the output.
+    Converting sorted points to unit vectors also uses that many threads.
+
+    The final HDF5 data file is written during the last pass over the
+    sorted points: the tree node generation pass, or the final merge pass
+    if no index is built. Buffers of points are converted in parallel and
+    written by a background thread, overlapping the next conversion.
+
+    With <tt>--fuse</tt>, tree nodes are generated from the points as the
+    final merge pass of the external sort produces them, rather than from
+    a separate sequential read of the sorted data file. That pass then
+    writes the HDF5 data file instead of the sorted points, which saves a
+    full write and read of them, at the cost of running the final merge
+    pass on a single thread, and of using the memory needed for node
+    generation at the same time as the memory needed for merging.
+
     \section data Data File Algorithm
 
     Producing the sorted data file is conceptually simple; all that is
-    required is an external sorting routine. The implementation uses
-    quicksort on in-memory blocks followed by a series of k-way merges.
+    required is an external sorting routine. Input files are parsed by
+    <tt>--threads</tt> threads into blocks of points, which are radix
+    sorted on their HTM IDs (using all available cores) while the
+    previous block is written out. The sorted blocks are then combined by
+    a series of k-way merge passes, each of which selects the next point
+    with a loser tree, and splits the key range of its output among the
+    threads.
+    Finally, the spherical coordinates of the sorted points are converted
+    to unit vectors by a pool of threads, and written to the HDF5 data
+    file by a background thread, during the tree node generation pass (or
+    during the final merge pass, with <tt>--fuse</tt> or if no index is
+    built).
 
     \section tree Tree File Algorithm
 
@@ -84,10 +173,12 @@
         - Each node N corresponds to an HTM triangle, and stores
           a count of the number of entries inside N, count(N), as well
           as the index (in the data file) of its first entry.
-        - If level(N) == 20, N is a leaf - no children are generated.
+        - If level(N) == D (the tree depth, 20 by default), N is a
+          leaf - no children are generated.
         - If count(N) < K for some fixed threshold K,
-          N is a leaf - no children are generated.
-        - If count(N) >= K and level(N) < 20, N is an internal node - the
+          N is a leaf - no children are generated (unless
+          <tt>--adaptive</tt> is given, and the cost model favors them).
+        - If count(N) >= K and level(N) < D, N is an internal node - the
           non-empty children of N are generated.
 
     Given the data file (points sorted by HTM ID), it is possible to emit
@@ -128,7 +219,9 @@
         - Internal nodes additionally store relative tree file offsets for
           4 children. Tree file offsets of empty children are set to 0.
         - Note that internal nodes can be distinguished from leaves simply
-          by comparing their position count to the leaf threshold K.
+          by comparing their position count to the leaf threshold K,
+          except in adaptive trees, where the count is stored doubled,
+          plus 1 for internal nodes.
 
     Variable length coding is used for counts and data file indexes. Using
     such an encoding for tree file offsets is hard. Why? Because with variable
@@ -191,9 +284,12 @@
     generation at larger scales will require parallelization, possibly even
     across machines.
 
-    While such parallelization is conceptually straightforward, even for
-    tree generation/compression, it adds very significant implementation
-    complexity, and so the code is mostly serial for now.
+    Parsing, block sorting, merging and unit vector conversion are
+    parallelized as described above. Tree node generation, layout and
+    compression remain serial; while parallelizing them is conceptually
+    straightforward, it adds very significant implementation complexity.
+    Fused generation trades the parallel final merge pass for one less
+    write and read of the sorted points.
   */
 
 #include <errno.h>
@@ -207,13 +303,15 @@
 
 #include "../tree_entry.hxx"
 #include "../sort_and_index/mem_params.hxx"
+#include "../sort_and_index/index_options.hxx"
 #include "../sort_and_index/tree_root.hxx"
 #include "../sort_and_index/node.hxx"
 #include "../sort_and_index.hxx"
 
 size_t blk_sort_ascii (const std::vector<std::string> &infiles,
                        const std::string &outfile, const char delim,
-                       const struct mem_params *const mem);
+                       const struct mem_params *const mem, const int depth,
+                       const int nthreads);
 
 void usage (const char *prog);
 
@@ -224,24 +322,33 @@ int main (int argc, char **argv)
   size_t npoints;
   size_t memsz = 512 * 1024 * 1024;
   size_t ioblksz = 1024 * 1024;
-  size_t minpoints = 1024;
-  uint64_t leafthresh = 64;
+  index_options opts;
   char delim = '|';
+  int nthreads = 1;
 
   while (1)
     {
       static struct option long_options[]
           = { { "help", no_argument, 0, 'h' },
+              { "adaptive", no_argument, 0, 'a' },
               { "blk-size", required_argument, 0, 'b' },
+              { "caps", no_argument, 0, 'c' },
               { "delim", required_argument, 0, 'd' },
+              { "depth", required_argument, 0, 'D' },
+              { "fixed", no_argument, 0, 'f' },
+              { "fuse", no_argument, 0, 'F' },
+              { "threads", required_argument, 0, 'j' },
               { "max-mem", required_argument, 0, 'm' },
               { "tree-min", required_argument, 0, 't' },
               { "leaf-thresh", required_argument, 0, 'l' },
+              { "prefix-level", required_argument, 0, 'p' },
+              { "succinct", no_argument, 0, 's' },
+              { "compress", required_argument, 0, 'z' },
               { 0, 0, 0, 0 } };
       unsigned long long v;
       char *endptr;
       int option_index = 0;
-      int c = getopt_long (argc, argv, "hb:d:l:m:t:", long_options,
+      int c = getopt_long (argc, argv, "hab:cd:D:fFj:l:m:p:st:z:", long_options,
                            &option_index);
       if (c == -1)
         {
@@ -252,7 +359,11 @@ int main (int argc, char **argv)
         case 'h':
           usage (argv[0]);
           return EXIT_SUCCESS;
+        case 'a':
+          opts.adaptive = true;
+          break;
         case 'b':
+          errno = 0;
           v = strtoull (optarg, &endptr, 0);
           if (endptr == optarg || errno != 0 || v < 1 || v > 1024 * 1024)
             {
@@ -262,6 +373,9 @@ int main (int argc, char **argv)
             }
           ioblksz = (size_t)v * 1024;
           break;
+        case 'c':
+          opts.caps = true;
+          break;
         case 'd':
           if (strlen (optarg) != 1)
             {
@@ -277,7 +391,37 @@ int main (int argc, char **argv)
               throw std::runtime_error (ss.str ());
             }
           break;
+        case 'D':
+          errno = 0;
+          v = strtoull (optarg, &endptr, 0);
+          if (endptr == optarg || errno != 0 || v > HTM_MAX_LEVEL)
+            {
+              std::stringstream ss;
+              ss << "--depth invalid. Please specify an integer between 0 "
+                    "and " << HTM_MAX_LEVEL << ".";
+              throw std::runtime_error (ss.str ());
+            }
+          opts.depth = (int)v;
+          break;
+        case 'f':
+          opts.fixed = true;
+          break;
+        case 'F':
+          opts.fused = true;
+          break;
+        case 'j':
+          errno = 0;
+          v = strtoull (optarg, &endptr, 0);
+          if (endptr == optarg || errno != 0 || v < 1 || v > 256)
+            {
+              throw std::runtime_error (
+                  "--threads invalid. Please specify an integer between "
+                  "1 and 256.");
+            }
+          nthreads = (int)v;
+          break;
         case 'l':
+          errno = 0;
           v = strtoull (optarg, &endptr, 0);
           if (endptr == optarg || errno != 0 || v < 1 || v > 1024 * 1024)
             {
@@ -285,9 +429,10 @@ int main (int argc, char **argv)
                   "--leaf-max invalid. Please specify an integer between "
                   "1 and 1,048,576.");
             }
-          leafthresh = (uint64_t)v;
+          opts.leafthresh = (uint64_t)v;
           break;
         case 'm':
+          errno = 0;
           v = strtoull (optarg, &endptr, 0);
           if (endptr == optarg || errno != 0 || v < 1
               || v > SIZE_MAX / 2097152)
@@ -299,7 +444,22 @@ int main (int argc, char **argv)
             }
           memsz = (size_t)v * 1024 * 1024;
           break;
+        case 'p':
+          errno = 0;
+          v = strtoull (optarg, &endptr, 0);
+          if (endptr == optarg || errno != 0 || v > 12)
+            {
+              throw std::runtime_error (
+                  "--prefix-level invalid. Please specify an integer between "
+                  "0 and 12.");
+            }
+          opts.prefixlevel = (int)v;
+          break;
+        case 's':
+          opts.succinct = true;
+          break;
         case 't':
+          errno = 0;
           v = strtoull (optarg, &endptr, 0);
           if (endptr == optarg || errno != 0 || v > SIZE_MAX)
             {
@@ -308,7 +468,18 @@ int main (int argc, char **argv)
                     "integer less than or equal to " << SIZE_MAX;
               throw std::runtime_error (ss.str ());
             }
-          minpoints = (size_t)v;
+          opts.minpoints = (size_t)v;
+          break;
+        case 'z':
+          errno = 0;
+          v = strtoull (optarg, &endptr, 0);
+          if (endptr == optarg || errno != 0 || v < 1 || v > 9)
+            {
+              throw std::runtime_error (
+                  "--compress invalid. Please specify an integer between "
+                  "1 and 9.");
+            }
+          opts.compress = (int)v;
           break;
         case '?':
           return EXIT_FAILURE;
@@ -316,6 +487,16 @@ int main (int argc, char **argv)
           abort ();
         }
     }
+  if (opts.fixed && opts.succinct)
+    {
+      throw std::runtime_error (
+          "--fixed and --succinct are mutually exclusive");
+    }
+  if (opts.prefixlevel > opts.depth)
+    {
+      throw std::runtime_error (
+          "--prefix-level must not be greater than --depth");
+    }
   if (argc - optind < 2)
     {
       throw std::runtime_error (
@@ -331,14 +512,14 @@ int main (int argc, char **argv)
     {
       infiles.push_back (argv[optind]);
     }
-  mem_params mem (memsz, ioblksz);
+  mem_params mem (memsz, ioblksz, (size_t)nthreads);
 
   printf ("\n");
 
   /* Phase 1: produce sorted point file from ASCII inputs */
-  npoints = blk_sort_ascii (infiles, datafile, delim, &mem);
+  npoints = blk_sort_ascii (infiles, datafile, delim, &mem, opts.depth,
+                            nthreads);
 
-  sort_and_index<tree_entry>(datafile, scratch, treefile, mem, npoints,
-                             minpoints, leafthresh);
+  sort_and_index<tree_entry>(datafile, scratch, treefile, mem, npoints, opts);
   return EXIT_SUCCESS;
 }
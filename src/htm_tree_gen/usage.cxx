@@ -25,23 +25,52 @@ void usage (const char *prog)
       "be omitted.\n"
       "\n"
       "    The first is a tree index, and the second contains points\n"
-      "sorted by level 20 HTM ID. If the inputs contain no more than a\n"
-      "configurable number of points, the tree index is omitted. When is\n"
-      "this useful? For small data-sets, scanning the point file and\n"
-      "testing each point for spherical-region membership can be faster\n"
-      "than searching a tree. This is because tree searching has some\n"
-      "overhead, and for sufficiently small data sets, a single page\n"
-      "on disk will contain a significant fraction of the points. In\n"
-      "this case, using a tree to reduce the number of points tested\n"
-      "against a region fails to reduce IO compared to a scan.\n"
+      "sorted by HTM ID (at level 20 by default). If the inputs\n"
+      "contain no more than a configurable number of points, the tree\n"
+      "index is omitted. When is this useful? For small data-sets,\n"
+      "scanning the point file and testing each point for spherical-\n"
+      "region membership can be faster than searching a tree. This is\n"
+      "because tree searching has some overhead, and for sufficiently\n"
+      "small data sets, a single page on disk will contain a\n"
+      "significant fraction of the points. In this case, using a tree\n"
+      "to reduce the number of points tested against a region fails to\n"
+      "reduce IO compared to a scan.\n"
       "\n"
       "== Options ====\n"
       "\n"
       "--help        |-h        :  Prints usage information.\n"
+      "--adaptive    |-a        :  Let a query cost model split nodes\n"
+      "                            with fewer points than the leaf\n"
+      "                            threshold, so that dense regions get\n"
+      "                            deeper trees. Nodes at or above the\n"
+      "                            threshold are always split, so sparse\n"
+      "                            regions are never made shallower. Nodes\n"
+      "                            then record whether they are leaves.\n"
       "--blk-size    |-b <int>  :  IO block size in KiB. The default is\n"
       "                            1024 KiB.\n"
+      "--caps        |-c        :  Store a bounding cap for the points of\n"
+      "                            every tree node in the index. Queries\n"
+      "                            can then classify nodes against their\n"
+      "                            actual contents rather than their HTM\n"
+      "                            triangles, at a cost of 16 bytes/node.\n"
       "--delim       |-d <char> :  The separator character to use when\n"
       "                            parsing input files. The default is '|'.\n"
+      "--depth       |-D <int>  :  HTM level of the IDs points are sorted\n"
+      "                            on, and of the deepest tree nodes\n"
+      "                            (0-24). The default is 20; deeper\n"
+      "                            trees split dense regions further.\n"
+      "--fixed       |-f        :  Describe the children of index nodes\n"
+      "                            with fixed-width integers rather than\n"
+      "                            varints. The index is larger, but\n"
+      "                            faster to decode once in memory.\n"
+      "--fuse        |-F        :  Generate tree nodes during the final\n"
+      "                            merge pass of the point sort, saving a\n"
+      "                            write and read of the sorted points.\n"
+      "                            That pass then runs on a single thread.\n"
+      "--threads     |-j <int>  :  Number of threads parsing the input\n"
+      "                            files, merging sorted runs and\n"
+      "                            converting points to unit vectors\n"
+      "                            (1-256). The default is 1.\n"
       "--max-mem     |-m <int>  :  Approximate memory usage limit in MiB.\n"
       "                            The default is 512 MiB. Note that this\n"
       "                            applies only to various external sorts,\n"
@@ -52,6 +81,23 @@ void usage (const char *prog)
       "                            index generation is skipped. The default\n"
       "                            is 1024.\n"
       "--leaf-thresh |-l <int>  :  Minimum number of points in an internal\n"
-      "                            tree node; defaults to 64.\n",
+      "                            tree node; defaults to 64. With\n"
+      "                            --adaptive, nodes this large are always\n"
+      "                            split, and smaller ones may be.\n"
+      "--prefix-level|-p <int>  :  Store the cumulative point count of\n"
+      "                            every HTM triangle at the given level\n"
+      "                            (0-12), so that points in lists of\n"
+      "                            HTM ID ranges can be counted without\n"
+      "                            searching the index. The table takes\n"
+      "                            8*4^level 64 bit integers.\n"
+      "--succinct    |-s        :  Store the index as a bit-vector of\n"
+      "                            child masks and bit-packed node counts,\n"
+      "                            without child offsets. The index is\n"
+      "                            2-3 times smaller, but each node\n"
+      "                            takes a little longer to decode.\n"
+      "--compress    |-z <int>  :  Store points in deflate compressed\n"
+      "                            chunks, using the given compression\n"
+      "                            level (1-9). By default, points are\n"
+      "                            stored uncompressed.\n",
       prog);
 }
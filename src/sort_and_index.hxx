@@ -4,49 +4,126 @@
 #include <stddef.h>
 
 #include "sort_and_index/mem_params.hxx"
+#include "sort_and_index/index_options.hxx"
 #include "sort_and_index/tree_root.hxx"
 #include "sort_and_index/tree_gen.hxx"
 #include "sort_and_index/spherical_to_vec.hxx"
 #include "sort_and_index/ext_sort.hxx"
+#include "sort_and_index/sorted_scan.hxx"
 
 uint64_t tree_compress (const std::string &treefile,
                         const std::string &scratchfile, const mem_params &mem,
                         const tree_root &super, const size_t nnodes,
-                        const uint64_t leafthresh);
+                        const uint64_t leafthresh, const uint64_t flags);
+void tree_succinct (const std::string &treefile,
+                    const std::string &scratchfile, const mem_params &mem,
+                    const tree_root &super, const size_t nnodes,
+                    const uint64_t leafthresh, const uint64_t flags);
 void reverse_file (const std::string &infile, const std::string &outfile,
                    const mem_params &mem, const uint64_t filesz);
 
 void append_htm (const std::string &htm_path, const std::string &data_path);
+void append_prefix (const std::string &prefix_path,
+                    const std::string &data_path);
 
 template <class T>
 void sort_and_index (const std::string &data_path,
                      const std::string &scratch_path,
                      const std::string &htm_path, const mem_params &mem,
-                     const size_t npoints, const size_t minpoints,
-                     const uint64_t leafthresh)
+                     const size_t npoints, const index_options &opts)
 {
-  size_t nnodes;
-  ext_sort<T>(data_path, scratch_path, mem, npoints);
+  const std::string vec_path = data_path + ".vec";
+  size_t nnodes = 0;
+  struct tree_root super;
+  bool create_index (npoints > opts.minpoints);
+
+  /* Phase 4 runs alongside the last pass over the sorted points: their
+     spherical coords are converted to unit vectors and written to the
+     final data file as they are produced. Compressed data files are split
+     into chunks of about 256KiB holding a multiple of leafthresh rows, so
+     that a leaf (fewer than leafthresh points, unless at the tree depth)
+     is decompressed with at most two chunks, and usually one. */
+  const hsize_t leafbytes = opts.leafthresh * sizeof(htm_entry<T>);
+  const hsize_t chunkrows
+      = std::max ((hsize_t)1, (hsize_t)(256 * 1024) / leafbytes)
+        * opts.leafthresh;
+  {
+    vec_writer<T> vec (vec_path, mem, npoints, opts.compress, chunkrows);
+
+    if (!create_index)
+      {
+        if (!ext_sort<T>(data_path, scratch_path, mem, npoints, &vec))
+          {
+            sorted_scan<T>(data_path, mem, npoints, vec);
+          }
+      }
+    else
+      {
+        if (!opts.fused)
+          {
+            ext_sort<T>(data_path, scratch_path, mem, npoints);
+          }
+        /* Phase 2: produce sorted tree nodes (and prefix counts) from the
+           sorted points, either during the final merge pass (fused), or
+           from a read of the sorted data file */
+        std::cout << "Generating block sorted tree node file " << htm_path
+                  << (opts.fused ? " during the final merge of " : " from ")
+                  << data_path << "\n";
+        tree_builder<T> b (htm_path, mem, super, opts, htm_path + ".prefix");
+        ext_sort_tee<tree_builder<T>, vec_writer<T> > tee = { b, vec };
+        if (!opts.fused
+            || !ext_sort<T>(data_path, scratch_path, mem, npoints, &tee))
+          {
+            sorted_scan<T>(data_path, mem, npoints, tee);
+          }
+        nnodes = b.finish (npoints);
+      }
+    vec.finish ();
+  }
+  if (rename (vec_path.c_str (), data_path.c_str ()) != 0)
+    {
+      throw std::runtime_error ("failed to rename file " + vec_path + " to "
+                                + data_path);
+    }
 
-  bool create_index (npoints > minpoints);
   if (create_index)
     {
-      struct tree_root super;
       uint64_t filesz;
-      /* Phase 2: produce sorted tree nodes from data file */
-      nnodes
-          = tree_gen<T>(data_path, htm_path, mem, super, leafthresh, npoints);
       ext_sort<disk_node>(htm_path, scratch_path, mem, nnodes);
-      /* Phase 3: compress tree file */
-      filesz = tree_compress (htm_path, scratch_path, mem, super, nnodes,
-                              leafthresh);
-      reverse_file (scratch_path, htm_path, mem, filesz);
+      /* Phase 3: compress tree file, or encode it succinctly (which
+         leaves no child offsets to make fixed-width). The depth is only
+         recorded if it is not the historical level 20. */
+      const uint64_t flags
+          = (opts.caps ? HTM_TREE_CAPS : 0)
+            | (opts.succinct ? HTM_TREE_SUCCINCT
+                             : (opts.fixed ? HTM_TREE_FIXED : 0))
+            | (opts.depth != 20 ? HTM_TREE_DEPTH : 0)
+            | (opts.adaptive ? HTM_TREE_ADAPTIVE : 0);
+      if (opts.succinct)
+        {
+          tree_succinct (htm_path, scratch_path, mem, super, nnodes,
+                         opts.leafthresh, flags);
+        }
+      else
+        {
+          filesz = tree_compress (htm_path, scratch_path, mem, super, nnodes,
+                                  opts.leafthresh, flags);
+          reverse_file (scratch_path, htm_path, mem, filesz);
+        }
     }
-  /* Phase 4: convert spherical coords to unit vectors */
-  spherical_to_vec<T>(data_path, scratch_path, mem, npoints);
 
   if (create_index)
-    append_htm (htm_path, data_path);
+    {
+      append_htm (htm_path, data_path);
+      if (opts.prefixlevel >= 0)
+        append_prefix (htm_path + ".prefix", data_path);
+    }
+
+  /* Open the result once, so that its layout descriptor is cached and
+     later opens can skip HDF5. */
+  struct htm_tree tree;
+  if (htm_tree_init (&tree, data_path.c_str ()) == HTM_OK)
+    htm_tree_destroy (&tree);
 }
 
 #endif
@@ -18,3 +18,21 @@ void append_htm (const std::string &htm_path, const std::string &data_path)
   }
   boost::filesystem::remove (htm_path);
 }
+
+void append_prefix (const std::string &prefix_path,
+                    const std::string &data_path)
+{
+  hsize_t dim[] = { boost::filesystem::file_size (prefix_path) / 8 };
+  H5::DataSpace data_space (1, dim);
+
+  {
+    H5::H5File file (data_path, H5F_ACC_RDWR);
+    H5::DataSet dataset (file.createDataSet (
+        "htm_prefix", H5::PredType::STD_U64LE, data_space));
+
+    boost::iostreams::mapped_file_source prefix (prefix_path);
+
+    dataset.write (prefix.data (), H5::PredType::STD_U64LE);
+  }
+  boost::filesystem::remove (prefix_path);
+}
@@ -37,16 +37,19 @@ template <class T, bool sorted = true> struct blk_writer
   enum blk_write_state state;
   unsigned char *wrbuf;
   size_t wrbytes;
+  void *scratch;          /* Block sort scratch space, allocated lazily */
+  unsigned int nthreads;  /* Max # of threads sorting a block */
   pthread_attr_t attr;
   pthread_mutex_t mtx;
   pthread_cond_t cv;
   pthread_t thr;
 
-  blk_writer (const std::string &file, size_t blksz)
+  blk_writer (const std::string &file, size_t blksz, size_t Nthreads = 1)
       : bytes_per_block (blksz), bytes_in_block (0),
         fd (open (file.c_str (), O_CREAT | O_TRUNC | O_APPEND | O_WRONLY,
                   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)),
-        state (BK_WRITE_START), wrbuf (nullptr), wrbytes (0)
+        state (BK_WRITE_START), wrbuf (nullptr), wrbytes (0),
+        scratch (nullptr), nthreads ((unsigned int)Nthreads)
   {
     if (fd == -1)
       throw std::runtime_error ("failed to open file " + file
@@ -146,6 +149,7 @@ template <class T, bool sorted = true> struct blk_writer
     pthread_join (thr, NULL);
     /* clean up */
     free (mem);
+    free (scratch);
 
     if (::close (fd) != 0)
       throw std::runtime_error ("file close() failed");
@@ -158,10 +162,29 @@ template <class T, bool sorted = true> struct blk_writer
   blk_writer () = delete;
 };
 
+/*  Sorts a block of entries before it is written, using scratch space
+    for as many entries if needed, and up to nthreads threads. Entry
+    types with a radix sort key overload this (see radix_sort.hxx).
+ */
+template <class T> void blk_sort (T *begin, T *end, T *, unsigned int)
+{
+  std::sort (begin, end);
+}
+
 template <class T> void blk_writer_issue (blk_writer<T, true> &b)
 {
-  std::sort (reinterpret_cast<T *>(b.buf),
-             reinterpret_cast<T *>(b.buf + b.bytes_in_block));
+  if (b.scratch == nullptr)
+    {
+      b.scratch = std::malloc (b.bytes_per_block);
+      if (b.scratch == nullptr)
+        throw std::runtime_error ("sort buffer allocation malloc() failed "
+                                  "when allocating "
+                                  + std::to_string (b.bytes_per_block)
+                                  + " bytes.");
+    }
+  blk_sort (reinterpret_cast<T *>(b.buf),
+            reinterpret_cast<T *>(b.buf + b.bytes_in_block),
+            static_cast<T *>(b.scratch), b.nthreads);
   b.issue_helper ();
 }
 
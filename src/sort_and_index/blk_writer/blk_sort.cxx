@@ -0,0 +1,21 @@
+/** \file
+    \brief      HTM tree generation.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+
+#include "../node.hxx"
+#include "../radix_sort.hxx"
+
+/*  Node IDs are handed out sequentially in post-order, so within a
+    block each of their words spans a narrow range, and the packed radix
+    key is far shorter than the 48 byte ID.
+ */
+void blk_sort (struct disk_node *begin, struct disk_node *end,
+               struct disk_node *scratch, unsigned int nthreads)
+{
+  radix_sort (begin, (size_t)(end - begin), scratch, NLOD + 1, nthreads,
+              [](const struct disk_node &n, int i)
+  { return n.id.block[i]; });
+}
@@ -9,6 +9,12 @@
     @param[in] mem      Memory parameters.
     @param[in] itemsz   Size of a single item in bytes.
     @param[in] nitems   Number of items in file.
+    @param[in] sink     If not null, the final merge pass passes every
+                        item, in sorted order, to sink->add() instead of
+                        writing it out; file is then left unsorted.
+
+    Returns true if the items were passed to sink, and false if there was
+    nothing to merge (in which case file is already sorted).
  */
 
 #include <string>
@@ -19,6 +25,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <cerrno>
 #include <cstdio>
 #include <chrono>
 #include "mem_params.hxx"
@@ -27,9 +34,27 @@
 
 int mrg_npasses (size_t n, size_t k);
 
-template <class T>
-void ext_sort (const std::string &file, const std::string &scratch,
-               const mem_params &mem, size_t nitems)
+/*  Item sink that discards its input. */
+struct ext_sort_no_sink
+{
+  template <class T> void add (const T &) {}
+};
+
+/*  Item sink passing its input on to two other sinks. */
+template <class A, class B> struct ext_sort_tee
+{
+  A &a;
+  B &b;
+  template <class T> void add (const T &item)
+  {
+    a.add (item);
+    b.add (item);
+  }
+};
+
+template <class T, class Sink = ext_sort_no_sink>
+bool ext_sort (const std::string &file, const std::string &scratch,
+               const mem_params &mem, size_t nitems, Sink *sink = nullptr)
 {
   const size_t itemsz (sizeof(T));
   const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
@@ -43,7 +68,7 @@ void ext_sort (const std::string &file, const std::string &scratch,
     {
       std::cout << "Skipping multi-way merge step (" << file
                 << " already sorted)\n";
-      return;
+      return false;
     }
   std::cout << "Multi-way external merge sort of " << file << "\n";
   auto ttot = std::chrono::high_resolution_clock::now ();
@@ -97,7 +122,8 @@ void ext_sort (const std::string &file, const std::string &scratch,
         }
 
       /* perform merges */
-      mrg_pass<T>(outf, data, mem, filesz, sortsz);
+      mrg_pass<T>(outf, data, mem, filesz, sortsz,
+                  mp == nmp - 1 ? sink : nullptr);
 
       /* cleanup */
       if (munmap ((void *)data, nmap) != 0)
@@ -116,7 +142,16 @@ void ext_sort (const std::string &file, const std::string &scratch,
       std::cout << msecs.count () << " msec\n";
     }
   /* make sure sorted results are in data file and delete scratch file. */
-  if (nmp % 2 == 1)
+  if (sink != nullptr)
+    {
+      /* the final pass wrote nothing; scratch may not even exist */
+      if (unlink (scratch.c_str ()) != 0 && errno != ENOENT)
+        {
+          throw std::runtime_error ("failed to delete file "
+                                    + std::string (scratch));
+        }
+    }
+  else if (nmp % 2 == 1)
     {
       if (rename (scratch.c_str (), file.c_str ()) != 0)
         {
@@ -137,6 +172,7 @@ void ext_sort (const std::string &file, const std::string &scratch,
       std::chrono::duration_cast<std::chrono::milliseconds>(
           std::chrono::high_resolution_clock::now () - ttot));
   std::cout << "\t" << msecs.count () << " msec total\n";
+  return sink != nullptr;
 }
 
 #endif
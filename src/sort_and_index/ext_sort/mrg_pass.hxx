@@ -4,21 +4,183 @@
 /*  Performs one multi-way merge pass.
  */
 
+#include <algorithm>
 #include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../blk_writer.hxx"
 #include "../mem_params.hxx"
 #include "mrg_seg.hxx"
-#include "mrg_pass/heap_up.hxx"
-#include "mrg_pass/heap_down.hxx"
+#include "mrg_pass/loser_tree.hxx"
+#include "mrg_pass/mrg_pwriter.hxx"
 
+/*  Number of splitter samples taken from each merge segment per thread.
+ */
+static const size_t MRG_SAMPLES = 16;
+
+/*  Merges ns segments, passing every item to out in ascending order.
+ */
+template <class T, class Out>
+void mrg_merge (mrg_seg<T> *segs, size_t ns, const size_t blksz, Out out)
+{
+  loser_tree<T> t (segs, ns);
+  for (; t.live > 0; t.pop (blksz))
+    {
+      /* output minimum value from all ns merge segments */
+      out (segs[t.top ()].cur);
+    }
+}
+
+/*  Performs one multi-way merge pass on mem.nthreads threads. Each group
+    of up to mem.k sorted runs is cut into one key range per thread, with
+    splitters chosen by sampling the runs. Runs are split at the
+    splitters by binary search, so the position of each key range in the
+    output is known up front, and every thread merges its key range and
+    writes it to its own region of the output file. The IO block size
+    used for reading and writing is divided among the threads.
+ */
 template <class T>
+void mrg_pass_parallel (const std::string &outf, const void *const data,
+                        const mem_params &mem, const size_t filesz,
+                        const size_t sortsz)
+{
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  const size_t nt = mem.nthreads;
+  const size_t n = filesz / sizeof(T);
+  const size_t runlen = sortsz / sizeof(T);
+  T *const base = reinterpret_cast<T *>(const_cast<void *>(data));
+  size_t blksz = mem.ioblksz / nt;
+  size_t start;
+  int fd;
+
+  blksz -= blksz % pagesz;
+  if (blksz < pagesz)
+    {
+      blksz = pagesz;
+    }
+  fd = open (outf.c_str (), O_CREAT | O_TRUNC | O_WRONLY,
+             S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd == -1)
+    {
+      throw std::runtime_error ("failed to open file " + outf
+                                + " for writing");
+    }
+  for (start = 0; start < n; start += mem.k * runlen)
+    {
+      const size_t end = std::min (n, start + mem.k * runlen);
+      const size_t ns = (end - start + runlen - 1) / runlen;
+      std::vector<T> samples;
+      std::vector<size_t> cut (ns * (nt + 1));
+      std::vector<std::thread> threads;
+      std::exception_ptr error;
+      std::mutex mtx;
+      size_t s, p;
+
+      /* choose nt - 1 splitters from regularly spaced samples */
+      for (s = 0; s < ns; ++s)
+        {
+          const size_t b = start + s * runlen;
+          const size_t len = std::min (end, b + runlen) - b;
+          const size_t m = std::min (len, MRG_SAMPLES * nt);
+          for (size_t i = 0; i < m; ++i)
+            {
+              samples.push_back (base[b + i * len / m]);
+            }
+        }
+      std::sort (samples.begin (), samples.end ());
+      /* split every run at the splitters */
+      for (s = 0; s < ns; ++s)
+        {
+          T *const b = base + start + s * runlen;
+          T *const e = base + std::min (end, start + (s + 1) * runlen);
+          size_t *c = &cut[s * (nt + 1)];
+          c[0] = 0;
+          for (p = 1; p < nt; ++p)
+            {
+              c[p] = std::lower_bound (b, e, samples[p * samples.size () / nt])
+                     - b;
+            }
+          c[nt] = e - b;
+        }
+      /* merge key ranges in parallel */
+      for (p = 0; p < nt; ++p)
+        {
+          threads.emplace_back ([&, p]()
+          {
+            try
+              {
+                std::vector<mrg_seg<T> > segs (ns);
+                size_t off = start, nseg = 0;
+                for (size_t i = 0; i < ns; ++i)
+                  {
+                    const size_t *c = &cut[i * (nt + 1)];
+                    T *const b = base + start + i * runlen;
+                    off += c[p];
+                    if (c[p + 1] > c[p])
+                      {
+                        segs[nseg++].init (b + c[p], b + c[p + 1], blksz);
+                      }
+                  }
+                mrg_pwriter<T> w (fd, (off_t)(off * sizeof(T)), blksz);
+                mrg_merge (segs.data (), nseg, blksz,
+                           [&](const T *item) { w.append (item); });
+                w.flush ();
+              }
+            catch (...)
+              {
+                std::lock_guard<std::mutex> lock (mtx);
+                if (!error)
+                  {
+                    error = std::current_exception ();
+                  }
+              }
+          });
+        }
+      for (auto &t : threads)
+        {
+          t.join ();
+        }
+      if (error)
+        {
+          ::close (fd);
+          std::rethrow_exception (error);
+        }
+    }
+  if (::close (fd) != 0)
+    {
+      throw std::runtime_error ("file close() failed");
+    }
+}
+
+/*  Performs one multi-way merge pass. If sink is not null, every item is
+    passed to sink->add() rather than written to outf; such a pass runs
+    serially, as the sink must see the items of the whole file in order.
+ */
+template <class T, class Sink>
 void mrg_pass (const std::string &outf, const void *const data,
-               const mem_params &mem, const size_t filesz, const size_t sortsz)
+               const mem_params &mem, const size_t filesz, const size_t sortsz,
+               Sink *sink)
 {
-  blk_writer<T> w (outf, mem.ioblksz);
   mrg_seg<T> *segs;
   size_t start;
 
+  if (mem.nthreads > 1 && sink == nullptr)
+    {
+      mrg_pass_parallel<T>(outf, data, mem, filesz, sortsz);
+      return;
+    }
+  /* merged output is already sorted, and blocks may straddle two groups */
+  std::unique_ptr<blk_writer<T, false> > w;
+  if (sink == nullptr)
+    {
+      w.reset (new blk_writer<T, false>(outf, mem.ioblksz));
+    }
   /* allocate merge segments */
   segs = (mrg_seg<T> *)malloc (mem.k * sizeof(mrg_seg<T>));
   if (segs == NULL)
@@ -36,20 +198,19 @@ void mrg_pass (const std::string &outf, const void *const data,
           segs[ns].init (reinterpret_cast<T *>((char *)data + start),
                          reinterpret_cast<T *>((char *)data + end),
                          mem.ioblksz);
-          heap_up (segs, ns);
         }
       /* merge ns segments */
-      while (ns > 0)
-        {
-          /* write minimum value from all ns merge segments to disk */
-          w.append (segs->cur);
-          if (segs->consume (mem.ioblksz, sizeof(T)) == 0)
-            {
-              segs[0] = segs[ns - 1];
-              --ns;
-            }
-          heap_down (segs, ns);
-        }
+      mrg_merge (segs, ns, mem.ioblksz, [&](const T *item)
+      {
+        if (sink != nullptr)
+          {
+            sink->add (*item);
+          }
+        else
+          {
+            w->append (item);
+          }
+      });
     }
   free (segs);
 }
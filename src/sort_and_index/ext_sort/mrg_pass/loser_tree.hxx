@@ -0,0 +1,115 @@
+#ifndef SORT_AND_INDEX_LOSER_TREE_HXX
+#define SORT_AND_INDEX_LOSER_TREE_HXX
+
+/*  Tournament tree selecting the minimum current item of a set of merge
+    segments.
+ */
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "../mrg_seg.hxx"
+
+/*  Returns a 64 bit prefix of the sort key of an item: if the prefix of
+    a is less than that of b, then a < b. Item types overload this (see
+    tree_entry.hxx and node.hxx); by default every prefix is equal, so
+    that all items are compared with operator<.
+ */
+template <class T> uint64_t mrg_key (const T &) { return 0; }
+
+/*  A loser tree over n merge segments. Leaf i is segment i, internal
+    node i (0 < i < n) holds the loser of the match between its two
+    subtrees, and node 0 holds the overall winner. Every node caches the
+    key prefix of the current item of its segment, so replacing the
+    winner only takes a walk from its leaf to the root, with one
+    comparison per level. Items are compared with operator< only when
+    their key prefixes are equal.
+ */
+template <class T> struct loser_tree
+{
+  mrg_seg<T> *segs;
+  size_t n;
+  size_t live;                     /* Number of non-empty segments */
+  std::vector<uint64_t> key;       /* Key prefix of the item of a node */
+  std::vector<size_t> seg;         /* Segment of a node */
+  std::vector<unsigned char> done; /* Is a segment exhausted? */
+
+  loser_tree (mrg_seg<T> *Segs, const size_t N)
+      : segs (Segs), n (N), live (N), key (N), seg (N, N), done (N, 0)
+  {
+    size_t i, j;
+
+    /* play every leaf up the tree until it meets an empty node; a winner
+       only leaves a node once both of its subtrees have been played */
+    for (i = 0; i < n; ++i)
+      {
+        uint64_t k = mrg_key (*segs[i].cur);
+        size_t s = i;
+        for (j = (i + n) / 2; j > 0 && seg[j] != n; j /= 2)
+          {
+            if (less (key[j], seg[j], k, s))
+              {
+                std::swap (key[j], k);
+                std::swap (seg[j], s);
+              }
+          }
+        key[j] = k;
+        seg[j] = s;
+      }
+  }
+
+  /*  Is the item of segment sa (with key prefix ka) less than that of
+      segment sb? Exhausted segments are greater than all others. */
+  bool less (const uint64_t ka, const size_t sa, const uint64_t kb,
+             const size_t sb) const
+  {
+    if (ka != kb)
+      {
+        return ka < kb;
+      }
+    if (done[sa] || done[sb])
+      {
+        return !done[sa];
+      }
+    return *segs[sa].cur < *segs[sb].cur;
+  }
+
+  /*  Returns the index of the segment holding the minimum item. */
+  size_t top () const { return seg[0]; }
+
+  /*  Consumes the minimum item and replays its segment. */
+  void pop (const size_t blksz)
+  {
+    size_t s = seg[0], j;
+    uint64_t k;
+
+    if (segs[s].consume (blksz, sizeof(T)) == 0)
+      {
+        done[s] = 1;
+        k = UINT64_MAX;
+        --live;
+      }
+    else
+      {
+        k = mrg_key (*segs[s].cur);
+      }
+    for (j = (s + n) / 2; j > 0; j /= 2)
+      {
+        /* swap with masks rather than branch, as the outcome of a match
+           is unpredictable */
+        const uint64_t ok = key[j];
+        const size_t os = seg[j];
+        const uint64_t m = UINT64_C (0) - (uint64_t)less (ok, os, k, s);
+        const uint64_t xk = (ok ^ k) & m;
+        const size_t xs = (os ^ s) & m;
+        key[j] = ok ^ xk;
+        seg[j] = os ^ xs;
+        k ^= xk;
+        s ^= xs;
+      }
+    key[0] = k;
+    seg[0] = s;
+  }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SORT_AND_INDEX_MRG_PWRITER_HXX
+#define SORT_AND_INDEX_MRG_PWRITER_HXX
+
+/*  Buffered writer of a contiguous region of a file, starting at a
+    given offset. Several writers can fill disjoint regions of the same
+    file concurrently.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+template <class T> struct mrg_pwriter
+{
+  int fd;                          /* File descriptor of output file */
+  off_t off;                       /* File offset of buffered data */
+  std::vector<unsigned char> buf;  /* Output buffer */
+  size_t nbytes;                   /* Number of bytes in buf */
+
+  mrg_pwriter (const int Fd, const off_t Off, const size_t blksz)
+      : fd (Fd), off (Off), buf (blksz < sizeof(T) ? sizeof(T) : blksz),
+        nbytes (0)
+  {
+  }
+
+  void append (const T *const item)
+  {
+    if (nbytes + sizeof(T) > buf.size ())
+      {
+        flush ();
+      }
+    memcpy (&buf[nbytes], item, sizeof(T));
+    nbytes += sizeof(T);
+  }
+
+  void flush ()
+  {
+    size_t done = 0;
+    while (done < nbytes)
+      {
+        const ssize_t n = pwrite (fd, &buf[done], nbytes - done, off + done);
+        if (n < 0)
+          {
+            if (errno == EINTR)
+              {
+                continue;
+              }
+            throw std::runtime_error ("pwrite() failed");
+          }
+        done += (size_t)n;
+      }
+    off += nbytes;
+    nbytes = 0;
+  }
+};
+
+#endif
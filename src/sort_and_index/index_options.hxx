@@ -0,0 +1,35 @@
+#ifndef HTM_TREE_GEN_INDEX_OPTIONS_H
+#define HTM_TREE_GEN_INDEX_OPTIONS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*  Options controlling the data file and tree index produced by
+    sort_and_index. The defaults are those of htm_tree_gen: a varint
+    index over level 20 HTM IDs, with a leaf threshold of 64 points, for
+    inputs of more than 1024 points.
+ */
+
+struct index_options
+{
+  uint64_t leafthresh; /* min # of points in an internal node (or max # of
+                          points in a leaf, if adaptive) */
+  size_t minpoints;    /* no index is built for this many points or less */
+  bool caps;           /* store node bounding caps in the index? */
+  bool fixed;          /* fixed-width children blocks? */
+  bool succinct;       /* succinct index format? */
+  bool adaptive;       /* choose leaves with a query cost model? */
+  bool fused;          /* generate nodes during the final merge pass? */
+  int compress;        /* deflate level of the points, or 0 */
+  int prefixlevel;     /* level of the prefix count table, or -1 */
+  int depth;           /* level of point HTM IDs (and leaves) */
+
+  index_options ()
+      : leafthresh (64), minpoints (1024), caps (false), fixed (false),
+        succinct (false), adaptive (false), fused (false), compress (0),
+        prefixlevel (-1), depth (20)
+  {
+  }
+};
+
+#endif
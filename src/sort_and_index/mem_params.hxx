@@ -6,12 +6,13 @@
 
 struct mem_params
 {
-  size_t memsz;   /* Max memory usage in bytes */
-  size_t sortsz;  /* Size of blocks operated on by in-memory sorts */
-  size_t ioblksz; /* Size of IO blocks */
-  size_t k;       /* Number of merge segments in one multi-way merge pass */
+  size_t memsz;    /* Max memory usage in bytes */
+  size_t sortsz;   /* Size of blocks operated on by in-memory sorts */
+  size_t ioblksz;  /* Size of IO blocks */
+  size_t k;        /* Number of merge segments in one multi-way merge pass */
+  size_t nthreads; /* Number of threads merging in parallel */
 
-  mem_params (size_t total, size_t Ioblksz)
+  mem_params (size_t total, size_t Ioblksz, size_t Nthreads = 1)
   {
     const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
     if (total % (2 * pagesz) != 0)
@@ -27,9 +28,11 @@ struct mem_params
         total = 6 * Ioblksz;
       }
     memsz = total;
-    sortsz = total / 2;
+    /* sorted block writers hold 2 blocks, plus one of sort scratch space */
+    sortsz = total / 3 - (total / 3) % pagesz;
     ioblksz = Ioblksz;
     k = (total - 2 * Ioblksz) / (2 * Ioblksz);
+    nthreads = (Nthreads < 1 ? 1 : Nthreads);
   }
 };
 
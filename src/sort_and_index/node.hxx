@@ -1,6 +1,7 @@
 #ifndef HTM_TREE_GEN_NODE_H
 #define HTM_TREE_GEN_NODE_H
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include "tinyhtm.h"
@@ -55,6 +56,24 @@ struct node_id
   }
 } HTM_ALIGNED (16);
 
+/*  A spherical cap bounding the points of a tree node.
+ */
+struct node_cap
+{
+  struct htm_v3 cen; /* cap center; sum of point vectors until emitted */
+  double radius;     /* cap radius angle (radians) */
+};
+
+/*  Returns the angle (radians) between unit vectors v1 and v2.
+ */
+HTM_INLINE double node_cap_angle (const struct htm_v3 *v1,
+                                  const struct htm_v3 *v2)
+{
+  struct htm_v3 x;
+  htm_v3_cross (&x, v1, v2);
+  return atan2 (htm_v3_norm (&x), htm_v3_dot (v1, v2));
+}
+
 /*  On-disk representation of a tree node.
  */
 struct disk_node
@@ -63,6 +82,7 @@ struct disk_node
   uint64_t count;
   uint64_t index;
   struct node_id child[4];
+  struct node_cap cap;
   bool operator<(const disk_node &d) const { return id < d.id; }
 } HTM_ALIGNED (16);
 
@@ -98,8 +118,6 @@ HTM_INLINE int node_id_eq (const struct node_id *const id1,
   return 1;
 }
 
-void disk_node_sort (void *data, size_t nbytes);
-int disk_node_cmp (const void *n1, const void *n2);
 
 /* ---- In-memory node representation ---- */
 
@@ -113,8 +131,7 @@ enum node_status
 };
 
 /*  In-memory representation of a tree node.  Note that block size/depth
-    is packed into a single 32 bit integer; as a result, nodes occupy
-    exactly 256 bytes and are nicely cache aligned.
+    is packed into a single 32 bit integer to keep nodes small.
  */
 struct mem_node
 {
@@ -126,6 +143,8 @@ struct mem_node
   uint32_t blockinfo[NLOD]; /* Clark & Munro: block depth (8 MSBs) and
                                block size (24 LSBs) for each LOD. */
   struct mem_node *child[4];
+  struct node_cap cap;
+  double cost; /* Expected query cost of the subtree (adaptive leaves) */
 } HTM_ALIGNED (16);
 
 /* get/set block size/depth from 32 bit blockinfo */
@@ -144,6 +163,25 @@ HTM_INLINE uint32_t make_block_info (uint32_t size, uint8_t depth)
 
 #ifdef __cplusplus
 }
+
+/*  Sorts a block of disk nodes with a radix sort on node ID, on up to
+    nthreads threads.
+ */
+void blk_sort (struct disk_node *begin, struct disk_node *end,
+               struct disk_node *scratch, unsigned int nthreads);
+
+/*  Returns the merge key prefix of a disk node: its 2MiB and 64KiB block
+    IDs, 32 bits each. Block IDs that do not fit saturate the whole key,
+    leaving such nodes to be compared by full node ID.
+ */
+inline uint64_t mrg_key (const struct disk_node &n)
+{
+  if (n.id.block[0] >= UINT32_MAX)
+    {
+      return UINT64_MAX;
+    }
+  return (n.id.block[0] << 32) | std::min<uint64_t>(n.id.block[1], UINT32_MAX);
+}
 #endif
 
 #endif
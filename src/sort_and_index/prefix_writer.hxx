@@ -0,0 +1,67 @@
+#ifndef HTM_TREE_GEN_PREFIX_WRITER_H
+#define HTM_TREE_GEN_PREFIX_WRITER_H
+
+#include <cstdint>
+#include <stdexcept>
+#include "blk_writer.hxx"
+
+/*  Writes the prefix count table of a data file (see htm_tree::prefix) as
+    its points are visited in HTM ID order: entry k is the number of
+    points in the level L trixels preceding the k-th one, and a final
+    entry holds the total number of points. Entries are little-endian
+    64 bit integers.
+ */
+struct prefix_writer
+{
+  blk_writer<uint64_t, false> wr;
+  int shift;     /* converts point HTM IDs to level L */
+  uint64_t base; /* first level L HTM ID */
+  uint64_t next; /* next table entry */
+
+  prefix_writer () = delete;
+  prefix_writer (const std::string &file, const size_t blksz,
+                 const int level, const int depth)
+      : wr (file, blksz), shift (2 * (depth - level)),
+        base (UINT64_C (8) << (2 * level)), next (0)
+  {
+    if (level < 0 || level > depth)
+      {
+        throw std::runtime_error ("invalid prefix table level");
+      }
+  }
+
+  /*  Records that the points with the given HTM ID start at
+      data file index \p index. IDs must be passed in ascending order.
+   */
+  void add (const int64_t htmid, const uint64_t index)
+  {
+    const uint64_t k = ((uint64_t)htmid >> shift) - base;
+    while (next <= k)
+      {
+        put (index);
+      }
+  }
+
+  /*  Writes the remaining entries, given the total number of points.
+   */
+  void finish (const uint64_t npoints)
+  {
+    while (next <= base)
+      {
+        put (npoints);
+      }
+  }
+
+  void put (const uint64_t v)
+  {
+    unsigned char buf[8];
+    for (int i = 0; i < 8; ++i)
+      {
+        buf[i] = (unsigned char)(v >> (8 * i));
+      }
+    wr.append (buf, 8);
+    ++next;
+  }
+};
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef HTM_TREE_GEN_RADIX_SORT_H
+#define HTM_TREE_GEN_RADIX_SORT_H
+
+/* ---- Parallel MSD radix sort of in-memory runs ---- */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/*  Number of bits in a radix sort digit.
+ */
+static const int RADIX_BITS = 8;
+
+/*  Runs with fewer elements than this are comparison sorted.
+ */
+static const size_t RADIX_MIN = 4096;
+
+/*  Log 2 of the size of buckets sorted with a key-position sort.
+ */
+static const int RADIX_LOCAL = 16;
+
+/*  Minimum number of elements handled by each radix sort thread.
+ */
+static const size_t RADIX_GRAIN = 65536;
+
+/*  Calls f(t, nthreads) for t in [0, nthreads), on nthreads threads.
+ */
+template <class F> void radix_parallel (const unsigned int nthreads, F f)
+{
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1; t < nthreads; ++t)
+    {
+      threads.emplace_back (f, t, nthreads);
+    }
+  f (0u, nthreads);
+  for (auto &t : threads)
+    {
+      t.join ();
+    }
+}
+
+/*  Sorts the n elements of x on bits [0, hi) of their packed keys, and
+    then, if ties is true, on operator<. The result is stored in y if
+    to_y is true, and in x otherwise; the other array is used as scratch
+    space, as is v.
+
+    Buckets of at most 2^RADIX_LOCAL elements are sorted by packing the
+    key bits and the position of every element into an integer, sorting
+    the integers, and gathering the elements in that order.
+ */
+template <class T, class Packed>
+void radix_msd (T *const x, T *const y, const size_t n, const int hi,
+                const bool to_y, const Packed &packed, const bool ties,
+                std::vector<uint64_t> &v)
+{
+  const int shift = std::max (0, hi - RADIX_BITS);
+  const uint64_t mask = (UINT64_C (1) << (hi - shift)) - 1;
+  size_t count[size_t (1) << RADIX_BITS] = { 0 };
+  size_t pos[size_t (1) << RADIX_BITS];
+  size_t i, j, off;
+
+  if (n <= 1 || hi == 0)
+    {
+      if (ties)
+        {
+          std::sort (x, x + n);
+        }
+      if (to_y)
+        {
+          std::memcpy (static_cast<void *>(y), x, n * sizeof(T));
+        }
+      return;
+    }
+  if (n <= (size_t (1) << RADIX_LOCAL) && hi <= 64 - RADIX_LOCAL)
+    {
+      const uint64_t kmask = (UINT64_C (1) << hi) - 1;
+      v.resize (2 * n);
+      uint64_t *a = v.data (), *b = a + n;
+      for (i = 0; i < n; ++i)
+        {
+          a[i] = ((packed (x[i]) & kmask) << RADIX_LOCAL) | i;
+        }
+      /* LSD radix sort of the key bits; positions are already sorted */
+      for (int s = RADIX_LOCAL; s < RADIX_LOCAL + hi; s += 8)
+        {
+          size_t c[256] = { 0 };
+          for (i = 0; i < n; ++i)
+            {
+              ++c[(a[i] >> s) & 255];
+            }
+          for (i = 0, off = 0; i < 256; ++i)
+            {
+              const size_t t = c[i];
+              c[i] = off;
+              off += t;
+            }
+          for (i = 0; i < n; ++i)
+            {
+              b[c[(a[i] >> s) & 255]++] = a[i];
+            }
+          std::swap (a, b);
+        }
+      for (i = 0; i < n; ++i)
+        {
+          y[i] = x[a[i] & ((UINT64_C (1) << RADIX_LOCAL) - 1)];
+        }
+      /* order runs of elements with equal keys */
+      for (i = 0; ties && i < n; i = j)
+        {
+          for (j = i + 1;
+               j < n && (a[j] >> RADIX_LOCAL) == (a[i] >> RADIX_LOCAL); ++j)
+            {
+            }
+          if (j - i > 1)
+            {
+              std::sort (y + i, y + j);
+            }
+        }
+      if (!to_y)
+        {
+          std::memcpy (static_cast<void *>(x), y, n * sizeof(T));
+        }
+      return;
+    }
+  for (i = 0; i < n; ++i)
+    {
+      ++count[(packed (x[i]) >> shift) & mask];
+    }
+  if (count[(packed (x[0]) >> shift) & mask] == n)
+    {
+      /* all elements share the digit */
+      radix_msd (x, y, n, shift, to_y, packed, ties, v);
+      return;
+    }
+  for (i = 0, off = 0; i <= mask; ++i)
+    {
+      pos[i] = off;
+      off += count[i];
+    }
+  for (i = 0; i < n; ++i)
+    {
+      y[pos[(packed (x[i]) >> shift) & mask]++] = x[i];
+    }
+  for (i = 0, off = 0; i <= mask; off += count[i], ++i)
+    {
+      radix_msd (y + off, x + off, count[i], shift, !to_y, packed, ties, v);
+    }
+}
+
+/*  Sorts n elements with a radix sort. The sort key of an element e is
+    the string of nwords 64 bit unsigned integers key(e, 0), key(e, 1),
+    ..., compared lexicographically, and must be consistent with
+    operator< on T. The scratch array tmp must have room for n elements.
+    At most nthreads threads are used.
+
+    Only the bits in which keys actually differ are sorted on: the
+    minimum of every key word is subtracted from it, and the remaining
+    bits of the leading words are packed into a single 64 bit integer,
+    for as many words as fit. Elements are scattered by the leading
+    digit of the packed key into a scratch buffer, with one contiguous
+    slice of the input per thread, and the resulting buckets are then
+    sorted by the threads independently, recursing on the next digit
+    until a bucket fits in cache (see radix_msd). Elements with equal
+    packed keys but unequal trailing words (e.g. tree entries with equal
+    HTM IDs, whose row IDs break the tie) are ordered with std::sort.
+
+    Runs that are already sorted (e.g. those written by a merge) are left
+    alone, and short runs are sorted with std::sort.
+ */
+template <class T, class Key>
+void radix_sort (T *const data, const size_t n, T *const tmp, const int nwords,
+                 const unsigned int maxthreads, Key key)
+{
+  std::vector<uint64_t> lo (nwords);
+  std::vector<int> bits (nwords);
+  std::vector<size_t> hist;
+  std::atomic<size_t> next (0);
+  unsigned int nthreads;
+  int w, npacked, nbits, shift;
+  size_t nbuckets;
+
+  if (n < RADIX_MIN)
+    {
+      std::sort (data, data + n);
+      return;
+    }
+  if (std::is_sorted (data, data + n))
+    {
+      return;
+    }
+  nthreads = std::max (1u, maxthreads);
+  nthreads = (unsigned int)std::min<size_t>(nthreads, n / RADIX_GRAIN + 1);
+
+  /* find the range of every key word */
+  {
+    std::vector<uint64_t> tlo (nthreads * nwords), thi (nthreads * nwords);
+    radix_parallel (nthreads, [&](unsigned int t, unsigned int nt)
+    {
+      const size_t beg = n * t / nt, end = n * (t + 1) / nt;
+      for (int i = 0; i < nwords; ++i)
+        {
+          uint64_t mn = UINT64_MAX, mx = 0;
+          for (size_t j = beg; j < end; ++j)
+            {
+              const uint64_t v = key (data[j], i);
+              mn = std::min (mn, v);
+              mx = std::max (mx, v);
+            }
+          tlo[t * nwords + i] = mn;
+          thi[t * nwords + i] = mx;
+        }
+    });
+    for (w = 0; w < nwords; ++w)
+      {
+        uint64_t hi = 0, d;
+        lo[w] = UINT64_MAX;
+        for (unsigned int t = 0; t < nthreads; ++t)
+          {
+            lo[w] = std::min (lo[w], tlo[t * nwords + w]);
+            hi = std::max (hi, thi[t * nwords + w]);
+          }
+        for (d = hi - lo[w], bits[w] = 0; d != 0; d >>= 1)
+          {
+            ++bits[w];
+          }
+      }
+  }
+  /* pack leading words into 64 bits */
+  for (npacked = 0, nbits = 0;
+       npacked < nwords && nbits + bits[npacked] <= 64; ++npacked)
+    {
+      nbits += bits[npacked];
+    }
+  auto packed = [&](const T &e)
+  {
+    uint64_t k = 0;
+    for (int i = 0; i < npacked; ++i)
+      {
+        if (bits[i] != 0)
+          {
+            k = (bits[i] == 64 ? 0 : k << bits[i]) | (key (e, i) - lo[i]);
+          }
+      }
+    return k;
+  };
+  if (nbits == 0)
+    {
+      std::sort (data, data + n);
+      return;
+    }
+
+  /* scatter slices of the input by leading digit */
+  shift = std::max (0, nbits - RADIX_BITS);
+  nbuckets = size_t (1) << (nbits - shift);
+  hist.resize ((nthreads + 1) * nbuckets);
+  radix_parallel (nthreads, [&](unsigned int t, unsigned int nt)
+  {
+    const size_t beg = n * t / nt, end = n * (t + 1) / nt;
+    size_t *h = &hist[t * nbuckets];
+    for (size_t j = beg; j < end; ++j)
+      {
+        ++h[packed (data[j]) >> shift];
+      }
+  });
+  {
+    size_t *b = &hist[nthreads * nbuckets], sum = 0;
+    for (size_t d = 0; d < nbuckets; ++d)
+      {
+        b[d] = sum;
+        for (unsigned int t = 0; t < nthreads; ++t)
+          {
+            const size_t c = hist[t * nbuckets + d];
+            hist[t * nbuckets + d] = sum;
+            sum += c;
+          }
+      }
+  }
+  radix_parallel (nthreads, [&](unsigned int t, unsigned int nt)
+  {
+    const size_t beg = n * t / nt, end = n * (t + 1) / nt;
+    size_t *h = &hist[t * nbuckets];
+    for (size_t j = beg; j < end; ++j)
+      {
+        tmp[h[packed (data[j]) >> shift]++] = data[j];
+      }
+  });
+
+  /* sort buckets back into place */
+  for (w = npacked; w < nwords && bits[w] == 0; ++w)
+    {
+    }
+  radix_parallel (nthreads, [&](unsigned int, unsigned int)
+  {
+    const size_t *b = &hist[nthreads * nbuckets];
+    std::vector<uint64_t> v;
+    size_t d;
+    while ((d = next++) < nbuckets)
+      {
+        const size_t end = (d + 1 < nbuckets) ? b[d + 1] : n;
+        radix_msd (&tmp[b[d]], data + b[d], end - b[d], shift, true, packed,
+                   w < nwords, v);
+      }
+  });
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SORT_AND_INDEX_SORTED_SCAN_HXX
+#define SORT_AND_INDEX_SORTED_SCAN_HXX
+
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "mem_params.hxx"
+
+/*  Passes the npoints items of a sorted file to sink.add() in order,
+    reading the file sequentially.
+ */
+template <class T, class Sink>
+void sorted_scan (const std::string &datafile, const mem_params &mem,
+                  const size_t npoints, Sink &sink)
+{
+  const T *data;
+  void *behind;
+  size_t i;
+  int fd;
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  size_t mapsz = npoints * sizeof(T);
+
+  if (npoints == 0)
+    {
+      throw std::runtime_error ("no input points");
+    }
+  fd = open (datafile.c_str (), O_RDONLY);
+  if (fd == -1)
+    {
+      throw std::runtime_error ("failed to open file " + datafile
+                                + " for reading");
+    }
+  if (mapsz % pagesz != 0)
+    {
+      mapsz += pagesz - mapsz % pagesz;
+    }
+  behind = mmap (NULL, mapsz, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (behind == MAP_FAILED)
+    {
+      throw std::runtime_error ("mmap() file " + datafile + " for reading");
+    }
+  if (madvise (behind, mapsz, MADV_SEQUENTIAL) != 0)
+    {
+      throw std::runtime_error ("madvise() failed on mmap for file "
+                                + datafile);
+    }
+  data = (const T *)behind;
+  behind = ((unsigned char *)behind) + mem.ioblksz;
+
+  /* walk over items, dropping the pages behind */
+  for (i = 0; i < npoints; ++i)
+    {
+      if ((void *)&data[i] > behind)
+        {
+          void *ptr = ((unsigned char *)behind) - mem.ioblksz;
+          if (madvise (ptr, mem.ioblksz, MADV_DONTNEED) != 0)
+            {
+              throw std::runtime_error ("madvise() failed");
+            }
+          behind = ((unsigned char *)behind) + mem.ioblksz;
+        }
+      sink.add (data[i]);
+    }
+  if (munmap ((void *)data, mapsz) != 0)
+    {
+      throw std::runtime_error ("munmap() failed");
+    }
+  if (close (fd) != 0)
+    {
+      throw std::runtime_error ("close() failed");
+    }
+}
+
+#endif
@@ -1,121 +1,229 @@
 #pragma once
 
-/// Phase 4: Convert spherical coords to unit vectors
+/// Phase 4: Convert spherical coords to unit vectors, as the sorted points
+/// are produced. With a non-zero deflate level, the data set is stored in
+/// chunks of chunkrows rows, shuffled and compressed.
 
+#include <algorithm>
+#include <exception>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <stdexcept>
-#include <cstdio>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
+#include <thread>
+#include <vector>
+#include <cstring>
 #include <H5Cpp.h>
 #include "mem_params.hxx"
 #include "now.hxx"
-#include "blk_writer.hxx"
 #include "../htm_entry.hxx"
 
-template <class T>
-void spherical_to_vec (const std::string &datafile,
-                       const std::string &scratchfile,
-                       const mem_params &mem_orig, const size_t npoints)
+/// Minimum number of points converted by each thread.
+static const size_t VEC_GRAIN = 16384;
+
+/// Writes points, passed to add() in sorted order, to the compound typed
+/// "data" data set of a new HDF5 file, converting their spherical
+/// coordinates to unit vectors. Points are gathered in a buffer of about
+/// mem.memsz / 16 bytes, which is converted by mem.nthreads threads into
+/// one of two output buffers. The output buffer is then written by a
+/// background thread while the next one is filled and converted, so that
+/// HDF5 is only ever called by one thread at a time.
+template <class T> struct vec_writer
 {
-  double t;
-
-  mem_params mem (mem_orig);
-  mem.memsz = 1024 * 1024;
-
-  std::cout << "Converting spherical coordinates in " + datafile
-               + " to unit vectors\n";
-  t = now ();
-
-  try
+  std::string path;
+  hsize_t npoints;
+  hsize_t current; ///< # of points handed to the writer thread
+  size_t n;        ///< # of points in the input buffer
+  size_t nthreads;
+  int cur; ///< output buffer being filled
+  std::vector<int> data_offset;
+  std::vector<int> data_sizes;
+  std::vector<T> in;
+  std::vector<htm_entry<T> > out[2];
+  std::unique_ptr<H5::H5File> file;
+  H5::CompType compound;
+  H5::DataSet dataset;
+  std::thread writer;
+  std::exception_ptr error;
+  double t; ///< seconds spent converting and waiting for writes
+
+  vec_writer (const std::string &Path, const mem_params &mem,
+              const size_t Npoints, const int compress = 0,
+              const hsize_t chunkrows = 0)
+      : path (Path), npoints (Npoints), current (0), n (0),
+        nthreads (mem.nthreads), cur (0), compound (sizeof(htm_entry<T>)),
+        t (0.0)
+  {
+    const size_t num_data_elements = T::names.size ();
+    size_t rows = std::max ((size_t)1,
+                            mem.memsz / 16 / sizeof(htm_entry<T>));
+
+    if (compress > 0 && chunkrows > 0)
+      {
+        /// write whole chunks, so that none is compressed twice
+        rows = std::max ((size_t)chunkrows, rows - rows % (size_t)chunkrows);
+      }
+    rows = std::min (rows, std::max ((size_t)npoints, (size_t)1));
+    in.resize (rows);
+    out[0].resize (rows);
+    out[1].resize (rows);
+    data_offset.resize (num_data_elements);
+    data_sizes.resize (num_data_elements);
+    data_offset[0] = 0;
+    for (size_t i = 0; i < num_data_elements; ++i)
+      {
+        data_sizes[i] = T::types[i].getSize ();
+        if (i + 1 < num_data_elements)
+          data_offset[i + 1] = data_offset[i] + data_sizes[i];
+      }
+
+    try
+      {
+        H5::Exception::dontPrint ();
+
+        hsize_t dim[] = { npoints };
+        H5::DataSpace file_space (1, dim);
+
+        /// The compound type must describe the in-memory htm_entry
+        /// (vector and data members, padded to a multiple of 16 bytes).
+        file.reset (new H5::H5File (path, H5F_ACC_TRUNC));
+
+        const H5::DataType vector_type = (sizeof(typename T::vector_type) == 4
+                                              ? H5::PredType::NATIVE_FLOAT
+                                              : H5::PredType::NATIVE_DOUBLE);
+
+        compound.insertMember ("x", 0, vector_type);
+        compound.insertMember ("y", sizeof(typename T::vector_type),
+                               vector_type);
+        compound.insertMember ("z", 2 * sizeof(typename T::vector_type),
+                               vector_type);
+
+        for (size_t i = 0; i < num_data_elements; ++i)
+          compound.insertMember (T::names[i],
+                                 3 * sizeof(typename T::vector_type)
+                                     + data_offset[i],
+                                 T::types[i]);
+
+        H5::DSetCreatPropList plist;
+        if (compress > 0)
+          {
+            if (H5Zfilter_avail (H5Z_FILTER_DEFLATE) <= 0)
+              {
+                throw std::runtime_error (
+                    "HDF5 was built without the deflate filter");
+              }
+            hsize_t chunk[] = { std::min (chunkrows, (hsize_t)npoints) };
+            plist.setChunk (1, chunk);
+            plist.setShuffle ();
+            plist.setDeflate (compress);
+          }
+        dataset = file->createDataSet ("data", compound, file_space, plist);
+      }
+    catch (H5::Exception &e)
+      {
+        throw std::runtime_error (e.getDetailMsg ());
+      }
+  }
+
+  ~vec_writer ()
+  {
+    if (writer.joinable ())
+      writer.join ();
+  }
+
+  void add (const T &e)
+  {
+    in[n++] = e;
+    if (n == in.size ())
+      flush ();
+  }
+
+  /// Converts the points of the input buffer into the current output
+  /// buffer, and writes it once the previous write is done.
+  void flush ()
+  {
+    if (n == 0)
+      return;
+
+    double t0 = now ();
+    htm_entry<T> *const o = out[cur].data ();
+    const size_t num_data_elements = data_offset.size ();
+    const size_t nt = std::max (
+        (size_t)1, std::min (nthreads, n / VEC_GRAIN + 1));
+    auto convert = [&](size_t beg, size_t end)
     {
-      H5::Exception::dontPrint ();
-
-      hsize_t dim[] = { npoints };
-      H5::DataSpace file_space (1, dim);
-
-      const size_t num_data_elements = T::names.size ();
-      size_t data_size = 0;
-      int data_offset[num_data_elements];
-      int data_sizes[num_data_elements];
-      data_offset[0] = 0;
-
-      for (size_t i = 0; i < num_data_elements; ++i)
+      for (size_t i = beg; i < end; ++i)
         {
-          data_sizes[i] = T::types[i].getSize ();
-          if (i + 1 < num_data_elements)
-            data_offset[i + 1] = data_offset[i] + data_sizes[i];
+          /// Use a temporary here so that we can assign it to a
+          /// double or float easily.
+          htm_v3 v3;
+          htm_sc_tov3 (&v3, &in[i].sc);
+          o[i].x = v3.x;
+          o[i].y = v3.y;
+          o[i].z = v3.z;
+          for (size_t j = 0; j < num_data_elements; ++j)
+            memcpy (o[i].data + data_offset[j], in[i].data (j),
+                    data_sizes[j]);
         }
-      data_size = data_offset[num_data_elements - 1]
-                  + T::types[num_data_elements - 1].getSize ();
-      /// round data_size up to nearest multiple of 16
-      if ((data_size % 16) != 0)
-        data_size = ((data_size / 16) + 1) * 16;
-
-      H5::H5File file (scratchfile, H5F_ACC_TRUNC);
-      H5::CompType compound (data_size);
-
-      const H5::DataType vector_type = (sizeof(typename T::vector_type) == 4
-                                            ? H5::PredType::NATIVE_FLOAT
-                                            : H5::PredType::NATIVE_DOUBLE);
-
-      compound.insertMember ("x", 0, vector_type);
-      compound.insertMember ("y", sizeof(typename T::vector_type),
-                             vector_type);
-      compound.insertMember ("z", 2 * sizeof(typename T::vector_type),
-                             vector_type);
-
-      for (size_t i = 0; i < num_data_elements; ++i)
-        compound.insertMember (T::names[i], 3 * sizeof(typename T::vector_type)
-                                            + data_offset[i],
-                               T::types[i]);
-
-      H5::DataSet dataset (file.createDataSet ("data", compound, file_space));
-      std::vector<T> ra_dec (std::min (npoints, mem.memsz / sizeof(T)));
-      std::vector<htm_entry<T> > htm_data (
-          std::min (npoints, mem.memsz / sizeof(htm_entry<T>)));
-      std::ifstream infile (datafile.c_str ());
-      hsize_t current (0);
-
-      while (current < npoints)
+    };
+    std::vector<std::thread> threads;
+    for (size_t p = 1; p < nt; ++p)
+      threads.emplace_back (convert, n * p / nt, n * (p + 1) / nt);
+    convert (0, n / nt);
+    for (auto &th : threads)
+      th.join ();
+
+    wait ();
+    const hsize_t offset = current, count = n;
+    writer = std::thread ([this, o, offset, count]()
+    {
+      try
         {
-          hsize_t n (std::min (static_cast<size_t>(npoints - current),
-                               mem.memsz / sizeof(T)));
-
-          infile.read (reinterpret_cast<char *>(ra_dec.data ()),
-                       n * sizeof(T));
-          for (size_t i = 0; i < infile.gcount () / sizeof(T); ++i)
-            {
-              /// Use a temporary here so that we can assign it to a
-              /// double or float easily.
-              htm_v3 v3;
-              htm_sc_tov3 (&v3, &ra_dec[i].sc);
-              htm_data[i].x = v3.x;
-              htm_data[i].y = v3.y;
-              htm_data[i].z = v3.z;
-              for (size_t j = 0; j < num_data_elements; ++j)
-                memcpy (htm_data[i].data + data_offset[j], ra_dec[i].data (j),
-                        data_sizes[j]);
-            }
-
-          file_space.selectHyperslab (H5S_SELECT_SET, &n, &current);
-          hsize_t mem_dim[] = { n };
-          H5::DataSpace mem_space (1, mem_dim);
-          dataset.write (htm_data.data (), compound, mem_space, file_space);
-          current += n;
+          H5::DataSpace file_space = dataset.getSpace ();
+          file_space.selectHyperslab (H5S_SELECT_SET, &count, &offset);
+          H5::DataSpace mem_space (1, &count);
+          dataset.write (o, compound, mem_space, file_space);
         }
-    }
-  catch (H5::Exception &e)
-    {
-      throw std::runtime_error (e.getDetailMsg ());
-    }
-
-  if (rename (scratchfile.c_str (), datafile.c_str ()) != 0)
-    {
-      throw std::runtime_error ("failed to rename file " + scratchfile + " to "
-                                + datafile);
-    }
-  std::cout << "\t" << now () - t << " sec total\n\n";
-}
+      catch (H5::Exception &e)
+        {
+          error = std::make_exception_ptr (
+              std::runtime_error (e.getDetailMsg ()));
+        }
+    });
+    current += n;
+    n = 0;
+    cur ^= 1;
+    t += now () - t0;
+  }
+
+  /// Waits for the write in progress, if any.
+  void wait ()
+  {
+    if (writer.joinable ())
+      writer.join ();
+    if (error)
+      std::rethrow_exception (error);
+  }
+
+  /// Writes the remaining points and closes the file.
+  void finish ()
+  {
+    flush ();
+    wait ();
+    if (current != npoints)
+      {
+        throw std::runtime_error ("bug in unit vector conversion: wrong "
+                                  "number of points");
+      }
+    try
+      {
+        dataset.close ();
+        file->close ();
+      }
+    catch (H5::Exception &e)
+      {
+        throw std::runtime_error (e.getDetailMsg ());
+      }
+    std::cout << "\t" << t << " sec converting spherical coordinates to "
+              << "unit vectors (" << nthreads << " threads)\n\n";
+  }
+};
@@ -3,61 +3,124 @@
 
 #include <stdexcept>
 #include "../../tinyhtm/varint.h"
+#include "../../tinyhtm/tree.h"
+#include "../../htm/_htm_cap.hxx"
+#include "../../htm/_htm_fixed.hxx"
 #include "hash_table.hxx"
 #include "../blk_writer.hxx"
 
 uint64_t compress_node (struct hash_table *const ht,
                         blk_writer<unsigned char, false> &wr,
                         const struct disk_node *const n, const uint64_t filesz,
-                        const uint64_t leafthresh)
+                        const uint64_t leafthresh, const uint64_t flags,
+                        const bool root)
 {
-  unsigned char buf[48];
+  unsigned char buf[160];
   unsigned char *s = buf;
   uint64_t sz = filesz;
+  uint64_t count;
   unsigned int v;
   int c, leaf;
 
-  /* write out child offsets (from child 3 to child 0) */
-  for (c = 3, leaf = 1; c >= 0; --c)
+  if ((flags & HTM_TREE_FIXED) != 0)
     {
-      if (node_empty (&n->child[c]))
+      /* write out the children block: the count, relative index and
+         offset of every child, with offsets relative to the end of the
+         block (+ 1, as for varint child offsets) */
+      uint64_t val[_HTM_FIXED_NVAL];
+      unsigned char block[1 + _HTM_FIXED_NVAL * 8];
+      size_t i, nb;
+      for (c = 0, leaf = 1; c < 4; ++c)
         {
-          *s = 0;
-          ++s;
-          ++sz;
+          if (node_empty (&n->child[c]))
+            {
+              val[3 * c] = 0;
+              val[3 * c + 1] = 0;
+              val[3 * c + 2] = 0;
+            }
+          else
+            {
+              val[3 * c + 2]
+                  = sz + 1 - hash_table_get (ht, &n->child[c], &val[3 * c],
+                                             &val[3 * c + 1]);
+              leaf = 0;
+            }
         }
-      else
+      if (leaf == 0)
         {
-          /* this is tricky - child 3 of n can be laid out immediately after
-             n, yielding a child offset of 0. But 0 also means "empty child",
-             so instead encode the actual offset + 1. */
-          v = htm_varint_rencode (s,
-                                  sz + 1 - hash_table_get (ht, &n->child[c]));
-          s += v;
-          sz += v;
-          leaf = 0;
+          nb = _htm_fixed_encode (block, val);
+          for (i = 0; i < nb; ++i, ++s)
+            {
+              *s = block[nb - 1 - i];
+            }
+          sz += nb;
         }
     }
-  if (leaf != 0)
+  else
     {
-      /* n is a leaf: don't store child offsets */
-      s -= 4;
-      sz -= 4;
+      /* write out child offsets (from child 3 to child 0) */
+      for (c = 3, leaf = 1; c >= 0; --c)
+        {
+          if (node_empty (&n->child[c]))
+            {
+              *s = 0;
+              ++s;
+              ++sz;
+            }
+          else
+            {
+              /* this is tricky - child 3 of n can be laid out immediately
+                 after n, yielding a child offset of 0. But 0 also means
+                 "empty child", so instead encode the actual offset + 1. */
+              v = htm_varint_rencode (
+                  s, sz + 1 - hash_table_get (ht, &n->child[c], NULL, NULL));
+              s += v;
+              sz += v;
+              leaf = 0;
+            }
+        }
+      if (leaf != 0)
+        {
+          /* n is a leaf: don't store child offsets */
+          s -= 4;
+          sz -= 4;
+        }
+    }
+  count = n->count;
+  if ((flags & HTM_TREE_ADAPTIVE) != 0)
+    {
+      /* nodes record whether they are internal in the count low bit */
+      count = 2 * count + (leaf == 0);
     }
-  else if (n->count < leafthresh)
+  else if (leaf == 0 && n->count < leafthresh)
     {
       throw std::runtime_error (
           "tree generation bug: internal node contains too few points");
     }
-  /* write out relative index, then count */
-  v = htm_varint_rencode (s, n->index);
-  s += v;
-  sz += v;
-  v = htm_varint_rencode (s, n->count);
-  s += v;
-  sz += v;
+  if ((flags & HTM_TREE_CAPS) != 0)
+    {
+      /* write out bounding cap */
+      unsigned char cap[_HTM_CAP_SIZE];
+      _htm_cap_encode (cap, &n->cap.cen, n->cap.radius);
+      for (c = _HTM_CAP_SIZE - 1; c >= 0; --c, ++s)
+        {
+          *s = cap[c];
+        }
+      sz += _HTM_CAP_SIZE;
+    }
+  if ((flags & HTM_TREE_FIXED) == 0 || root)
+    {
+      /* write out relative index, then count (fixed-width indexes store
+         those of non-root nodes in the children block of their parent) */
+      v = htm_varint_rencode (s, n->index);
+      s += v;
+      sz += v;
+      v = htm_varint_rencode (s, count);
+      s += v;
+      sz += v;
+    }
   /* write out byte reversed node, add node id to hashtable */
   wr.append (buf, (size_t)(s - buf));
-  hash_table_add (ht, &n->id, sz);
+  hash_table_add (ht, &n->id, sz, count, n->index);
   return sz;
 }
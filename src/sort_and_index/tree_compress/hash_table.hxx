@@ -24,8 +24,10 @@ void hash_table_init (struct hash_table *ht);
 void hash_table_destroy (struct hash_table *ht);
 void hash_table_grow (struct hash_table *ht);
 uint64_t hash_table_get (struct hash_table *const ht,
-                         const struct node_id *const id);
+                         const struct node_id *const id,
+                         uint64_t *const count, uint64_t *const index);
 void hash_table_add (struct hash_table *const ht,
-                     const struct node_id *const id, uint64_t off);
+                     const struct node_id *const id, uint64_t off,
+                     uint64_t count, uint64_t index);
 
 #endif
@@ -1,11 +1,13 @@
-/*  Adds an id to offset mapping to the given hash table.
+/*  Adds an id to offset (and node count/index) mapping to the given hash
+    table.
  */
 
 #include <stdexcept>
 #include "../hash_table.hxx"
 
 void hash_table_add (struct hash_table *const ht,
-                     const struct node_id *const id, uint64_t off)
+                     const struct node_id *const id, uint64_t off,
+                     uint64_t count, uint64_t index)
 {
   struct id_off *e;
   size_t i;
@@ -25,6 +27,8 @@ void hash_table_add (struct hash_table *const ht,
 #endif
   e->id = *id;
   e->off = off;
+  e->count = count;
+  e->index = index;
   e->next = ht->array[i];
   ht->array[i] = e;
   ++ht->n;
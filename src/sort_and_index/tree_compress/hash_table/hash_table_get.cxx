@@ -1,12 +1,14 @@
 /*  Returns the offset of the node with the given ID and removes
-    the corresponding hash table entry.
+    the corresponding hash table entry. The count and relative index of
+    the node are stored in *count and *index, unless they are NULL.
  */
 
 #include <stdexcept>
 #include "../hash_table.hxx"
 
 uint64_t hash_table_get (struct hash_table *const ht,
-                         const struct node_id *const id)
+                         const struct node_id *const id,
+                         uint64_t *const count, uint64_t *const index)
 {
   struct id_off *e, *prev;
   const size_t i = (ht->cap - 1) & (size_t)id->block[NLOD];
@@ -23,6 +25,14 @@ uint64_t hash_table_get (struct hash_table *const ht,
       if (node_id_eq (id, &e->id))
         {
           uint64_t off = e->off;
+          if (count != NULL)
+            {
+              *count = e->count;
+            }
+          if (index != NULL)
+            {
+              *index = e->index;
+            }
           if (prev == NULL)
             {
               ht->array[i] = e->next;
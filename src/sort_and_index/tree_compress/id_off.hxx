@@ -1,4 +1,5 @@
-/*  Mapping from a node ID to a relative file offset.
+/*  Mapping from a node ID to a relative file offset, along with the point
+    count and relative index of the node.
  */
 
 #ifndef HTM_TREE_GEN_ID_OFF_H
@@ -10,6 +11,8 @@ struct id_off
 {
   struct node_id id;
   uint64_t off;
+  uint64_t count;
+  uint64_t index;
   struct id_off *next;
 } HTM_ALIGNED (16);
 
@@ -10,6 +10,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <cassert>
+#include "../../tinyhtm/tree.h"
 #include "../mem_params.hxx"
 #include "../tree_root.hxx"
 #include "../now.hxx"
@@ -19,17 +20,18 @@
 uint64_t compress_node (struct hash_table *const ht,
                         blk_writer<unsigned char, false> &wr,
                         const struct disk_node *const n, const uint64_t filesz,
-                        const uint64_t leafthresh);
+                        const uint64_t leafthresh, const uint64_t flags,
+                        const bool root);
 
 uint64_t write_tree_header (struct hash_table *const ht,
                             blk_writer<unsigned char, false> &wr,
                             const tree_root &super, const uint64_t filesz,
-                            const uint64_t leafthresh);
+                            const uint64_t leafthresh, const uint64_t flags);
 
 uint64_t tree_compress (const std::string &treefile,
                         const std::string &scratchfile, const mem_params &mem,
                         const tree_root &super, const size_t nnodes,
-                        const uint64_t leafthresh)
+                        const uint64_t leafthresh, const uint64_t flags)
 {
   struct hash_table ht;
   const struct disk_node *data;
@@ -90,10 +92,20 @@ uint64_t tree_compress (const std::string &treefile,
               }
             behind = ((unsigned char *)behind) + mem.ioblksz;
           }
-        filesz = compress_node (&ht, wr, &data[i], filesz, leafthresh);
+        bool root = false;
+        if ((flags & HTM_TREE_FIXED) != 0)
+          {
+            /* roots have no parent to store their count and index */
+            for (int r = 0; r < 8 && !root; ++r)
+              {
+                root = node_id_eq (&data[i].id, &super.childid[r]) != 0;
+              }
+          }
+        filesz = compress_node (&ht, wr, &data[i], filesz, leafthresh,
+                                flags, root);
       }
     /* and tree header */
-    filesz = write_tree_header (&ht, wr, super, filesz, leafthresh);
+    filesz = write_tree_header (&ht, wr, super, filesz, leafthresh, flags);
   }
   /* cleanup */
   hash_table_destroy (&ht);
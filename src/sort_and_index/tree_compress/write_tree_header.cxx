@@ -11,7 +11,7 @@
 uint64_t write_tree_header (struct hash_table *const ht,
                             blk_writer<unsigned char, false> &wr,
                             const tree_root &super, const uint64_t filesz,
-                            const uint64_t leafthresh)
+                            const uint64_t leafthresh, const uint64_t flags)
 {
   unsigned char buf[96];
   unsigned char *s;
@@ -33,8 +33,8 @@ uint64_t write_tree_header (struct hash_table *const ht,
           /* N3 could be laid out immediately after super root,
              yielding a child offset of 0, which means "empty child".
              Therefore encode 1 + actual offset. */
-          v = htm_varint_rencode (s, sz + 1
-                                     - hash_table_get (ht, &super.childid[r]));
+          v = htm_varint_rencode (
+              s, sz + 1 - hash_table_get (ht, &super.childid[r], NULL, NULL));
           s += v;
           sz += v;
         }
@@ -47,6 +47,24 @@ uint64_t write_tree_header (struct hash_table *const ht,
   v = htm_varint_rencode (s, leafthresh);
   s += v;
   sz += v;
+  if ((flags & HTM_TREE_DEPTH) != 0)
+    {
+      /* write tree depth */
+      v = htm_varint_rencode (s, (uint64_t)super.depth);
+      s += v;
+      sz += v;
+    }
+  if (flags != 0)
+    {
+      /* write format flags, preceded by a 0 (an invalid leaf threshold)
+         so that readers can tell them apart from a plain header */
+      v = htm_varint_rencode (s, flags);
+      s += v;
+      sz += v;
+      *s = 0;
+      ++s;
+      ++sz;
+    }
   wr.append (buf, (size_t)(s - buf));
   if (ht->n != 0)
     {
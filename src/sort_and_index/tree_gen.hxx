@@ -1,7 +1,8 @@
-/*  Tree generation driver function.
+/*  Tree node generation.
  */
 
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <unistd.h>
 #include <sys/types.h>
@@ -10,173 +11,209 @@
 #include <sys/mman.h>
 #include <cstring>
 #include <cassert>
+#include <memory>
+#include <vector>
 #include "tree_root.hxx"
 #include "mem_params.hxx"
 #include "now.hxx"
 #include "tree_gen/emit_node.hxx"
 #include "tree_gen/layout_node.hxx"
 #include "tree_gen_context.hxx"
+#include "prefix_writer.hxx"
 
 void finish_root (struct tree_root &super, tree_gen_context &ctx);
 
 void add_node (mem_node *const root, tree_gen_context &ctx, int64_t htmid,
-               int64_t count, int64_t index);
+               int64_t count, int64_t index, const struct node_cap &cap);
 
+/*  Computes a cap bounding the n points starting at data, as the sum of
+    the point vectors along with the largest angle between a point and
+    their normalized sum. When the data file stores single precision unit
+    vectors, the radius is padded to cover the error of the conversion.
+ */
 template <class T>
-size_t tree_gen (const std::string &datafile, const std::string &treefile,
-                 const mem_params &mem, struct tree_root &super,
-                 const uint64_t leafthresh, const size_t npoints)
+struct node_cap points_cap (const T *data, const size_t n)
 {
-  const T *data;
-  void *behind;
-  int64_t htmid;
-  uint64_t index, count;
-  size_t i, nseg;
-  int r, fd;
-  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
-  size_t mapsz = npoints * sizeof(T);
-  double t;
+  const double pad
+      = (sizeof(typename T::vector_type) == 4) ? 1.0e-6 : 1.0e-9;
+  struct node_cap cap;
+  struct htm_v3 cen, v;
+  size_t i;
 
-  if (npoints == 0)
-    {
-      throw std::runtime_error ("no input points");
-    }
-  std::cout << "Generating block sorted tree node file " << treefile
-            << " from " << datafile << "\n";
-  t = now ();
-  fd = open (datafile.c_str (), O_RDONLY);
-  if (fd == -1)
-    {
-      throw std::runtime_error ("failed to open file " + datafile
-                                + " for reading");
-    }
-  if (mapsz % pagesz != 0)
-    {
-      mapsz += pagesz - mapsz % pagesz;
-    }
-  behind = mmap (NULL, mapsz, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
-  if (behind == MAP_FAILED)
+  memset (&cap, 0, sizeof(cap));
+  for (i = 0; i < n; ++i)
     {
-      throw std::runtime_error ("mmap() file " + datafile + " for reading");
+      htm_sc_tov3 (&v, &data[i].sc);
+      htm_v3_add (&cap.cen, &cap.cen, &v);
     }
-  if (madvise (behind, mapsz, MADV_SEQUENTIAL) != 0)
+  htm_v3_normalize (&cen, &cap.cen);
+  for (i = 0; i < n; ++i)
     {
-      throw std::runtime_error ("madvise() failed on mmap for file "
-                                + datafile);
+      htm_sc_tov3 (&v, &data[i].sc);
+      double r = node_cap_angle (&cen, &v);
+      if (r > cap.radius)
+        {
+          cap.radius = r;
+        }
     }
-  data = (const T *)behind;
-  behind = ((unsigned char *)behind) + mem.ioblksz;
+  cap.radius += pad;
+  return cap;
+}
+
+/*  Builds the tree nodes of points visited one at a time, in ascending
+    HTM ID order. Nodes are added, emitted and laid out as soon as the
+    points of an HTM ID are known, and written to the (block sorted) tree
+    node file. When caps are computed, the points of the current HTM ID
+    are buffered, since the cap of a node takes two passes over them.
+ */
+template <class T> struct tree_builder
+{
+  tree_gen_context ctx;
+  std::unique_ptr<prefix_writer> prefix;
+  struct tree_root &super;
+  std::vector<T> pts;  /* points with the current HTM ID, if caps */
+  int64_t htmid;       /* current HTM ID */
+  uint64_t index;      /* index of the first point with the current ID */
+  uint64_t count;      /* # of points with the current HTM ID */
+  uint64_t npoints;    /* # of points added so far */
+  int r;               /* index of the current HTM root, or -1 */
+  double t;            /* start time */
+
+  tree_builder (const std::string &treefile, const mem_params &mem,
+                struct tree_root &Super, const index_options &opts,
+                const std::string &prefixfile = std::string ())
+      : ctx (treefile, mem.sortsz, opts, (uint32_t)sizeof(T),
+             mem.nthreads),
+        super (Super),
+        htmid (0), index (0), count (0), npoints (0), r (-1), t (now ())
   {
-    tree_gen_context ctx (leafthresh, treefile, mem.sortsz);
+    if (opts.depth < 0 || opts.depth > HTM_MAX_LEVEL)
+      {
+        throw std::runtime_error ("invalid tree depth");
+      }
+    if (opts.prefixlevel >= 0)
+      {
+        prefix.reset (new prefix_writer (prefixfile, mem.ioblksz,
+                                         opts.prefixlevel, opts.depth));
+      }
     memset (&super, 0, sizeof(struct tree_root));
+    super.depth = opts.depth;
+  }
 
-    /* walk over tree entries, adding tree nodes. */
-    if (data[0].htmid == 0)
+  /*  Adds the node of the points with the current HTM ID. */
+  void add_current ()
+  {
+    struct node_cap cap;
+    memset (&cap, 0, sizeof(cap));
+    if (ctx.caps)
       {
-        throw std::runtime_error ("invalid HTM ID");
+        cap = points_cap (pts.data (), count);
       }
-    htmid = 0;
-    index = 0;
-    count = 0;
-    r = -1;
+    add_node (super.child[r], ctx, htmid, count, index, cap);
+  }
 
-    for (i = 0; i < npoints; ++i)
+  /*  Adds the next point. */
+  void add (const T &e)
+  {
+    if (e.htmid == htmid && npoints != 0)
+      {
+        /* increase point count for the current htmid */
+        ++count;
+      }
+    else
       {
-        if ((void *)&data[i] > behind)
+        int r2;
+        if (!(e.htmid > htmid))
           {
-            void *ptr = ((unsigned char *)behind) - mem.ioblksz;
-            if (madvise (ptr, mem.ioblksz, MADV_DONTNEED) != 0)
+            std::stringstream ss;
+            if (npoints == 0)
               {
-                throw std::runtime_error ("madvise() failed");
+                throw std::runtime_error ("invalid HTM ID");
               }
-            behind = ((unsigned char *)behind) + mem.ioblksz;
+            ss << "bug in tree generation phase:\n\t"
+               << "data[i].htmid: " << e.htmid << "\n\t"
+               << "htmid: " << htmid;
+            throw std::runtime_error (ss.str ());
           }
-        if (data[i].htmid == htmid)
+        if (r >= 0)
           {
-            /* increase point count for the current htmid */
-            ++count;
+            /* add previous node if there is one */
+            add_current ();
           }
-        else
+        /* reset index, count, and htmid */
+        count = 1;
+        index = npoints;
+        htmid = e.htmid;
+        pts.clear ();
+        if (prefix)
           {
-            int r2;
-            if (!(data[i].htmid > htmid))
-              {
-                std::stringstream ss;
-                ss << "bug in tree generation phase:\n\t"
-                   << "data[i].htmid: " << data[i].htmid << "\n\t"
-                   << "htmid: " << htmid;
-                throw std::runtime_error (ss.str ());
-              }
+            prefix->add (htmid, index);
+          }
+        r2 = (int)(htmid >> 2 * ctx.depth) - 8;
+        if (r2 < 0 || r2 > 7)
+          {
+            throw std::runtime_error ("invalid HTM ID");
+          }
+        if (r != r2)
+          {
+            /* need a new HTM root node */
             if (r >= 0)
               {
-                /* add previous node if there is one */
-                add_node (super.child[r], ctx, htmid, count, (uint64_t)index);
-              }
-            /* reset index, count, and htmid */
-            count = 1;
-            index = (uint64_t)i;
-            htmid = data[i].htmid;
-            r2 = (int)(htmid >> 40) - 8;
-            if (r2 < 0 || r2 > 7)
-              {
-                throw std::runtime_error ("invalid HTM ID");
+                /* emit and layout the previous root if there is one */
+                emit_node (super.child[r], ctx);
+                layout_node (super.child[r], ctx);
               }
-            if (r != r2)
-              {
-                /* need a new HTM root node */
-                if (r >= 0)
-                  {
-                    /* emit and layout the previous root if there is one */
-                    emit_node (super.child[r], ctx);
-                    layout_node (super.child[r], ctx);
-                  }
-                r = r2;
+            r = r2;
 /* create new root */
 #if FAST_ALLOC
-                super.child[r] = (struct mem_node *)ctx.ar.alloc ();
+            super.child[r] = (struct mem_node *)ctx.ar.alloc ();
 #else
-                super.child[r]
-                    = (struct mem_node *)malloc (sizeof(struct mem_node));
-                if (super.child[r] == NULL)
-                  {
-                    throw std::runtime_error ("malloc() failed");
-                  }
-#endif
-                memset (super.child[r], 0, sizeof(struct mem_node));
-                super.child[r]->htmid = r + 8;
-                super.child[r]->index = index;
+            super.child[r]
+                = (struct mem_node *)malloc (sizeof(struct mem_node));
+            if (super.child[r] == NULL)
+              {
+                throw std::runtime_error ("malloc() failed");
               }
+#endif
+            memset (super.child[r], 0, sizeof(struct mem_node));
+            super.child[r]->htmid = r + 8;
+            super.child[r]->index = index;
           }
       }
+    if (ctx.caps)
+      {
+        pts.push_back (e);
+      }
+    ++npoints;
+  }
 
-    /* add last node, emit and layout last root */
-    add_node (super.child[r], ctx, htmid, count, (uint64_t)index);
+  /*  Adds the last node, emits and lays out the last root, and assigns
+      block IDs to the HTM roots. Returns the number of tree nodes. */
+  size_t finish (const size_t expected)
+  {
+    if (npoints == 0)
+      {
+        throw std::runtime_error ("no input points");
+      }
+    add_current ();
     emit_node (super.child[r], ctx);
     layout_node (super.child[r], ctx);
-
-    /* assign block IDs to the HTM roots */
     finish_root (super, ctx);
-    if (super.count != npoints)
+    if (super.count != expected)
       {
         std::stringstream ss;
         ss << "bug in tree generation phase:\n\t"
            << "super.count: " << super.count << "\n\t"
-           << "npoints: " << npoints;
+           << "npoints: " << expected;
         throw std::runtime_error (ss.str ());
       }
-    /* cleanup */
-    i = ctx.nnodes;
-    nseg = ctx.ar.nseg;
+    if (prefix)
+      {
+        prefix->finish (expected);
+      }
+    std::cout << "\t" << now () - t << " sec total (" << ctx.nnodes
+              << " tree nodes, " << (ctx.ar.nseg * ARENA_SEGSZ) / (1024 * 1024)
+              << " MiB memory)\n\n";
+    return ctx.nnodes;
   }
-  if (munmap ((void *)data, mapsz) != 0)
-    {
-      throw std::runtime_error ("munmap() failed");
-    }
-  if (close (fd) != 0)
-    {
-      throw std::runtime_error ("close() failed");
-    }
-  std::cout << "\t" << now () - t << " sec total (" << i << " tree nodes, "
-            << (nseg * ARENA_SEGSZ) / (1024 * 1024) << " MiB memory)\n\n";
-  return i;
-}
+};
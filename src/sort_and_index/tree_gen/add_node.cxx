@@ -7,17 +7,18 @@
 #include "emit_node.hxx"
 
 void add_node (mem_node *const root, tree_gen_context &ctx, int64_t htmid,
-               int64_t count, int64_t index)
+               int64_t count, int64_t index, const struct node_cap &cap)
 {
   struct mem_node *node;
   int lvl = 0;
 
-  for (lvl = 0, node = root; lvl < 20; ++lvl)
+  for (lvl = 0, node = root; lvl < ctx.depth; ++lvl)
     {
       /* keep subdividing */
       int i, c;
       node->count += count;
-      c = (htmid >> 2 * (19 - lvl)) & 3;
+      htm_v3_add (&node->cap.cen, &node->cap.cen, &cap.cen);
+      c = (htmid >> 2 * (ctx.depth - 1 - lvl)) & 3;
       for (i = 0; i < c; ++i)
         {
           struct mem_node *tmp = node->child[i];
@@ -53,4 +54,5 @@ void add_node (mem_node *const root, tree_gen_context &ctx, int64_t htmid,
     }
   assert (node->htmid == htmid);
   node->count = count;
+  node->cap = cap;
 }
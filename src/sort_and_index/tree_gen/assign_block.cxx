@@ -39,6 +39,7 @@ void assign_block (tree_gen_context &ctx, mem_node *const n,
     d.id = n->id;
     d.count = n->count;
     d.index = n->index;
+    d.cap = n->cap;
     for (i = 0; i < 4; ++i)
       {
         struct mem_node *tmp = n->child[i];
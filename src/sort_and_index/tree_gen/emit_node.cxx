@@ -5,6 +5,115 @@
 #include "../node.hxx"
 #include "layout_node.hxx"
 
+uint32_t estimate_node_size (const struct mem_node *const node,
+                             const uint32_t nchild, const bool caps,
+                             const bool fixed);
+
+/*  Query cost model for adaptive leaves. The cost of a node is the
+    expected work, in index byte equivalents, of a query whose region
+    boundary crosses the node triangle, beyond reading and classifying
+    the node itself. A leaf costs reading and testing all of its points.
+    An internal node costs reading and classifying its non-empty children,
+    plus the cost of those the boundary crosses as well - about half of
+    them when the region is large compared to the node.
+ */
+static const double VISIT_POINTS = 8.0; /* classifying a node, in points */
+static const double CROSS_PROB = 0.5;
+
+static uint32_t num_children (const mem_node *const node)
+{
+  uint32_t n = 0;
+  int c;
+  for (c = 0; c < 4; ++c)
+    {
+      n += (node->child[c] != NULL);
+    }
+  return n;
+}
+
+/*  Returns the cost of keeping the children of a node (see above).
+ */
+static double split_cost (const mem_node *const node,
+                          const tree_gen_context &ctx)
+{
+  const uint32_t nchild = num_children (node);
+  double cost = (double)estimate_node_size (node, nchild, ctx.caps, ctx.fixed)
+                - (double)estimate_node_size (node, 0, ctx.caps, ctx.fixed);
+  int c;
+  for (c = 0; c < 4; ++c)
+    {
+      const struct mem_node *child = node->child[c];
+      if (child != NULL)
+        {
+          cost += estimate_node_size (child, num_children (child), ctx.caps,
+                                      ctx.fixed)
+                  + VISIT_POINTS * ctx.pointsz + CROSS_PROB * child->cost;
+        }
+    }
+  return cost;
+}
+
+/*  Frees the subtrees rooted at the children of a node.
+ */
+static void free_children (mem_node *const node, tree_gen_context &ctx)
+{
+  int c;
+  for (c = 0; c < 4; ++c)
+    {
+      if (node->child[c] != NULL)
+        {
+          free_children (node->child[c], ctx);
+#if FAST_ALLOC
+          ctx.ar.free (node->child[c]);
+#else
+          free (node->child[c]);
+#endif
+          node->child[c] = NULL;
+        }
+    }
+}
+
+/*  Turns the point vector sum accumulated in the bounding cap of a node
+    into a cap center, and bounds the caps of its children. The result is
+    not minimal, but is cheap to compute and never smaller than the
+    minimal bounding cap of the node points.
+ */
+static void finish_cap (mem_node *const node)
+{
+  struct node_cap *cap = &node->cap;
+  double norm = htm_v3_norm (&cap->cen);
+  int c, leaf = 1;
+
+  if (norm == 0.0)
+    {
+      /* degenerate point distribution */
+      cap->cen.x = 1.0;
+      cap->cen.y = 0.0;
+      cap->cen.z = 0.0;
+      cap->radius = M_PI;
+      return;
+    }
+  htm_v3_div (&cap->cen, &cap->cen, norm);
+  for (c = 0; c < 4; ++c)
+    {
+      const struct mem_node *child = node->child[c];
+      if (child != NULL)
+        {
+          double r = node_cap_angle (&cap->cen, &child->cap.cen)
+                     + child->cap.radius;
+          if (leaf || r > cap->radius)
+            {
+              cap->radius = r;
+            }
+          leaf = 0;
+        }
+    }
+  if (cap->radius > M_PI)
+    {
+      cap->radius = M_PI;
+    }
+}
+
 void emit_node (mem_node *const node, tree_gen_context &ctx)
 {
   int c;
@@ -20,27 +129,38 @@ void emit_node (mem_node *const node, tree_gen_context &ctx)
           emit_node (node->child[c], ctx);
         }
     }
+  if (ctx.caps)
+    {
+      finish_cap (node);
+    }
   if (node->count < ctx.leafthresh)
     {
-      /* if the node point count is too small,
-         make it a leaf by deleting all children. */
-      for (c = 0; c < 4; ++c)
+      const double leaf_cost = (double)node->count * ctx.pointsz;
+      node->status = NODE_EMITTED;
+      if (ctx.adaptive && num_children (node) != 0)
         {
-          if (node->child[c] != NULL)
+          const double cost = split_cost (node, ctx);
+          if (cost < leaf_cost)
             {
-#if FAST_ALLOC
-              ctx.ar.free (node->child[c]);
-#else
-              free (node->child[c]);
-#endif
-              node->child[c] = NULL;
+              /* keep the children. The subtree is laid out along with
+                 the first ancestor that has leafthresh points or more,
+                 unless a smaller ancestor becomes a leaf first. */
+              node->cost = cost;
+              return;
             }
         }
-      node->status = NODE_EMITTED;
+      /* if the node point count is too small (or splitting the node
+         does not pay off), make it a leaf by deleting all children. */
+      free_children (node, ctx);
+      node->cost = leaf_cost;
     }
   else
     {
       /* otherwise, layout the subtree rooted at node */
+      if (ctx.adaptive)
+        {
+          node->cost = split_cost (node, ctx);
+        }
       layout_node (node, ctx);
     }
 }
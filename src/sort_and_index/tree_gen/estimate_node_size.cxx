@@ -5,10 +5,29 @@
 #include "../node.hxx"
 
 uint32_t estimate_node_size (const struct mem_node *const node,
-                             const uint32_t nchild)
+                             const uint32_t nchild, const bool caps,
+                             const bool fixed)
 {
-  uint32_t sz = htm_varint_len (node->index) + htm_varint_len (node->count);
-  if (nchild > 0)
+  uint32_t sz = 0;
+  if (!fixed || node->htmid < 16)
+    {
+      /* fixed-width indexes only store the count and index of roots
+         (HTM IDs 8-15) in the node itself */
+      sz += htm_varint_len (node->index) + htm_varint_len (node->count);
+    }
+  if (caps)
+    {
+      /* bounding caps are stored as 4 floats */
+      sz += 16;
+    }
+  if (nchild > 0 && fixed)
+    {
+      /* A width byte, and 12 integers. Child counts and indexes are
+         bounded by the node count, but offsets are not known until
+         layout, so assume they fit in 16 bits if counts do. */
+      sz += 1 + 12 * ((node->count <= 0xffff) ? 2 : 4);
+    }
+  else if (nchild > 0)
     {
       /* There is no way to compute size of a child offset accurately
          without knowing the final node layout, so use a guess of 4 bytes
@@ -5,7 +5,8 @@
 #include "assign_block.hxx"
 
 uint32_t estimate_node_size (const struct mem_node *const node,
-                             const uint32_t nchild);
+                             const uint32_t nchild, const bool caps,
+                             const bool fixed);
 
 void layout_node (mem_node *const node, tree_gen_context &ctx)
 {
@@ -38,7 +39,8 @@ void layout_node (mem_node *const node, tree_gen_context &ctx)
     {
       /* leaf */
       int lod;
-      const uint32_t nodesz = estimate_node_size (node, nchild);
+      const uint32_t nodesz = estimate_node_size (node, nchild, ctx.caps,
+                                                  ctx.fixed);
       const uint32_t info = make_block_info (nodesz, 1u);
       for (lod = 0; lod < NLOD; ++lod)
         {
@@ -54,7 +56,8 @@ void layout_node (mem_node *const node, tree_gen_context &ctx)
     {
       /* internal node */
       int lod;
-      const uint32_t nodesz = estimate_node_size (node, nchild);
+      const uint32_t nodesz = estimate_node_size (node, nchild, ctx.caps,
+                                                  ctx.fixed);
       for (lod = 0; lod < NLOD; ++lod)
         {
           uint64_t blockid;
@@ -4,6 +4,7 @@
 #include "node.hxx"
 #include "arena.hxx"
 #include "blk_writer.hxx"
+#include "index_options.hxx"
 
 /*  Tree generation context.
  */
@@ -15,18 +16,26 @@ struct tree_gen_context
 #endif
   size_t nnodes;            /* number of nodes in the tree */
   uint64_t leafthresh;      /* maximum # of points per leaf */
+  bool caps;                /* compute node bounding caps? */
+  bool fixed;               /* fixed-width children blocks? */
+  int depth;                /* level of point HTM IDs (and leaves) */
+  bool adaptive;            /* choose leaves with a query cost model? */
+  uint32_t pointsz;         /* size of a point (bytes), for the model */
   uint64_t poidx;           /* next post-order tree traversal index */
   uint64_t blockid[NLOD];   /* index of next block ID to assign for each LOD */
   blk_writer<disk_node> wr; /* node writer */
 
   tree_gen_context () = delete;
-  tree_gen_context (const uint64_t Leafthresh, const std::string &file,
-                    const size_t blksz)
+  tree_gen_context (const std::string &file, const size_t blksz,
+                    const index_options &opts, const uint32_t Pointsz = 0,
+                    const size_t nthreads = 1)
       :
 #if FAST_ALLOC
         ar (sizeof(mem_node)),
 #endif
-        nnodes (0), leafthresh (Leafthresh), poidx (0), wr (file, blksz)
+        nnodes (0), leafthresh (opts.leafthresh), caps (opts.caps),
+        fixed (opts.fixed), depth (opts.depth), adaptive (opts.adaptive),
+        pointsz (Pointsz), poidx (0), wr (file, blksz, nthreads)
   {
     for (int i = 0; i < NLOD; ++i)
       blockid[i] = 0;
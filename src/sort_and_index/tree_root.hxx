@@ -8,6 +8,7 @@
 struct tree_root
 {
   uint64_t count; /* Total number of points in tree */
+  int depth;      /* Level of point HTM IDs, and of the deepest nodes */
   struct mem_node *child[8];
   struct node_id childid[8];
 };
@@ -0,0 +1,269 @@
+/*  Succinct tree index generation.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "../../tinyhtm/tree.h"
+#include "../../tinyhtm/varint.h"
+#include "../../htm/_htm_cap.hxx"
+#include "../mem_params.hxx"
+#include "../tree_root.hxx"
+#include "../now.hxx"
+#include "../blk_writer.hxx"
+
+/* Marks an empty root in the level order node list. */
+static const uint64_t EMPTY = UINT64_MAX;
+
+/*  Returns the position of the node with the given ID in the sorted tree
+    node file memory map.
+ */
+static uint64_t find_node (const struct disk_node *const data,
+                           const size_t nnodes, const struct node_id *const id)
+{
+  struct disk_node key;
+  const struct disk_node *n;
+  key.id = *id;
+  n = std::lower_bound (data, data + nnodes, key);
+  if (n == data + nnodes || !node_id_eq (&n->id, id))
+    {
+      throw std::runtime_error (
+          "tree generation bug: child node missing from tree node file");
+    }
+  return (uint64_t)(n - data);
+}
+
+static void append_word (blk_writer<unsigned char, false> &wr, uint64_t w)
+{
+  unsigned char buf[8];
+  int i;
+  for (i = 0; i < 8; ++i)
+    {
+      buf[i] = (unsigned char)(w >> (8 * i));
+    }
+  wr.append (buf, 8);
+}
+
+static unsigned int bit_width (uint64_t v)
+{
+  unsigned int w = 0;
+  for (; v != 0; v >>= 1)
+    {
+      ++w;
+    }
+  return w;
+}
+
+/*  Writes the succinct index (see _htm_succinct.hxx) for the sorted tree
+    node file treefile to scratchfile, and then replaces treefile with it.
+    Nodes are visited breadth first, so the node file is read in random
+    order, but only once per section of the index.
+ */
+void tree_succinct (const std::string &treefile,
+                    const std::string &scratchfile, const mem_params &mem,
+                    const tree_root &super, const size_t nnodes,
+                    const uint64_t leafthresh, const uint64_t flags)
+{
+  const struct disk_node *data;
+  void *ptr;
+  std::vector<uint64_t> order;
+  std::vector<unsigned char> widths;
+  double t;
+  uint64_t i, n, nbits;
+  int c, fd;
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  size_t mapsz = nnodes * sizeof(struct disk_node);
+
+  if (nnodes == 0)
+    {
+      throw std::runtime_error ("no input nodes");
+    }
+  t = now ();
+  std::cout << "Generating succinct tree index " + treefile + "\n";
+  fd = open (treefile.c_str (), O_RDONLY);
+  if (fd == -1)
+    {
+      throw std::runtime_error ("failed to open file " + treefile
+                                + " for reading");
+    }
+  if (mapsz % pagesz != 0)
+    {
+      mapsz += pagesz - mapsz % pagesz;
+    }
+  ptr = mmap (NULL, mapsz, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (ptr == MAP_FAILED)
+    {
+      throw std::runtime_error ("mmap() file " + treefile + " for reading");
+    }
+  data = (const struct disk_node *)ptr;
+
+  /* number nodes in level order: the 8 roots, then their children, ... */
+  order.reserve (nnodes + 8);
+  for (c = 0; c < 8; ++c)
+    {
+      order.push_back (node_empty (&super.childid[c])
+                           ? EMPTY
+                           : find_node (data, nnodes, &super.childid[c]));
+    }
+  for (i = 0; i < order.size (); ++i)
+    {
+      if (order[i] == EMPTY)
+        {
+          continue;
+        }
+      for (c = 0; c < 4; ++c)
+        {
+          if (!node_empty (&data[order[i]].child[c]))
+            {
+              if (data[order[i]].count < leafthresh
+                  && (flags & HTM_TREE_ADAPTIVE) == 0)
+                {
+                  throw std::runtime_error ("tree generation bug: internal "
+                                            "node contains too few points");
+                }
+              order.push_back (
+                  find_node (data, nnodes, &data[order[i]].child[c]));
+            }
+        }
+    }
+  n = order.size ();
+  if (n != nnodes + std::count (order.begin (), order.end (), EMPTY))
+    {
+      throw std::runtime_error (
+          "tree generation bug: nodes unreachable from the roots");
+    }
+
+  /* choose a count bit width for every group of 64 nodes */
+  for (i = 0, nbits = 0; i < n; i += 64)
+    {
+      uint64_t max = 0, j;
+      for (j = i; j < n && j < i + 64; ++j)
+        {
+          if (order[j] != EMPTY)
+            {
+              max = std::max (max, data[order[j]].count);
+            }
+        }
+      widths.push_back ((unsigned char)bit_width (max));
+      nbits += (std::min (n, i + 64) - i) * widths.back ();
+    }
+
+  {
+    blk_writer<unsigned char, false> wr (scratchfile, mem.ioblksz);
+    unsigned char buf[64];
+    std::vector<uint64_t> rank;
+    uint64_t word, acc, ones;
+    unsigned int k, shift;
+
+    /* header: format flags, tree depth, leaf threshold, point count,
+       node count and # of count words */
+    k = 0;
+    k += htm_varint_encode (buf + k, 0);
+    k += htm_varint_encode (buf + k, flags);
+    if ((flags & HTM_TREE_DEPTH) != 0)
+      {
+        k += htm_varint_encode (buf + k, (uint64_t)super.depth);
+      }
+    k += htm_varint_encode (buf + k, leafthresh);
+    k += htm_varint_encode (buf + k, super.count);
+    k += htm_varint_encode (buf + k, n);
+    k += htm_varint_encode (buf + k, (nbits + 63) / 64);
+    wr.append (buf, k);
+
+    /* child masks, sampling their rank every 8 words */
+    for (i = 0, word = 0, ones = 0; i < n; ++i)
+      {
+        if (order[i] != EMPTY)
+          {
+            for (c = 0; c < 4; ++c)
+              {
+                if (!node_empty (&data[order[i]].child[c]))
+                  {
+                    word |= UINT64_C (1) << (4 * (i & 15) + c);
+                  }
+              }
+          }
+        if ((i & 15) == 15 || i == n - 1)
+          {
+            if (((i >> 4) & 7) == 0)
+              {
+                rank.push_back (ones);
+              }
+            ones += htm_popcount (word);
+            append_word (wr, word);
+            word = 0;
+          }
+      }
+    for (i = 0; i < rank.size (); ++i)
+      {
+        append_word (wr, rank[i]);
+      }
+
+    /* count directory */
+    for (i = 0, acc = 0; i < widths.size (); ++i)
+      {
+        append_word (wr, (acc << 7) | widths[i]);
+        acc += (std::min (n, 64 * i + 64) - 64 * i) * widths[i];
+      }
+
+    /* bit-packed counts, followed by a padding word */
+    for (i = 0, word = 0, shift = 0; i < n; ++i)
+      {
+        const unsigned int w = widths[i >> 6];
+        const uint64_t v = (order[i] == EMPTY) ? 0 : data[order[i]].count;
+        if (w == 0)
+          {
+            continue;
+          }
+        word |= v << shift;
+        if (shift + w >= 64)
+          {
+            append_word (wr, word);
+            word = (shift == 0) ? 0 : v >> (64 - shift);
+          }
+        shift = (shift + w) & 63;
+      }
+    if (shift != 0)
+      {
+        append_word (wr, word);
+      }
+    append_word (wr, 0);
+
+    /* bounding caps */
+    if ((flags & HTM_TREE_CAPS) != 0)
+      {
+        for (i = 0; i < n; ++i)
+          {
+            unsigned char cap[_HTM_CAP_SIZE] = { 0 };
+            if (order[i] != EMPTY)
+              {
+                _htm_cap_encode (cap, &data[order[i]].cap.cen,
+                                 data[order[i]].cap.radius);
+              }
+            wr.append (cap, _HTM_CAP_SIZE);
+          }
+      }
+  }
+  if (munmap (ptr, mapsz) != 0)
+    {
+      throw std::runtime_error ("munmap() failed");
+    }
+  if (close (fd) != 0)
+    {
+      throw std::runtime_error ("close() failed");
+    }
+  if (rename (scratchfile.c_str (), treefile.c_str ()) != 0)
+    {
+      throw std::runtime_error ("failed to rename " + scratchfile + " to "
+                                + treefile);
+    }
+  std::cout << "\t" << now () - t << " sec total\n\n";
+}
@@ -25,14 +25,17 @@
         <td> contains types and functions related to spherical geometry,
              including \link htm_v3 vectors \endlink,
              \link htm_sc spherical coordinates \endlink,
-             \link htm_s2ellipse ellipses \endlink and
-             \link htm_s2cpoly convex polygons \endlink. Spherical circles
-             are easily represented as a position and a radius.
+             \link htm_s2ellipse ellipses \endlink,
+             \link htm_s2cpoly convex polygons \endlink,
+             \link htm_s2box longitude/latitude boxes \endlink and
+             \link htm_s2region composite regions \endlink. Spherical
+             circles are easily represented as a position and a radius.
         </td>
     </tr>
     <tr><td> tinyhtm/htm.h </td>
         <td> contains types and functions for HTM indexing of points,
-             circles, ellipses and polygons.
+             circles, ellipses, polygons, longitude/latitude boxes and
+             composite regions.
         </td>
     </tr>
     <tr><td> tinyhtm/select.h </td>
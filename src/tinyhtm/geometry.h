@@ -579,6 +579,190 @@ int htm_v3_convex (const struct htm_v3 *points, size_t n,
 struct htm_s2cpoly *htm_s2cpoly_hull (const struct htm_v3 *points, size_t n,
                                       enum htm_errcode *err);
 
+/* ================================================================ */
+/** @}
+    \defgroup geom_box Longitude/Latitude Boxes
+    @{
+ */
+/* ================================================================ */
+
+/** A longitude/latitude box on the sphere, i.e. the points with longitude
+    in <tt>[lonmin, lonmin + width]</tt> (modulo 360) and latitude in
+    <tt>[latmin, latmax]</tt>. The longitude edges of the box are great
+    circle (meridian) segments, and the latitude edges are small circles.
+    Unlike the polygons returned by htm_s2cpoly_box(), such a box may
+    contain a pole, and may span more than a hemisphere.
+  */
+struct htm_s2box
+{
+  double lonmin;  /**< Minimum longitude, in <tt>[0, 360)</tt> (degrees). */
+  double width;   /**< Longitude extent, in <tt>[0, 360]</tt> (degrees). */
+  double latmin;  /**< Minimum latitude (degrees). */
+  double latmax;  /**< Maximum latitude (degrees). */
+  double zmin;    /**< Sine of the minimum latitude. */
+  double zmax;    /**< Sine of the maximum latitude. */
+  struct htm_v3 w; /**< Inward normal of the western meridian plane. */
+  struct htm_v3 e; /**< Inward normal of the eastern meridian plane. */
+};
+
+/** Initializes a longitude/latitude box. All angles are in degrees.
+
+    The box extends eastwards from \p lonmin to \p lonmax, so that a
+    box crossing the 0/360 degree meridian is obtained with
+    <tt>lonmax < lonmin</tt> (e.g. 350 to 10). When <tt>lonmax - lonmin</tt>
+    is 360 or more, the box covers all longitudes. Latitudes must lie in
+    <tt>[-90, 90]</tt>, with <tt>latmin <= latmax</tt>.
+  */
+enum htm_errcode htm_s2box_init (struct htm_s2box *box, double lonmin,
+                                 double lonmax, double latmin,
+                                 double latmax);
+
+/** Returns 1 if the longitude/latitude box \p box contains the unit
+    vector \p v, and 0 otherwise.  Arguments must not be NULL pointers.
+  */
+HTM_INLINE int htm_s2box_cv3 (const struct htm_s2box *box,
+                              const struct htm_v3 *v)
+{
+  int w, e;
+  if (v->z < box->zmin || v->z > box->zmax)
+    {
+      return 0;
+    }
+  else if (box->width >= 360.0)
+    {
+      return 1;
+    }
+  w = htm_v3_dot (&box->w, v) >= 0.0;
+  e = htm_v3_dot (&box->e, v) >= 0.0;
+  if (box->width <= 180.0)
+    {
+      return w && e;
+    }
+  return w || e;
+}
+
+/* ================================================================ */
+/** @}
+    \defgroup geom_region Composite Spherical Regions
+    @{
+ */
+/* ================================================================ */
+
+/** Spherical region types.
+  */
+enum htm_s2region_type
+{
+  HTM_S2REGION_CIRCLE = 0, /**< Spherical circle. */
+  HTM_S2REGION_ELLIPSE,    /**< Spherical ellipse. */
+  HTM_S2REGION_CPOLY,      /**< Spherical convex polygon. */
+  HTM_S2REGION_BOX,        /**< Longitude/latitude box. */
+  HTM_S2REGION_UNION,      /**< Union of two regions. */
+  HTM_S2REGION_ISECT,      /**< Intersection of two regions. */
+  HTM_S2REGION_DIFF        /**< First region minus the second. */
+};
+
+/** A spherical region - either a circle, ellipse, convex polygon or
+    longitude/latitude box, or the union, intersection or difference of
+    two other regions. Composite regions are binary trees with primitive
+    shapes at the leaves, and own their operands.
+  */
+struct htm_s2region
+{
+  enum htm_s2region_type type;
+  struct htm_v3 cen;             /**< Circle center (unit vector). */
+  double dist2;                  /**< Circle radius (square secant dist). */
+  struct htm_s2ellipse ellipse;  /**< Ellipse. */
+  struct htm_s2cpoly *poly;      /**< Polygon (owned by the region). */
+  struct htm_s2box box;          /**< Longitude/latitude box. */
+  struct htm_s2region *op[2];    /**< Operands of a set operation. */
+};
+
+/** Creates a region corresponding to the spherical circle with the given
+    center (which must be a unit vector) and radius (in degrees). A negative
+    radius results in an empty region, and a radius of 180 degrees or more
+    in a region covering the entire sphere.
+
+    To release resources for the region, call htm_s2region_destroy() on
+    the returned pointer.
+
+    \return
+            - a newly allocated region on success.
+            - NULL if an error occurs or the inputs are invalid. In this
+              case, \p *err is additionally set to indicate the reason
+              for the failure.
+  */
+struct htm_s2region *htm_s2region_circle (const struct htm_v3 *cen,
+                                          double radius,
+                                          enum htm_errcode *err);
+
+/** Creates a region corresponding to a copy of the given spherical ellipse.
+
+    To release resources for the region, call htm_s2region_destroy() on
+    the returned pointer.
+  */
+struct htm_s2region *htm_s2region_ellipse (const struct htm_s2ellipse *ellipse,
+                                           enum htm_errcode *err);
+
+/** Creates a region corresponding to a copy of the given spherical convex
+    polygon.
+
+    To release resources for the region, call htm_s2region_destroy() on
+    the returned pointer.
+  */
+struct htm_s2region *htm_s2region_cpoly (const struct htm_s2cpoly *poly,
+                                         enum htm_errcode *err);
+
+/** Creates a region corresponding to a copy of the given longitude/latitude
+    box.
+
+    To release resources for the region, call htm_s2region_destroy() on
+    the returned pointer.
+  */
+struct htm_s2region *htm_s2region_box (const struct htm_s2box *box,
+                                       enum htm_errcode *err);
+
+/** Creates a region corresponding to the union of \p r1 and \p r2.
+
+    The returned region takes ownership of its operands; they must not be
+    destroyed by the caller. If an error occurs, both operands are
+    destroyed and NULL is returned.
+  */
+struct htm_s2region *htm_s2region_union (struct htm_s2region *r1,
+                                         struct htm_s2region *r2,
+                                         enum htm_errcode *err);
+
+/** Creates a region corresponding to the intersection of \p r1 and \p r2.
+
+    The returned region takes ownership of its operands; they must not be
+    destroyed by the caller. If an error occurs, both operands are
+    destroyed and NULL is returned.
+  */
+struct htm_s2region *htm_s2region_isect (struct htm_s2region *r1,
+                                         struct htm_s2region *r2,
+                                         enum htm_errcode *err);
+
+/** Creates a region containing the points of \p r1 that are not in \p r2.
+
+    The returned region takes ownership of its operands; they must not be
+    destroyed by the caller. If an error occurs, both operands are
+    destroyed and NULL is returned.
+  */
+struct htm_s2region *htm_s2region_diff (struct htm_s2region *r1,
+                                        struct htm_s2region *r2,
+                                        enum htm_errcode *err);
+
+/** Releases the resources for \p region and all of its operands. Passing
+    a NULL pointer is a no-op.
+  */
+void htm_s2region_destroy (struct htm_s2region *region);
+
+/** Returns 1 if the region \p r contains vector \p v, and 0 otherwise.
+    Set operations are short-circuited: the second operand is only
+    tested when the first does not decide the outcome. Arguments must
+    not be NULL pointers.
+  */
+int htm_s2region_cv3 (const struct htm_s2region *r, const struct htm_v3 *v);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -369,6 +369,27 @@ struct htm_ids *htm_s2cpoly_ids (struct htm_ids *ids,
                                  const struct htm_s2cpoly *poly, int level,
                                  size_t maxranges, enum htm_errcode *err);
 
+/** Returns a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given composite region. Parameters and return value
+    are as for htm_s2cpoly_ids().
+
+    The coverage is computed in a single pass over the HTM triangles,
+    by combining the coverage codes of the region operands; it is a
+    superset of the coverage of the exact region.
+  */
+struct htm_ids *htm_s2region_ids (struct htm_ids *ids,
+                                  const struct htm_s2region *region,
+                                  int level, size_t maxranges,
+                                  enum htm_errcode *err);
+
+/** Returns a list of HTM ID ranges corresponding to the HTM triangles
+    overlapping the given longitude/latitude box. Parameters and return
+    value are as for htm_s2cpoly_ids().
+  */
+struct htm_ids *htm_s2box_ids (struct htm_ids *ids,
+                               const struct htm_s2box *box, int level,
+                               size_t maxranges, enum htm_errcode *err);
+
 /** Converts an HTM ID as returned by the various indexing functions to
     decimal form. Returns 0 if the input ID is invalid.
 
@@ -25,14 +25,52 @@ extern "C" {
   */
 /* ================================================================ */
 
+/** HTM tree index format flags, recorded in the index header.
+  */
+enum htm_tree_flags
+{
+  /** Every node stores a spherical cap bounding its points. Queries
+      classify nodes against these caps before falling back to the
+      geometry of the node HTM triangles. */
+  HTM_TREE_CAPS = 1,
+  /** The children of every internal node are described by a block of
+      fixed-width integers (their counts, relative indexes and offsets),
+      rather than by varints, so that they can be decoded without
+      data-dependent branches. Indexes are somewhat larger. */
+  HTM_TREE_FIXED = 2,
+  /** The tree shape is stored as a bit-vector of child masks in level
+      order, navigated with rank queries, along with bit-packed node
+      counts; there are no child offsets or node indexes. Indexes are
+      2-3 times smaller, at some cost in decoding work per node. */
+  HTM_TREE_SUCCINCT = 4,
+  /** Points are sorted on HTM IDs at a level other than 20, recorded
+      in the index header. It is the deepest level of index nodes, so
+      that leaves in dense regions hold fewer points. */
+  HTM_TREE_DEPTH = 8,
+  /** Leaves are chosen per node by a query cost model, rather than being
+      exactly the nodes with fewer than leafthresh points, so nodes record
+      whether they are internal: their stored point count (in the node, or
+      in the children block of its parent) is 2 * count + 1 for internal
+      nodes and 2 * count for leaves. Nodes with leafthresh points or more
+      are still always internal. In succinct indexes, leaves are the nodes
+      with no children, and counts are stored as is. */
+  HTM_TREE_ADAPTIVE = 16
+};
+
+struct _htm_storage;
+
 /** An HTM tree containing a list of points sorted on HTM ID (tree
     entries), and optionally an index over the points that allows for
     fast spatial searches/counts.
   */
 struct htm_tree
 {
-  uint64_t leafthresh;          /**< Min # of points in an internal node. */
+  uint64_t leafthresh;          /**< Min # of points in an internal node,
+                                     unless HTM_TREE_ADAPTIVE is set. */
+  uint64_t flags;               /**< Index format flags (htm_tree_flags). */
   uint64_t count;               /**< Total # of points in tree. */
+  int depth;                    /**< Level of the HTM IDs points are sorted
+                                     on, and of the deepest index nodes. */
   const unsigned char *root[8]; /**< Pointers to HTM root nodes. */
   size_t entry_size;            /**< Size of each entry. */
   size_t num_elements_per_entry;
@@ -42,7 +80,20 @@ struct htm_tree
   const void *index; /**< Tree file memory map. */
   size_t indexsz;    /**< Size of tree file memory-map (bytes). */
   off_t offset;      /**< Size of tree file memory-map (bytes). */
-  hsize_t datasz;    /**< Size of data file memory-map (bytes). */
+  hsize_t datasz;    /**< Size of data file memory-map (bytes), or 0 if
+                          the data file is chunked. */
+  size_t mapsz;      /**< Size of the whole file memory-map (bytes). */
+  void *indexcopy;   /**< Anonymous memory copy of the index, or NULL. */
+  size_t indexcopysz; /**< Size of the index copy mapping (bytes). */
+  struct _htm_storage *storage; /**< Data file storage backend, or NULL
+                                     if data is read from the memory map. */
+  size_t lookahead;  /**< # of leaves prefetched ahead of the one being
+                          scanned when reading from the memory map. */
+  /** Prefix count table, or NULL: 8*4^prefixlevel + 1 little-endian
+      64 bit integers, entry k being the number of points in the level
+      \p prefixlevel HTM triangles preceding the k-th one. */
+  const unsigned char *prefix;
+  int prefixlevel;   /**< HTM level of the prefix count table. */
   int datafd;        /**< File descriptor for data file. */
 } HTM_ALIGNED (16);
 
@@ -62,15 +113,146 @@ void htm_tree_destroy (struct htm_tree *tree);
   */
 enum htm_errcode htm_tree_lock (struct htm_tree *tree, size_t datathresh);
 
+/** Parameters for htm_tree_warmup().
+  */
+struct htm_tree_warmup_params
+{
+  /** If non-zero, prefetched pages are faulted in before
+      htm_tree_warmup() returns. Otherwise the kernel is merely advised
+      to read them ahead. */
+  int touch;
+  /** Number of subtrees whose points are prefetched. The subtrees are
+      the index nodes at HTM level \p level containing the most points. */
+  size_t topk;
+  /** HTM level of the subtrees considered for point prefetching. */
+  int level;
+  /** If the index fits in this many bytes, it is copied to anonymous
+      memory backed by transparent huge pages (where available), so that
+      it can no longer be evicted along with the page cache and needs
+      fewer TLB entries. 0 disables copying. */
+  size_t copybudget;
+};
+
+/** Page residency of an HTM tree, as reported by mincore().
+  */
+struct htm_tree_residency
+{
+  size_t index_pages;    /**< # of pages spanned by the tree index. */
+  size_t index_resident; /**< # of resident tree index pages. */
+  size_t data_pages;     /**< # of pages spanned by the tree points. */
+  size_t data_resident;  /**< # of resident tree point pages. */
+};
+
+/** Warms up an HTM tree after it has been opened, so that queries do not
+    suffer major page faults: the index is prefetched in on-disk layout
+    order, along with the points of the densest subtrees, and is
+    optionally copied to anonymous memory. A NULL \p params selects
+    defaults: prefetch only, points of the 64 densest level 6 subtrees,
+    no copy.
+
+    Must not be called while \p tree is being queried.
+  */
+enum htm_errcode htm_tree_warmup (struct htm_tree *tree,
+                                  const struct htm_tree_warmup_params *params);
+
+/** Reports how much of an HTM tree is resident in memory.
+  */
+enum htm_errcode htm_tree_resident (const struct htm_tree *tree,
+                                    struct htm_tree_residency *res);
+
+/** Records which pages of the tree file backing \p tree are currently
+    resident in the page cache to the hot-set file \p path. Residency of
+    pages that have not been mapped by the calling process is only
+    reported by mincore() if the caller owns or may write the tree file.
+  */
+enum htm_errcode htm_tree_hotset_save (const struct htm_tree *tree,
+                                       const char *path);
+
+/** Reads the pages listed in the hot-set file \p path into the page cache
+    using \p nthreads threads, and returns once they have been requested.
+    Returns HTM_ETREE if the hot-set was recorded for a different (or
+    since modified) tree file.
+  */
+enum htm_errcode htm_tree_hotset_load (const struct htm_tree *tree,
+                                       const char *path, int nthreads);
+
+/** Storage backends for the points of an HTM tree.
+  */
+enum htm_tree_backend
+{
+  /** Points are read from the data file memory map (the default). */
+  HTM_TREE_MMAP = 0,
+  /** Points are read into a user-space block cache, with batched preadv()
+      calls, or io_uring reads where the kernel supports them. This avoids
+      serialized page faults and unsuitable kernel readahead on network
+      file systems. */
+  HTM_TREE_PREAD
+};
+
+/** Parameters for htm_tree_storage(). Zero-valued sizes select defaults.
+  */
+struct htm_tree_storage_params
+{
+  enum htm_tree_backend backend; /**< Storage backend. */
+  size_t blocksz;      /**< Block cache block size (bytes, default 64KiB). */
+  size_t cachesz;      /**< Block cache capacity (bytes, default 64MiB). */
+  unsigned int depth;  /**< Maximum # of reads in flight (default 32). */
+  /** Memory map backend only: number of leaves whose points are
+      prefetched (with MADV_WILLNEED) ahead of the leaf being scanned, so
+      that reads of cold data overlap with point tests. 0 scans every leaf
+      as soon as the index traversal reaches it. */
+  size_t lookahead;
+};
+
+/** Selects the storage backend from which tree queries read points.
+    A NULL \p params selects the memory map without look-ahead. The tree
+    index is always read from the memory map.
+
+    Must not be called while \p tree is being queried; queries on trees
+    with a block cache may run concurrently.
+  */
+enum htm_errcode htm_tree_storage (struct htm_tree *tree,
+                                   const struct htm_tree_storage_params *params);
+
 typedef std::function<bool(const char *)> htm_callback;
 
 /* ================================================================ */
 /** @}
     \defgroup tree_query HTM tree index queries
+
+    Every query takes an optional \p stats argument. If it is not NULL,
+    the statistics of the query (see htm_query_stats) are stored in
+    \p *stats; otherwise, none are gathered.
     @{
   */
 /* ================================================================ */
 
+/** Deepest HTM level for which query statistics are kept per level. */
+#define HTM_QUERY_MAX_LEVEL 24
+
+/** Execution statistics of a tree query.
+  */
+struct htm_query_stats
+{
+  /** # of index nodes visited at each level. Nodes below
+      HTM_QUERY_MAX_LEVEL are tallied at that level. */
+  uint64_t nodes[HTM_QUERY_MAX_LEVEL + 1];
+  /** # of index nodes visited at each level that were disjoint from
+      (0), intersected (1), contained (2) or were inside (3) the region. */
+  uint64_t classified[HTM_QUERY_MAX_LEVEL + 1][4];
+  uint64_t disjoint;     /**< # of visited nodes disjoint from the region. */
+  uint64_t intersect;    /**< # of visited nodes intersecting the region. */
+  uint64_t contains;     /**< # of visited nodes containing the region. */
+  uint64_t inside;       /**< # of visited nodes inside the region. */
+  uint64_t leaves;       /**< # of nodes whose points were read. */
+  uint64_t tested;       /**< # of points tested against the region. */
+  uint64_t matched;      /**< # of tested points inside the region. */
+  uint64_t index_bytes;  /**< # of tree index bytes decoded. */
+  uint64_t data_bytes;   /**< # of point data bytes read. */
+  double traversal_time; /**< Time spent traversing the index (s). */
+  double scan_time;      /**< Time spent reading and scanning points (s). */
+};
+
 /** Returns the number of points in \p tree that are inside the
     spherical circle with the given center and radius.
 
@@ -84,7 +266,8 @@ typedef std::function<bool(const char *)> htm_callback;
   */
 int64_t htm_tree_s2circle_scan (const struct htm_tree *tree,
                                 const struct htm_v3 *center, double radius,
-                                enum htm_errcode *err, htm_callback callback);
+                                enum htm_errcode *err, htm_callback callback,
+                                struct htm_query_stats *stats = NULL);
 
 /** Returns the number of points in \p tree that are inside
     the given spherical ellipse.
@@ -99,7 +282,8 @@ int64_t htm_tree_s2circle_scan (const struct htm_tree *tree,
   */
 int64_t htm_tree_s2ellipse_scan (const struct htm_tree *tree,
                                  const struct htm_s2ellipse *ellipse,
-                                 enum htm_errcode *err, htm_callback callback);
+                                 enum htm_errcode *err, htm_callback callback,
+                                 struct htm_query_stats *stats = NULL);
 
 /** Returns the number of points in \p tree that are inside
     the given spherical convex polygon.
@@ -114,7 +298,40 @@ int64_t htm_tree_s2ellipse_scan (const struct htm_tree *tree,
   */
 int64_t htm_tree_s2cpoly_scan (const struct htm_tree *tree,
                                const struct htm_s2cpoly *poly,
-                               enum htm_errcode *err, htm_callback callback);
+                               enum htm_errcode *err, htm_callback callback,
+                               struct htm_query_stats *stats = NULL);
+
+/** Returns the number of points in \p tree that are inside
+    the given composite region.
+
+    The implementation scans over all the points in the tree rather than
+    taking advantage of the index. Therefore, this function is primarily
+    useful for testing - application code should use htm_tree_s2region_count()
+    instead.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+  */
+int64_t htm_tree_s2region_scan (const struct htm_tree *tree,
+                                const struct htm_s2region *region,
+                                enum htm_errcode *err, htm_callback callback,
+                                struct htm_query_stats *stats = NULL);
+
+/** Returns the number of points in \p tree that are inside
+    the given longitude/latitude box.
+
+    The implementation scans over all the points in the tree rather than
+    taking advantage of the index. Therefore, this function is primarily
+    useful for testing - application code should use htm_tree_s2box_count()
+    instead.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+  */
+int64_t htm_tree_s2box_scan (const struct htm_tree *tree,
+                             const struct htm_s2box *box,
+                             enum htm_errcode *err, htm_callback callback,
+                             struct htm_query_stats *stats = NULL);
 
 /** Returns the number of points in \p tree that are inside the
     spherical circle with the given center and radius.
@@ -124,14 +341,16 @@ int64_t htm_tree_s2cpoly_scan (const struct htm_tree *tree,
   */
 int64_t htm_tree_s2circle_count (const struct htm_tree *tree,
                                  const struct htm_v3 *center, double radius,
-                                 enum htm_errcode *err);
+                                 enum htm_errcode *err,
+                                 struct htm_query_stats *stats = NULL);
 
 /** Invokes a callback for every point inside a given circle
   */
 
 int64_t htm_tree_s2circle (const struct htm_tree *tree,
                            const struct htm_v3 *center, double radius,
-                           enum htm_errcode *err, htm_callback callback);
+                           enum htm_errcode *err, htm_callback callback,
+                           struct htm_query_stats *stats = NULL);
 
 /** Returns the number of points in \p tree that are inside
     the given spherical ellipse.
@@ -141,14 +360,16 @@ int64_t htm_tree_s2circle (const struct htm_tree *tree,
   */
 int64_t htm_tree_s2ellipse_count (const struct htm_tree *tree,
                                   const struct htm_s2ellipse *ellipse,
-                                  enum htm_errcode *err);
+                                  enum htm_errcode *err,
+                                  struct htm_query_stats *stats = NULL);
 
 /** Invokes a callback for every point inside a given ellipse
   */
 
 int64_t htm_tree_s2ellipse (const struct htm_tree *tree,
                             const struct htm_s2ellipse *ellipse,
-                            enum htm_errcode *err, htm_callback callback);
+                            enum htm_errcode *err, htm_callback callback,
+                            struct htm_query_stats *stats = NULL);
 
 /** Returns the number of points in \p tree that are inside
     the given spherical convex polygon.
@@ -158,14 +379,108 @@ int64_t htm_tree_s2ellipse (const struct htm_tree *tree,
   */
 int64_t htm_tree_s2cpoly_count (const struct htm_tree *tree,
                                 const struct htm_s2cpoly *poly,
-                                enum htm_errcode *err);
+                                enum htm_errcode *err,
+                                struct htm_query_stats *stats = NULL);
 
 /** Invokes a callback for every point inside a given polygon
   */
 
 int64_t htm_tree_s2cpoly (const struct htm_tree *tree,
                           const struct htm_s2cpoly *poly,
-                          enum htm_errcode *err, htm_callback callback);
+                          enum htm_errcode *err, htm_callback callback,
+                          struct htm_query_stats *stats = NULL);
+
+/** Returns the number of points in \p tree that are inside
+    the given composite region. The index is traversed once, whatever
+    the number of operands in the region.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+  */
+int64_t htm_tree_s2region_count (const struct htm_tree *tree,
+                                 const struct htm_s2region *region,
+                                 enum htm_errcode *err,
+                                 struct htm_query_stats *stats = NULL);
+
+/** Invokes a callback for every point inside a given composite region
+  */
+
+int64_t htm_tree_s2region (const struct htm_tree *tree,
+                           const struct htm_s2region *region,
+                           enum htm_errcode *err, htm_callback callback,
+                           struct htm_query_stats *stats = NULL);
+
+/** Approximates the number of points in \p tree that are inside the given
+    composite region, without ever reading point data to decide whether a
+    point belongs to the region.
+
+    Nodes of the tree index that intersect the region are not subdivided
+    beyond HTM level \p level. Such nodes, as well as leaves that intersect
+    the region, are treated as if they were entirely inside it. The result
+    is therefore never smaller than the exact count, and every point
+    counted lies within \p *maxerr degrees of the region. \p *maxerr is
+    twice the bounding circle radius (see htm_tri) of the largest HTM
+    triangle treated in this way, and is 0 if the result is exact.
+
+    If \p callback is not NULL, it is invoked for every point counted.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+  */
+int64_t htm_tree_s2region_approx (const struct htm_tree *tree,
+                                  const struct htm_s2region *region,
+                                  int level, double *maxerr,
+                                  enum htm_errcode *err,
+                                  htm_callback callback,
+                                  struct htm_query_stats *stats = NULL);
+
+/** Returns the number of points in \p tree that are inside
+    the given longitude/latitude box.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+  */
+int64_t htm_tree_s2box_count (const struct htm_tree *tree,
+                              const struct htm_s2box *box,
+                              enum htm_errcode *err,
+                              struct htm_query_stats *stats = NULL);
+
+/** Invokes a callback for every point inside a given longitude/latitude box
+  */
+
+int64_t htm_tree_s2box (const struct htm_tree *tree,
+                        const struct htm_s2box *box, enum htm_errcode *err,
+                        htm_callback callback,
+                        struct htm_query_stats *stats = NULL);
+
+/** Returns the number of points in \p tree whose HTM IDs belong to the
+    given list of ID ranges, such as a coverage computed by
+    htm_s2circle_ids(). The ranges may be at any level up to the depth
+    of the tree.
+
+    The count of every range is read from the prefix count table of the
+    tree, at the cost of two table lookups, except for the level
+    htm_tree::prefixlevel HTM triangles that are only partially covered
+    by a range finer than the table. Only the points of those triangles
+    are read.
+
+    If an error occurs, the return value is negative, and \p *err
+    is set to an error code describing the reason for the failure.
+    In particular, HTM_EINV is returned if \p tree has no prefix count
+    table, HTM_EID if a range contains invalid HTM IDs, and HTM_ELEVEL if
+    it is deeper than the tree.
+  */
+int64_t htm_tree_ids_count (const struct htm_tree *tree,
+                            const struct htm_ids *ids, enum htm_errcode *err,
+                            struct htm_query_stats *stats = NULL);
+
+/** Invokes a callback for every point whose HTM ID belongs to the given
+    list of ID ranges (see htm_tree_ids_count()).
+  */
+
+int64_t htm_tree_ids (const struct htm_tree *tree, const struct htm_ids *ids,
+                      enum htm_errcode *err, htm_callback callback,
+                      struct htm_query_stats *stats = NULL);
 
 /** Returns a lower and upper bound on the number of points in \p tree
     that are inside the spherical circle with the given center and radius.
@@ -174,10 +489,11 @@ int64_t htm_tree_s2cpoly (const struct htm_tree *tree,
     bound below the lower bound, and \p *err is set to an error code
     describing the reason for the failure.
   */
-struct htm_range htm_tree_s2circle_range (const struct htm_tree *tree,
-                                          const struct htm_v3 *center,
-                                          double radius,
-                                          enum htm_errcode *err);
+struct htm_range
+htm_tree_s2circle_range (const struct htm_tree *tree,
+                         const struct htm_v3 *center, double radius,
+                         enum htm_errcode *err,
+                         struct htm_query_stats *stats = NULL);
 
 /** Returns a lower and upper bound on the number of points in \p tree
     that are inside the given spherical ellipse.
@@ -186,9 +502,11 @@ struct htm_range htm_tree_s2circle_range (const struct htm_tree *tree,
     bound below the lower bound, and \p *err is set to an error code
     describing the reason for the failure.
   */
-struct htm_range htm_tree_s2ellipse_range (const struct htm_tree *tree,
-                                           const struct htm_s2ellipse *ellipse,
-                                           enum htm_errcode *err);
+struct htm_range
+htm_tree_s2ellipse_range (const struct htm_tree *tree,
+                          const struct htm_s2ellipse *ellipse,
+                          enum htm_errcode *err,
+                          struct htm_query_stats *stats = NULL);
 
 /** Returns a lower and upper bound on the number of points in \p tree
     that are inside the given spherical convex polygon.
@@ -199,7 +517,33 @@ struct htm_range htm_tree_s2ellipse_range (const struct htm_tree *tree,
   */
 struct htm_range htm_tree_s2cpoly_range (const struct htm_tree *tree,
                                          const struct htm_s2cpoly *poly,
-                                         enum htm_errcode *err);
+                                         enum htm_errcode *err,
+                                         struct htm_query_stats *stats = NULL);
+
+/** Returns a lower and upper bound on the number of points in \p tree
+    that are inside the given composite region.
+
+    If an error occurs, the returned range will contain an upper
+    bound below the lower bound, and \p *err is set to an error code
+    describing the reason for the failure.
+  */
+struct htm_range
+htm_tree_s2region_range (const struct htm_tree *tree,
+                         const struct htm_s2region *region,
+                         enum htm_errcode *err,
+                         struct htm_query_stats *stats = NULL);
+
+/** Returns a lower and upper bound on the number of points in \p tree
+    that are inside the given longitude/latitude box.
+
+    If an error occurs, the returned range will contain an upper
+    bound below the lower bound, and \p *err is set to an error code
+    describing the reason for the failure.
+  */
+struct htm_range htm_tree_s2box_range (const struct htm_tree *tree,
+                                       const struct htm_s2box *box,
+                                       enum htm_errcode *err,
+                                       struct htm_query_stats *stats = NULL);
 
 /** @} */
 
@@ -8,6 +8,7 @@ e
   */
 #include "tinyhtm/tree.h"
 
+#include <endian.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,7 +18,22 @@ e
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <mutex>
+
 #include "tinyhtm/varint.h"
+#include "htm/_htm_succinct.hxx"
+#include "htm/_htm_tree_layout.hxx"
+#include "htm/_htm_tree_storage.hxx"
+
+/*  The HDF5 library is not thread-safe (unless built to be), so data files
+    whose layout is not cached are read with it one at a time. Opens served
+    from the layout cache proceed concurrently.
+ */
+static std::mutex &_htm_hdf5_mutex ()
+{
+  static std::mutex m;
+  return m;
+}
 
 extern "C" {
 
@@ -31,11 +47,15 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
   const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
   enum htm_errcode err = HTM_OK;
   void *data_mmap;
-  size_t mmap_size, index_offset;
+  size_t mmap_size, index_offset, prefix_offset, prefixsz;
+  struct _htm_chunk_table chunks;
+  int cached, chunked = 0;
 
   /* set defaults */
   tree->leafthresh = 0;
+  tree->flags = 0;
   tree->count = 0;
+  tree->depth = 20;
   for (i = 0; i < 8; ++i)
     {
       tree->root[i] = NULL;
@@ -44,9 +64,18 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
   tree->index = (const void *)MAP_FAILED;
   tree->indexsz = 0;
   tree->datasz = 0;
+  tree->mapsz = 0;
+  tree->indexcopy = NULL;
+  tree->indexcopysz = 0;
+  tree->storage = NULL;
+  tree->lookahead = 0;
+  tree->prefix = NULL;
+  tree->prefixlevel = -1;
   tree->datafd = -1;
 
   index_offset = 0;
+  prefix_offset = 0;
+  prefixsz = 0;
 
   /* check inputs */
   if (tree == NULL || datafile == NULL)
@@ -58,53 +87,80 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
       return HTM_EIO;
     }
 
-  /* Open with hdf5 commands just to get the size and offsets.  Then
-     mmap with raw calls */
-  try
+  /* Open with hdf5 commands just to get the size and offsets (unless
+     they are cached in an up to date layout descriptor). Then mmap with
+     raw calls */
+  cached = _htm_tree_layout_read (tree, datafile, &sb, &index_offset,
+                                  &prefix_offset, &prefixsz);
+  if (!cached)
     {
-      H5::H5File hdf_file (datafile, H5F_ACC_RDONLY);
-      H5::DataSet dataset = hdf_file.openDataSet ("data");
-      tree->offset = dataset.getOffset ();
-      tree->datasz = dataset.getStorageSize ();
-      auto htm_type = dataset.getCompType ();
-      tree->entry_size = htm_type.getSize ();
-      tree->num_elements_per_entry = htm_type.getNmembers ();
-
+      std::lock_guard<std::mutex> lock (_htm_hdf5_mutex ());
       try
         {
-          tree->element_types.reserve (tree->num_elements_per_entry);
-          tree->element_names.reserve (tree->num_elements_per_entry);
-          for (size_t i = 0; i < tree->num_elements_per_entry; ++i)
+          H5::H5File hdf_file (datafile, H5F_ACC_RDONLY);
+          H5::DataSet dataset = hdf_file.openDataSet ("data");
+          if (dataset.getCreatePlist ().getLayout () == H5D_CHUNKED)
             {
-              tree->element_types.push_back (htm_type.getMemberDataType (i));
-              tree->element_names.push_back (htm_type.getMemberName (i));
+              /* chunks are located now, and decoded on demand */
+              err = _htm_chunk_table_read (dataset, &chunks);
+              if (err != HTM_OK)
+                {
+                  return err;
+                }
+              chunked = 1;
+              tree->offset = 0;
+              tree->datasz = 0;
             }
-        }
-      catch (std::exception &e)
-        {
-          return HTM_ENOMEM;
-        }
+          else
+            {
+              tree->offset = dataset.getOffset ();
+              tree->datasz = dataset.getStorageSize ();
+            }
+          auto htm_type = dataset.getCompType ();
+          tree->entry_size = htm_type.getSize ();
+          tree->num_elements_per_entry = htm_type.getNmembers ();
 
-      /* memory map the index (if there is one) */
+          try
+            {
+              tree->element_types.reserve (tree->num_elements_per_entry);
+              tree->element_names.reserve (tree->num_elements_per_entry);
+              for (size_t i = 0; i < tree->num_elements_per_entry; ++i)
+                {
+                  tree->element_types.push_back (
+                      htm_type.getMemberDataType (i));
+                  tree->element_names.push_back (htm_type.getMemberName (i));
+                }
+            }
+          catch (std::exception &e)
+            {
+              return HTM_ENOMEM;
+            }
 
-      try
-        {
-          auto index_dataset = hdf_file.openDataSet ("htm_index");
-          index_offset = index_dataset.getOffset ();
-          tree->indexsz = index_dataset.getStorageSize ();
-          if (tree->indexsz % pagesz != 0)
-            tree->indexsz += pagesz - tree->indexsz % pagesz;
+          /* memory map the index (if there is one); optional datasets
+             are looked up first, so that HDF5 reports no error for them */
+
+          if (H5Lexists (hdf_file.getId (), "htm_index", H5P_DEFAULT) > 0)
+            {
+              auto index_dataset = hdf_file.openDataSet ("htm_index");
+              index_offset = index_dataset.getOffset ();
+              tree->indexsz = index_dataset.getStorageSize ();
+              if (tree->indexsz % pagesz != 0)
+                tree->indexsz += pagesz - tree->indexsz % pagesz;
+            }
+
+          /* and the prefix count table (likewise optional) */
+          if (H5Lexists (hdf_file.getId (), "htm_prefix", H5P_DEFAULT) > 0)
+            {
+              auto prefix_dataset = hdf_file.openDataSet ("htm_prefix");
+              prefix_offset = prefix_dataset.getOffset ();
+              prefixsz = prefix_dataset.getStorageSize ();
+            }
         }
       catch (H5::Exception &e)
         {
-          /// Ignore any errors from trying to open a non-existant
-          /// dataset.
+          return HTM_EIO;
         }
     }
-  catch (H5::Exception &e)
-    {
-      return HTM_EIO;
-    }
 
   tree->datafd = open (datafile, O_RDONLY);
   if (tree->datafd == -1)
@@ -113,12 +169,43 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
       goto cleanup;
     }
 
-  if (tree->datasz % tree->entry_size != 0 || tree->datasz == 0)
+  if (chunked)
+    {
+      count = chunks.nrows;
+      err = _htm_storage_chunked (tree, &chunks);
+      if (err != HTM_OK)
+        {
+          goto cleanup;
+        }
+    }
+  else
+    {
+      if (tree->datasz % tree->entry_size != 0 || tree->datasz == 0)
+        {
+          err = HTM_EINV;
+          goto cleanup;
+        }
+      count = (uint64_t)tree->datasz / tree->entry_size;
+    }
+  if (count == 0)
     {
       err = HTM_EINV;
       goto cleanup;
     }
-  count = (uint64_t)tree->datasz / tree->entry_size;
+  if (!cached && !chunked)
+    {
+      /* cache the layout for later opens, if the file did not change
+         while it was being read (chunk tables are not cached) */
+      struct stat fsb;
+      if (fstat (tree->datafd, &fsb) == 0 && fsb.st_ino == sb.st_ino
+          && fsb.st_dev == sb.st_dev && fsb.st_size == sb.st_size
+          && fsb.st_mtim.tv_sec == sb.st_mtim.tv_sec
+          && fsb.st_mtim.tv_nsec == sb.st_mtim.tv_nsec)
+        {
+          _htm_tree_layout_write (tree, datafile, &sb, index_offset,
+                                  prefix_offset, prefixsz);
+        }
+    }
 
   /* /\* memory map datafile *\/ */
   /* if (tree->datasz % pagesz != 0) { */
@@ -128,11 +215,23 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
   mmap_size = (tree->datasz + tree->offset > tree->indexsz + index_offset)
                   ? (tree->datasz + tree->offset)
                   : (tree->indexsz + index_offset);
+  if (prefixsz + prefix_offset > mmap_size)
+    {
+      mmap_size = prefixsz + prefix_offset;
+    }
+
+  if (mmap_size == 0)
+    {
+      /* chunked points and no index or prefix table: nothing to map */
+      tree->count = count;
+      return HTM_OK;
+    }
 
   data_mmap = mmap (NULL, mmap_size, PROT_READ, MAP_SHARED | MAP_NORESERVE,
                     tree->datafd, 0);
 
   tree->entries = static_cast<char *>(data_mmap) + tree->offset;
+  tree->mapsz = mmap_size;
 
   if (data_mmap == MAP_FAILED)
     {
@@ -146,6 +245,33 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
       goto cleanup;
     }
 
+  if (prefix_offset != 0)
+    {
+      /* the table level follows from its size, and its last entry must
+         be the number of points */
+      uint64_t total;
+      tree->prefix = static_cast<const unsigned char *>(data_mmap)
+                     + prefix_offset;
+      for (i = 0; i <= HTM_MAX_LEVEL; ++i)
+        {
+          if (prefixsz == 8 * ((UINT64_C (8) << 2 * i) + 1))
+            {
+              tree->prefixlevel = i;
+            }
+        }
+      if (tree->prefixlevel < 0)
+        {
+          err = HTM_ETREE;
+          goto cleanup;
+        }
+      memcpy (&total, tree->prefix + prefixsz - 8, sizeof(total));
+      if (le64toh (total) != count)
+        {
+          err = HTM_ETREE;
+          goto cleanup;
+        }
+    }
+
   /* Make sure index exists */
   if (index_offset == 0)
     {
@@ -159,6 +285,36 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
   s = (const unsigned char *)tree->index;
   tree->leafthresh = htm_varint_decode (s);
   s += 1 + htm_varint_nfollow (*s);
+  if (tree->leafthresh == 0)
+    {
+      /* a leading 0 (never a valid leaf threshold) introduces the
+         index format flags */
+      const uint64_t formats = HTM_TREE_FIXED | HTM_TREE_SUCCINCT;
+      const uint64_t known
+          = HTM_TREE_CAPS | HTM_TREE_DEPTH | HTM_TREE_ADAPTIVE | formats;
+      tree->flags = htm_varint_decode (s);
+      s += 1 + htm_varint_nfollow (*s);
+      if ((tree->flags & ~known) != 0
+          || (tree->flags & formats) == formats)
+        {
+          /* unsupported index format */
+          err = HTM_ETREE;
+          goto cleanup;
+        }
+      if ((tree->flags & HTM_TREE_DEPTH) != 0)
+        {
+          const uint64_t depth = htm_varint_decode (s);
+          s += 1 + htm_varint_nfollow (*s);
+          if (depth > HTM_MAX_LEVEL)
+            {
+              err = HTM_ETREE;
+              goto cleanup;
+            }
+          tree->depth = (int)depth;
+        }
+      tree->leafthresh = htm_varint_decode (s);
+      s += 1 + htm_varint_nfollow (*s);
+    }
   tree->count = htm_varint_decode (s);
   s += 1 + htm_varint_nfollow (*s);
   if (tree->count != count)
@@ -167,6 +323,21 @@ enum htm_errcode htm_tree_init (struct htm_tree *tree,
       err = HTM_ETREE;
       goto cleanup;
     }
+  if ((tree->flags & HTM_TREE_SUCCINCT) != 0)
+    {
+      /* succinct indexes have no root offsets; the first root points
+         at the index itself */
+      struct _htm_succinct sx;
+      const unsigned char *end = _htm_succinct_init (&sx, s, tree->flags);
+      tree->root[0] = s;
+      if (sx.n < 8 || end - (const unsigned char *)tree->index > sb.st_size)
+        {
+          /* index overflowed tree file size */
+          err = HTM_ETREE;
+          goto cleanup;
+        }
+      return HTM_OK;
+    }
   for (i = 0; i < 8; ++i)
     {
       off = htm_varint_decode (s);
@@ -200,20 +371,34 @@ void htm_tree_destroy (struct htm_tree *tree)
     {
       return;
     }
+  if (tree->storage != NULL)
+    {
+      _htm_storage_destroy (tree->storage);
+      tree->storage = NULL;
+    }
   /* unmap and close data file */
   if (static_cast<char *>(tree->entries) - tree->offset != MAP_FAILED)
     {
-      munmap (static_cast<char *>(tree->entries) - tree->offset, tree->datasz);
+      munmap (static_cast<char *>(tree->entries) - tree->offset, tree->mapsz);
       tree->entries = MAP_FAILED;
     }
   tree->datasz = 0;
+  tree->mapsz = 0;
   if (tree->datafd != -1)
     {
       close (tree->datafd);
       tree->datafd = -1;
     }
+  if (tree->indexcopy != NULL)
+    {
+      munmap (tree->indexcopy, tree->indexcopysz);
+      tree->indexcopy = NULL;
+      tree->indexcopysz = 0;
+    }
   tree->index = (const void *)MAP_FAILED;
   tree->indexsz = 0;
+  tree->prefix = NULL;
+  tree->prefixlevel = -1;
   // /* Deallocate names and types */
   // if(tree->element_names!=NULL)
   //   {
@@ -227,7 +412,9 @@ void htm_tree_destroy (struct htm_tree *tree)
 
   /* set remaining fields to default values */
   tree->leafthresh = 0;
+  tree->flags = 0;
   tree->count = 0;
+  tree->depth = 20;
   for (i = 0; i < 8; ++i)
     {
       tree->root[i] = NULL;
@@ -247,7 +434,7 @@ enum htm_errcode htm_tree_lock (struct htm_tree *tree, size_t datathresh)
           return HTM_ENOMEM;
         }
     }
-  if (tree->datasz <= datathresh)
+  if (tree->entries != MAP_FAILED && tree->datasz <= datathresh)
     {
       if (mlock (tree->entries, tree->datasz) != 0)
         {
@@ -28,6 +28,19 @@ static int json = 0;
 /* Should the count be estimated, or determined exactly? */
 static int estimate = 0;
 static int print = 0;
+/* Should the traversal profile of the query be reported? */
+static int explain = 0;
+
+/* Traversal profile of the query, and page residency of the tree before
+   and after running it. */
+static struct
+{
+  struct htm_query_stats stats;
+  struct htm_tree_residency before;
+  struct htm_tree_residency after;
+  uint64_t rows;      /* # of points in the tree */
+  size_t entry_size;  /* size of a point (bytes) */
+} profile;
 
 /* Performs string escaping for the JSON/IPAC SVC formats. */
 static const char *esc (const char *s)
@@ -129,7 +142,9 @@ static void err (const char *fmt, ...)
 static double get_double (const char *s)
 {
   char *endptr;
-  double d = strtod (s, &endptr);
+  double d;
+  errno = 0;
+  d = strtod (s, &endptr);
   if (errno != 0 || endptr == s)
     {
       err ("failed to convert argument `%s' to a double", s);
@@ -137,15 +152,150 @@ static double get_double (const char *s)
   return d;
 }
 
+/* Returns the statistics a query should gather, and records the page
+   residency of the tree before the query runs. */
+static struct htm_query_stats *explain_begin (const struct htm_tree *tree)
+{
+  if (explain == 0)
+    {
+      return NULL;
+    }
+  memset (&profile, 0, sizeof(profile));
+  profile.rows = tree->count;
+  profile.entry_size = tree->entry_size;
+  htm_tree_resident (tree, &profile.before);
+  return &profile.stats;
+}
+
+/* Records the page residency of the tree after the query ran. */
+static void explain_end (const struct htm_tree *tree)
+{
+  if (explain != 0)
+    {
+      htm_tree_resident (tree, &profile.after);
+    }
+}
+
+static unsigned long long faults (size_t before, size_t after)
+{
+  return (after > before) ? (unsigned long long)(after - before) : 0ull;
+}
+
+/* Prints the traversal profile of the query as additional fields of the
+   result, along with the estimated cost of a full scan. The page faults
+   of the query are estimated from the # of tree file pages that became
+   resident while it ran, and those of a scan from the # of data pages
+   that are still not resident. The scan time is extrapolated from the
+   rate at which the query read points, when it read any. */
+static void print_explain ()
+{
+  const struct htm_query_stats *s = &profile.stats;
+  const unsigned long long scanbytes
+      = (unsigned long long)(profile.rows * profile.entry_size);
+  const unsigned long long scanfaults
+      = profile.after.data_pages - profile.after.data_resident;
+  char scantime[64];
+  const char *sep = "";
+  int l;
+
+  if (explain == 0)
+    {
+      return;
+    }
+  if (s->data_bytes > 0 && s->scan_time > 0.0)
+    {
+      snprintf (scantime, sizeof(scantime), json ? "%.6f" : "\"%.6f\"",
+                s->scan_time * (double)scanbytes / (double)s->data_bytes);
+    }
+  else
+    {
+      /* IPAC struct values are quoted strings */
+      strcpy (scantime, json ? "null" : "\"null\"");
+    }
+  printf (json ? ", \"explain\":{\"levels\":["
+               : ", explain=[struct levels=[array ");
+  for (l = 0; l <= HTM_QUERY_MAX_LEVEL; ++l)
+    {
+      const uint64_t *c = s->classified[l];
+      if (s->nodes[l] == 0)
+        {
+          continue;
+        }
+      if (json)
+        {
+          printf ("%s{\"level\":%d, \"disjoint\":%llu, \"intersect\":%llu, "
+                  "\"contains\":%llu, \"inside\":%llu}",
+                  sep, l, (unsigned long long)c[0], (unsigned long long)c[1],
+                  (unsigned long long)c[2], (unsigned long long)c[3]);
+        }
+      else
+        {
+          printf ("%s[struct level=\"%d\", disjoint=\"%llu\", "
+                  "intersect=\"%llu\", contains=\"%llu\", inside=\"%llu\"]",
+                  sep, l, (unsigned long long)c[0], (unsigned long long)c[1],
+                  (unsigned long long)c[2], (unsigned long long)c[3]);
+        }
+      sep = ", ";
+    }
+  if (json)
+    {
+      printf ("], \"leaves\":%llu, \"rows_read\":%llu, "
+              "\"rows_tested\":%llu, \"rows_matched\":%llu, "
+              "\"index_bytes\":%llu, \"data_bytes\":%llu, "
+              "\"index_faults\":%llu, \"data_faults\":%llu, "
+              "\"traversal_sec\":%.6f, \"scan_sec\":%.6f, "
+              "\"scan\":{\"rows\":%llu, \"data_bytes\":%llu, "
+              "\"data_faults\":%llu, \"sec\":%s}}",
+              (unsigned long long)s->leaves,
+              (unsigned long long)(s->data_bytes / profile.entry_size),
+              (unsigned long long)s->tested, (unsigned long long)s->matched,
+              (unsigned long long)s->index_bytes,
+              (unsigned long long)s->data_bytes,
+              faults (profile.before.index_resident,
+                      profile.after.index_resident),
+              faults (profile.before.data_resident,
+                      profile.after.data_resident),
+              s->traversal_time, s->scan_time,
+              (unsigned long long)profile.rows, scanbytes, scanfaults,
+              scantime);
+    }
+  else
+    {
+      printf ("], leaves=\"%llu\", rows_read=\"%llu\", "
+              "rows_tested=\"%llu\", rows_matched=\"%llu\", "
+              "index_bytes=\"%llu\", data_bytes=\"%llu\", "
+              "index_faults=\"%llu\", data_faults=\"%llu\", "
+              "traversal_sec=\"%.6f\", scan_sec=\"%.6f\", "
+              "scan=[struct rows=\"%llu\", data_bytes=\"%llu\", "
+              "data_faults=\"%llu\", sec=%s]]",
+              (unsigned long long)s->leaves,
+              (unsigned long long)(s->data_bytes / profile.entry_size),
+              (unsigned long long)s->tested, (unsigned long long)s->matched,
+              (unsigned long long)s->index_bytes,
+              (unsigned long long)s->data_bytes,
+              faults (profile.before.index_resident,
+                      profile.after.index_resident),
+              faults (profile.before.data_resident,
+                      profile.after.data_resident),
+              s->traversal_time, s->scan_time,
+              (unsigned long long)profile.rows, scanbytes, scanfaults,
+              scantime);
+    }
+}
+
 static void print_count (int64_t count)
 {
   if (json)
     {
-      printf ("{\"stat\":\"OK\", \"count\":%lld}\n", (long long)count);
+      printf ("{\"stat\":\"OK\", \"count\":%lld", (long long)count);
+      print_explain ();
+      printf ("}\n");
     }
   else
     {
-      printf ("[struct stat=\"OK\", count=\"%lld\"]\n", (long long)count);
+      printf ("[struct stat=\"OK\", count=\"%lld\"", (long long)count);
+      print_explain ();
+      printf ("]\n");
     }
 }
 
@@ -153,13 +303,17 @@ static void print_range (const struct htm_range *range)
 {
   if (json)
     {
-      printf ("{\"stat\":\"OK\", \"min\":%lld, \"max\":%lld}\n",
+      printf ("{\"stat\":\"OK\", \"min\":%lld, \"max\":%lld",
               (long long)range->min, (long long)range->max);
+      print_explain ();
+      printf ("}\n");
     }
   else
     {
-      printf ("[struct stat=\"OK\", min=\"%lld\", max=\"%lld\"]\n",
+      printf ("[struct stat=\"OK\", min=\"%lld\", max=\"%lld\"",
               (long long)range->min, (long long)range->max);
+      print_explain ();
+      printf ("]\n");
     }
 }
 
@@ -242,7 +396,10 @@ static void circle_count (const char *const datafile, char **argv)
     }
   if (estimate != 0)
     {
-      struct htm_range range = htm_tree_s2circle_range (&tree, &cen, r, &ec);
+      struct htm_query_stats *stats = explain_begin (&tree);
+      struct htm_range range
+          = htm_tree_s2circle_range (&tree, &cen, r, &ec, stats);
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       if (ec != HTM_OK)
         {
@@ -252,10 +409,12 @@ static void circle_count (const char *const datafile, char **argv)
     }
   else
     {
+      struct htm_query_stats *stats = explain_begin (&tree);
       int64_t count;
       if (print == 0)
         {
-          count = htm_tree_s2circle (&tree, &cen, r, &ec, htm_callback ());
+          count = htm_tree_s2circle (&tree, &cen, r, &ec, htm_callback (),
+                                     stats);
         }
       else
         {
@@ -263,8 +422,10 @@ static void circle_count (const char *const datafile, char **argv)
           count = htm_tree_s2circle (&tree, &cen, r, &ec,
                                      std::bind (&Print_Entry::print,
                                                 &print_entry,
-                                                std::placeholders::_1));
+                                                std::placeholders::_1),
+                                     stats);
         }
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       if (ec != HTM_OK)
         {
@@ -309,7 +470,10 @@ static void ellipse_count (const char *const datafile, char **argv)
     }
   if (estimate != 0)
     {
-      struct htm_range range = htm_tree_s2ellipse_range (&tree, &ellipse, &ec);
+      struct htm_query_stats *stats = explain_begin (&tree);
+      struct htm_range range
+          = htm_tree_s2ellipse_range (&tree, &ellipse, &ec, stats);
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       if (ec != HTM_OK)
         {
@@ -319,10 +483,12 @@ static void ellipse_count (const char *const datafile, char **argv)
     }
   else
     {
+      struct htm_query_stats *stats = explain_begin (&tree);
       int64_t count;
       if (print == 0)
         {
-          count = htm_tree_s2ellipse (&tree, &ellipse, &ec, htm_callback ());
+          count = htm_tree_s2ellipse (&tree, &ellipse, &ec, htm_callback (),
+                                      stats);
         }
       else
         {
@@ -330,8 +496,10 @@ static void ellipse_count (const char *const datafile, char **argv)
           count = htm_tree_s2ellipse (&tree, &ellipse, &ec,
                                       std::bind (&Print_Entry::print,
                                                  &print_entry,
-                                                 std::placeholders::_1));
+                                                 std::placeholders::_1),
+                                      stats);
         }
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       if (ec != HTM_OK)
         {
@@ -388,7 +556,10 @@ static void hull_count (const char *const datafile, const int argc,
     }
   if (estimate != 0)
     {
-      struct htm_range range = htm_tree_s2cpoly_range (&tree, poly, &ec);
+      struct htm_query_stats *stats = explain_begin (&tree);
+      struct htm_range range
+          = htm_tree_s2cpoly_range (&tree, poly, &ec, stats);
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       free (poly);
       if (ec != HTM_OK)
@@ -399,18 +570,22 @@ static void hull_count (const char *const datafile, const int argc,
     }
   else
     {
+      struct htm_query_stats *stats = explain_begin (&tree);
       int64_t count;
       if (print == 0)
         {
-          count = htm_tree_s2cpoly (&tree, poly, &ec, htm_callback ());
+          count = htm_tree_s2cpoly (&tree, poly, &ec, htm_callback (),
+                                    stats);
         }
       else
         {
           Print_Entry print_entry (tree.element_types, tree.element_names);
           count = htm_tree_s2cpoly (
               &tree, poly, &ec, std::bind (&Print_Entry::print, &print_entry,
-                                           std::placeholders::_1));
+                                           std::placeholders::_1),
+              stats);
         }
+      explain_end (&tree);
       htm_tree_destroy (&tree);
       free (poly);
       if (ec != HTM_OK)
@@ -434,6 +609,10 @@ static void test_tree (const char *const datafile, char **argv)
     {
       err ("Failed to load tree and/or data file: %s", htm_errmsg (ec));
     }
+  if (tree.datasz == 0)
+    {
+      err ("Integrity tests require an unchunked data file");
+    }
   for (i = 0; i < tree.count; ++i)
     {
       int64_t c = htm_tree_s2circle_count (
@@ -505,7 +684,14 @@ static void usage (const char *prog)
       "--print    | -p              :  Print values of matching entries in\n"
       "                                addition to the total count\n"
       "--json     | -j              :  Print results in JSON format.\n"
-      "                                the input points.\n",
+      "--explain  | -x              :  Also print the traversal profile of\n"
+      "                                the query: visited index nodes per\n"
+      "                                level and how they were classified,\n"
+      "                                points read, tested and matched,\n"
+      "                                bytes read, page faults estimated\n"
+      "                                from page residency before and after\n"
+      "                                the query, and timing, along with\n"
+      "                                the estimated cost of a full scan.\n",
       prog);
 }
 
@@ -521,9 +707,11 @@ int main (int argc, char **argv)
               { "json", no_argument, 0, 'j' },
               { "estimate", no_argument, 0, 'e' },
               { "print", no_argument, 0, 'p' },
+              { "explain", no_argument, 0, 'x' },
               { 0, 0, 0, 0 } };
       int option_index = 0;
-      int c = getopt_long (argc, argv, "+ephjt:", long_options, &option_index);
+      int c = getopt_long (argc, argv, "+ephjxt:", long_options,
+                           &option_index);
       if (c == -1)
         {
           break; /* no more options */
@@ -542,6 +730,9 @@ int main (int argc, char **argv)
         case 'j':
           json = 1;
           break;
+        case 'x':
+          explain = 1;
+          break;
         case '?':
           err ("Unknown option. Pass --help for usage instructions");
           break;
@@ -1,6 +1,18 @@
 #include "tree_entry.hxx"
+#include "sort_and_index/radix_sort.hxx"
 
 std::array<std::string, 1> tree_entry::names{ { std::string ("rowId") } };
 std::array<H5::DataType, 1> tree_entry::types{
   { H5::PredType::NATIVE_INT64 }
 };
+
+void blk_sort (tree_entry *begin, tree_entry *end, tree_entry *scratch,
+               unsigned int nthreads)
+{
+  radix_sort (begin, (size_t)(end - begin), scratch, 2, nthreads,
+              [](const tree_entry &e, int i)
+  {
+    /* flip sign bits so that unsigned order matches signed order */
+    return (uint64_t)(i == 0 ? e.htmid : e.rowid) ^ (UINT64_C (1) << 63);
+  });
+}
@@ -34,4 +34,18 @@ struct tree_entry
   }
 } HTM_ALIGNED (16);
 
+/*  Sorts a block of tree entries with a radix sort on (HTM ID, row ID),
+    on up to nthreads threads.
+ */
+void blk_sort (tree_entry *begin, tree_entry *end, tree_entry *scratch,
+               unsigned int nthreads);
+
+/*  Returns the merge key prefix of a tree entry: its HTM ID, with the
+    sign bit flipped so that unsigned order matches signed order.
+ */
+inline uint64_t mrg_key (const tree_entry &e)
+{
+  return (uint64_t)e.htmid ^ (UINT64_C (1) << 63);
+}
+
 #endif
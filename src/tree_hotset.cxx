@@ -0,0 +1,153 @@
+/** \file
+    \brief      Recording and replaying the hot pages of HTM tree files.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "tinyhtm/tree.h"
+
+/** \cond */
+
+static void err (const char *fmt, ...)
+{
+  va_list ap;
+  fprintf (stderr, "ERROR: ");
+  va_start (ap, fmt);
+  vfprintf (stderr, fmt, ap);
+  va_end (ap);
+  fprintf (stderr, "\n");
+  exit (EXIT_FAILURE);
+}
+
+static void print_residency (const struct htm_tree *tree)
+{
+  struct htm_tree_residency res;
+  enum htm_errcode ec = htm_tree_resident (tree, &res);
+  if (ec != HTM_OK)
+    {
+      err ("Failed to determine page residency: %s", htm_errmsg (ec));
+    }
+  printf ("index: %zu/%zu pages resident\n", res.index_resident,
+          res.index_pages);
+  printf ("data:  %zu/%zu pages resident\n", res.data_resident,
+          res.data_pages);
+}
+
+static void usage (const char *prog)
+{
+  printf (
+      "%1$s [options] <file> save <hotset>\n"
+      "\n"
+      "%1$s [options] <file> load <hotset>\n"
+      "\n"
+      "    This utility records which pages of the HTM tree file <file>\n"
+      "are cached in memory to the hot-set file <hotset> (save), or reads\n"
+      "the pages listed in <hotset> back into memory (load). Saving the\n"
+      "hot-set of a warm service before it shuts down, and loading it\n"
+      "before the restarted service takes traffic, recovers the working\n"
+      "set of queries without reading the whole tree file.\n"
+      "\n"
+      "    A hot-set is tied to the tree file it was recorded from, and is\n"
+      "rejected once that file is modified or replaced.\n"
+      "\n"
+      "== Options ====\n"
+      "\n"
+      "--help     | -h              :  Prints usage information.\n"
+      "--threads  | -t <n>          :  Number of threads used to load a\n"
+      "                                hot-set (default 8).\n"
+      "--status   | -s              :  Print page residency afterwards.\n",
+      prog);
+}
+
+int main (int argc, char **argv)
+{
+  struct htm_tree tree;
+  enum htm_errcode ec;
+  char *endptr;
+  int nthreads = 8;
+  int status = 0;
+
+  opterr = 0;
+  while (1)
+    {
+      static struct option long_options[]
+          = { { "help", no_argument, 0, 'h' },
+              { "threads", required_argument, 0, 't' },
+              { "status", no_argument, 0, 's' },
+              { 0, 0, 0, 0 } };
+      int option_index = 0;
+      int c = getopt_long (argc, argv, "+hst:", long_options, &option_index);
+      if (c == -1)
+        {
+          break; /* no more options */
+        }
+      switch (c)
+        {
+        case 'h':
+          usage (argv[0]);
+          return EXIT_SUCCESS;
+        case 's':
+          status = 1;
+          break;
+        case 't':
+          errno = 0;
+          nthreads = (int)strtol (optarg, &endptr, 10);
+          if (errno != 0 || endptr == optarg || *endptr != '\0'
+              || nthreads < 1)
+            {
+              err ("--threads must be a positive integer");
+            }
+          break;
+        case '?':
+          err ("Unknown option. Pass --help for usage instructions");
+          break;
+        default:
+          abort ();
+        }
+    }
+  if (argc - optind != 3)
+    {
+      err ("Missing arguments. Pass --help for usage instructions.");
+    }
+  ec = htm_tree_init (&tree, argv[optind]);
+  if (ec != HTM_OK)
+    {
+      err ("Failed to load tree and/or data file: %s", htm_errmsg (ec));
+    }
+  if (strcmp (argv[optind + 1], "save") == 0)
+    {
+      ec = htm_tree_hotset_save (&tree, argv[optind + 2]);
+      if (ec != HTM_OK)
+        {
+          err ("Failed to save hot-set: %s", htm_errmsg (ec));
+        }
+    }
+  else if (strcmp (argv[optind + 1], "load") == 0)
+    {
+      ec = htm_tree_hotset_load (&tree, argv[optind + 2], nthreads);
+      if (ec != HTM_OK)
+        {
+          err ("Failed to load hot-set: %s", htm_errmsg (ec));
+        }
+    }
+  else
+    {
+      err ("Unknown command `%s'. Pass --help for usage instructions.",
+           argv[optind + 1]);
+    }
+  if (status)
+    {
+      print_residency (&tree);
+    }
+  htm_tree_destroy (&tree);
+  return EXIT_SUCCESS;
+}
+
+/** \endcond */
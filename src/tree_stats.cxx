@@ -0,0 +1,518 @@
+/** \file
+    \brief      Reporting the shape and layout of HTM tree indexes.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+#include "tinyhtm/tree.h"
+#include "tinyhtm/varint.h"
+#include "htm/_htm_cap.hxx"
+#include "htm/_htm_fixed.hxx"
+#include "htm/_htm_succinct.hxx"
+#include "sort_and_index/node.hxx"
+
+/** \cond */
+
+/* Deepest level of any tree index (see htm_tree::depth). */
+#define MAX_LEVEL HTM_MAX_LEVEL
+/* # of leaf population histogram buckets: [1,2), [2,4), ..., [2^63, inf) */
+#define NBUCKETS 64
+/* Maximum width of a varint (bytes) */
+#define MAX_WIDTH 9
+
+/* Should output be in JSON format? */
+static int json = 0;
+
+/* Index statistics, gathered by walking every node of a tree index. */
+static struct
+{
+  const unsigned char *beg; /* start of the index memory map */
+  const unsigned char *end; /* end of the index */
+  uint64_t fileoff;         /* file offset of the index */
+  uint64_t leafthresh;
+  int depth; /* nodes at this level are never split */
+  int caps;
+  int fixed;
+  int adaptive; /* nodes record whether they are internal */
+  struct _htm_succinct *succinct; /* succinct index sections, or NULL */
+
+  uint64_t nodes[MAX_LEVEL + 1];  /* # of nodes per level */
+  uint64_t leaves[MAX_LEVEL + 1]; /* # of leaves per level */
+  uint64_t bytes[MAX_LEVEL + 1];  /* # of node bytes per level */
+  uint64_t bits[MAX_LEVEL + 1];   /* # of node bits per level (succinct) */
+  uint64_t population[NBUCKETS];  /* # of leaves by point count */
+  uint64_t countw[MAX_WIDTH + 1]; /* # of node counts by varint width */
+  uint64_t indexw[MAX_WIDTH + 1]; /* # of node indexes by varint width */
+  uint64_t childw[MAX_WIDTH + 1]; /* # of child offsets by varint width */
+  uint64_t blockw[3];             /* # of children blocks by width code */
+  uint64_t edges;                 /* # of parent/child pairs */
+  uint64_t coloc[NLOD];  /* # of pairs in the same layout block */
+  uint64_t near[NLOD];   /* # of pairs less than a block size apart */
+} st;
+
+static void err (const char *fmt, ...)
+{
+  va_list ap;
+  fprintf (stderr, "ERROR: ");
+  va_start (ap, fmt);
+  vfprintf (stderr, fmt, ap);
+  va_end (ap);
+  fprintf (stderr, "\n");
+  exit (EXIT_FAILURE);
+}
+
+static int bucket (uint64_t n)
+{
+  int b = 0;
+  for (; n > 1; n >>= 1)
+    {
+      ++b;
+    }
+  return b;
+}
+
+/* Decodes the varint at *s, tallies its width in widths, and advances *s
+   past it. */
+static uint64_t decode (const unsigned char **s, uint64_t *widths)
+{
+  const int w = 1 + htm_varint_nfollow (**s);
+  uint64_t v;
+  if (*s + w > st.end)
+    {
+      err ("tree index is truncated or corrupt");
+    }
+  v = htm_varint_decode (*s);
+  *s += w;
+  ++widths[w];
+  return v;
+}
+
+/* Walks the subtree rooted at the node encoded at s. In fixed-width
+   indexes, count is the point count of the node, unless it is a root. */
+static void walk (const unsigned char *s, int level, uint64_t count)
+{
+  const unsigned char *const node = s;
+  const unsigned char *child[4];
+  uint64_t childcount[4];
+  uint64_t off;
+  int c, n = 0, internal;
+
+  if (!st.fixed || level == 0)
+    {
+      count = decode (&s, st.countw);
+      decode (&s, st.indexw);
+    }
+  if (st.adaptive)
+    {
+      internal = (count & 1) != 0;
+      count >>= 1;
+    }
+  else
+    {
+      internal = count >= st.leafthresh;
+    }
+  if (st.caps)
+    {
+      s += _HTM_CAP_SIZE;
+    }
+  ++st.nodes[level];
+  if (!internal || level == st.depth)
+    {
+      /* leaf: child offsets are not stored */
+      ++st.leaves[level];
+      ++st.population[bucket (count)];
+      st.bytes[level] += (uint64_t)(s - node);
+      return;
+    }
+  if (st.fixed)
+    {
+      uint64_t v[_HTM_FIXED_NVAL];
+      if (s >= st.end || !_htm_fixed_decode (v, s)
+          || s + _htm_fixed_size (*s) > st.end)
+        {
+          err ("tree index is truncated or corrupt");
+        }
+      ++st.blockw[*s];
+      s += _htm_fixed_size (*s);
+      for (c = 0; c < 4; ++c)
+        {
+          if (v[3 * c + 2] != 0)
+            {
+              childcount[n] = v[3 * c];
+              child[n++] = s + (v[3 * c + 2] - 1);
+            }
+        }
+    }
+  else
+    {
+      for (c = 0; c < 4; ++c)
+        {
+          off = decode (&s, st.childw);
+          if (off != 0)
+            {
+              childcount[n] = 0;
+              child[n++] = s + (off - 1);
+            }
+        }
+    }
+  st.bytes[level] += (uint64_t)(s - node);
+  for (c = 0; c < n; ++c)
+    {
+      const uint64_t p = st.fileoff + (uint64_t)(node - st.beg);
+      const uint64_t q = st.fileoff + (uint64_t)(child[c] - st.beg);
+      int lod;
+      if (child[c] >= st.end)
+        {
+          err ("tree index child offset is out of bounds");
+        }
+      ++st.edges;
+      for (lod = 0; lod < NLOD; ++lod)
+        {
+          st.coloc[lod] += (p / layout_size[lod] == q / layout_size[lod]);
+          st.near[lod] += (q - p < layout_size[lod]);
+        }
+      walk (child[c], level + 1, childcount[c]);
+    }
+}
+
+/* Walks the subtree rooted at node i of a succinct index. */
+static void walk_succinct (const struct _htm_succinct *sx, uint64_t i,
+                           int level)
+{
+  uint64_t count, first;
+  unsigned int mask;
+  int c;
+
+  if (i >= sx->n)
+    {
+      err ("tree index child number is out of bounds");
+    }
+  count = _htm_succinct_count (sx, i);
+  mask = _htm_succinct_mask (sx, i);
+  ++st.nodes[level];
+  /* a child mask and a count, along with a cap */
+  st.bits[level] += 4 + _htm_succinct_width (sx, i)
+                    + (st.caps ? 8 * _HTM_CAP_SIZE : 0);
+  if ((st.adaptive ? mask == 0 : count < st.leafthresh)
+      || level == st.depth)
+    {
+      ++st.leaves[level];
+      ++st.population[bucket (count)];
+      return;
+    }
+  first = _htm_succinct_first (sx, i);
+  for (c = 0; c < 4; ++c)
+    {
+      if ((mask & (1u << c)) != 0)
+        {
+          walk_succinct (sx, _htm_succinct_child (first, mask, c),
+                         level + 1);
+        }
+    }
+}
+
+static double pct (uint64_t n, uint64_t d)
+{
+  return (d == 0) ? 0.0 : 100.0 * (double)n / (double)d;
+}
+
+static void print_report (const char *file, const struct htm_tree *tree)
+{
+  uint64_t nodes = 0, leaves = 0, bytes = 0;
+  uint64_t shape = 0, counts = 0, capbytes = 0;
+  const char *sep;
+  int i, maxw;
+
+  if (st.succinct != NULL)
+    {
+      /* sizes of the succinct index sections */
+      const struct _htm_succinct *sx = st.succinct;
+      shape = (uint64_t)(sx->cdir - sx->masks);
+      counts = (uint64_t)(sx->end - sx->cdir);
+      if (sx->caps != NULL)
+        {
+          capbytes = (uint64_t)(sx->end - sx->caps);
+          counts -= capbytes;
+        }
+    }
+
+  for (i = 0; i <= MAX_LEVEL; ++i)
+    {
+      if (st.succinct != NULL)
+        {
+          st.bytes[i] = (st.bits[i] + 7) / 8;
+        }
+      nodes += st.nodes[i];
+      leaves += st.leaves[i];
+      bytes += st.bytes[i];
+    }
+  for (maxw = MAX_WIDTH; maxw > 1; --maxw)
+    {
+      if (st.countw[maxw] + st.indexw[maxw] + st.childw[maxw] != 0)
+        {
+          break;
+        }
+    }
+  if (json)
+    {
+      printf ("{\"file\":\"%s\", \"points\":%llu, \"leafthresh\":%llu, "
+              "\"depth\":%d, \"adaptive\":%s, \"caps\":%s, \"fixed\":%s, "
+              "\"succinct\":%s, \"index_bytes\":%llu, \"node_bytes\":%llu, "
+              "\"nodes\":%llu, \"leaves\":%llu,\n",
+              file, (unsigned long long)tree->count,
+              (unsigned long long)tree->leafthresh, tree->depth,
+              st.adaptive ? "true" : "false", st.caps ? "true" : "false",
+              st.fixed ? "true" : "false",
+              (st.succinct != NULL) ? "true" : "false",
+              (unsigned long long)(st.end - st.beg),
+              (unsigned long long)bytes, (unsigned long long)nodes,
+              (unsigned long long)leaves);
+      if (st.succinct != NULL)
+        {
+          printf (" \"shape_bytes\":%llu, \"count_bytes\":%llu, "
+                  "\"cap_bytes\":%llu,\n",
+                  (unsigned long long)shape, (unsigned long long)counts,
+                  (unsigned long long)capbytes);
+        }
+      printf (" \"levels\":[");
+      for (i = 0, sep = ""; i <= MAX_LEVEL; ++i)
+        {
+          if (st.nodes[i] != 0)
+            {
+              printf ("%s{\"level\":%d, \"nodes\":%llu, \"leaves\":%llu, "
+                      "\"bytes\":%llu}",
+                      sep, i, (unsigned long long)st.nodes[i],
+                      (unsigned long long)st.leaves[i],
+                      (unsigned long long)st.bytes[i]);
+              sep = ", ";
+            }
+        }
+      printf ("],\n \"leaf_population\":[");
+      for (i = 0, sep = ""; i < NBUCKETS; ++i)
+        {
+          if (st.population[i] != 0)
+            {
+              printf ("%s{\"min\":%llu, \"leaves\":%llu}", sep,
+                      1ull << i, (unsigned long long)st.population[i]);
+              sep = ", ";
+            }
+        }
+      printf ("],\n \"varint_widths\":[");
+      for (i = 1; i <= maxw; ++i)
+        {
+          printf ("%s{\"bytes\":%d, \"counts\":%llu, \"indexes\":%llu, "
+                  "\"child_offsets\":%llu}",
+                  (i == 1) ? "" : ", ", i, (unsigned long long)st.countw[i],
+                  (unsigned long long)st.indexw[i],
+                  (unsigned long long)st.childw[i]);
+        }
+      printf ("],\n \"block_widths\":[");
+      for (i = 0; i < 3; ++i)
+        {
+          printf ("%s{\"bytes\":%d, \"blocks\":%llu}", (i == 0) ? "" : ", ",
+                  2 << i, (unsigned long long)st.blockw[i]);
+        }
+      printf ("],\n \"clustering\":[");
+      for (i = 0; i < NLOD; ++i)
+        {
+          printf ("%s{\"block_size\":%u, \"same_block\":%.3f, "
+                  "\"within_block_size\":%.3f}",
+                  (i == 0) ? "" : ", ", layout_size[i],
+                  pct (st.coloc[i], st.edges), pct (st.near[i], st.edges));
+        }
+      printf ("]}\n");
+      return;
+    }
+  printf ("tree:             %s\n", file);
+  printf ("points:           %llu\n", (unsigned long long)tree->count);
+  printf ("leaf threshold:   %llu\n", (unsigned long long)tree->leafthresh);
+  printf ("depth:            %d\n", tree->depth);
+  printf ("adaptive leaves:  %s\n", st.adaptive ? "yes" : "no");
+  printf ("bounding caps:    %s\n", st.caps ? "yes" : "no");
+  printf ("fixed-width:      %s\n", st.fixed ? "yes" : "no");
+  printf ("succinct:         %s\n", (st.succinct != NULL) ? "yes" : "no");
+  if (st.succinct != NULL)
+    {
+      printf ("section bytes:    %llu shape, %llu counts, %llu caps\n",
+              (unsigned long long)shape, (unsigned long long)counts,
+              (unsigned long long)capbytes);
+    }
+  printf ("index bytes:      %llu (%llu in nodes)\n",
+          (unsigned long long)(st.end - st.beg), (unsigned long long)bytes);
+  printf ("nodes:            %llu (%llu internal, %llu leaves)\n",
+          (unsigned long long)nodes, (unsigned long long)(nodes - leaves),
+          (unsigned long long)leaves);
+  printf ("\n== Levels ====\n\n");
+  printf ("%5s %12s %12s %14s %10s\n", "level", "nodes", "leaves", "bytes",
+          "bytes/node");
+  for (i = 0; i <= MAX_LEVEL; ++i)
+    {
+      if (st.nodes[i] != 0)
+        {
+          printf ("%5d %12llu %12llu %14llu %10.2f\n", i,
+                  (unsigned long long)st.nodes[i],
+                  (unsigned long long)st.leaves[i],
+                  (unsigned long long)st.bytes[i],
+                  (double)st.bytes[i] / (double)st.nodes[i]);
+        }
+    }
+  printf ("\n== Leaf population ====\n\n");
+  printf ("%21s %12s %8s\n", "points", "leaves", "%");
+  for (i = 0; i < NBUCKETS; ++i)
+    {
+      if (st.population[i] != 0)
+        {
+          printf ("%10llu - %8llu %12llu %8.2f\n", 1ull << i,
+                  (i == NBUCKETS - 1) ? ~0ull : (2ull << i) - 1,
+                  (unsigned long long)st.population[i],
+                  pct (st.population[i], leaves));
+        }
+    }
+  printf ("\n== Varint widths ====\n\n");
+  printf ("%5s %12s %12s %14s\n", "bytes", "counts", "indexes",
+          "child offsets");
+  for (i = 1; i <= maxw; ++i)
+    {
+      printf ("%5d %12llu %12llu %14llu\n", i,
+              (unsigned long long)st.countw[i],
+              (unsigned long long)st.indexw[i],
+              (unsigned long long)st.childw[i]);
+    }
+  if (st.fixed)
+    {
+      printf ("\n== Children block widths ====\n\n");
+      printf ("%5s %12s\n", "bytes", "blocks");
+      for (i = 0; i < 3; ++i)
+        {
+          printf ("%5d %12llu\n", 2 << i, (unsigned long long)st.blockw[i]);
+        }
+    }
+  printf ("\n== Parent/child clustering (%llu pairs) ====\n\n",
+          (unsigned long long)st.edges);
+  printf ("%10s %13s %20s\n", "block size", "same block %",
+          "within block size %");
+  for (i = 0; i < NLOD; ++i)
+    {
+      printf ("%10u %13.2f %20.2f\n", layout_size[i],
+              pct (st.coloc[i], st.edges), pct (st.near[i], st.edges));
+    }
+}
+
+static void usage (const char *prog)
+{
+  printf (
+      "%1$s [options] <file>\n"
+      "\n"
+      "    This utility walks every node of the index of the HTM tree\n"
+      "file <file>, and reports the shape of the tree (nodes, leaves and\n"
+      "index bytes per level, and the distribution of leaf populations),\n"
+      "the distribution of the varint byte widths used to encode node\n"
+      "point counts, point indexes and child offsets (or of the integer\n"
+      "widths of the children blocks of fixed-width indexes), and how\n"
+      "well the index layout clusters parent/child node pairs: the\n"
+      "percentage of pairs that lie in the same block, and that lie within\n"
+      "a block size of one another, for each of the layout block sizes\n"
+      "targeted by htm_tree_gen. Comparing these reports for trees built\n"
+      "with different options helps tune leaf thresholds and layout\n"
+      "sizes.\n"
+      "\n"
+      "== Options ====\n"
+      "\n"
+      "--help     | -h              :  Prints usage information.\n"
+      "--json     | -j              :  Print the report in JSON format.\n",
+      prog);
+}
+
+int main (int argc, char **argv)
+{
+  struct htm_tree tree;
+  enum htm_errcode ec;
+  int r;
+
+  opterr = 0;
+  while (1)
+    {
+      static struct option long_options[]
+          = { { "help", no_argument, 0, 'h' },
+              { "json", no_argument, 0, 'j' },
+              { 0, 0, 0, 0 } };
+      int option_index = 0;
+      int c = getopt_long (argc, argv, "+hj", long_options, &option_index);
+      if (c == -1)
+        {
+          break; /* no more options */
+        }
+      switch (c)
+        {
+        case 'h':
+          usage (argv[0]);
+          return EXIT_SUCCESS;
+        case 'j':
+          json = 1;
+          break;
+        case '?':
+          err ("Unknown option. Pass --help for usage instructions");
+          break;
+        default:
+          abort ();
+        }
+    }
+  if (argc - optind != 1)
+    {
+      err ("Missing arguments. Pass --help for usage instructions.");
+    }
+  ec = htm_tree_init (&tree, argv[optind]);
+  if (ec != HTM_OK)
+    {
+      err ("Failed to load tree and/or data file: %s", htm_errmsg (ec));
+    }
+  if (tree.index == MAP_FAILED)
+    {
+      err ("%s has no tree index", argv[optind]);
+    }
+  st.beg = static_cast<const unsigned char *>(tree.index);
+  st.end = st.beg + tree.indexsz;
+  st.fileoff = (uint64_t)(static_cast<const char *>(tree.index)
+                          - (static_cast<const char *>(tree.entries)
+                             - tree.offset));
+  st.leafthresh = tree.leafthresh;
+  st.depth = tree.depth;
+  st.caps = (tree.flags & HTM_TREE_CAPS) != 0;
+  st.fixed = (tree.flags & HTM_TREE_FIXED) != 0;
+  st.adaptive = (tree.flags & HTM_TREE_ADAPTIVE) != 0;
+  if ((tree.flags & HTM_TREE_SUCCINCT) != 0)
+    {
+      static struct _htm_succinct sx;
+      _htm_succinct_init (&sx, tree.root[0], tree.flags);
+      st.succinct = &sx;
+      for (r = 0; r < 8; ++r)
+        {
+          if (_htm_succinct_count (&sx, r) != 0)
+            {
+              walk_succinct (&sx, r, 0);
+            }
+        }
+    }
+  else
+    {
+      for (r = 0; r < 8; ++r)
+        {
+          if (tree.root[r] != NULL)
+            {
+              walk (tree.root[r], 0, 0);
+            }
+        }
+    }
+  print_report (argv[optind], &tree);
+  htm_tree_destroy (&tree);
+  return EXIT_SUCCESS;
+}
+
+/** \endcond */
@@ -0,0 +1,841 @@
+/** \file
+    \brief      Storage backends for HTM tree data files.
+
+    For API documentation, see tree.h.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+#include "tinyhtm/tree.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <new>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "htm/_htm_tree_storage.hxx"
+
+#ifdef HAVE_IO_URING
+/*  An io_uring instance, and its mapped submission and completion queues.
+ */
+struct _htm_uring
+{
+  int fd;
+  struct io_uring_params params;
+  char *sq, *cq;
+  size_t sqsz, cqsz, sqesz;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  unsigned *sqtail, *sqmask, *sqarray, *cqhead, *cqtail, *cqmask;
+};
+#endif
+
+/*  A user-space cache of fixed-size data file blocks, filled with pread()
+    or io_uring reads. Block b holds data file rows bytes
+    [b * blocksz, min((b + 1) * blocksz, datasz)). For chunked data files,
+    block b is chunk b, decoded.
+ */
+struct _htm_storage
+{
+  typedef std::shared_ptr<const std::vector<char> > block_ptr;
+  typedef std::list<uint64_t> lru_list;
+
+  int fd;
+  off_t offset;
+  uint64_t datasz;
+  size_t blocksz;
+  size_t cachesz;
+  unsigned int depth;
+  /* chunks and filters of chunked data files, empty otherwise */
+  std::vector<struct _htm_chunk> chunks;
+  std::vector<struct _htm_filter> filters;
+
+  std::mutex mutex;
+  /* block numbers, most recently used first */
+  lru_list lru;
+  std::unordered_map<uint64_t, std::pair<block_ptr, lru_list::iterator> >
+      blocks;
+  size_t used;
+
+  /* io_uring instance, set up by the first concurrent read and used by
+     one query at a time (NULL before, or if io_uring is unavailable) */
+  std::mutex ring_mutex;
+  struct _htm_uring *ring;
+  bool ring_failed;
+};
+
+namespace
+{
+
+/* Default block size, cache size and queue depth. */
+const size_t default_blocksz = 64 * 1024;
+const size_t default_cachesz = 64 * 1024 * 1024;
+const unsigned int default_depth = 32;
+
+/* Maximum number of blocks read by a single system call. */
+const size_t max_run = std::min (64, IOV_MAX);
+
+/* A run of adjacent blocks, read with a single vectored read. */
+struct run
+{
+  off_t offset;
+  size_t nbytes;
+  std::vector<struct iovec> iov;
+  bool done;
+};
+
+/* Reads a run with preadv(), retrying after short reads. */
+bool read_run (int fd, struct run *r)
+{
+  std::vector<struct iovec> iov (r->iov);
+  struct iovec *v = iov.data ();
+  int nv = (int)iov.size ();
+  off_t off = r->offset;
+
+  while (nv > 0)
+    {
+      ssize_t n = preadv (fd, v, nv, off);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return false;
+        }
+      if (n == 0)
+        {
+          /* unexpected end of file */
+          return false;
+        }
+      off += n;
+      while (nv > 0 && (size_t)n >= v->iov_len)
+        {
+          n -= v->iov_len;
+          ++v;
+          --nv;
+        }
+      if (nv > 0)
+        {
+          v->iov_base = static_cast<char *>(v->iov_base) + n;
+          v->iov_len -= n;
+        }
+    }
+  r->done = true;
+  return true;
+}
+
+#ifdef HAVE_IO_URING
+
+/* Unmaps the queues of an io_uring instance, and closes it. */
+void uring_destroy (struct _htm_uring *u)
+{
+  if (u->sqes != MAP_FAILED)
+    {
+      munmap (u->sqes, u->sqesz);
+    }
+  if (u->cq != MAP_FAILED && u->cq != u->sq)
+    {
+      munmap (u->cq, u->cqsz);
+    }
+  if (u->sq != MAP_FAILED)
+    {
+      munmap (u->sq, u->sqsz);
+    }
+  close (u->fd);
+  delete u;
+}
+
+/* Sets up an io_uring instance with (at least) depth submission queue
+   entries, and maps its queues. Returns NULL if io_uring is unavailable. */
+struct _htm_uring *uring_setup (unsigned int depth)
+{
+  struct _htm_uring *u = new (std::nothrow) _htm_uring;
+  struct io_uring_params *p;
+
+  if (u == NULL)
+    {
+      return NULL;
+    }
+  p = &u->params;
+  memset (p, 0, sizeof(*p));
+  u->sq = u->cq = static_cast<char *>(MAP_FAILED);
+  u->sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+  u->fd = (int)syscall (__NR_io_uring_setup, depth, p);
+  if (u->fd < 0)
+    {
+      delete u;
+      return NULL;
+    }
+  u->sqsz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+  u->cqsz = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  if (p->features & IORING_FEAT_SINGLE_MMAP)
+    {
+      u->sqsz = u->cqsz = std::max (u->sqsz, u->cqsz);
+    }
+  u->sqesz = p->sq_entries * sizeof(struct io_uring_sqe);
+  u->sq = static_cast<char *>(mmap (NULL, u->sqsz, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, u->fd,
+                                    IORING_OFF_SQ_RING));
+  u->cq = u->sq;
+  if (u->sq != MAP_FAILED && !(p->features & IORING_FEAT_SINGLE_MMAP))
+    {
+      u->cq = static_cast<char *>(mmap (NULL, u->cqsz,
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, u->fd,
+                                        IORING_OFF_CQ_RING));
+    }
+  u->sqes = static_cast<struct io_uring_sqe *>(
+      mmap (NULL, u->sqesz, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES));
+  if (u->sq == MAP_FAILED || u->cq == MAP_FAILED || u->sqes == MAP_FAILED)
+    {
+      uring_destroy (u);
+      return NULL;
+    }
+  u->sqtail = reinterpret_cast<unsigned *>(u->sq + p->sq_off.tail);
+  u->sqmask = reinterpret_cast<unsigned *>(u->sq + p->sq_off.ring_mask);
+  u->sqarray = reinterpret_cast<unsigned *>(u->sq + p->sq_off.array);
+  u->cqhead = reinterpret_cast<unsigned *>(u->cq + p->cq_off.head);
+  u->cqtail = reinterpret_cast<unsigned *>(u->cq + p->cq_off.tail);
+  u->cqmask = reinterpret_cast<unsigned *>(u->cq + p->cq_off.ring_mask);
+  u->cqes = reinterpret_cast<struct io_uring_cqe *>(u->cq
+                                                     + p->cq_off.cqes);
+  return u;
+}
+
+/* Reads runs with up to depth reads in flight, using the io_uring
+   instance u. Runs that fail or come back short are left for
+   read_run(). Returns to the caller only once no read is in flight, and
+   returns false if u failed and must not be used again. */
+bool read_runs_uring (struct _htm_uring *u, int fd,
+                      std::vector<struct run> &runs, size_t depth)
+{
+  size_t next = 0, inflight = 0, tosubmit = 0;
+  bool ok = true;
+
+  while (next < runs.size () || inflight > 0)
+    {
+      unsigned tail = *u->sqtail;
+      unsigned head;
+      int n;
+
+      /* queue reads until depth of them are in flight */
+      while (next < runs.size () && inflight + tosubmit < depth)
+        {
+          unsigned i = tail & *u->sqmask;
+          struct io_uring_sqe *sqe = &u->sqes[i];
+          memset (sqe, 0, sizeof(*sqe));
+          sqe->opcode = IORING_OP_READV;
+          sqe->fd = fd;
+          sqe->off = (uint64_t)runs[next].offset;
+          sqe->addr = (uint64_t)(uintptr_t)runs[next].iov.data ();
+          sqe->len = (uint32_t)runs[next].iov.size ();
+          sqe->user_data = next;
+          u->sqarray[i] = i;
+          ++tail;
+          ++tosubmit;
+          ++next;
+        }
+      __atomic_store_n (u->sqtail, tail, __ATOMIC_RELEASE);
+      n = (int)syscall (__NR_io_uring_enter, u->fd, (unsigned)tosubmit, 1U,
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          if (inflight == 0)
+            {
+              /* give up; unfinished runs are read synchronously */
+              ok = false;
+              break;
+            }
+          if (!ok)
+            {
+              /* waiting failed too; completions still arrive in the
+                 completion queue, so poll it */
+              sched_yield ();
+            }
+          /* stop submitting (unsubmitted entries are left in the
+             abandoned ring), but wait for the reads into our buffers */
+          ok = false;
+          next = runs.size ();
+          tosubmit = 0;
+        }
+      else
+        {
+          tosubmit -= (size_t)n;
+          inflight += (size_t)n;
+        }
+
+      /* reap completions */
+      head = *u->cqhead;
+      while (head != __atomic_load_n (u->cqtail, __ATOMIC_ACQUIRE))
+        {
+          const struct io_uring_cqe *cqe = &u->cqes[head & *u->cqmask];
+          struct run *r = &runs[cqe->user_data];
+          r->done = (cqe->res >= 0 && (size_t)cqe->res == r->nbytes);
+          ++head;
+          --inflight;
+        }
+      __atomic_store_n (u->cqhead, head, __ATOMIC_RELEASE);
+    }
+  return ok;
+}
+
+#endif
+
+/* Reads the given runs, concurrently if possible. */
+bool read_runs (struct _htm_storage *s, std::vector<struct run> &runs)
+{
+#ifdef HAVE_IO_URING
+  if (s->depth > 1 && runs.size () > 1)
+    {
+      /* the ring serves one query at a time; the others read
+         synchronously rather than wait for it */
+      std::unique_lock<std::mutex> lock (s->ring_mutex, std::try_to_lock);
+      if (lock.owns_lock () && !s->ring_failed)
+        {
+          if (s->ring == NULL)
+            {
+              s->ring = uring_setup (s->depth);
+              s->ring_failed = (s->ring == NULL);
+            }
+          if (s->ring != NULL
+              && !read_runs_uring (s->ring, s->fd, runs,
+                                   std::min<size_t> (s->depth,
+                                                     runs.size ())))
+            {
+              uring_destroy (s->ring);
+              s->ring = NULL;
+              s->ring_failed = true;
+            }
+        }
+    }
+#endif
+  for (size_t i = 0; i < runs.size (); ++i)
+    {
+      if (!runs[i].done && !read_run (s->fd, &runs[i]))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+/* Reverses the byte shuffle of HDF5's shuffle filter. */
+void unshuffle (const std::vector<char> &in, std::vector<char> &out,
+                size_t elemsz)
+{
+  const size_t n = in.size () / elemsz;
+  size_t i, b;
+
+  out.resize (in.size ());
+  for (b = 0; b < elemsz; ++b)
+    {
+      for (i = 0; i < n; ++i)
+        {
+          out[i * elemsz + b] = in[b * n + i];
+        }
+    }
+  /* trailing bytes are not shuffled */
+  memcpy (out.data () + n * elemsz, in.data () + n * elemsz,
+          in.size () - n * elemsz);
+}
+
+/* Undoes the filters applied to a stored chunk, in reverse order. The
+   decoded chunk is returned in data. */
+bool decode_chunk (const struct _htm_storage *s, unsigned int mask,
+                   std::vector<char> &data)
+{
+  std::vector<char> out;
+  size_t f;
+
+  for (f = s->filters.size (); f-- > 0;)
+    {
+      const struct _htm_filter &filter = s->filters[f];
+      if ((mask & (1u << f)) != 0)
+        {
+          continue;
+        }
+      switch (filter.id)
+        {
+#ifdef HAVE_ZLIB
+        case H5Z_FILTER_DEFLATE:
+          {
+            uLongf n = (uLongf)s->blocksz;
+            out.resize (s->blocksz);
+            if (uncompress (reinterpret_cast<Bytef *>(out.data ()), &n,
+                            reinterpret_cast<const Bytef *>(data.data ()),
+                            (uLong)data.size ()) != Z_OK)
+              {
+                return false;
+              }
+            out.resize (n);
+          }
+          break;
+#endif
+        case H5Z_FILTER_SHUFFLE:
+          if (filter.cd_values.empty () || filter.cd_values[0] == 0)
+            {
+              return false;
+            }
+          unshuffle (data, out, filter.cd_values[0]);
+          break;
+        case H5Z_FILTER_FLETCHER32:
+          /* strip the checksum */
+          if (data.size () < 4)
+            {
+              return false;
+            }
+          out.assign (data.begin (), data.end () - 4);
+          break;
+        default:
+          return false;
+        }
+      data.swap (out);
+    }
+  return data.size () == s->blocksz;
+}
+
+/* Returns true if chunks filtered with the given filter can be decoded. */
+bool decodable (int id)
+{
+  switch (id)
+    {
+#ifdef HAVE_ZLIB
+    case H5Z_FILTER_DEFLATE:
+#endif
+    case H5Z_FILTER_SHUFFLE:
+    case H5Z_FILTER_FLETCHER32:
+      return true;
+    default:
+      return false;
+    }
+}
+
+} // namespace
+
+enum htm_errcode _htm_chunk_table_read (const H5::DataSet &dataset,
+                                        struct _htm_chunk_table *table)
+{
+  const hid_t dset = dataset.getId ();
+  hid_t dcpl, space;
+  hsize_t dims[1], chunkdims[1], nchunks, offset[1];
+  haddr_t addr;
+  hsize_t size;
+  unsigned int mask, flags, cd[16];
+  size_t ncd, i;
+  int nfilters, f, id;
+  enum htm_errcode err = HTM_ETREE;
+
+  dcpl = H5Dget_create_plist (dset);
+  space = H5Dget_space (dset);
+  if (dcpl < 0 || space < 0)
+    {
+      goto cleanup;
+    }
+  if (H5Sget_simple_extent_ndims (space) != 1
+      || H5Sget_simple_extent_dims (space, dims, NULL) != 1
+      || H5Pget_layout (dcpl) != H5D_CHUNKED
+      || H5Pget_chunk (dcpl, 1, chunkdims) != 1 || chunkdims[0] == 0)
+    {
+      goto cleanup;
+    }
+  table->rows = chunkdims[0];
+  table->nrows = dims[0];
+  table->chunks.clear ();
+  table->filters.clear ();
+
+  /* the filter pipeline */
+  nfilters = H5Pget_nfilters (dcpl);
+  for (f = 0; f < nfilters; ++f)
+    {
+      struct _htm_filter filter;
+      ncd = sizeof(cd) / sizeof(cd[0]);
+      id = (int)H5Pget_filter2 (dcpl, (unsigned)f, &flags, &ncd, cd, 0, NULL,
+                                NULL);
+      if (id < 0 || !decodable (id))
+        {
+          goto cleanup;
+        }
+      filter.id = id;
+      filter.cd_values.assign (cd, cd + std::min (ncd, sizeof(cd)
+                                                          / sizeof(cd[0])));
+      table->filters.push_back (filter);
+    }
+
+  /* the chunks, in row order (HDF5 1.10 miscounts them given H5S_ALL) */
+  if (H5Dget_num_chunks (dset, space, &nchunks) < 0
+      || nchunks != (dims[0] + chunkdims[0] - 1) / chunkdims[0])
+    {
+      /* unallocated chunks are not supported */
+      goto cleanup;
+    }
+  table->chunks.resize (nchunks);
+  for (i = 0; i < nchunks; ++i)
+    {
+      uint64_t c;
+      if (H5Dget_chunk_info (dset, space, i, offset, &mask, &addr, &size)
+          < 0)
+        {
+          goto cleanup;
+        }
+      c = offset[0] / chunkdims[0];
+      if (c >= nchunks)
+        {
+          goto cleanup;
+        }
+      table->chunks[c].addr = (uint64_t)addr;
+      table->chunks[c].size = (uint64_t)size;
+      table->chunks[c].mask = mask;
+    }
+  err = HTM_OK;
+
+cleanup:
+  if (space >= 0)
+    {
+      H5Sclose (space);
+    }
+  if (dcpl >= 0)
+    {
+      H5Pclose (dcpl);
+    }
+  return err;
+}
+
+enum htm_errcode _htm_storage_chunked (struct htm_tree *tree,
+                                       struct _htm_chunk_table *table)
+{
+  struct _htm_storage *s = new (std::nothrow) _htm_storage;
+
+  if (s == NULL)
+    {
+      return HTM_ENOMEM;
+    }
+  s->fd = tree->datafd;
+  s->offset = 0;
+  s->datasz = table->nrows * tree->entry_size;
+  s->blocksz = table->rows * tree->entry_size;
+  s->cachesz = std::max (default_cachesz, 4 * s->blocksz);
+  s->depth = default_depth;
+  s->chunks.swap (table->chunks);
+  s->filters.swap (table->filters);
+  s->used = 0;
+  s->ring = NULL;
+  s->ring_failed = false;
+  if (tree->storage != NULL)
+    {
+      _htm_storage_destroy (tree->storage);
+    }
+  tree->storage = s;
+  return HTM_OK;
+}
+
+bool _htm_storage_required (const struct _htm_storage *storage)
+{
+  return storage != NULL && !storage->chunks.empty ();
+}
+
+void _htm_prefetch_rows (const char *beg, const char *end,
+                         const char **done)
+{
+  static const uintptr_t pagesz = (uintptr_t)sysconf (_SC_PAGESIZE);
+  uintptr_t b = reinterpret_cast<uintptr_t>(std::max (beg, *done));
+  uintptr_t e = reinterpret_cast<uintptr_t>(end);
+
+  if (b >= e)
+    {
+      return;
+    }
+  b -= b % pagesz;
+  e = (e + pagesz - 1) - (e + pagesz - 1) % pagesz;
+  /* advisory: failure only costs the overlap */
+  madvise (reinterpret_cast<void *>(b), e - b, MADV_WILLNEED);
+  *done = reinterpret_cast<const char *>(e);
+}
+
+void _htm_storage_destroy (struct _htm_storage *storage)
+{
+#ifdef HAVE_IO_URING
+  if (storage != NULL && storage->ring != NULL)
+    {
+      uring_destroy (storage->ring);
+    }
+#endif
+  delete storage;
+}
+
+_htm_rows::_htm_rows (const struct htm_tree *tree)
+    : storage (tree->storage), entry_size (tree->entry_size),
+      limit (std::max (tree->storage->cachesz / 2, tree->storage->blocksz)),
+      pending (0)
+{
+}
+
+uint64_t _htm_rows::span_rows (uint64_t index) const
+{
+  const uint64_t count = storage->datasz / entry_size;
+  uint64_t off = index * entry_size;
+  uint64_t end = ((off + limit) / storage->blocksz) * storage->blocksz;
+  uint64_t n = (end > off) ? (end - off) / entry_size : 0;
+  return std::min (std::max (n, (uint64_t)1), count - index);
+}
+
+void _htm_rows::add (uint64_t index, uint64_t count)
+{
+  spans.push_back (std::make_pair (index * entry_size, count * entry_size));
+  pending += count * entry_size;
+}
+
+void _htm_rows::clear ()
+{
+  spans.clear ();
+  ptrs.clear ();
+  pins.clear ();
+  scratch.clear ();
+  pending = 0;
+}
+
+enum htm_errcode _htm_rows::fetch ()
+{
+  struct _htm_storage *s = storage;
+  const size_t bsz = s->blocksz;
+  std::vector<uint64_t> missing;
+  std::vector<std::pair<uint64_t, std::shared_ptr<std::vector<char> > > >
+      loaded;
+  std::vector<struct run> runs;
+  size_t i;
+
+  /* pin cached blocks, and list the missing ones */
+  {
+    std::lock_guard<std::mutex> lock (s->mutex);
+    for (i = 0; i < spans.size (); ++i)
+      {
+        uint64_t b, end;
+        if (spans[i].second == 0)
+          {
+            continue;
+          }
+        end = (spans[i].first + spans[i].second - 1) / bsz;
+        for (b = spans[i].first / bsz; b <= end; ++b)
+          {
+            if (pins.count (b) != 0)
+              {
+                continue;
+              }
+            auto it = s->blocks.find (b);
+            if (it != s->blocks.end ())
+              {
+                s->lru.splice (s->lru.begin (), s->lru, it->second.second);
+                pins[b] = it->second.first;
+              }
+            else
+              {
+                pins[b] = block_ptr ();
+                missing.push_back (b);
+              }
+          }
+      }
+  }
+
+  /* read missing blocks, coalescing adjacent ones */
+  std::sort (missing.begin (), missing.end ());
+  if (!s->chunks.empty ())
+    {
+      /* read and decode missing chunks */
+      std::vector<std::vector<char> > packed (missing.size ());
+      for (i = 0; i < missing.size (); ++i)
+        {
+          const struct _htm_chunk &c = s->chunks[missing[i]];
+          struct iovec v;
+          packed[i].resize (c.size);
+          runs.push_back (run ());
+          runs.back ().offset = (off_t)c.addr;
+          runs.back ().nbytes = c.size;
+          runs.back ().done = false;
+          v.iov_base = packed[i].data ();
+          v.iov_len = c.size;
+          runs.back ().iov.push_back (v);
+        }
+      if (!read_runs (s, runs))
+        {
+          return HTM_EIO;
+        }
+      for (i = 0; i < missing.size (); ++i)
+        {
+          uint64_t b = missing[i];
+          if (!decode_chunk (s, s->chunks[b].mask, packed[i]))
+            {
+              return HTM_ETREE;
+            }
+          packed[i].resize (
+              (size_t)std::min<uint64_t> (bsz, s->datasz - b * bsz));
+          loaded.push_back (std::make_pair (
+              b, std::make_shared<std::vector<char> >(std::move (packed[i]))));
+        }
+      missing.clear ();
+    }
+  for (i = 0; i < missing.size (); ++i)
+    {
+      uint64_t b = missing[i];
+      size_t n = (size_t)std::min<uint64_t> (bsz, s->datasz - b * bsz);
+      std::shared_ptr<std::vector<char> > block
+          = std::make_shared<std::vector<char> >(n);
+      struct iovec v;
+
+      if (runs.empty () || missing[i - 1] + 1 != b
+          || runs.back ().iov.size () == max_run)
+        {
+          runs.push_back (run ());
+          runs.back ().offset = s->offset + (off_t)(b * bsz);
+          runs.back ().nbytes = 0;
+          runs.back ().done = false;
+        }
+      v.iov_base = block->data ();
+      v.iov_len = n;
+      runs.back ().iov.push_back (v);
+      runs.back ().nbytes += n;
+      loaded.push_back (std::make_pair (b, block));
+    }
+  if (!missing.empty () && !read_runs (s, runs))
+    {
+      return HTM_EIO;
+    }
+
+  /* cache the new blocks, evicting the least recently used ones */
+  if (!loaded.empty ())
+    {
+      std::lock_guard<std::mutex> lock (s->mutex);
+      for (i = 0; i < loaded.size (); ++i)
+        {
+          pins[loaded[i].first] = loaded[i].second;
+          if (s->blocks.count (loaded[i].first) != 0)
+            {
+              /* read concurrently by another query */
+              continue;
+            }
+          s->lru.push_front (loaded[i].first);
+          s->blocks[loaded[i].first]
+              = std::make_pair (loaded[i].second, s->lru.begin ());
+          s->used += loaded[i].second->size ();
+        }
+      while (s->used > s->cachesz && !s->lru.empty ())
+        {
+          auto it = s->blocks.find (s->lru.back ());
+          s->used -= it->second.first->size ();
+          s->blocks.erase (it);
+          s->lru.pop_back ();
+        }
+    }
+
+  /* locate rows; spans straddling blocks are copied */
+  ptrs.resize (spans.size ());
+  for (i = 0; i < spans.size (); ++i)
+    {
+      uint64_t off = spans[i].first, len = spans[i].second;
+      uint64_t b = off / bsz;
+      if (len == 0)
+        {
+          ptrs[i] = NULL;
+        }
+      else if ((off + len - 1) / bsz == b)
+        {
+          ptrs[i] = pins[b]->data () + (off - b * bsz);
+        }
+      else
+        {
+          scratch.push_back (std::vector<char> (len));
+          char *dst = scratch.back ().data ();
+          while (len > 0)
+            {
+              uint64_t o = off - b * bsz;
+              uint64_t n = std::min<uint64_t> (len, pins[b]->size () - o);
+              memcpy (dst, pins[b]->data () + o, n);
+              dst += n;
+              off += n;
+              len -= n;
+              ++b;
+            }
+          ptrs[i] = scratch.back ().data ();
+        }
+    }
+  return HTM_OK;
+}
+
+extern "C" {
+
+enum htm_errcode htm_tree_storage (struct htm_tree *tree,
+                                   const struct htm_tree_storage_params *params)
+{
+  struct _htm_storage *s;
+
+  if (tree == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  if (params != NULL && params->backend != HTM_TREE_MMAP
+      && params->backend != HTM_TREE_PREAD)
+    {
+      return HTM_EINV;
+    }
+  if (_htm_storage_required (tree->storage))
+    {
+      /* chunked data files can only be read through their chunk cache */
+      return HTM_EINV;
+    }
+  if (tree->storage != NULL)
+    {
+      _htm_storage_destroy (tree->storage);
+      tree->storage = NULL;
+    }
+  tree->lookahead = 0;
+  if (params == NULL)
+    {
+      return HTM_OK;
+    }
+  if (params->backend == HTM_TREE_MMAP)
+    {
+      tree->lookahead = params->lookahead;
+      return HTM_OK;
+    }
+  if (tree->datafd == -1 || tree->entries == MAP_FAILED)
+    {
+      return HTM_EINV;
+    }
+  s = new (std::nothrow) _htm_storage;
+  if (s == NULL)
+    {
+      return HTM_ENOMEM;
+    }
+  s->fd = tree->datafd;
+  s->offset = tree->offset;
+  s->datasz = tree->datasz;
+  s->blocksz = params->blocksz != 0 ? params->blocksz : default_blocksz;
+  s->cachesz = params->cachesz != 0 ? params->cachesz : default_cachesz;
+  s->depth = params->depth != 0 ? params->depth : default_depth;
+  s->used = 0;
+  s->ring = NULL;
+  s->ring_failed = false;
+  tree->storage = s;
+  return HTM_OK;
+}
+}
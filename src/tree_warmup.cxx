@@ -0,0 +1,524 @@
+/** \file
+    \brief      HTM tree warm-up, residency reporting and hot-set files.
+
+    For API documentation, see tree.h.
+
+    \authors    Serge Monkewitz
+    \copyright  IPAC/Caltech
+  */
+#include "tinyhtm/tree.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tinyhtm/varint.h"
+#include "htm/_htm_tree_search.hxx"
+
+namespace
+{
+
+/* Size of the chunks in which the index is prefetched. */
+const size_t warmup_chunk = 4 * 1024 * 1024;
+
+/* Alignment of the anonymous index copy: the x86-64 huge page size. */
+const size_t hugepagesz = 2 * 1024 * 1024;
+
+/* Rounds [addr, addr + len) out to page boundaries, and returns
+   the page-aligned start address, storing the aligned length in len. */
+char *page_range (const void *addr, size_t &len, const size_t pagesz)
+{
+  uintptr_t beg = reinterpret_cast<uintptr_t>(addr);
+  uintptr_t end = beg + len;
+  beg -= beg % pagesz;
+  end = (end + pagesz - 1) - (end + pagesz - 1) % pagesz;
+  len = end - beg;
+  return reinterpret_cast<char *>(beg);
+}
+
+/* Advises the kernel that [addr, addr + len) will be needed soon, and
+   optionally faults in every page of the range. */
+enum htm_errcode prefetch (const void *addr, size_t len, int touch,
+                           const size_t pagesz)
+{
+  char *p;
+  size_t i;
+  volatile char sink = 0;
+
+  if (len == 0)
+    {
+      return HTM_OK;
+    }
+  p = page_range (addr, len, pagesz);
+  if (madvise (p, len, MADV_WILLNEED) != 0)
+    {
+      return HTM_EMMAN;
+    }
+  if (touch)
+    {
+      for (i = 0; i < len; i += pagesz)
+        {
+          sink += p[i];
+        }
+    }
+  (void)sink;
+  return HTM_OK;
+}
+
+/* Returns the number of resident pages in [addr, addr + len). */
+enum htm_errcode resident (const void *addr, size_t len, size_t *npages,
+                           size_t *nresident, const size_t pagesz)
+{
+  std::vector<unsigned char> vec;
+  char *p;
+  size_t i, n = 0;
+
+  *npages = 0;
+  *nresident = 0;
+  if (len == 0)
+    {
+      return HTM_OK;
+    }
+  p = page_range (addr, len, pagesz);
+  vec.resize (len / pagesz);
+  if (mincore (p, len, vec.data ()) != 0)
+    {
+      return HTM_EMMAN;
+    }
+  for (i = 0; i < vec.size (); ++i)
+    {
+      n += vec[i] & 1;
+    }
+  *npages = vec.size ();
+  *nresident = n;
+  return HTM_OK;
+}
+
+/* Returns the number of index bytes backed by the tree file. The index
+   size recorded in the tree file may overstate it, and touching pages
+   past the end of the file raises SIGBUS. */
+size_t index_file_size (const struct htm_tree *tree)
+{
+  struct stat sb;
+  const char *map = static_cast<const char *>(tree->entries) - tree->offset;
+  size_t off = static_cast<const char *>(tree->index) - map;
+
+  if (fstat (tree->datafd, &sb) != 0 || (size_t)sb.st_size <= off)
+    {
+      return 0;
+    }
+  return std::min ((size_t)sb.st_size - off, (size_t)tree->indexsz);
+}
+
+/* Copies the tree index to anonymous memory, and repoints the tree at
+   the copy. */
+enum htm_errcode copy_index (struct htm_tree *tree, size_t indexsz)
+{
+  const unsigned char *old = static_cast<const unsigned char *>(tree->index);
+  size_t mapsz = ((indexsz + hugepagesz - 1) / hugepagesz) * hugepagesz;
+  void *copy;
+  int i;
+
+  copy = mmap (NULL, mapsz, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (copy == MAP_FAILED)
+    {
+      return HTM_ENOMEM;
+    }
+#ifdef MADV_HUGEPAGE
+  /* failure just means transparent huge pages are unavailable */
+  madvise (copy, mapsz, MADV_HUGEPAGE);
+#endif
+  memcpy (copy, old, indexsz);
+  if (mprotect (copy, mapsz, PROT_READ) != 0)
+    {
+      munmap (copy, mapsz);
+      return HTM_EMMAN;
+    }
+  for (i = 0; i < 8; ++i)
+    {
+      if (tree->root[i] != NULL)
+        {
+          tree->root[i] = static_cast<const unsigned char *>(copy)
+                          + (tree->root[i] - old);
+        }
+    }
+  tree->index = copy;
+  tree->indexsz = indexsz;
+  tree->indexcopy = copy;
+  tree->indexcopysz = mapsz;
+  return HTM_OK;
+}
+
+/*  A hot-set file lists the resident pages of a tree file. All fields
+    are native-endian:
+
+        char[8]  magic ("HTMHOTS1")
+        uint64   tree file device, inode, size
+        int64    tree file modification time (seconds, nanoseconds)
+        uint64   page size, number of runs
+        per run of resident pages, as variable-length integers:
+            # of non-resident pages preceding the run, # of pages in run
+ */
+const char hotset_magic[8] = { 'H', 'T', 'M', 'H', 'O', 'T', 'S', '1' };
+
+/* Number of pages whose residency is queried with one mincore() call. */
+const size_t hotset_chunk = 1024 * 1024;
+
+void hotset_stat (uint64_t *w, const struct stat *sb)
+{
+  w[0] = (uint64_t)sb->st_dev;
+  w[1] = (uint64_t)sb->st_ino;
+  w[2] = (uint64_t)sb->st_size;
+  w[3] = (uint64_t)sb->st_mtim.tv_sec;
+  w[4] = (uint64_t)sb->st_mtim.tv_nsec;
+}
+
+/* Reads the resident page runs of the tree file into runs, as
+   (first page, # of pages) pairs. */
+enum htm_errcode hotset_scan (const struct htm_tree *tree, size_t filesz,
+                              std::vector<std::pair<uint64_t, uint64_t> > &runs,
+                              const size_t pagesz)
+{
+  char *map = static_cast<char *>(tree->entries) - tree->offset;
+  size_t npages = (std::min (filesz, tree->mapsz) + pagesz - 1) / pagesz;
+  std::vector<unsigned char> vec;
+  size_t page, n, i;
+
+  for (page = 0; page < npages; page += n)
+    {
+      n = std::min (hotset_chunk, npages - page);
+      vec.resize (n);
+      if (mincore (map + page * pagesz, n * pagesz, vec.data ()) != 0)
+        {
+          return HTM_EMMAN;
+        }
+      for (i = 0; i < n; ++i)
+        {
+          if ((vec[i] & 1) == 0)
+            {
+              continue;
+            }
+          if (!runs.empty ()
+              && runs.back ().first + runs.back ().second == page + i)
+            {
+              ++runs.back ().second;
+            }
+          else
+            {
+              runs.push_back (std::make_pair ((uint64_t)(page + i),
+                                              (uint64_t)1));
+            }
+        }
+    }
+  return HTM_OK;
+}
+
+/* Reads a variable-length integer from f. */
+int hotset_getv (FILE *f, uint64_t *val)
+{
+  unsigned char buf[9];
+  int c = getc (f);
+  unsigned int n;
+
+  if (c == EOF)
+    {
+      return 0;
+    }
+  buf[0] = (unsigned char)c;
+  n = htm_varint_nfollow (buf[0]);
+  if (n > 0 && fread (buf + 1, n, 1, f) != 1)
+    {
+      return 0;
+    }
+  *val = htm_varint_decode (buf);
+  return 1;
+}
+
+/* Pulls the given (file offset, # of bytes) ranges of the tree file into
+   the page cache. */
+void hotset_fetch (const struct htm_tree *tree,
+                   const std::pair<uint64_t, uint64_t> *ranges, size_t n)
+{
+  const char *map = static_cast<const char *>(tree->entries) - tree->offset;
+  size_t i;
+
+  for (i = 0; i < n; ++i)
+    {
+      if (readahead (tree->datafd, (off_t)ranges[i].first,
+                     (size_t)ranges[i].second) != 0)
+        {
+          /* readahead() is unsupported by some file systems */
+          madvise (const_cast<char *>(map) + ranges[i].first,
+                   ranges[i].second, MADV_WILLNEED);
+        }
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+enum htm_errcode htm_tree_warmup (struct htm_tree *tree,
+                                  const struct htm_tree_warmup_params *params)
+{
+  struct htm_tree_warmup_params defaults;
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  std::vector<std::pair<uint64_t, uint64_t> > subtrees;
+  enum htm_errcode err;
+  size_t indexsz, off, n, i;
+  off_t fileoff;
+
+  if (tree == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  if (params == NULL)
+    {
+      defaults.touch = 0;
+      defaults.topk = 64;
+      defaults.level = 6;
+      defaults.copybudget = 0;
+      params = &defaults;
+    }
+  if (params->level < 0 || params->level > HTM_MAX_LEVEL)
+    {
+      return HTM_ELEVEL;
+    }
+  if (tree->index == MAP_FAILED)
+    {
+      /* nothing to warm up but the points, which a scan reads in order */
+      return HTM_OK;
+    }
+
+  /* prefetch the index in file order */
+  if (tree->indexcopy == NULL)
+    {
+      indexsz = index_file_size (tree);
+      fileoff = static_cast<const char *>(tree->index)
+                - (static_cast<const char *>(tree->entries) - tree->offset);
+      for (off = 0; off < indexsz; off += n)
+        {
+          n = std::min (warmup_chunk, indexsz - off);
+          /* readahead() populates the page cache even where madvise()
+             is ignored, e.g. for pages already mapped MADV_RANDOM */
+          readahead (tree->datafd, fileoff + (off_t)off, n);
+          err = prefetch (static_cast<const char *>(tree->index) + off, n,
+                          params->touch, pagesz);
+          if (err != HTM_OK)
+            {
+              return err;
+            }
+        }
+      if (indexsz != 0 && indexsz <= params->copybudget)
+        {
+          err = copy_index (tree, indexsz);
+          if (err != HTM_OK)
+            {
+              return err;
+            }
+        }
+    }
+
+  /* prefetch the points of the densest subtrees (chunked data files have
+     no memory mapped points) */
+  if (params->topk == 0 || tree->datasz == 0)
+    {
+      return HTM_OK;
+    }
+  err = _htm_tree_search (
+      tree, [](const struct _htm_node *) { return HTM_INTERSECT; },
+      [](const struct _htm_cap *) { return HTM_INTERSECT; },
+      [&](enum _htm_cov, const struct _htm_node *node, uint64_t count)
+      { subtrees.push_back (std::make_pair (count, node->index)); },
+      params->level);
+  if (err != HTM_OK)
+    {
+      return err;
+    }
+  n = std::min (params->topk, subtrees.size ());
+  std::partial_sort (
+      subtrees.begin (), subtrees.begin () + n, subtrees.end (),
+      [](const std::pair<uint64_t, uint64_t> &a,
+         const std::pair<uint64_t, uint64_t> &b) { return a.first > b.first; });
+  /* visit the chosen subtrees in file order */
+  std::sort (subtrees.begin (), subtrees.begin () + n,
+             [](const std::pair<uint64_t, uint64_t> &a,
+                const std::pair<uint64_t, uint64_t> &b)
+             { return a.second < b.second; });
+  for (i = 0; i < n; ++i)
+    {
+      err = prefetch (static_cast<const char *>(tree->entries)
+                          + subtrees[i].second * tree->entry_size,
+                      subtrees[i].first * tree->entry_size, params->touch,
+                      pagesz);
+      if (err != HTM_OK)
+        {
+          return err;
+        }
+    }
+  return HTM_OK;
+}
+
+enum htm_errcode htm_tree_resident (const struct htm_tree *tree,
+                                    struct htm_tree_residency *res)
+{
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  enum htm_errcode err;
+  size_t indexsz;
+
+  if (tree == NULL || res == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  memset (res, 0, sizeof(struct htm_tree_residency));
+  if (tree->entries == MAP_FAILED)
+    {
+      return HTM_OK;
+    }
+  err = resident (tree->entries, tree->datasz, &res->data_pages,
+                  &res->data_resident, pagesz);
+  if (err != HTM_OK || tree->index == MAP_FAILED)
+    {
+      return err;
+    }
+  indexsz = (tree->indexcopy != NULL) ? (size_t)tree->indexsz
+                                      : index_file_size (tree);
+  return resident (tree->index, indexsz, &res->index_pages,
+                   &res->index_resident, pagesz);
+}
+
+enum htm_errcode htm_tree_hotset_save (const struct htm_tree *tree,
+                                       const char *path)
+{
+  const size_t pagesz = (size_t)sysconf (_SC_PAGESIZE);
+  const std::string tmp = std::string (path) + "." + std::to_string (getpid ());
+  std::vector<std::pair<uint64_t, uint64_t> > runs;
+  unsigned char buf[18];
+  uint64_t w[7], end = 0;
+  enum htm_errcode err;
+  struct stat sb;
+  size_t i, n;
+  FILE *f;
+  int ok;
+
+  if (tree == NULL || path == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  if (tree->entries == MAP_FAILED || fstat (tree->datafd, &sb) != 0)
+    {
+      return HTM_EIO;
+    }
+  err = hotset_scan (tree, (size_t)sb.st_size, runs, pagesz);
+  if (err != HTM_OK)
+    {
+      return err;
+    }
+  f = fopen (tmp.c_str (), "wb");
+  if (f == NULL)
+    {
+      return HTM_EIO;
+    }
+  hotset_stat (w, &sb);
+  w[5] = pagesz;
+  w[6] = runs.size ();
+  ok = fwrite (hotset_magic, sizeof(hotset_magic), 1, f) == 1
+       && fwrite (w, sizeof(w), 1, f) == 1;
+  for (i = 0; ok && i < runs.size (); ++i)
+    {
+      n = htm_varint_encode (buf, runs[i].first - end);
+      n += htm_varint_encode (buf + n, runs[i].second);
+      end = runs[i].first + runs[i].second;
+      ok = fwrite (buf, n, 1, f) == 1;
+    }
+  if (fclose (f) != 0 || !ok || rename (tmp.c_str (), path) != 0)
+    {
+      unlink (tmp.c_str ());
+      return HTM_EIO;
+    }
+  return HTM_OK;
+}
+
+enum htm_errcode htm_tree_hotset_load (const struct htm_tree *tree,
+                                       const char *path, int nthreads)
+{
+  std::vector<std::pair<uint64_t, uint64_t> > ranges;
+  std::vector<std::thread> threads;
+  uint64_t w[7], expect[5], gap, len, page = 0, total = 0, nbytes = 0;
+  uint64_t share;
+  char magic[8];
+  struct stat sb;
+  size_t i, beg, end;
+  FILE *f;
+  int ok, t;
+
+  if (tree == NULL || path == NULL)
+    {
+      return HTM_ENULLPTR;
+    }
+  if (tree->entries == MAP_FAILED || fstat (tree->datafd, &sb) != 0)
+    {
+      return HTM_EIO;
+    }
+  f = fopen (path, "rb");
+  if (f == NULL)
+    {
+      return HTM_EIO;
+    }
+  hotset_stat (expect, &sb);
+  ok = fread (magic, sizeof(magic), 1, f) == 1
+       && memcmp (magic, hotset_magic, sizeof(magic)) == 0
+       && fread (w, sizeof(w), 1, f) == 1
+       && memcmp (w, expect, sizeof(expect)) == 0 && w[5] != 0;
+  for (i = 0; ok && i < w[6]; ++i)
+    {
+      ok = hotset_getv (f, &gap) && hotset_getv (f, &len) && len != 0
+           && page + gap + len > page
+           && (page + gap + len) <= ((uint64_t)sb.st_size + w[5] - 1) / w[5];
+      if (ok)
+        {
+          page += gap;
+          ranges.push_back (std::make_pair (page * w[5], len * w[5]));
+          total += len * w[5];
+          page += len;
+        }
+    }
+  fclose (f);
+  if (!ok)
+    {
+      /* the hot-set does not describe this tree file */
+      return HTM_ETREE;
+    }
+
+  /* give each thread a contiguous slice of roughly total/nthreads bytes,
+     so that every thread reads ahead sequentially */
+  if (nthreads < 1)
+    {
+      nthreads = 1;
+    }
+  share = total / (uint64_t)nthreads + 1;
+  for (beg = 0, t = 1; beg < ranges.size (); beg = end, ++t)
+    {
+      for (end = beg; end < ranges.size () && nbytes < share * t; ++end)
+        {
+          nbytes += ranges[end].second;
+        }
+      threads.emplace_back (hotset_fetch, tree, ranges.data () + beg,
+                            end - beg);
+    }
+  for (i = 0; i < threads.size (); ++i)
+    {
+      threads[i].join ();
+    }
+  return HTM_OK;
+}
+}
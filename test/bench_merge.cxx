@@ -0,0 +1,184 @@
+/** \file
+    \brief  Microbenchmark of the multi-way merge used by external sorts
+
+    Merges k in-memory sorted runs of tree entries and of disk nodes,
+    for a range of k, once with the loser tree used by mrg_pass and once
+    with the binary heap it replaced, and prints the merge rates.
+
+    Usage: bench_merge [<# of items, default 4194304>]
+
+    \copyright IPAC/Caltech
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tree_entry.hxx"
+#include "sort_and_index/node.hxx"
+#include "sort_and_index/now.hxx"
+#include "sort_and_index/ext_sort/mrg_pass.hxx"
+#include "rand.h"
+
+
+/*  Reference merge: a binary min-heap of segments, ordered by operator<
+    on their current items.
+ */
+template <class T>
+static void heap_down(mrg_seg<T> *segs, const size_t n)
+{
+    size_t i = 0;
+    while (1) {
+        size_t left = 2 * i + 1, right = 2 * i + 2, least = i;
+        if (left < n && *(segs[left].cur) < *(segs[i].cur)) {
+            least = left;
+        }
+        if (right < n && *(segs[right].cur) < *(segs[least].cur)) {
+            least = right;
+        }
+        if (least == i) {
+            break;
+        }
+        std::swap(segs[i], segs[least]);
+        i = least;
+    }
+}
+
+
+template <class T, class Out>
+static void heap_merge(mrg_seg<T> *segs, size_t ns, const size_t blksz,
+                       Out out)
+{
+    size_t i, j;
+    for (i = 1; i < ns; ++i) {
+        for (j = i; j > 0 && *(segs[j].cur) < *(segs[(j - 1) / 2].cur);
+             j = (j - 1) / 2) {
+            std::swap(segs[j], segs[(j - 1) / 2]);
+        }
+    }
+    while (ns > 0) {
+        out(segs->cur);
+        if (segs->consume(blksz, sizeof(T)) == 0) {
+            segs[0] = segs[ns - 1];
+            --ns;
+        }
+        heap_down(segs, ns);
+    }
+}
+
+
+static void rand_item(struct tree_entry *e, size_t i)
+{
+    e->htmid = (INT64_C(8) << 40) + (int64_t)(htm_rand() * 1.0e12);
+    e->rowid = (int64_t)i;
+}
+
+
+/*  Node IDs of a tree with roughly n nodes of 4KiB blocks, whose 2MiB
+    and 64KiB block IDs are shared by many nodes.
+ */
+static void rand_item(struct disk_node *d, size_t i)
+{
+    d->id.block[0] = (uint64_t)(htm_rand() * 64.0);
+    d->id.block[1] = (uint64_t)(htm_rand() * 2048.0);
+    d->id.block[2] = (uint64_t)(htm_rand() * 65536.0);
+    d->id.block[3] = (uint64_t)(htm_rand() * 1048576.0);
+    d->id.block[4] = (uint64_t)(htm_rand() * 4194304.0);
+    d->id.block[NLOD] = i;
+}
+
+
+/*  Returns the number of seconds taken to merge k sorted runs of the
+    n items at data (using the loser tree if tree is true), after
+    refilling the runs, which the merge discards as it consumes them.
+ */
+template <class T>
+static double bench(T *data, const T *runs, size_t n, size_t k,
+                    std::vector<T> &out, bool tree)
+{
+    const size_t blksz = 1024 * 1024;
+    std::vector<mrg_seg<T> > segs(k);
+    T *o = &out[0];
+    size_t s;
+    double t;
+
+    memcpy(static_cast<void *>(data), runs, n * sizeof(T));
+    for (s = 0; s < k; ++s) {
+        segs[s].init(data + n * s / k, data + n * (s + 1) / k, blksz);
+    }
+    auto append = [&o](const T *item) { *o++ = *item; };
+    t = now();
+    if (tree) {
+        mrg_merge(&segs[0], k, blksz, append);
+    } else {
+        heap_merge(&segs[0], k, blksz, append);
+    }
+    t = now() - t;
+    if (!std::is_sorted(out.begin(), out.end()) ||
+        o != &out[0] + n) {
+        fprintf(stderr, "merge output is not sorted\n");
+        exit(1);
+    }
+    return t;
+}
+
+
+template <class T>
+static void bench_type(const char *name, size_t n)
+{
+    const size_t pagesz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapsz = n * sizeof(T), i, k;
+    std::vector<T> runs(n), out(n);
+    T *data;
+
+    mapsz += pagesz - mapsz % pagesz;
+    data = (T *)mmap(NULL, mapsz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap() failed\n");
+        exit(1);
+    }
+    memset(static_cast<void *>(&runs[0]), 0, n * sizeof(T));
+    printf("%-10s %8s %12s %12s %8s\n", name, "k", "heap Mi/s",
+           "tree Mi/s", "speedup");
+    for (k = 2; k <= 1024 && k <= n; k *= 2) {
+        double th, tt;
+        /* fresh items, so that the key ranges of all runs overlap */
+        for (i = 0; i < n; ++i) {
+            rand_item(&runs[i], i);
+        }
+        for (i = 0; i < k; ++i) {
+            std::sort(&runs[0] + n * i / k, &runs[0] + n * (i + 1) / k);
+        }
+        /* best of 3, to filter out noise */
+        th = tt = 1.0e9;
+        for (i = 0; i < 3; ++i) {
+            th = std::min(th, bench(data, &runs[0], n, k, out, false));
+            tt = std::min(tt, bench(data, &runs[0], n, k, out, true));
+        }
+        printf("%-10s %8zu %12.2f %12.2f %8.2f\n", "", k,
+               n / th / 1048576.0, n / tt / 1048576.0, th / tt);
+    }
+    munmap(data, mapsz);
+}
+
+
+int main(int argc, char **argv) {
+    size_t n = 4 * 1024 * 1024;
+
+    if (argc > 1) {
+        n = (size_t)strtoull(argv[1], NULL, 0);
+    }
+    if (n == 0) {
+        fprintf(stderr, "usage: %s [<# of items>]\n", argv[0]);
+        return 1;
+    }
+    htm_seed(123456789UL);
+    bench_type<tree_entry>("tree_entry", n);
+    bench_type<disk_node>("disk_node", n / 4);
+    return 0;
+}
@@ -5,6 +5,7 @@
     \copyright IPAC/Caltech
   */
 #include <float.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -600,6 +601,360 @@ static void test_adaptive_poly()
 }
 
 
+/*  Returns a random unit vector within roughly r degrees of cen.
+ */
+static void rand_near(struct htm_v3 *out, const struct htm_v3 *cen, double r)
+{
+    struct htm_v3 d;
+    d.x = htm_rand() - 0.5;
+    d.y = htm_rand() - 0.5;
+    d.z = htm_rand() - 0.5;
+    htm_v3_mul(&d, &d, 2.0 * r * HTM_RAD_PER_DEG);
+    htm_v3_add(out, cen, &d);
+    htm_v3_normalize(out, out);
+}
+
+
+/*  Returns a random circle, ellipse or polygon close to cen.
+ */
+static struct htm_s2region * rand_shape(const struct htm_v3 *cen, double r)
+{
+    struct htm_s2region *region = NULL;
+    struct htm_s2cpoly *poly;
+    struct htm_s2ellipse ellipse;
+    struct htm_v3 v;
+    enum htm_errcode err;
+
+    rand_near(&v, cen, r);
+    switch ((int) (htm_rand() * 3.0)) {
+        case 0:
+            region = htm_s2region_circle(&v, htm_rand() * r, &err);
+            break;
+        case 1:
+            err = htm_s2ellipse_init2(&ellipse, &v, htm_rand() * r + 0.01,
+                                      htm_rand() * r + 0.01,
+                                      htm_rand() * 360.0);
+            HTM_ASSERT(err == HTM_OK, "htm_s2ellipse_init2() failed");
+            region = htm_s2region_ellipse(&ellipse, &err);
+            break;
+        default:
+            poly = htm_s2cpoly_ngon(&v, htm_rand() * r + 0.01,
+                                    3 + (size_t) (htm_rand() * 6.0), &err);
+            HTM_ASSERT(poly != NULL, "htm_s2cpoly_ngon() failed");
+            region = htm_s2region_cpoly(poly, &err);
+            free(poly);
+            break;
+    }
+    HTM_ASSERT(region != NULL && err == HTM_OK, "region creation failed");
+    return region;
+}
+
+
+/*  Returns a random composite region with the given number of set
+    operations, close to cen.
+ */
+static struct htm_s2region * rand_region(const struct htm_v3 *cen, double r,
+                                         int nops)
+{
+    struct htm_s2region *r1, *r2, *region;
+    enum htm_errcode err;
+
+    if (nops == 0) {
+        return rand_shape(cen, r);
+    }
+    r1 = rand_region(cen, r, nops - 1);
+    r2 = rand_shape(cen, r);
+    switch ((int) (htm_rand() * 3.0)) {
+        case 0:
+            region = htm_s2region_union(r1, r2, &err);
+            break;
+        case 1:
+            region = htm_s2region_isect(r1, r2, &err);
+            break;
+        default:
+            region = htm_s2region_diff(r1, r2, &err);
+            break;
+    }
+    HTM_ASSERT(region != NULL && err == HTM_OK, "region creation failed");
+    return region;
+}
+
+
+/*  Returns 1 if id falls inside one of the ranges in ids.
+ */
+static int ids_contain(const struct htm_ids *ids, int64_t id)
+{
+    size_t i;
+    for (i = 0; i < ids->n; ++i) {
+        if (id >= ids->range[i].min && id <= ids->range[i].max) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*  Tests HTM indexing of composite regions: every point inside a region
+    must belong to one of the HTM triangles covering it.
+ */
+static void test_regions()
+{
+    struct htm_s2region *region;
+    struct htm_ids *ids = NULL;
+    struct htm_v3 cen, v;
+    enum htm_errcode err;
+    int i, j, level;
+
+    /* Failure tests */
+    HTM_ASSERT(htm_s2region_ids(NULL, NULL, 0, SIZE_MAX, &err) == NULL,
+               "htm_s2region_ids() should have failed");
+    HTM_ASSERT(htm_s2region_circle(NULL, 1.0, &err) == NULL &&
+               err == HTM_ENULLPTR, "htm_s2region_circle() should have failed");
+    HTM_ASSERT(htm_s2region_union(NULL, NULL, &err) == NULL &&
+               err == HTM_ENULLPTR, "htm_s2region_union() should have failed");
+    /* empty and full circles */
+    region = htm_s2region_circle(&test_points[18].v, -1.0, &err);
+    HTM_ASSERT(region != NULL, "htm_s2region_circle() failed");
+    ids = htm_s2region_ids(ids, region, 3, SIZE_MAX, &err);
+    HTM_ASSERT(ids != NULL && err == HTM_OK && ids->n == 0,
+               "htm_s2region_ids() failed");
+    region = htm_s2region_diff(
+        htm_s2region_circle(&test_points[18].v, 180.0, &err), region, &err);
+    HTM_ASSERT(region != NULL, "htm_s2region_diff() failed");
+    ids = htm_s2region_ids(ids, region, 1, SIZE_MAX, &err);
+    HTM_ASSERT(ids != NULL && err == HTM_OK && ids->n == 1 &&
+               ids->range[0].min == 32 && ids->range[0].max == 63,
+               "htm_s2region_ids() failed");
+    htm_s2region_destroy(region);
+
+    /* the union of N3 and its complement must cover the whole sky */
+    region = htm_s2region_union(
+        htm_s2region_circle(&test_points[18].v, 10.0, &err),
+        htm_s2region_diff(
+            htm_s2region_circle(&test_points[18].v, 180.0, &err),
+            htm_s2region_circle(&test_points[18].v, 10.0, &err), &err), &err);
+    HTM_ASSERT(region != NULL, "region creation failed");
+    for (j = 0; j < 1000; ++j) {
+        v.x = htm_rand() - 0.5;
+        v.y = htm_rand() - 0.5;
+        v.z = htm_rand() - 0.5;
+        htm_v3_normalize(&v, &v);
+        HTM_ASSERT(htm_s2region_cv3(region, &v),
+                   "htm_s2region_cv3() failed");
+    }
+    htm_s2region_destroy(region);
+
+    /* random regions */
+    for (i = 0; i < 200; ++i) {
+        cen.x = htm_rand() - 0.5;
+        cen.y = htm_rand() - 0.5;
+        cen.z = htm_rand() - 0.5;
+        htm_v3_normalize(&cen, &cen);
+        region = rand_region(&cen, 5.0, i % 4);
+        for (level = 0; level <= 8; level += 2) {
+            ids = htm_s2region_ids(ids, region, level, SIZE_MAX, &err);
+            HTM_ASSERT(ids != NULL && err == HTM_OK,
+                       "htm_s2region_ids() failed");
+            for (j = 0; j < 500; ++j) {
+                rand_near(&v, &cen, 10.0);
+                if (htm_s2region_cv3(region, &v)) {
+                    HTM_ASSERT(ids_contain(ids, htm_v3_id(&v, level)),
+                               "htm_s2region_ids() missed a point "
+                               "inside the region");
+                }
+            }
+        }
+        htm_s2region_destroy(region);
+    }
+    free(ids);
+}
+
+
+/*  Returns a random unit vector inside the given longitude/latitude box.
+ */
+static void rand_in_box(struct htm_v3 *out, const struct htm_s2box *box)
+{
+    struct htm_sc sc;
+    double z = box->zmin + htm_rand() * (box->zmax - box->zmin);
+    sc.lon = htm_angred(box->lonmin + htm_rand() * box->width);
+    sc.lat = asin(htm_clamp(z, -1.0, 1.0)) * HTM_DEG_PER_RAD;
+    htm_sc_tov3(out, &sc);
+}
+
+
+/*  Returns 1 if the longitude/latitude of v is inside the given box, -1 if
+    it is within eps degrees of the box boundary, and 0 otherwise.
+ */
+static int box_contains_sc(const struct htm_s2box *box, const struct htm_v3 *v,
+                           double eps)
+{
+    struct htm_sc sc;
+    double d;
+    HTM_ASSERT(htm_v3_tosc(&sc, v) == HTM_OK, "htm_v3_tosc() failed");
+    if (fabs(sc.lat - box->latmin) < eps || fabs(sc.lat - box->latmax) < eps) {
+        return -1;
+    }
+    if (sc.lat < box->latmin || sc.lat > box->latmax) {
+        return 0;
+    }
+    if (box->width >= 360.0 || fabs(sc.lat) > 90.0 - eps) {
+        return 1;
+    }
+    d = htm_angred(sc.lon - box->lonmin);
+    if (fabs(d - box->width) < eps || d < eps || d > 360.0 - eps) {
+        return -1;
+    }
+    return d <= box->width;
+}
+
+
+/*  Tests HTM indexing of longitude/latitude boxes, including boxes crossing
+    the 0/360 meridian and boxes containing a pole.
+ */
+static void test_boxes()
+{
+    static const double boxes[][4] = {
+        { 350.0, 10.0, -20.0, 20.0 },    /* crosses lon = 0 */
+        { 340.0, 30.0, 40.0, 70.0 },     /* crosses lon = 0 */
+        { 0.0, 360.0, 80.0, 90.0 },      /* north polar cap */
+        { 100.0, 130.0, 75.0, 90.0 },    /* touches the north pole */
+        { 0.0, 360.0, -90.0, -85.0 },    /* south polar cap */
+        { 200.0, 160.0, -90.0, -60.0 },  /* touches the south pole, wide */
+        { 30.0, 300.0, -10.0, 40.0 },    /* wider than a hemisphere */
+        { 10.0, 10.5, -60.0, 60.0 },     /* thin */
+        { 0.0, 90.0, 0.0, 90.0 },        /* matches a root triangle */
+        { 0.0, 360.0, -30.0, 30.0 },     /* band */
+        { 0.0, 360.0, -90.0, 90.0 }      /* whole sky */
+    };
+    const size_t nboxes = sizeof(boxes) / sizeof(boxes[0]);
+    struct htm_s2region *region;
+    struct htm_ids *ids = NULL;
+    struct htm_s2box box;
+    struct htm_v3 v;
+    enum htm_errcode err;
+    size_t b, j;
+    int level, in;
+
+    /* Failure tests */
+    HTM_ASSERT(htm_s2box_init(NULL, 0.0, 10.0, 0.0, 10.0) == HTM_ENULLPTR,
+               "htm_s2box_init() should have failed");
+    HTM_ASSERT(htm_s2box_init(&box, 0.0, 10.0, 0.0, 91.0) == HTM_ELAT,
+               "htm_s2box_init() should have failed");
+    HTM_ASSERT(htm_s2box_init(&box, 0.0, 10.0, 10.0, 0.0) == HTM_EANG,
+               "htm_s2box_init() should have failed");
+    HTM_ASSERT(htm_s2box_init(&box, 0.0, NAN, 0.0, 10.0) == HTM_ENANINF,
+               "htm_s2box_init() should have failed");
+    HTM_ASSERT(htm_s2box_ids(NULL, NULL, 0, SIZE_MAX, &err) == NULL &&
+               err == HTM_ENULLPTR, "htm_s2box_ids() should have failed");
+    /* longitude range reduction */
+    HTM_ASSERT(htm_s2box_init(&box, -10.0, 10.0, 0.0, 10.0) == HTM_OK &&
+               box.lonmin == 350.0 && box.width == 20.0,
+               "htm_s2box_init() failed");
+    HTM_ASSERT(htm_s2box_init(&box, 10.0, 370.0, 0.0, 10.0) == HTM_OK &&
+               box.width == 360.0, "htm_s2box_init() failed");
+
+    for (b = 0; b < nboxes; ++b) {
+        HTM_ASSERT(htm_s2box_init(&box, boxes[b][0], boxes[b][1],
+                                  boxes[b][2], boxes[b][3]) == HTM_OK,
+                   "htm_s2box_init() failed");
+        region = htm_s2region_box(&box, &err);
+        HTM_ASSERT(region != NULL && err == HTM_OK,
+                   "htm_s2region_box() failed");
+        /* point-in-box test against spherical coordinates */
+        for (j = 0; j < 10000; ++j) {
+            v.x = htm_rand() - 0.5;
+            v.y = htm_rand() - 0.5;
+            v.z = htm_rand() - 0.5;
+            htm_v3_normalize(&v, &v);
+            in = box_contains_sc(&box, &v, 1.0e-9);
+            if (in >= 0) {
+                HTM_ASSERT(htm_s2box_cv3(&box, &v) == in,
+                           "htm_s2box_cv3() failed for box %d", (int) b);
+            }
+            HTM_ASSERT(htm_s2region_cv3(region, &v) ==
+                       htm_s2box_cv3(&box, &v), "htm_s2region_cv3() failed");
+        }
+        for (level = 0; level <= 12; level += 3) {
+            ids = htm_s2box_ids(ids, &box, level, SIZE_MAX, &err);
+            HTM_ASSERT(ids != NULL && err == HTM_OK,
+                       "htm_s2box_ids() failed");
+            /* every point in the box must be covered */
+            for (j = 0; j < 2000; ++j) {
+                rand_in_box(&v, &box);
+                if (htm_s2box_cv3(&box, &v)) {
+                    HTM_ASSERT(ids_contain(ids, htm_v3_id(&v, level)),
+                               "htm_s2box_ids() missed a point inside "
+                               "box %d at level %d", (int) b, level);
+                }
+            }
+            /* the poles belong to every meridian */
+            v.x = 0.0; v.y = 0.0; v.z = 1.0;
+            if (box.latmax == 90.0) {
+                HTM_ASSERT(htm_s2box_cv3(&box, &v) &&
+                           ids_contain(ids, htm_v3_id(&v, level)),
+                           "north pole not in box %d", (int) b);
+            }
+            v.z = -1.0;
+            if (box.latmin == -90.0) {
+                HTM_ASSERT(htm_s2box_cv3(&box, &v) &&
+                           ids_contain(ids, htm_v3_id(&v, level)),
+                           "south pole not in box %d", (int) b);
+            }
+        }
+        /* the level 6 coverage must closely follow the box: every
+           triangle must lie within about its own radius of the box */
+        ids = htm_s2box_ids(ids, &box, 6, SIZE_MAX, &err);
+        HTM_ASSERT(ids != NULL && err == HTM_OK, "htm_s2box_ids() failed");
+        for (j = 0; j < ids->n; ++j) {
+            int64_t id;
+            for (id = ids->range[j].min; id <= ids->range[j].max; ++id) {
+                struct htm_tri tri;
+                struct htm_sc sc;
+                double r, dlon;
+                HTM_ASSERT(htm_tri_init(&tri, id) == HTM_OK,
+                           "htm_tri_init() failed");
+                HTM_ASSERT(htm_v3_tosc(&sc, &tri.center) == HTM_OK,
+                           "htm_v3_tosc() failed");
+                r = 1.5 * tri.radius;
+                HTM_ASSERT(sc.lat >= box.latmin - r &&
+                           sc.lat <= box.latmax + r,
+                           "htm_s2box_ids() coverage of box %d is too loose",
+                           (int) b);
+                if (box.width >= 360.0 || fabs(sc.lat) + r >= 90.0) {
+                    continue;
+                }
+                dlon = r / cos((fabs(sc.lat) + r) * HTM_RAD_PER_DEG);
+                HTM_ASSERT(htm_angred(sc.lon - box.lonmin + dlon) <=
+                           box.width + 2.0 * dlon,
+                           "htm_s2box_ids() coverage of box %d is too loose",
+                           (int) b);
+            }
+        }
+        htm_s2region_destroy(region);
+    }
+
+    /* a box crossing lon = 0 is the union of two boxes that do not */
+    HTM_ASSERT(htm_s2box_init(&box, 350.0, 10.0, -20.0, 20.0) == HTM_OK,
+               "htm_s2box_init() failed");
+    {
+        struct htm_s2box west, east;
+        HTM_ASSERT(htm_s2box_init(&west, 350.0, 360.0, -20.0, 20.0) ==
+                   HTM_OK && htm_s2box_init(&east, 0.0, 10.0, -20.0, 20.0) ==
+                   HTM_OK, "htm_s2box_init() failed");
+        for (j = 0; j < 10000; ++j) {
+            v.x = htm_rand() - 0.5;
+            v.y = htm_rand() - 0.5;
+            v.z = htm_rand() - 0.5;
+            htm_v3_normalize(&v, &v);
+            HTM_ASSERT(htm_s2box_cv3(&box, &v) ==
+                       (htm_s2box_cv3(&west, &v) || htm_s2box_cv3(&east, &v)),
+                       "htm_s2box_cv3() failed across lon = 0");
+        }
+    }
+    free(ids);
+}
+
+
 /*  Test binary to decimal ID conversion.
  */
 static void test_decimal_ids()
@@ -703,6 +1058,8 @@ int main(int argc HTM_UNUSED, char **argv HTM_UNUSED) {
     test_polygons();
     test_adaptive_circle();
     test_adaptive_poly();
+    test_regions();
+    test_boxes();
     test_decimal_ids();
     test_tri();
     return 0;
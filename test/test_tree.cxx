@@ -0,0 +1,1723 @@
+/** \file
+    \brief  Unit tests for HTM tree indexes and queries
+
+    Trees are generated from random points (some uniformly distributed,
+    some clustered) with the same machinery used by htm_tree_gen, and the
+    results of index based queries are checked against full scans.
+
+    \copyright IPAC/Caltech
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tinyhtm/tree.h"
+#include "Tree.hxx"
+#include "Query.hxx"
+#include "tree_entry.hxx"
+#include "sort_and_index.hxx"
+#include "rand.h"
+
+
+double parse_double(const char *s, char **endptr);
+size_t blk_sort_ascii(const std::vector<std::string> &infiles,
+                      const std::string &outfile, const char delim,
+                      const struct mem_params *const mem, const int depth,
+                      const int nthreads);
+
+
+#define HTM_ASSERT(pred, ...) \
+    do { \
+        if (!(pred)) { \
+            fprintf(stderr, "[%s:%d]  ", __FILE__, __LINE__); \
+            fprintf(stderr, #pred " is false: " __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            exit(1); \
+        } \
+    } while(0)
+
+#define NCLUSTERS 4
+
+/* The seed and number of points of the trees built by main(), and of the
+   trees compared with them. */
+#define SEED 123456789UL
+#define NPOINTS 100000
+
+static struct htm_v3 clusters[NCLUSTERS];
+
+
+/*  Returns a random unit vector.
+ */
+static void rand_v3(struct htm_v3 *out)
+{
+    double z = 2.0 * htm_rand() - 1.0;
+    double phi = 2.0 * M_PI * htm_rand();
+    double r = sqrt(1.0 - z * z);
+    out->x = r * cos(phi);
+    out->y = r * sin(phi);
+    out->z = z;
+}
+
+
+/*  Returns a random unit vector within roughly r degrees of cen.
+ */
+static void rand_near(struct htm_v3 *out, const struct htm_v3 *cen, double r)
+{
+    struct htm_v3 d;
+    d.x = htm_rand() - 0.5;
+    d.y = htm_rand() - 0.5;
+    d.z = htm_rand() - 0.5;
+    htm_v3_mul(&d, &d, 2.0 * r * HTM_RAD_PER_DEG);
+    htm_v3_add(out, cen, &d);
+    htm_v3_normalize(out, out);
+}
+
+
+/*  Returns index options for a tree with the given leaf threshold,
+    optionally storing node bounding caps, that is always indexed.
+ */
+static index_options tree_options(uint64_t leafthresh, bool caps)
+{
+    index_options opts;
+    opts.leafthresh = leafthresh;
+    opts.minpoints = 0;
+    opts.caps = caps;
+    return opts;
+}
+
+
+/*  Writes n random points to a block sorted tree entry file, and builds
+    the data file and tree index <path>.h5 from it with the given options
+    and memory parameters.
+ */
+static void build_tree(const std::string &path, size_t n,
+                       const index_options &opts,
+                       const mem_params &mem = mem_params(4 * 1024 * 1024,
+                                                          64 * 1024))
+{
+    const std::string datafile = path + ".h5";
+    size_t i;
+
+    for (i = 0; i < NCLUSTERS; ++i) {
+        rand_v3(&clusters[i]);
+    }
+    {
+        blk_writer<tree_entry> out(datafile, mem.sortsz);
+        for (i = 0; i < n; ++i) {
+            struct tree_entry entry;
+            struct htm_v3 v;
+            if (i % 2 == 0) {
+                rand_v3(&v);
+            } else {
+                rand_near(&v, &clusters[i % NCLUSTERS], 2.0);
+            }
+            HTM_ASSERT(htm_v3_tosc(&entry.sc, &v) == HTM_OK,
+                       "htm_v3_tosc() failed");
+            htm_sc_tov3(&v, &entry.sc);
+            entry.htmid = htm_v3_id(&v, 20);
+            entry.rowid = (int64_t) i;
+            HTM_ASSERT(entry.htmid != 0, "htm_v3_id() failed");
+            out.append(&entry);
+        }
+    }
+    sort_and_index<tree_entry>(datafile, path + ".scr", path + ".htm", mem,
+                               n, opts);
+}
+
+
+/*  Builds the data file and tree index <path>.h5 of n points within
+    roughly r degrees of cen, with points sorted and indexed at the given
+    tree depth.
+ */
+static void build_dense(const std::string &path, size_t n,
+                        const struct htm_v3 *cen, double r, int depth)
+{
+    const std::string datafile = path + ".h5";
+    mem_params mem(4 * 1024 * 1024, 64 * 1024);
+    size_t i;
+
+    {
+        blk_writer<tree_entry> out(datafile, mem.sortsz);
+        for (i = 0; i < n; ++i) {
+            struct tree_entry entry;
+            struct htm_v3 v;
+            rand_near(&v, cen, r);
+            HTM_ASSERT(htm_v3_tosc(&entry.sc, &v) == HTM_OK,
+                       "htm_v3_tosc() failed");
+            htm_sc_tov3(&v, &entry.sc);
+            entry.htmid = htm_v3_id(&v, depth);
+            entry.rowid = (int64_t) i;
+            HTM_ASSERT(entry.htmid != 0, "htm_v3_id() failed");
+            out.append(&entry);
+        }
+    }
+    index_options opts = tree_options(16, false);
+    opts.prefixlevel = 6;
+    opts.depth = depth;
+    sort_and_index<tree_entry>(datafile, path + ".scr", path + ".htm", mem,
+                               n, opts);
+}
+
+
+/*  Returns a random circle, ellipse or polygon close to cen.
+ */
+static struct htm_s2region * rand_shape(const struct htm_v3 *cen, double r)
+{
+    struct htm_s2region *region = NULL;
+    struct htm_s2cpoly *poly;
+    struct htm_s2ellipse ellipse;
+    struct htm_v3 v;
+    enum htm_errcode err;
+
+    rand_near(&v, cen, r);
+    switch ((int) (htm_rand() * 3.0)) {
+        case 0:
+            region = htm_s2region_circle(&v, htm_rand() * r, &err);
+            break;
+        case 1:
+            err = htm_s2ellipse_init2(&ellipse, &v, htm_rand() * r + 0.01,
+                                      htm_rand() * r + 0.01,
+                                      htm_rand() * 360.0);
+            HTM_ASSERT(err == HTM_OK, "htm_s2ellipse_init2() failed");
+            region = htm_s2region_ellipse(&ellipse, &err);
+            break;
+        default:
+            poly = htm_s2cpoly_ngon(&v, htm_rand() * r + 0.01,
+                                    3 + (size_t) (htm_rand() * 6.0), &err);
+            HTM_ASSERT(poly != NULL, "htm_s2cpoly_ngon() failed");
+            region = htm_s2region_cpoly(poly, &err);
+            free(poly);
+            break;
+    }
+    HTM_ASSERT(region != NULL && err == HTM_OK, "region creation failed");
+    return region;
+}
+
+
+/*  Returns a random composite region with the given number of set
+    operations, close to cen.
+ */
+static struct htm_s2region * rand_region(const struct htm_v3 *cen, double r,
+                                         int nops)
+{
+    struct htm_s2region *r1, *r2, *region;
+    enum htm_errcode err;
+
+    if (nops == 0) {
+        return rand_shape(cen, r);
+    }
+    r1 = rand_region(cen, r, nops - 1);
+    r2 = rand_shape(cen, r);
+    switch ((int) (htm_rand() * 3.0)) {
+        case 0:
+            region = htm_s2region_union(r1, r2, &err);
+            break;
+        case 1:
+            region = htm_s2region_isect(r1, r2, &err);
+            break;
+        default:
+            region = htm_s2region_diff(r1, r2, &err);
+            break;
+    }
+    HTM_ASSERT(region != NULL && err == HTM_OK, "region creation failed");
+    return region;
+}
+
+
+/*  Checks index based composite region queries against scans.
+ */
+static void test_regions(const struct htm_tree *tree)
+{
+    struct htm_s2region *region;
+    struct htm_range range;
+    struct htm_v3 cen;
+    enum htm_errcode err;
+    int64_t count, scan, ncb;
+    int i;
+
+    /* Failure tests */
+    HTM_ASSERT(htm_tree_s2region_count(tree, NULL, &err) < 0 &&
+               err == HTM_ENULLPTR, "htm_tree_s2region_count() should "
+               "have failed");
+    range = htm_tree_s2region_range(NULL, NULL, &err);
+    HTM_ASSERT(range.max < range.min && err == HTM_ENULLPTR,
+               "htm_tree_s2region_range() should have failed");
+
+    /* whole sky */
+    rand_v3(&cen);
+    region = htm_s2region_circle(&cen, 180.0, &err);
+    HTM_ASSERT(region != NULL, "htm_s2region_circle() failed");
+    count = htm_tree_s2region_count(tree, region, &err);
+    HTM_ASSERT(err == HTM_OK && count == (int64_t) tree->count,
+               "htm_tree_s2region_count() failed for the whole sky");
+    htm_s2region_destroy(region);
+
+    for (i = 0; i < 400; ++i) {
+        if (i % 2 == 0) {
+            cen = clusters[(i / 2) % NCLUSTERS];
+        } else {
+            rand_v3(&cen);
+        }
+        region = rand_region(&cen, (i % 3 == 0) ? 20.0 : 3.0, i % 4);
+        scan = htm_tree_s2region_scan(tree, region, &err, NULL);
+        HTM_ASSERT(err == HTM_OK && scan >= 0,
+                   "htm_tree_s2region_scan() failed");
+        count = htm_tree_s2region_count(tree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        HTM_ASSERT(count == scan, "htm_tree_s2region_count() = %lld, but "
+                   "scan found %lld points", (long long) count,
+                   (long long) scan);
+        ncb = 0;
+        count = htm_tree_s2region(tree, region, &err,
+                                  [&](const char *) { ++ncb; return true; });
+        HTM_ASSERT(err == HTM_OK && count == scan && ncb == scan,
+                   "htm_tree_s2region() failed");
+        range = htm_tree_s2region_range(tree, region, &err);
+        HTM_ASSERT(err == HTM_OK && range.min <= scan && range.max >= scan,
+                   "htm_tree_s2region_range() does not bracket the count");
+        htm_s2region_destroy(region);
+    }
+}
+
+
+/*  Checks index based longitude/latitude box queries against scans.
+ */
+static void test_boxes(const struct htm_tree *tree)
+{
+    struct htm_s2box box;
+    struct htm_range range;
+    struct htm_sc sc;
+    enum htm_errcode err;
+    int64_t count, scan, ncb;
+    double lon, lat, w, h;
+    int i;
+
+    /* Failure tests */
+    HTM_ASSERT(htm_tree_s2box_count(tree, NULL, &err) < 0 &&
+               err == HTM_ENULLPTR, "htm_tree_s2box_count() should "
+               "have failed");
+
+    /* whole sky */
+    HTM_ASSERT(htm_s2box_init(&box, 0.0, 360.0, -90.0, 90.0) == HTM_OK,
+               "htm_s2box_init() failed");
+    count = htm_tree_s2box_count(tree, &box, &err);
+    HTM_ASSERT(err == HTM_OK && count == (int64_t) tree->count,
+               "htm_tree_s2box_count() failed for the whole sky");
+
+    for (i = 0; i < 400; ++i) {
+        if (i % 2 == 0) {
+            err = htm_v3_tosc(&sc, &clusters[(i / 2) % NCLUSTERS]);
+            HTM_ASSERT(err == HTM_OK, "htm_v3_tosc() failed");
+            lon = sc.lon + 4.0 * (htm_rand() - 0.5);
+            lat = sc.lat + 4.0 * (htm_rand() - 0.5);
+        } else {
+            lon = 360.0 * htm_rand();
+            lat = 180.0 * htm_rand() - 90.0;
+        }
+        switch (i % 4) {
+            case 0:
+                /* small boxes */
+                w = 5.0 * htm_rand();
+                h = 5.0 * htm_rand();
+                break;
+            case 1:
+                /* boxes crossing lon = 0 */
+                lon = 10.0 * (htm_rand() - 0.5);
+                w = 60.0 * htm_rand();
+                h = 60.0 * htm_rand();
+                break;
+            case 2:
+                /* polar boxes */
+                lat = (htm_rand() < 0.5) ? -90.0 : 90.0;
+                w = 400.0 * htm_rand();
+                h = 30.0 * htm_rand();
+                break;
+            default:
+                /* large boxes */
+                w = 360.0 * htm_rand();
+                h = 90.0 * htm_rand();
+                break;
+        }
+        HTM_ASSERT(htm_s2box_init(&box, lon - 0.5 * w, lon + 0.5 * w,
+                                  htm_clamp(lat - 0.5 * h, -90.0, 90.0),
+                                  htm_clamp(lat + 0.5 * h, -90.0, 90.0)) ==
+                   HTM_OK, "htm_s2box_init() failed");
+        scan = htm_tree_s2box_scan(tree, &box, &err, NULL);
+        HTM_ASSERT(err == HTM_OK && scan >= 0, "htm_tree_s2box_scan() failed");
+        count = htm_tree_s2box_count(tree, &box, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2box_count() failed");
+        HTM_ASSERT(count == scan, "htm_tree_s2box_count() = %lld, but "
+                   "scan found %lld points", (long long) count,
+                   (long long) scan);
+        ncb = 0;
+        count = htm_tree_s2box(tree, &box, &err,
+                               [&](const char *) { ++ncb; return true; });
+        HTM_ASSERT(err == HTM_OK && count == scan && ncb == scan,
+                   "htm_tree_s2box() failed");
+        range = htm_tree_s2box_range(tree, &box, &err);
+        HTM_ASSERT(err == HTM_OK && range.min <= scan && range.max >= scan,
+                   "htm_tree_s2box_range() does not bracket the count");
+    }
+}
+
+
+/*  Checks approximate circle queries: approximate counts must bracket
+    the exact count from below, and the count of points in the circle
+    grown by the reported boundary error from above.
+ */
+static void test_approx(const struct htm_tree *tree)
+{
+    struct htm_s2region *region, *grown;
+    struct htm_v3 cen;
+    enum htm_errcode err;
+    int64_t count, approx, bound, ncb;
+    double r, maxerr;
+    int i, level;
+
+    /* Failure tests */
+    rand_v3(&cen);
+    region = htm_s2region_circle(&cen, 1.0, &err);
+    HTM_ASSERT(region != NULL, "htm_s2region_circle() failed");
+    HTM_ASSERT(htm_tree_s2region_approx(tree, NULL, 10, &maxerr, &err,
+                                        NULL) < 0 && err == HTM_ENULLPTR,
+               "htm_tree_s2region_approx() should have failed");
+    HTM_ASSERT(htm_tree_s2region_approx(tree, region, HTM_MAX_LEVEL + 1,
+                                        &maxerr, &err, NULL) < 0 &&
+               err == HTM_ELEVEL,
+               "htm_tree_s2region_approx() should have failed");
+    htm_s2region_destroy(region);
+
+    /* whole sky */
+    region = htm_s2region_circle(&cen, 180.0, &err);
+    approx = htm_tree_s2region_approx(tree, region, 0, &maxerr, &err, NULL);
+    HTM_ASSERT(err == HTM_OK && approx == (int64_t) tree->count &&
+               maxerr == 0.0, "htm_tree_s2region_approx() failed for the "
+               "whole sky");
+    htm_s2region_destroy(region);
+
+    for (i = 0; i < 200; ++i) {
+        if (i % 2 == 0) {
+            rand_near(&cen, &clusters[(i / 2) % NCLUSTERS], 2.0);
+        } else {
+            rand_v3(&cen);
+        }
+        r = (i % 3 == 0) ? 10.0 * htm_rand() : htm_rand();
+        region = htm_s2region_circle(&cen, r, &err);
+        HTM_ASSERT(region != NULL, "htm_s2region_circle() failed");
+        count = htm_tree_s2region_count(tree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        for (level = 0; level <= 20; level += 5) {
+            approx = htm_tree_s2region_approx(tree, region, level, &maxerr,
+                                              &err, NULL);
+            HTM_ASSERT(err == HTM_OK && approx >= count && maxerr >= 0.0,
+                       "htm_tree_s2region_approx() undercounted");
+            ncb = 0;
+            HTM_ASSERT(htm_tree_s2region_approx(
+                           tree, region, level, NULL, &err,
+                           [&](const char *) { ++ncb; return true; }) ==
+                       approx && ncb == approx,
+                       "htm_tree_s2region_approx() callback mismatch");
+            grown = htm_s2region_circle(&cen, htm_clamp(r + maxerr, 0.0, 180.0),
+                                        &err);
+            HTM_ASSERT(grown != NULL, "htm_s2region_circle() failed");
+            bound = htm_tree_s2region_count(tree, grown, &err);
+            HTM_ASSERT(err == HTM_OK && approx <= bound,
+                       "htm_tree_s2region_approx() counted points further "
+                       "than the maximum error from the region");
+            htm_s2region_destroy(grown);
+        }
+        htm_s2region_destroy(region);
+    }
+}
+
+
+/*  Checks that a tree with node bounding caps answers queries like the
+    same tree without caps, and that it yields tighter count ranges.
+ */
+static void test_caps(const struct htm_tree *tree,
+                      const struct htm_tree *captree)
+{
+    struct htm_s2region *region;
+    struct htm_range range, caprange;
+    struct htm_v3 cen;
+    enum htm_errcode err;
+    int64_t count, capcount, width = 0, capwidth = 0;
+    int i;
+
+    HTM_ASSERT(tree->flags == 0, "tree should not have bounding caps");
+    HTM_ASSERT(captree->flags == HTM_TREE_CAPS,
+               "tree should have bounding caps");
+    HTM_ASSERT(captree->count == tree->count &&
+               captree->leafthresh == tree->leafthresh,
+               "trees with and without caps differ");
+    for (i = 0; i < 400; ++i) {
+        if (i % 2 == 0) {
+            cen = clusters[(i / 2) % NCLUSTERS];
+        } else {
+            rand_v3(&cen);
+        }
+        region = rand_region(&cen, (i % 3 == 0) ? 20.0 : 3.0, i % 4);
+        count = htm_tree_s2region_count(tree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        capcount = htm_tree_s2region_count(captree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        HTM_ASSERT(count == capcount, "htm_tree_s2region_count() = %lld "
+                   "with caps, but %lld without", (long long) capcount,
+                   (long long) count);
+        range = htm_tree_s2region_range(tree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_range() failed");
+        caprange = htm_tree_s2region_range(captree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_range() failed");
+        HTM_ASSERT(caprange.min >= range.min && caprange.max <= range.max,
+                   "bounding caps loosened the count range");
+        width += range.max - range.min;
+        capwidth += caprange.max - caprange.min;
+        htm_s2region_destroy(region);
+    }
+    HTM_ASSERT(capwidth < width, "bounding caps did not tighten count "
+               "ranges (%lld vs. %lld)", (long long) capwidth,
+               (long long) width);
+}
+
+
+/*  Opens the tree for datafile, and checks that its layout matches that
+    of ref.
+ */
+static void check_layout(const std::string &datafile,
+                         const struct htm_tree *ref)
+{
+    struct htm_tree tree;
+    enum htm_errcode err;
+    size_t i;
+
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    HTM_ASSERT(tree.offset == ref->offset && tree.datasz == ref->datasz &&
+               tree.indexsz == ref->indexsz &&
+               tree.entry_size == ref->entry_size &&
+               tree.count == ref->count && tree.flags == ref->flags &&
+               tree.leafthresh == ref->leafthresh &&
+               tree.num_elements_per_entry == ref->num_elements_per_entry &&
+               tree.prefixlevel == ref->prefixlevel,
+               "tree layouts differ");
+    HTM_ASSERT((tree.prefix == NULL) == (ref->prefix == NULL) &&
+               (tree.prefix == NULL ||
+                (const char *) tree.prefix - (const char *) tree.entries ==
+                (const char *) ref->prefix - (const char *) ref->entries),
+               "tree prefix count table offsets differ");
+    HTM_ASSERT((const char *) tree.index - (const char *) tree.entries ==
+               (const char *) ref->index - (const char *) ref->entries,
+               "tree index offsets differ");
+    for (i = 0; i < tree.num_elements_per_entry; ++i) {
+        HTM_ASSERT(tree.element_names[i] == ref->element_names[i] &&
+                   tree.element_types[i] == ref->element_types[i],
+                   "tree entry members differ");
+    }
+    htm_tree_destroy(&tree);
+}
+
+
+/*  Checks that trees are opened identically with and without a cached
+    layout descriptor, and that bad descriptors are ignored.
+ */
+static void test_layout(const std::string &datafile)
+{
+    const std::string layout = datafile + ".layout";
+    struct htm_tree ref;
+    struct stat sb;
+    enum htm_errcode err;
+    FILE *f;
+
+    HTM_ASSERT(stat(layout.c_str(), &sb) == 0,
+               "tree generation did not write a layout descriptor");
+    HTM_ASSERT(unlink(layout.c_str()) == 0, "unlink() failed");
+    /* opening without a descriptor reads the layout with HDF5 */
+    err = htm_tree_init(&ref, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    HTM_ASSERT(stat(layout.c_str(), &sb) == 0,
+               "htm_tree_init() did not cache the layout");
+    check_layout(datafile, &ref);
+
+    /* stale and corrupt descriptors must be ignored */
+    HTM_ASSERT(utimensat(AT_FDCWD, datafile.c_str(), NULL, 0) == 0,
+               "utimensat() failed");
+    check_layout(datafile, &ref);
+    f = fopen(layout.c_str(), "wb");
+    HTM_ASSERT(f != NULL, "failed to open layout descriptor");
+    fputs("HTMLAYT2 garbage", f);
+    fclose(f);
+    check_layout(datafile, &ref);
+    check_layout(datafile, &ref);
+    htm_tree_destroy(&ref);
+}
+
+
+/*  Checks that warming up a tree copies its index and faults in the
+    requested pages without changing query results.
+ */
+static void test_warmup(const std::string &datafile)
+{
+    struct htm_tree_warmup_params params;
+    struct htm_tree_residency res;
+    struct htm_tree tree;
+    enum htm_errcode err;
+
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    err = htm_tree_warmup(&tree, NULL);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_warmup() failed: %s",
+               htm_errmsg(err));
+    HTM_ASSERT(tree.indexcopy == NULL, "index copied without a budget");
+    params.touch = 1;
+    params.topk = 4;
+    params.level = 4;
+    params.copybudget = 1 << 30;
+    err = htm_tree_warmup(&tree, &params);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_warmup() failed: %s",
+               htm_errmsg(err));
+    HTM_ASSERT(tree.indexcopy != NULL && tree.index == tree.indexcopy,
+               "index was not copied");
+    err = htm_tree_resident(&tree, &res);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_resident() failed: %s",
+               htm_errmsg(err));
+    HTM_ASSERT(res.index_pages > 0 && res.index_resident == res.index_pages,
+               "index is not resident");
+    HTM_ASSERT(res.data_pages > 0 && res.data_resident > 0,
+               "no points are resident");
+    params.level = -1;
+    HTM_ASSERT(htm_tree_warmup(&tree, &params) == HTM_ELEVEL,
+               "htm_tree_warmup() accepted an invalid level");
+    test_regions(&tree);
+    test_boxes(&tree);
+    htm_tree_destroy(&tree);
+}
+
+
+/*  Checks that queries read the same points through the block cache of
+    the pread() storage backend, and with look-ahead, as through the
+    memory map.
+ */
+static void test_storage(const std::string &datafile)
+{
+    struct htm_tree_storage_params params;
+    struct htm_tree tree;
+    enum htm_errcode err;
+
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    params.backend = (enum htm_tree_backend) 7;
+    params.blocksz = 0;
+    params.cachesz = 0;
+    params.depth = 0;
+    params.lookahead = 0;
+    HTM_ASSERT(htm_tree_storage(&tree, &params) == HTM_EINV,
+               "htm_tree_storage() accepted an invalid backend");
+    /* pipelined scans of memory mapped leaves */
+    params.backend = HTM_TREE_MMAP;
+    params.lookahead = 8;
+    err = htm_tree_storage(&tree, &params);
+    HTM_ASSERT(err == HTM_OK && tree.storage == NULL && tree.lookahead == 8,
+               "htm_tree_storage() failed: %s", htm_errmsg(err));
+    test_regions(&tree);
+    test_boxes(&tree);
+    test_approx(&tree);
+    /* small, unaligned blocks and a tiny cache exercise rows straddling
+       blocks, and eviction */
+    params.backend = HTM_TREE_PREAD;
+    params.blocksz = 1000;
+    params.cachesz = 16000;
+    params.depth = 4;
+    err = htm_tree_storage(&tree, &params);
+    HTM_ASSERT(err == HTM_OK && tree.storage != NULL,
+               "htm_tree_storage() failed: %s", htm_errmsg(err));
+    test_regions(&tree);
+    test_boxes(&tree);
+    test_approx(&tree);
+    /* one read at a time, with default sizes */
+    params.blocksz = 0;
+    params.cachesz = 0;
+    params.depth = 1;
+    err = htm_tree_storage(&tree, &params);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_storage() failed: %s",
+               htm_errmsg(err));
+    test_regions(&tree);
+    err = htm_tree_storage(&tree, NULL);
+    HTM_ASSERT(err == HTM_OK && tree.storage == NULL && tree.lookahead == 0,
+               "htm_tree_storage() did not restore the memory map");
+    htm_tree_destroy(&tree);
+}
+
+
+/*  Checks that query statistics are consistent with query results, and
+    that gathering them does not change the results.
+ */
+static void test_stats(const std::string &datafile)
+{
+    struct htm_query_stats stats;
+    struct htm_s2region *region;
+    struct htm_range range;
+    struct htm_v3 cen;
+    struct htm_tree tree;
+    enum htm_errcode err;
+    int64_t count, scan;
+    uint64_t nodes;
+    int i, l;
+
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    for (i = 0; i < 100; ++i) {
+        if (i % 2 == 0) {
+            cen = clusters[(i / 2) % NCLUSTERS];
+        } else {
+            rand_v3(&cen);
+        }
+        region = rand_region(&cen, (i % 3 == 0) ? 20.0 : 3.0, i % 4);
+        count = htm_tree_s2region_count(&tree, region, &err);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        memset(&stats, 0xff, sizeof(stats));
+        HTM_ASSERT(htm_tree_s2region_count(&tree, region, &err, &stats) ==
+                   count && err == HTM_OK,
+                   "htm_tree_s2region_count() failed with statistics");
+        for (l = 0, nodes = 0; l <= HTM_QUERY_MAX_LEVEL; ++l) {
+            HTM_ASSERT(stats.nodes[l] == stats.classified[l][0] +
+                       stats.classified[l][1] + stats.classified[l][2] +
+                       stats.classified[l][3],
+                       "per-level node classifications do not add up");
+            nodes += stats.nodes[l];
+        }
+        HTM_ASSERT(nodes > 0 && nodes == stats.disjoint + stats.intersect +
+                   stats.contains + stats.inside,
+                   "node classifications do not add up");
+        HTM_ASSERT(stats.matched <= stats.tested &&
+                   stats.matched <= (uint64_t) count &&
+                   stats.data_bytes >= stats.tested * tree.entry_size &&
+                   stats.data_bytes % tree.entry_size == 0 &&
+                   (stats.leaves == 0) == (stats.data_bytes == 0),
+                   "point statistics are inconsistent");
+        HTM_ASSERT(stats.index_bytes > 0 && stats.traversal_time >= 0.0 &&
+                   stats.scan_time >= 0.0, "invalid index statistics");
+
+        /* ranges are computed from the index alone */
+        range = htm_tree_s2region_range(&tree, region, &err, &stats);
+        HTM_ASSERT(err == HTM_OK && range.min <= count && range.max >= count,
+                   "htm_tree_s2region_range() failed with statistics");
+        HTM_ASSERT(stats.leaves == 0 && stats.tested == 0 &&
+                   stats.data_bytes == 0 && stats.index_bytes > 0,
+                   "htm_tree_s2region_range() read points");
+
+        /* scans test every point */
+        scan = htm_tree_s2region_scan(&tree, region, &err, NULL, &stats);
+        HTM_ASSERT(err == HTM_OK && scan == count,
+                   "htm_tree_s2region_scan() failed with statistics");
+        HTM_ASSERT(stats.tested == tree.count &&
+                   stats.matched == (uint64_t) scan &&
+                   stats.data_bytes == tree.count * tree.entry_size &&
+                   stats.index_bytes == 0,
+                   "scan statistics are inconsistent");
+        htm_s2region_destroy(region);
+    }
+    htm_tree_destroy(&tree);
+
+    /* the C++ query interface */
+    {
+        tinyhtm::Tree t(datafile);
+        tinyhtm::Query q(t, tinyhtm::Spherical(10.0, 20.0), 30.0);
+        count = q.count();
+        HTM_ASSERT(q.count(&stats) == count && stats.matched <= stats.tested,
+                   "Query::count() failed with statistics");
+        HTM_ASSERT(q.search([](const char *) { return true; }, &stats) ==
+                   count, "Query::search() failed with statistics");
+    }
+}
+
+
+/*  Checks that tree answers region queries like ref, a tree of the same
+    points. If the trees have the same nodes (their indexes differ at
+    most in format), queries must also return the same count ranges and
+    visit the same nodes.
+ */
+static void compare_trees(const struct htm_tree *tree,
+                          const struct htm_tree *ref)
+{
+    const uint64_t formats = HTM_TREE_FIXED | HTM_TREE_SUCCINCT;
+    const bool same = tree->leafthresh == ref->leafthresh &&
+                      tree->depth == ref->depth &&
+                      (tree->flags & ~formats) == (ref->flags & ~formats);
+    struct htm_query_stats stats, refstats;
+    struct htm_s2region *region;
+    struct htm_range range, refrange;
+    struct htm_v3 cen;
+    enum htm_errcode err;
+    int64_t count, refcount;
+    int i, l;
+
+    for (i = 0; i < 100; ++i) {
+        if (i % 2 == 0) {
+            cen = clusters[(i / 2) % NCLUSTERS];
+        } else {
+            rand_v3(&cen);
+        }
+        region = rand_region(&cen, (i % 3 == 0) ? 20.0 : 3.0, i % 4);
+        count = htm_tree_s2region_count(tree, region, &err, &stats);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        refcount = htm_tree_s2region_count(ref, region, &err, &refstats);
+        HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        HTM_ASSERT(count == refcount, "htm_tree_s2region_count() = %lld, "
+                   "but %lld for the reference tree", (long long) count,
+                   (long long) refcount);
+        if (same) {
+            for (l = 0; l <= HTM_QUERY_MAX_LEVEL; ++l) {
+                HTM_ASSERT(stats.nodes[l] == refstats.nodes[l],
+                           "trees visited different nodes");
+            }
+            HTM_ASSERT(stats.leaves == refstats.leaves &&
+                       stats.tested == refstats.tested,
+                       "trees read different leaves");
+            range = htm_tree_s2region_range(tree, region, &err);
+            HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_range() failed");
+            refrange = htm_tree_s2region_range(ref, region, &err);
+            HTM_ASSERT(err == HTM_OK && range.min == refrange.min &&
+                       range.max == refrange.max,
+                       "htm_tree_s2region_range() differs from that of the "
+                       "reference tree");
+        }
+        htm_s2region_destroy(region);
+    }
+}
+
+
+/*  Tests specific to a tree built by test_variant(), given the tree, the
+    reference tree it was compared with, and its data file.
+ */
+typedef std::function<void (struct htm_tree *tree,
+                            const struct htm_tree *ref,
+                            const std::string &datafile)> variant_check;
+
+
+/*  Builds the tree <dir>/<name>.h5 from the same points as the trees of
+    main(), with the given index and memory parameters. Checks that it
+    answers queries like the tree in the data file other, then runs check
+    on it, and removes its files.
+ */
+static void test_variant(const std::string &dir, const char *name,
+                         const index_options &opts, const std::string &other,
+                         const variant_check &check,
+                         const mem_params &mem = mem_params(4 * 1024 * 1024,
+                                                            64 * 1024))
+{
+    const std::string path = dir + "/" + name;
+    const std::string datafile = path + ".h5";
+    struct htm_tree tree, ref;
+    enum htm_errcode err;
+
+    htm_seed(SEED);
+    build_tree(path, NPOINTS, opts, mem);
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    err = htm_tree_init(&ref, other.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    HTM_ASSERT(tree.count == ref.count,
+               "tree and reference tree have different points");
+    compare_trees(&tree, &ref);
+    test_regions(&tree);
+    test_boxes(&tree);
+    test_approx(&tree);
+    check(&tree, &ref, datafile);
+    htm_tree_destroy(&ref);
+    htm_tree_destroy(&tree);
+    unlink(datafile.c_str());
+    unlink((datafile + ".layout").c_str());
+}
+
+
+/*  Checks that a tree with a compressed data file answers queries like
+    the same tree with an uncompressed one.
+ */
+static void test_compressed(const std::string &dir, const std::string &other)
+{
+    index_options opts = tree_options(16, false);
+    auto check = [](struct htm_tree *tree, const struct htm_tree *ref,
+                    const std::string &) {
+        struct htm_tree_storage_params params;
+        HTM_ASSERT(tree->datasz == 0 && tree->storage != NULL,
+                   "compressed points should be read through a chunk cache");
+        HTM_ASSERT(tree->leafthresh == ref->leafthresh && ref->datasz != 0,
+                   "compressed and uncompressed trees differ");
+        params.backend = HTM_TREE_MMAP;
+        params.blocksz = 0;
+        params.cachesz = 0;
+        params.depth = 0;
+        params.lookahead = 0;
+        HTM_ASSERT(htm_tree_storage(tree, &params) == HTM_EINV,
+                   "htm_tree_storage() replaced the chunk cache");
+    };
+    opts.compress = 6;
+    test_variant(dir, "ztree", opts, other, check);
+}
+
+
+/*  Returns the bytes of the points in the "data" data set of a data file,
+    decompressed if necessary.
+ */
+static std::string read_points(const std::string &datafile)
+{
+    H5::H5File file(datafile, H5F_ACC_RDONLY);
+    H5::DataSet data = file.openDataSet("data");
+    H5::DataType type = data.getDataType();
+    std::string bytes((size_t) data.getSpace().getSimpleExtentNpoints() *
+                      type.getSize(), '\0');
+
+    data.read(&bytes[0], type);
+    return bytes;
+}
+
+
+/*  Checks that points converted to unit vectors on several threads, and
+    written in several buffers by the background writer, are identical to
+    those of the tree in other, with and without compression.
+ */
+static void test_vec_threads(const std::string &dir, const std::string &other)
+{
+    /* conversion buffers of at least 2 grains, so that several threads
+       convert each one, and several flushes of them */
+    mem_params mem(16 * 1024 * 1024, 64 * 1024, 4);
+    const size_t rows = mem.memsz / 16 / sizeof(htm_entry<tree_entry>);
+    int t;
+
+    HTM_ASSERT(rows >= 2 * VEC_GRAIN && NPOINTS >= 3 * rows,
+               "unexpected unit vector buffer size");
+    for (t = 0; t < 2; ++t) {
+        index_options opts = tree_options(16, false);
+        auto check = [&other](struct htm_tree *, const struct htm_tree *,
+                              const std::string &datafile) {
+            HTM_ASSERT(read_points(datafile) == read_points(other),
+                       "points converted on several threads differ");
+        };
+        opts.compress = 6 * t;
+        test_variant(dir, t == 0 ? "vtree" : "zvtree", opts, other, check,
+                     mem);
+    }
+}
+
+
+/*  Checks that a tree with the given options, but an alternative index
+    format (the given format flag), answers queries like the tree in
+    other, which has a varint index, visiting the same nodes.
+ */
+static void test_format(const std::string &dir, const char *name,
+                        index_options opts, uint64_t format,
+                        const std::string &other)
+{
+    auto check = [format](struct htm_tree *tree, const struct htm_tree *ref,
+                          const std::string &) {
+        HTM_ASSERT(tree->flags == (ref->flags | format) &&
+                   (ref->flags & ~HTM_TREE_ADAPTIVE) == HTM_TREE_CAPS,
+                   "tree should have index format %llu",
+                   (unsigned long long) format);
+        if (format == HTM_TREE_SUCCINCT) {
+            HTM_ASSERT(tree->indexsz < ref->indexsz,
+                       "succinct index is not smaller than a varint one");
+        }
+    };
+    opts.fixed = (format == HTM_TREE_FIXED);
+    opts.succinct = (format == HTM_TREE_SUCCINCT);
+    test_variant(dir, name, opts, other, check);
+}
+
+
+/*  Checks that a tree with adaptive leaves and a leaf threshold of 1024
+    answers queries like the tree in small, which has a plain leaf
+    threshold of 16, with a smaller index, and that its queries test fewer
+    points than those of a tree with a plain leaf threshold of 1024. The
+    adaptive tree is also checked in the alternative index formats.
+ */
+static void test_adaptive(const std::string &dir, const std::string &small)
+{
+    index_options opts = tree_options(1024, true);
+    auto fewer_tested = [](struct htm_tree *large,
+                           const struct htm_tree *tree,
+                           const std::string &) {
+        struct htm_query_stats stats;
+        struct htm_s2region *region;
+        struct htm_v3 cen;
+        enum htm_errcode err;
+        uint64_t tested = 0, largetested = 0;
+        int i;
+
+        HTM_ASSERT(large->leafthresh == 1024 &&
+                   (large->flags & HTM_TREE_ADAPTIVE) == 0,
+                   "reference tree has the wrong leaf threshold");
+        for (i = 0; i < 100; ++i) {
+            if (i % 2 == 0) {
+                cen = clusters[(i / 2) % NCLUSTERS];
+            } else {
+                rand_v3(&cen);
+            }
+            region = rand_region(&cen, (i % 3 == 0) ? 20.0 : 3.0, i % 4);
+            htm_tree_s2region_count(tree, region, &err, &stats);
+            HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+            tested += stats.tested;
+            htm_tree_s2region_count(large, region, &err, &stats);
+            HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+            largetested += stats.tested;
+            htm_s2region_destroy(region);
+        }
+        HTM_ASSERT(tested < largetested,
+                   "adaptive tree tested %llu points, but a tree with a leaf "
+                   "threshold of 1024 only %llu",
+                   (unsigned long long) tested,
+                   (unsigned long long) largetested);
+    };
+    auto check = [&](struct htm_tree *tree, const struct htm_tree *ref,
+                     const std::string &datafile) {
+        HTM_ASSERT((tree->flags & HTM_TREE_ADAPTIVE) != 0 &&
+                   tree->leafthresh == 1024,
+                   "tree should have adaptive leaves");
+        HTM_ASSERT(ref->leafthresh == 16 &&
+                   (ref->flags & HTM_TREE_ADAPTIVE) == 0,
+                   "reference tree has the wrong leaf threshold");
+        HTM_ASSERT(tree->indexsz < ref->indexsz,
+                   "adaptive index (%llu bytes) is not smaller than one with "
+                   "a leaf threshold of 16 (%llu bytes)",
+                   (unsigned long long) tree->indexsz,
+                   (unsigned long long) ref->indexsz);
+        test_variant(dir, "btree", tree_options(1024, true), datafile,
+                     fewer_tested);
+        test_format(dir, "aftree", opts, HTM_TREE_FIXED, datafile);
+        test_format(dir, "astree", opts, HTM_TREE_SUCCINCT, datafile);
+    };
+    opts.adaptive = true;
+    test_variant(dir, "atree", opts, small, check);
+}
+
+
+/*  Checks that counting the points of HTM ID range lists with a level 6
+    prefix count table agrees with testing the ID of every point, for
+    coverages coarser and finer than the table. other has no prefix count
+    table.
+ */
+static void test_prefix(const std::string &dir, const std::string &other)
+{
+    static const int levels[3] = { 3, 6, 11 };
+    index_options opts = tree_options(16, false);
+    auto check = [](struct htm_tree *tree, const struct htm_tree *ref,
+                    const std::string &datafile) {
+        struct htm_query_stats stats;
+        struct htm_ids *ids = NULL;
+        struct htm_v3 cen;
+        enum htm_errcode err;
+        int64_t count, expect, ncb;
+        uint64_t j;
+        size_t k;
+        int i;
+
+        HTM_ASSERT(tree->prefix != NULL && tree->prefixlevel == 6,
+                   "tree has no level 6 prefix count table");
+        HTM_ASSERT(ref->prefix == NULL,
+                   "tree has an unexpected prefix table");
+        for (i = 0; i < 60; ++i) {
+            const int level = levels[i % 3];
+            const int shift = 2 * (20 - level);
+            if (i % 2 == 0) {
+                cen = clusters[(i / 2) % NCLUSTERS];
+            } else {
+                rand_v3(&cen);
+            }
+            ids = htm_s2circle_ids(ids, &cen, (i % 4 == 0) ? 20.0 : 2.0,
+                                   level, SIZE_MAX, &err);
+            HTM_ASSERT(ids != NULL, "htm_s2circle_ids() failed");
+            if (i == 0) {
+                HTM_ASSERT(htm_tree_ids_count(ref, ids, &err) < 0 &&
+                           err == HTM_EINV, "htm_tree_ids_count() should "
+                           "have failed without a prefix count table");
+            }
+            /* test the ID of every point */
+            expect = 0;
+            for (j = 0; j < tree->count; ++j) {
+                const struct htm_v3 *v = (const struct htm_v3 *)
+                    ((const char *) tree->entries + j * tree->entry_size);
+                const int64_t id = htm_v3_id(v, 20) >> shift;
+                for (k = 0; k < ids->n; ++k) {
+                    if (id >= ids->range[k].min && id <= ids->range[k].max) {
+                        ++expect;
+                        break;
+                    }
+                }
+            }
+            count = htm_tree_ids_count(tree, ids, &err, &stats);
+            HTM_ASSERT(err == HTM_OK && count == expect,
+                       "htm_tree_ids_count() = %lld, but %lld points are "
+                       "inside the ranges", (long long) count,
+                       (long long) expect);
+            HTM_ASSERT(level > 6 || stats.data_bytes == 0,
+                       "ranges no finer than the prefix table read points");
+            ncb = 0;
+            count = htm_tree_ids(tree, ids, &err,
+                                 [&](const char *) { ++ncb; return true; });
+            HTM_ASSERT(err == HTM_OK && count == expect && ncb == expect,
+                       "htm_tree_ids() failed");
+        }
+        /* invalid IDs */
+        ids->n = 1;
+        ids->range[0].min = 3;
+        ids->range[0].max = 4;
+        HTM_ASSERT(htm_tree_ids_count(tree, ids, &err) < 0 &&
+                   err == HTM_EID, "htm_tree_ids_count() should have failed");
+        free(ids);
+        test_layout(datafile);
+    };
+    opts.prefixlevel = 6;
+    test_variant(dir, "ptree", opts, other, check);
+}
+
+
+/*  Checks that a tree indexed at depth 24 answers queries over a dense
+    cluster of points like the same tree indexed at depth 20, while
+    splitting the cluster into more, smaller leaves.
+ */
+static void test_depth(const std::string &dir)
+{
+    static const int depths[2] = { 20, 24 };
+    const std::string path[2] = { dir + "/d20tree", dir + "/d24tree" };
+    struct htm_tree tree[2];
+    struct htm_query_stats stats;
+    struct htm_ids *ids = NULL;
+    struct htm_v3 cen, v;
+    enum htm_errcode err;
+    int64_t count[2], scan, expect;
+    uint64_t tested[2] = { 0, 0 }, deep = 0, j;
+    size_t k;
+    int i, t, l;
+
+    rand_v3(&cen);
+    for (t = 0; t < 2; ++t) {
+        htm_seed(987654321UL);
+        build_dense(path[t], 20000, &cen, 1.0e-4, depths[t]);
+        err = htm_tree_init(&tree[t], (path[t] + ".h5").c_str());
+        HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s",
+                   htm_errmsg(err));
+        HTM_ASSERT(tree[t].depth == depths[t] &&
+                   ((tree[t].flags & HTM_TREE_DEPTH) != 0) == (t == 1),
+                   "tree has depth %d", tree[t].depth);
+    }
+    for (i = 0; i < 50; ++i) {
+        const double r = (i % 2 == 0) ? 1.0e-6 : 2.0e-5;
+        rand_near(&v, &cen, 1.0e-4);
+        for (t = 0; t < 2; ++t) {
+            count[t] = htm_tree_s2circle_count(&tree[t], &v, r, &err,
+                                               &stats);
+            HTM_ASSERT(err == HTM_OK, "htm_tree_s2circle_count() failed");
+            tested[t] += stats.tested;
+            for (l = 21; l <= HTM_QUERY_MAX_LEVEL; ++l) {
+                HTM_ASSERT(t == 1 || stats.nodes[l] == 0,
+                           "depth 20 tree has nodes below level 20");
+                deep += stats.nodes[l];
+            }
+            scan = htm_tree_s2circle_scan(&tree[t], &v, r, &err, NULL);
+            HTM_ASSERT(err == HTM_OK && scan == count[t],
+                       "htm_tree_s2circle_count() = %lld, but "
+                       "htm_tree_s2circle_scan() = %lld",
+                       (long long) count[t], (long long) scan);
+        }
+        HTM_ASSERT(count[0] == count[1],
+                   "trees of different depths disagree");
+    }
+    HTM_ASSERT(deep > 0, "depth 24 tree has no nodes below level 20");
+    HTM_ASSERT(tested[1] < tested[0],
+               "depth 24 tree tested %llu points, depth 20 tree %llu",
+               (unsigned long long) tested[1],
+               (unsigned long long) tested[0]);
+
+    /* prefix count tables use the tree depth */
+    for (l = 8; l <= 24; l += 8) {
+        ids = htm_s2circle_ids(ids, &cen, 5.0e-5, l, SIZE_MAX, &err);
+        HTM_ASSERT(ids != NULL, "htm_s2circle_ids() failed");
+        expect = 0;
+        for (j = 0; j < tree[1].count; ++j) {
+            const struct htm_v3 *p = (const struct htm_v3 *)
+                ((const char *) tree[1].entries + j * tree[1].entry_size);
+            const int64_t id = htm_v3_id(p, 24) >> 2 * (24 - l);
+            for (k = 0; k < ids->n; ++k) {
+                if (id >= ids->range[k].min && id <= ids->range[k].max) {
+                    ++expect;
+                    break;
+                }
+            }
+        }
+        count[1] = htm_tree_ids_count(&tree[1], ids, &err);
+        HTM_ASSERT(err == HTM_OK && count[1] == expect,
+                   "htm_tree_ids_count() = %lld, but %lld points are inside "
+                   "the ranges", (long long) count[1], (long long) expect);
+        if (l > 20) {
+            HTM_ASSERT(htm_tree_ids_count(&tree[0], ids, &err) < 0 &&
+                       err == HTM_ELEVEL, "htm_tree_ids_count() should have "
+                       "failed for ranges deeper than the tree");
+        }
+    }
+    free(ids);
+    for (t = 0; t < 2; ++t) {
+        htm_tree_destroy(&tree[t]);
+        unlink((path[t] + ".h5").c_str());
+        unlink((path[t] + ".h5.layout").c_str());
+    }
+}
+
+
+/*  Checks that hot-sets round-trip, and are rejected by other trees.
+ */
+static void test_hotset(const std::string &datafile,
+                        const std::string &other)
+{
+    const std::string hotset = datafile + ".hot";
+    struct htm_tree tree;
+    enum htm_errcode err;
+    FILE *f;
+
+    err = htm_tree_init(&tree, datafile.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    err = htm_tree_hotset_save(&tree, hotset.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_hotset_save() failed: %s",
+               htm_errmsg(err));
+    err = htm_tree_hotset_load(&tree, hotset.c_str(), 3);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_hotset_load() failed: %s",
+               htm_errmsg(err));
+    err = htm_tree_hotset_load(&tree, hotset.c_str(), 0);
+    HTM_ASSERT(err == HTM_OK, "htm_tree_hotset_load() failed: %s",
+               htm_errmsg(err));
+    HTM_ASSERT(htm_tree_hotset_load(&tree, (hotset + "x").c_str(), 1) ==
+               HTM_EIO, "htm_tree_hotset_load() read a missing file");
+    test_regions(&tree);
+    htm_tree_destroy(&tree);
+
+    err = htm_tree_init(&tree, other.c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s", htm_errmsg(err));
+    HTM_ASSERT(htm_tree_hotset_load(&tree, hotset.c_str(), 2) == HTM_ETREE,
+               "htm_tree_hotset_load() accepted another tree's hot-set");
+    f = fopen(hotset.c_str(), "wb");
+    HTM_ASSERT(f != NULL, "failed to open hot-set");
+    fputs("HTMHOTS1 garbage", f);
+    fclose(f);
+    HTM_ASSERT(htm_tree_hotset_load(&tree, hotset.c_str(), 2) == HTM_ETREE,
+               "htm_tree_hotset_load() accepted a corrupt hot-set");
+    htm_tree_destroy(&tree);
+    unlink(hotset.c_str());
+}
+
+
+/*  Checks that the tree registry shares handles between opens of the same
+    file, and reopens files that changed.
+ */
+static void test_registry(const std::string &dir, const std::string &path)
+{
+    const std::string bad = dir + "/bad.h5";
+    std::shared_ptr<const struct htm_tree> h1, h2, h3, handles[4];
+    std::vector<std::thread> threads;
+    struct timespec times[2];
+    bool thrown = false;
+    FILE *f;
+    int i;
+
+    h1 = tinyhtm::Tree::open(path);
+    HTM_ASSERT(h1 && h1->count == NPOINTS, "Tree::open() failed");
+    h2 = tinyhtm::Tree::open(dir + "/./" + path.substr(dir.size() + 1));
+    HTM_ASSERT(h1 == h2, "Tree::open() did not share the tree handle");
+    {
+        tinyhtm::Tree tree(path);
+        tinyhtm::Tree copy(tree);
+        HTM_ASSERT(&tree.tree == h1.get() && &copy.tree == h1.get(),
+                   "Tree did not use the shared tree handle");
+    }
+
+    /* a modified file must be reopened, without closing the old handle */
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = 1000000000;
+    times[1].tv_nsec = 0;
+    HTM_ASSERT(utimensat(AT_FDCWD, path.c_str(), times, 0) == 0,
+               "utimensat() failed");
+    h3 = tinyhtm::Tree::open(path);
+    HTM_ASSERT(h3 && h3 != h1, "Tree::open() did not reopen a modified file");
+    HTM_ASSERT(h1->count == h3->count && h1.use_count() == 2,
+               "stale tree handle was closed or leaked");
+    h2.reset();
+
+    /* evicted trees are reopened, and closed once unreferenced */
+    tinyhtm::Tree::evict(path);
+    HTM_ASSERT(h3.use_count() == 1, "Tree::evict() kept a reference");
+    h2 = tinyhtm::Tree::open(path);
+    HTM_ASSERT(h2 && h2 != h3, "Tree::open() returned an evicted tree");
+    tinyhtm::Tree::evict_all();
+    HTM_ASSERT(h2.use_count() == 1, "Tree::evict_all() kept a reference");
+
+    /* concurrent requests for a tree share a single open */
+    for (i = 0; i < 4; ++i) {
+        threads.emplace_back([&handles, &path, i]() {
+            handles[i] = tinyhtm::Tree::open(path);
+        });
+    }
+    for (i = 0; i < 4; ++i) {
+        threads[i].join();
+    }
+    for (i = 0; i < 4; ++i) {
+        HTM_ASSERT(handles[i] && handles[i] == handles[0] &&
+                   handles[i] != h2, "concurrent Tree::open() calls did not "
+                   "share a new tree handle");
+    }
+
+    try {
+        tinyhtm::Tree::open(dir + "/missing.h5");
+    } catch (tinyhtm::Exception &) {
+        thrown = true;
+    }
+    HTM_ASSERT(thrown, "Tree::open() should have failed");
+
+    /* failed opens are not cached */
+    f = fopen(bad.c_str(), "wb");
+    HTM_ASSERT(f != NULL, "failed to create file");
+    fputs("not a tree", f);
+    fclose(f);
+    for (i = 0; i < 2; ++i) {
+        thrown = false;
+        try {
+            tinyhtm::Tree::open(bad);
+        } catch (tinyhtm::Exception &) {
+            thrown = true;
+        }
+        HTM_ASSERT(thrown, "Tree::open() should have failed");
+    }
+    unlink(bad.c_str());
+    tinyhtm::Tree::evict_all();
+}
+
+
+/*  Radix sorted blocks of tree entries and disk nodes must match
+    comparison sorted ones, including the order of entries with equal
+    HTM IDs, whether sorted on one thread or several.
+ */
+static void test_radix_sort(void)
+{
+    const size_t n = 100000;
+    std::vector<tree_entry> e(n), ecopy, eorig, escratch(n);
+    std::vector<disk_node> d(n), dcopy, dorig, dscratch(n);
+    size_t i;
+    int j;
+
+    memset(&e[0], 0, n * sizeof(tree_entry));
+    memset(&d[0], 0, n * sizeof(disk_node));
+    for (i = 0; i < n; ++i) {
+        /* few distinct HTM IDs, so that row IDs break many ties */
+        e[i].htmid = (INT64_C(8) << 40) + (int64_t)(htm_rand() * 1000.0);
+        e[i].rowid = (int64_t)((htm_rand() - 0.5) * 1.0e12);
+        e[i].sc.lon = (double)i;
+        for (j = 0; j < NLOD + 1; ++j) {
+            d[i].id.block[j] = (uint64_t)(htm_rand() * (1 << (4 * j)));
+        }
+        d[i].id.block[NLOD] = i;
+        d[i].count = i;
+    }
+    eorig = e;
+    dorig = d;
+    for (int pass = 0; pass < 3; ++pass) {
+        /* the first two passes sort on 1 and 4 threads, the third sorts
+           already sorted blocks */
+        const unsigned int nthreads = (pass == 1) ? 4 : 1;
+        if (pass < 2) {
+            e = eorig;
+            d = dorig;
+        }
+        ecopy = e;
+        dcopy = d;
+        std::sort(ecopy.begin(), ecopy.end());
+        std::stable_sort(dcopy.begin(), dcopy.end());
+        blk_sort(&e[0], &e[0] + n, &escratch[0], nthreads);
+        blk_sort(&d[0], &d[0] + n, &dscratch[0], nthreads);
+        for (i = 0; i < n; ++i) {
+            HTM_ASSERT(e[i].htmid == ecopy[i].htmid &&
+                       e[i].rowid == ecopy[i].rowid &&
+                       e[i].sc.lon == ecopy[i].sc.lon,
+                       "radix sorted tree entries out of order");
+            HTM_ASSERT(d[i].count == dcopy[i].count,
+                       "radix sorted disk nodes out of order");
+        }
+    }
+}
+
+
+/*  External merge passes run on several threads must produce the same
+    file as a comparison sort of the input.
+ */
+static void test_parallel_merge(const std::string &dir)
+{
+    const std::string file = dir + "/merge", scratch = dir + "/merge.scr";
+    const size_t n = 20000;
+    std::vector<tree_entry> e(n), sorted(n);
+    size_t i;
+
+    /* 20 KiB runs merged 7 at a time, so that there are several passes */
+    mem_params mem(64 * 1024, 4096, 4);
+    HTM_ASSERT(mem.nthreads == 4 && mem.k == 7,
+               "unexpected merge memory parameters");
+    memset(&e[0], 0, n * sizeof(tree_entry));
+    for (i = 0; i < n; ++i) {
+        /* many duplicate HTM IDs, so that splitters fall inside ties */
+        e[i].htmid = (INT64_C(8) << 40) + (int64_t)(htm_rand() * 100.0);
+        e[i].rowid = (int64_t)(htm_rand() * 1.0e9);
+        e[i].sc.lon = (double)i;
+    }
+    {
+        blk_writer<tree_entry> out(file, mem.sortsz);
+        for (i = 0; i < n; ++i) {
+            out.append(&e[i]);
+        }
+    }
+    ext_sort<tree_entry>(file, scratch, mem, n);
+    std::sort(e.begin(), e.end());
+    {
+        FILE *f = fopen(file.c_str(), "rb");
+        HTM_ASSERT(f != NULL, "failed to open merged file");
+        HTM_ASSERT(fread(&sorted[0], sizeof(tree_entry), n, f) == n,
+                   "merged file is too short");
+        HTM_ASSERT(fgetc(f) == EOF, "merged file is too long");
+        fclose(f);
+    }
+    for (i = 0; i < n; ++i) {
+        HTM_ASSERT(sorted[i].htmid == e[i].htmid &&
+                   sorted[i].rowid == e[i].rowid &&
+                   sorted[i].sc.lon == e[i].sc.lon,
+                   "parallel merge output out of order");
+    }
+    unlink(file.c_str());
+}
+
+
+/*  Merging must order disk nodes by full node ID, including nodes whose
+    block IDs are too large for the cached merge key prefix, with 1 and
+    with 4 threads.
+ */
+static void test_merge_keys(const std::string &dir)
+{
+    static const uint64_t big[4] = {
+        UINT32_MAX - 1, UINT32_MAX, UINT64_C(1) << 40, UINT64_MAX - 1
+    };
+    const std::string file = dir + "/nodes", scratch = dir + "/nodes.scr";
+    const size_t n = 5000;
+    std::vector<disk_node> d(n), sorted(n);
+    size_t i, nthreads;
+
+    memset(&d[0], 0, n * sizeof(disk_node));
+    for (i = 0; i < n; ++i) {
+        const double r = htm_rand();
+        d[i].id.block[0] = (r < 0.5) ? (uint64_t)(r * 8.0)
+                                     : big[(size_t)(r * 8.0) - 4];
+        d[i].id.block[1] = (htm_rand() < 0.5) ? (uint64_t)(htm_rand() * 4.0)
+                                              : big[i & 3];
+        d[i].id.block[2] = (uint64_t)(htm_rand() * 4.0);
+        d[i].id.block[NLOD] = i;
+        d[i].count = i;
+    }
+    for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+        mem_params mem(64 * 1024, 4096, nthreads);
+        {
+            blk_writer<disk_node> out(
+                file, mem.sortsz - mem.sortsz % sizeof(disk_node));
+            for (i = 0; i < n; ++i) {
+                out.append(&d[i]);
+            }
+        }
+        ext_sort<disk_node>(file, scratch, mem, n);
+        {
+            FILE *f = fopen(file.c_str(), "rb");
+            HTM_ASSERT(f != NULL, "failed to open merged file");
+            HTM_ASSERT(fread(&sorted[0], sizeof(disk_node), n, f) == n,
+                       "merged file is too short");
+            fclose(f);
+        }
+        for (i = 1; i < n; ++i) {
+            HTM_ASSERT(sorted[i - 1] < sorted[i],
+                       "merged disk nodes out of order");
+        }
+    }
+    unlink(file.c_str());
+}
+
+
+/*  Checks that a tree whose nodes were generated during the final merge
+    pass of the point sort is identical to one generated from the sorted
+    data file.
+ */
+static void test_fused(const std::string &dir, const std::string &other)
+{
+    index_options opts = tree_options(16, true);
+    auto check = [](struct htm_tree *tree, const struct htm_tree *ref,
+                    const std::string &datafile) {
+        struct stat sb;
+        size_t n;
+
+        HTM_ASSERT(tree->flags == ref->flags,
+                   "fused tree generation produced a different tree");
+        /* the index is mapped in whole pages; only compare bytes in the
+           file */
+        HTM_ASSERT(stat(datafile.c_str(), &sb) == 0, "stat() failed");
+        n = (size_t) sb.st_size - (size_t) ((const char *) tree->index -
+                                            ((const char *) tree->entries -
+                                             tree->offset));
+        n = std::min(n, tree->indexsz);
+        HTM_ASSERT(tree->indexsz == ref->indexsz &&
+                   memcmp(tree->index, ref->index, n) == 0,
+                   "fused tree generation produced a different index");
+        HTM_ASSERT(tree->datasz == ref->datasz &&
+                   memcmp(tree->entries, ref->entries, ref->datasz) == 0,
+                   "fused tree generation produced different points");
+    };
+    opts.fused = true;
+    test_variant(dir, "utree", opts, other, check);
+}
+
+
+/*  Checks that a compressed data file too small to be indexed can be
+    opened, and answers queries like the same uncompressed data file.
+ */
+static void test_unindexed(const std::string &dir)
+{
+    const std::string path[2] = { dir + "/untree", dir + "/zuntree" };
+    struct htm_tree tree[2];
+    struct htm_s2region *region;
+    struct htm_v3 cen;
+    enum htm_errcode err;
+    int64_t count[2];
+    int i, t;
+
+    for (t = 0; t < 2; ++t) {
+        index_options opts;
+        opts.compress = 6 * t;
+        htm_seed(555555555UL);
+        build_tree(path[t], 500, opts);
+        err = htm_tree_init(&tree[t], (path[t] + ".h5").c_str());
+        HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s",
+                   htm_errmsg(err));
+        HTM_ASSERT(tree[t].index == MAP_FAILED && tree[t].count == 500,
+                   "tree should have 500 points and no index");
+    }
+    HTM_ASSERT(tree[1].storage != NULL,
+               "compressed points should be read through a chunk cache");
+    for (i = 0; i < 20; ++i) {
+        rand_v3(&cen);
+        region = rand_region(&cen, (i % 2 == 0) ? 60.0 : 20.0, i % 4);
+        for (t = 0; t < 2; ++t) {
+            count[t] = htm_tree_s2region_count(&tree[t], region, &err);
+            HTM_ASSERT(err == HTM_OK, "htm_tree_s2region_count() failed");
+        }
+        HTM_ASSERT(count[0] == count[1], "htm_tree_s2region_count() = %lld "
+                   "for compressed points, but %lld for uncompressed ones",
+                   (long long) count[1], (long long) count[0]);
+        htm_s2region_destroy(region);
+    }
+    for (t = 0; t < 2; ++t) {
+        htm_tree_destroy(&tree[t]);
+        unlink((path[t] + ".h5").c_str());
+        unlink((path[t] + ".h5.layout").c_str());
+    }
+}
+
+
+/*  The fast path of parse_double() must agree with strtod() bit for bit,
+    and leave the same end pointer and errno behind.
+ */
+static void test_parse_double(void)
+{
+    static const char * const str[] = {
+        "0.1", "-0", "0", "+1.5", "1e22", "1e23", "-1e-22",
+        "9007199254740992", "9007199254740993", "1234567890123456789",
+        "123456789012345678901234567890", "0.0000000000000000000001",
+        "1e-400", "1e400", "4.9e-324", "1.7976931348623157e308",
+        "inf", "-infinity", "nan", "0x1p-2", ".5", "5.", "-.5e1", "1e",
+        "1e+", "2.5e-3|x", "  -45.25", "-", ".", ""
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(str) / sizeof(str[0]); ++i) {
+        char *end[2];
+        double d[2];
+        int e[2];
+
+        errno = 0;
+        d[0] = strtod(str[i], &end[0]);
+        e[0] = errno;
+        errno = 0;
+        d[1] = parse_double(str[i], &end[1]);
+        e[1] = errno;
+        HTM_ASSERT(memcmp(&d[0], &d[1], sizeof(double)) == 0,
+                   "parse_double(\"%s\") = %.17g, but strtod() gives %.17g",
+                   str[i], d[1], d[0]);
+        HTM_ASSERT(end[0] == end[1], "parse_double(\"%s\") consumed %d "
+                   "characters, but strtod() consumed %d", str[i],
+                   (int) (end[1] - str[i]), (int) (end[0] - str[i]));
+        HTM_ASSERT(e[0] == e[1], "parse_double(\"%s\") set errno to %d, "
+                   "but strtod() set it to %d", str[i], e[1], e[0]);
+    }
+}
+
+
+/*  Returns the contents of a file, which must exist.
+ */
+static std::string slurp(const std::string &file)
+{
+    std::string s;
+    char buf[65536];
+    size_t n;
+    FILE *f = fopen(file.c_str(), "rb");
+
+    HTM_ASSERT(f != NULL, "failed to open %s", file.c_str());
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        s.append(buf, n);
+    }
+    fclose(f);
+    return s;
+}
+
+
+/*  Runs blk_sort_ascii() on nthreads threads and returns the block sorted
+    output, or the message of the error it threw.
+ */
+static std::string ingest(const std::vector<std::string> &files,
+                          const std::string &out, int nthreads)
+{
+    mem_params mem(4 * 1024 * 1024, 64 * 1024, nthreads);
+    std::string result;
+
+    try {
+        blk_sort_ascii(files, out, '|', &mem, 20, nthreads);
+    } catch (std::runtime_error &ex) {
+        unlink(out.c_str());
+        return std::string("error: ") + ex.what();
+    }
+    result = slurp(out);
+    unlink(out.c_str());
+    return result;
+}
+
+
+/*  ASCII input parsed in chunks on several threads must produce the same
+    block sorted entries as a sequential parse, and report the same first
+    bad line.
+ */
+static void test_ascii_threads(const std::string &dir)
+{
+    const std::string out = dir + "/ascii.bin";
+    std::vector<std::string> files;
+    std::string seq;
+    int64_t rowid = 0;
+    int i, f;
+
+    /* several 4 MiB parse chunks per file */
+    for (f = 0; f < 2; ++f) {
+        files.push_back(dir + "/ascii" + std::to_string(f) + ".csv");
+        FILE *fp = fopen(files.back().c_str(), "w");
+        HTM_ASSERT(fp != NULL, "failed to create %s", files.back().c_str());
+        for (i = 0; i < 200000; ++i, ++rowid) {
+            fprintf(fp, "%lld|%.9f|%.9f\n", (long long) rowid,
+                    htm_rand() * 360.0, htm_rand() * 180.0 - 90.0);
+        }
+        fclose(fp);
+    }
+    seq = ingest(files, out, 1);
+    HTM_ASSERT(seq.size() == 400000 * sizeof(tree_entry),
+               "sequential ingest produced %llu bytes",
+               (unsigned long long) seq.size());
+    HTM_ASSERT(ingest(files, out, 4) == seq,
+               "threaded ingest produced different entries");
+
+    /* bad lines in two different chunks of the second file; only the
+       first may be reported */
+    {
+        FILE *fp = fopen(files[1].c_str(), "a");
+        HTM_ASSERT(fp != NULL, "failed to append to %s", files[1].c_str());
+        fprintf(fp, "400000|12.5|100.0\n");
+        for (i = 0; i < 150000; ++i) {
+            fprintf(fp, "%d|1.0|2.0\n", 400001 + i);
+        }
+        fprintf(fp, "550001|abc|2.0\n");
+        fclose(fp);
+    }
+    seq = ingest(files, out, 1);
+    HTM_ASSERT(seq == "error: [" + files[1] + ":200001] - invalid "
+               "spherical coordinates", "unexpected error: %s", seq.c_str());
+    HTM_ASSERT(ingest(files, out, 4) == seq,
+               "threaded ingest reported a different error");
+    for (f = 0; f < 2; ++f) {
+        unlink(files[f].c_str());
+    }
+}
+
+
+int main(int argc HTM_UNUSED, char **argv HTM_UNUSED) {
+    char dir[] = "/tmp/test_treeXXXXXX";
+    struct htm_tree tree, captree;
+    std::string path, cappath;
+    enum htm_errcode err;
+
+    HTM_ASSERT(mkdtemp(dir) != NULL, "failed to create scratch directory");
+    path = std::string(dir) + "/tree";
+    cappath = std::string(dir) + "/captree";
+    /* build identical trees, with and without bounding caps */
+    htm_seed(SEED);
+    build_tree(cappath, NPOINTS, tree_options(16, true));
+    htm_seed(SEED);
+    build_tree(path, NPOINTS, tree_options(16, false));
+    err = htm_tree_init(&tree, (path + ".h5").c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s",
+               htm_errmsg(err));
+    HTM_ASSERT(tree.index != MAP_FAILED, "tree has no index");
+    HTM_ASSERT(tree.count == NPOINTS, "tree has the wrong number of points");
+    test_regions(&tree);
+    test_boxes(&tree);
+    test_approx(&tree);
+    err = htm_tree_init(&captree, (cappath + ".h5").c_str());
+    HTM_ASSERT(err == HTM_OK, "htm_tree_init() failed: %s",
+               htm_errmsg(err));
+    test_regions(&captree);
+    test_boxes(&captree);
+    test_approx(&captree);
+    test_caps(&tree, &captree);
+    htm_tree_destroy(&captree);
+    htm_tree_destroy(&tree);
+    test_layout(cappath + ".h5");
+    test_warmup(cappath + ".h5");
+    test_hotset(cappath + ".h5", path + ".h5");
+    test_storage(path + ".h5");
+    test_compressed(dir, path + ".h5");
+    test_vec_threads(dir, path + ".h5");
+    test_format(dir, "ftree", tree_options(16, true), HTM_TREE_FIXED,
+                cappath + ".h5");
+    test_format(dir, "stree", tree_options(16, true), HTM_TREE_SUCCINCT,
+                cappath + ".h5");
+    test_prefix(dir, path + ".h5");
+    test_depth(dir);
+    test_adaptive(dir, cappath + ".h5");
+    test_stats(cappath + ".h5");
+    test_fused(dir, cappath + ".h5");
+    test_registry(dir, path + ".h5");
+    test_radix_sort();
+    test_parallel_merge(dir);
+    test_merge_keys(dir);
+    test_parse_double();
+    test_ascii_threads(dir);
+    test_unindexed(dir);
+    unlink((cappath + ".h5").c_str());
+    unlink((cappath + ".h5.layout").c_str());
+    unlink((path + ".h5").c_str());
+    unlink((path + ".h5.layout").c_str());
+    rmdir(dir);
+    return 0;
+}